@@ -1,7 +1,21 @@
 #include "agent.h"
 #include "agentmanager.h"
+#include "utils/job.h"
 
 
+char const *
+command_class_name(CommandClass c)
+{
+    switch (c)
+    {
+    case CommandClass::control:  return "control";
+    case CommandClass::metadata: return "metadata";
+    case CommandClass::bulk:     return "bulk";
+    }
+
+    return "unknown";
+}
+
 Agent::Agent(std::string const & id, std::string const & name, std::string const & type)
 : id_(id)
 , name_(name)
@@ -30,6 +44,59 @@ Agent::tsdb() const
     return am_->tsdb();
 }
 
+Json::Value
+Agent::command(std::string const & cmd, Json::Value const & params)
+{
+    std::chrono::milliseconds ttl;
+
+    if (cmd == "metrics_fetch")
+        return fetch_metrics(params);
+
+    // Work done for a job is not shared: were the job cancelled, its
+    // callers would all get "job cancelled".
+    if (utils::current_job() == nullptr and do_command_cache(cmd, ttl))
+        return cached_command(cmd, params, ttl);
+
+    return do_command(cmd, params);
+}
+
+Json::Value
+Agent::command(std::string const & cmd, Json::Value const & params, RpcResponseStream & stream)
+{
+    std::chrono::milliseconds ttl;
+
+    if (cmd == "metrics_fetch")
+        return fetch_metrics(params);
+
+    if (do_command_cache(cmd, ttl))
+        return cached_command(cmd, params, ttl);
+
+    return do_stream_command(cmd, params, stream);
+}
+
+// Objects are written with their keys sorted, which makes the written
+// params a fine key.  Responses with a non-zero code are not kept.
+Json::Value
+Agent::cached_command(std::string const & cmd, Json::Value const & params,
+                      std::chrono::milliseconds ttl)
+{
+    Json::FastWriter writer;
+    auto const key = cmd + " " + writer.write(params);
+
+    return cache_.get(key, ttl,
+                      [this, &cmd, &params]() { return do_command(cmd, params); },
+                      [](Json::Value const & res) {
+                          return not res.isObject() or res["code"].isNull() or res["code"].asInt() == 0;
+                      });
+}
+
+utils::MetricStore &
+Agent::metrics() const
+{
+    assert(am_ != nullptr);
+    return am_->metrics();
+}
+
 void
 Agent::update_id(std::string const & id)
 { 
@@ -90,3 +157,71 @@ Agent::mqtt_publish(std::string const & topic, Json::Value const & msg, int qos,
     assert(am_ != nullptr);
     return am_->mqtt_publish(*this, topic, msg, qos, retain);
 }
+
+Json::Value
+Agent::fetch_metrics(Json::Value const & params) const
+{
+    Json::Value res;
+
+    try
+    {
+        auto const now = utils::MetricStore::now_ms();
+        auto const seconds = params.get("seconds", 60).asUInt64();
+
+        auto const to   = params.get("to", Json::UInt64(now)).asUInt64();
+        auto const from = params.get("from", Json::UInt64(to - std::min(to, seconds * 1000))).asUInt64();
+        auto const res_ms = params.get("resolution_ms", 0).asUInt64();
+
+        std::vector<std::string> names;
+
+        if (params["series"].isString())
+            names.push_back(params["series"].asString());
+        else if (params["series"].isArray())
+            for (auto const & n : params["series"]) names.push_back(n.asString());
+        else
+            names = metrics().series();
+
+        res["code"] = 0;
+        res["now"]  = Json::UInt64(now);
+        res["series"] = Json::objectValue;
+
+        for (auto const & name : names)
+        {
+            utils::MetricRange range;
+
+            try
+            {
+                range = metrics().fetch(name, from, to, res_ms);
+            }
+            catch (std::out_of_range const &)
+            {
+                res["unknown"].append(name);
+                continue;
+            }
+
+            Json::Value s;
+            s["resolution_ms"] = Json::UInt64(range.resolution_ms);
+            s["points"] = Json::arrayValue;
+
+            for (auto const & p : range.points)
+            {
+                Json::Value v;
+                v.append(Json::UInt64(p.time_ms));
+                v.append(p.avg);
+                v.append(p.min);
+                v.append(p.max);
+                v.append(p.count);
+                s["points"].append(v);
+            }
+
+            res["series"][name] = s;
+        }
+    }
+    catch (std::exception const & ex)
+    {
+        res["code"]  = 1;
+        res["error"] = "metrics_fetch: " + std::string(ex.what());
+    }
+
+    return res;
+}
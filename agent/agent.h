@@ -4,10 +4,13 @@
 #include "utils/json/json.h"
 #include "utils/utils.h"
 #include "utils/rpcclient.h"
+#include "utils/rpcserver.h"
 
 #include "conf.h"
 #include "sitestore.h"
 #include "utils/tsdb.h"
+#include "utils/metricstore.h"
+#include "utils/singleflight.h"
 
 #include <thread>
 #include <chrono>
@@ -18,6 +21,19 @@
 
 class AgentManager;
 
+// Commands of each class run on threads of their own, so that a few
+// long checksum or expand commands can't hold up status or rate
+// queries; see AgentManager and utils/executor.h.
+enum class CommandClass
+{
+    control,    // quick, and waited on: status, rates, pings
+    metadata,   // file system walks and lookups
+    bulk        // reading whole files, or moving data
+};
+
+// "control", "metadata", "bulk"
+char const * command_class_name(CommandClass c);
+
 class Agent
 {
 public:
@@ -25,6 +41,9 @@ public:
     // ctor
     Agent(std::string const & id, std::string const & name, std::string const & type);
 
+    // modules are owned and deleted through Agent pointers
+    virtual ~Agent() { }
+
     // properties
     std::string const &    id() const { return id_; }
     std::string const &  name() const { return name_; }
@@ -33,6 +52,7 @@ public:
 
     SiteStore                 & store() const;
     const utils::TimeSeriesDB &  tsdb() const;
+    utils::MetricStore        & metrics() const;
 
     // update the agent module id and name
     void update_id   (std::string const & id);
@@ -54,9 +74,24 @@ public:
     void registration()
     { do_registration(); stage = 3; }
 
-    // RPC server commands
-    Json::Value command(std::string const & cmd, Json::Value const & params)
-    { return do_command(cmd, params); }
+    // RPC server commands; "metrics_fetch" is answered by every
+    // module, from the agent's metric store
+    Json::Value command(std::string const & cmd, Json::Value const & params);
+
+    // RPC server commands which may send partial responses through
+    // the stream before returning the final one
+    Json::Value command(std::string const & cmd, Json::Value const & params, RpcResponseStream & stream);
+
+    // hits, misses and coalesced requests of cached commands
+    utils::SingleFlightStats cache_stats() const { return cache_.stats(); }
+
+    // which executor runs the command
+    CommandClass command_class(std::string const & cmd, Json::Value const & params) const
+    { return cmd == "metrics_fetch" ? CommandClass::control : do_command_class(cmd, params); }
+
+    // whether the module has a command of the name
+    bool knows_command(std::string const & cmd) const
+    { return cmd == "metrics_fetch" or do_command_known(cmd); }
 
     // MQTT on_message handler
     void on_message(std::string const & topic, Json::Value const & msg)
@@ -77,6 +112,32 @@ protected:
         return {};
     }
 
+    // modules tell the heavy commands from the quick ones here
+    virtual CommandClass do_command_class(std::string const & cmd, Json::Value const & params) const {
+        return CommandClass::metadata;
+    }
+
+    // modules that answer only some command names list them here;
+    // the rest are not timed, so that stray names don't pile up
+    // latency histograms
+    virtual bool do_command_known(std::string const & cmd) const {
+        return true;
+    }
+
+    // identical requests of commands listed here share one
+    // computation, whose successful result is kept for @ttl@ (zero:
+    // not kept); only commands that change nothing belong here, and
+    // they don't stream
+    virtual bool do_command_cache(std::string const & cmd, std::chrono::milliseconds & ttl) const {
+        return false;
+    }
+
+    // modules that can stream their responses override this one;
+    // everything else falls back to the plain do_command()
+    virtual Json::Value do_stream_command(std::string const & cmd, Json::Value const & params, RpcResponseStream & stream) {
+        return do_command(cmd, params);
+    }
+
     // for inherited class to perform the mqtt related actions
     bool mqtt_subscribe(
             std::string const & topic,
@@ -89,6 +150,19 @@ protected:
 
 private:
 
+    // params: "series" (a name or a list of them; all if missing),
+    // and either "seconds" (the last 60 if missing) or "from" and
+    // "to" in milliseconds since the epoch; "resolution_ms" asks for
+    // buckets at least that wide.  Points are [time, avg, min, max,
+    // count], time being the start of the bucket.
+    Json::Value fetch_metrics(Json::Value const & params) const;
+
+    // see do_command_cache()
+    Json::Value cached_command(std::string const & cmd, Json::Value const & params,
+                               std::chrono::milliseconds ttl);
+
+    utils::SingleFlight<Json::Value> cache_;
+
     // basic properties
     std::string id_;
     std::string name_;
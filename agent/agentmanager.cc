@@ -12,6 +12,30 @@ using std::placeholders::_2;
 using std::placeholders::_3;
 using std::placeholders::_4;
 
+// "agent.metrics.tiers" is like "1s:1h,10s:6h,1m:24h"; see
+// utils/metricstore.h.
+static std::vector<utils::MetricTier> metric_tiers(Conf const & conf)
+{
+    auto const spec = conf.get<std::string>("agent.metrics.tiers", "");
+    return spec.empty() ? utils::default_metric_tiers() : utils::parse_metric_tiers(spec);
+}
+
+// Threads and queue bound of the executor of a command class.
+static utils::PriorityExecutor * make_executor(Conf const & conf, CommandClass c)
+{
+    static size_t const default_threads[] = { 2, 4, 2 };
+
+    auto const name = std::string(command_class_name(c));
+    auto const key  = "agent.executors." + name;
+
+    auto const threads = conf.get<int>(key + ".threads", default_threads[static_cast<int>(c)]);
+    auto const queue   = conf.get<int>(key + ".queue", 0);
+
+    slog() << "[AgentManager] " << name << " commands get " << threads << " threads.";
+
+    return new utils::PriorityExecutor(name, threads, queue);
+}
+
 AgentManager::AgentManager(Conf const & conf, size_t extra_threads)
     : mid(utils::get_first_mac_address())
     , cid(utils::guid())
@@ -21,7 +45,13 @@ AgentManager::AgentManager(Conf const & conf, size_t extra_threads)
     , mstore()
     , ss(conf)
     , ts(conf)
+    , ms(metric_tiers(conf))
     , work_threads(extra_threads)
+    , executors{{ std::unique_ptr<utils::PriorityExecutor>(make_executor(conf, CommandClass::control)),
+                  std::unique_ptr<utils::PriorityExecutor>(make_executor(conf, CommandClass::metadata)),
+                  std::unique_ptr<utils::PriorityExecutor>(make_executor(conf, CommandClass::bulk)) }}
+    , jobs(conf.get<int>("agent.jobs.keep_seconds", 3600),
+           conf.get<int>("agent.jobs.max_finished", 1000))
 
     , mq_host(conf.get<std::string>("agent.mq_server.host"))
     , mq_port(conf.get<int>("agent.mq_server.port"))
@@ -78,6 +108,9 @@ AgentManager::AgentManager(Conf const & conf, size_t extra_threads)
         mq_conf["encryption"] = "none";
     }
 
+    // large rpc responses go compressed to callers that take it
+    rpcserver.set_compress_bytes(config.get<int>("agent.mq_server.compress_bytes", 8192));
+
     // agent module storage
     mstore.reserve(100);
 
@@ -165,6 +198,29 @@ void AgentManager::prepare()
         de_reg_val["modules"].append(m->get_prop());
     }
 
+    // queue depths, every second
+    add_event([this]() {
+        record_executor_metrics();
+        return chrono::milliseconds(1000);
+    }, chrono::milliseconds(1000));
+
+    // command latencies, every minute by default
+    auto const latency_export_ms = config.get<int>("agent.latency.export_ms", 60000);
+
+    if (latency_export_ms > 0)
+    {
+        add_event([this, latency_export_ms]() {
+            export_latencies();
+            return chrono::milliseconds(latency_export_ms);
+        }, chrono::milliseconds(latency_export_ms));
+    }
+
+    // progress of jobs, at most every second each
+    add_event([this]() {
+        publish_job_progress();
+        return chrono::milliseconds(1000);
+    }, chrono::milliseconds(1000));
+
     // mqtt last will and start service
     mqtt.set_will("reg/" + cid, de_reg_val, 1 /* qos */, true /* retain */);
     mqtt.start();
@@ -186,6 +242,10 @@ void AgentManager::run()
     for (auto & t : work_threads)
         t.join();
 
+    // let running commands finish while responses can still go out
+    for (auto & e : executors)
+        e->stop();
+
     // at this point the main event loop is finished
     // more cleaning up work followed here
 #if 0
@@ -266,11 +326,15 @@ void AgentManager::rpc_msg_handler(Json::Value const & msg, RpcProps const & pro
 {
     std::string tgt = msg["target"].isNull() ? "" : msg["target"].asString();
 
-    if (tgt.empty() or tgt == "daemon")
+    if (tgt == "daemon")
+    {
+        // receiver is this agent daemon; its commands are cheap
+        // enough to answer on the message thread
+        rpcserver.send_response(daemon_command(msg["cmd"].asString(), msg["params"]), props);
+    }
+    else if (tgt.empty())
     {
-        // receiver is this agent daemon
-        auto status = std::string("Ignoring message; ") +
-            (tgt.empty() ? "no target." : "daemon target.");
+        auto status = std::string("Ignoring message; no target.");
 
         slog(s_warning) << status;
 
@@ -289,21 +353,48 @@ void AgentManager::rpc_msg_handler(Json::Value const & msg, RpcProps const & pro
             std::string cmd = msg["cmd"].asString();
             Json::Value arg = msg["params"];
 
-            slog() << "[AgentManager] dispatching command to "
-                   << tgt << ": " << msg;
+            // Higher goes first, among commands of the same class.
+            auto const cls      = agent.command_class(cmd, arg);
+            auto const priority = msg.get("priority", 0).asInt();
+            auto      &executor = *executors[static_cast<int>(cls)];
+
+            slog() << "[AgentManager] dispatching " << command_class_name(cls)
+                   << " command to " << tgt << ": " << msg;
+
+            if (msg.get("async", false).asBool())
+            {
+                rpcserver.send_response(submit_job(agent, cmd, arg, executor, priority), props);
+                return;
+            }
 
-            dispatch([this, &agent, cmd, arg, props]() {
+            auto queued = executor.post([this, &agent, cmd, arg, props]() {
                 auto start = chrono::steady_clock::now();
 
-                Json::Value res = agent.command(cmd, arg);
-                rpcserver.send_response(res, props);
+                auto stream = rpcserver.response_stream(props);
+
+                Json::Value res = agent.command(cmd, arg, stream);
+                rpcserver.send_response(stream.finish(res), props);
 
                 slog() << "[AgentManager] command processed. cmd: "
                        << cmd << ", params: " << arg;
 
                 auto dur = chrono::steady_clock::now() - start;
-                report_timing(agent.id(), agent.name(), cmd, dur);
-            });
+                report_timing(agent, cmd, dur);
+            }, priority);
+
+            if (not queued)
+            {
+                auto status = "Too many " + std::string(command_class_name(cls))
+                    + " commands queued; try again later.";
+
+                slog(s_warning) << status;
+
+                Json::Value res;
+                res["code"]    = 1;
+                res["message"] = status;
+
+                rpcserver.send_response(res, props);
+            }
         }
         catch (std::exception const & ex)
         {
@@ -332,6 +423,238 @@ void AgentManager::rpc_msg_handler(Json::Value const & msg, RpcProps const & pro
     }
 }
 
+// "executor_stats": threads, queue depth and waits of each class of
+// commands.  "cache_stats": hits, misses and coalesced requests of
+// the cached commands of each module.  "job_status", "job_cancel":
+// state and progress of the job with id params["job"], with its
+// result once done; cancelling stops the job's work at its next
+// check.  "job_list": all jobs still kept.  "latency_stats":
+// count, mean and percentiles of the latencies of each command of
+// each module, since the agent started.
+Json::Value AgentManager::daemon_command(std::string const & cmd, Json::Value const & params) const
+{
+    Json::Value res;
+
+    if (cmd == "cache_stats")
+    {
+        res["code"] = 0;
+
+        for (auto const & m : mstore)
+        {
+            auto const st = m->cache_stats();
+
+            Json::Value v;
+            v["hits"]      = Json::UInt64(st.hits);
+            v["misses"]    = Json::UInt64(st.misses);
+            v["coalesced"] = Json::UInt64(st.coalesced);
+            v["entries"]   = Json::UInt64(st.entries);
+
+            res["modules"][m->id()] = v;
+        }
+
+        return res;
+    }
+
+    if (cmd == "job_status" or cmd == "job_cancel")
+    {
+        auto job = jobs.find(params["job"].asString());
+
+        if (not job)
+        {
+            res["code"]    = 1;
+            res["message"] = "no such job " + params["job"].asString();
+            return res;
+        }
+
+        if (cmd == "job_cancel")
+        {
+            slog() << "[AgentManager] cancelling job " << job->id();
+            job->cancel();
+        }
+
+        res         = job->status(cmd == "job_status");
+        res["code"] = 0;
+
+        return res;
+    }
+
+    if (cmd == "latency_stats")
+    {
+        res["code"] = 0;
+        res["modules"] = Json::objectValue;
+
+        for (auto const & h : latencies.snapshot())
+            res["modules"][h.first.first][h.first.second] = h.second.summary();
+
+        return res;
+    }
+
+    if (cmd == "job_list")
+    {
+        res["code"] = 0;
+        res["jobs"] = Json::arrayValue;
+
+        for (auto const & job : jobs.list())
+            res["jobs"].append(job->status(false));
+
+        return res;
+    }
+
+    if (cmd != "executor_stats")
+    {
+        res["code"]    = 1;
+        res["message"] = "unknown daemon command " + cmd;
+        return res;
+    }
+
+    res["code"] = 0;
+
+    for (auto const & e : executors)
+    {
+        auto const st = e->stats();
+
+        Json::Value v;
+        v["threads"]     = Json::UInt64(st.threads);
+        v["queued"]      = Json::UInt64(st.queued);
+        v["running"]     = Json::UInt64(st.running);
+        v["max_queued"]  = Json::UInt64(st.max_queued);
+        v["completed"]   = Json::UInt64(st.completed);
+        v["rejected"]    = Json::UInt64(st.rejected);
+        v["avg_wait_ms"] = st.avg_wait_ms;
+        v["max_wait_ms"] = st.max_wait_ms;
+
+        res["executors"][e->name()] = v;
+    }
+
+    return res;
+}
+
+// Long commands, such as checksums of large trees, are better sent
+// with "async": true: the answer is a handle right away, progress goes
+// to the job's topic about every second, and "job_status" gets the
+// result once the job is done.
+Json::Value AgentManager::submit_job(Agent & agent, std::string const & cmd, Json::Value const & params,
+                                     utils::PriorityExecutor & executor, int priority)
+{
+    auto job = jobs.create(agent.id(), cmd);
+
+    auto queued = executor.post([this, &agent, cmd, params, job]() {
+        run_job(agent, cmd, params, job);
+    }, priority);
+
+    Json::Value res;
+
+    if (not queued)
+    {
+        auto status = "Too many " + executor.name() + " commands queued; try again later.";
+
+        slog(s_warning) << status;
+        job->fail(status);
+
+        res["code"]    = 1;
+        res["message"] = status;
+
+        return res;
+    }
+
+    slog() << "[AgentManager] queued job " << job->id() << ": " << cmd;
+
+    res["code"]  = 0;
+    res["job"]   = job->id();
+    res["topic"] = job_topic(*job);
+
+    return res;
+}
+
+void AgentManager::run_job(Agent & agent, std::string const & cmd, Json::Value const & params,
+                           std::shared_ptr<utils::Job> const & job)
+{
+    if (job->cancelled())
+    {
+        job->fail("cancelled before it started");
+        publish_job(*job, true);
+        return;
+    }
+
+    job->start();
+    publish_job(*job, false);
+
+    auto start = chrono::steady_clock::now();
+
+    try
+    {
+        utils::JobScope scope(job);
+        job->finish(agent.command(cmd, params));
+    }
+    catch (std::exception const & ex)
+    {
+        job->fail(ex.what());
+    }
+    catch (...)
+    {
+        job->fail("exception caught; unsure what kind");
+    }
+
+    slog() << "[AgentManager] job " << job->id() << " "
+           << utils::job_state_name(job->state()) << ". cmd: "
+           << cmd << ", params: " << params;
+
+    auto dur = chrono::steady_clock::now() - start;
+    report_timing(agent, cmd, dur);
+
+    publish_job(*job, true);
+}
+
+void AgentManager::publish_job(utils::Job const & job, bool with_result)
+{
+    auto rc = mqtt.publish(job_topic(job), job.status(with_result), 1, false);
+
+    if (rc != MOSQ_ERR_SUCCESS)
+    {
+        slog() << "[AgentManager] could not publish state of job "
+               << job.id() << " (error " << rc << ")";
+    }
+}
+
+void AgentManager::publish_job_progress()
+{
+    std::map<std::string, uint64_t> versions;
+
+    for (auto const & job : jobs.list())
+    {
+        if (job->state() != utils::Job::State::running)
+            continue;
+
+        auto const v = job->version();
+        auto const p = job_versions.find(job->id());
+
+        if (p == job_versions.end() or p->second != v)
+            publish_job(*job, false);
+
+        versions[job->id()] = v;
+    }
+
+    job_versions.swap(versions);
+
+    jobs.expire();
+}
+
+std::string AgentManager::job_topic(utils::Job const & job) const
+{
+    return "job/" + cid + "/" + job.id();
+}
+
+void AgentManager::record_executor_metrics()
+{
+    for (auto const & e : executors)
+    {
+        auto const st = e->stats();
+
+        ms.record("executor." + e->name() + ".queued", st.queued);
+        ms.record("executor." + e->name() + ".running", st.running);
+    }
+}
+
 void AgentManager::on_mqtt_msg(std::string const & topic, Json::Value const & msg)
 {
     // log
@@ -433,11 +756,13 @@ bool AgentManager::mqtt_publish(Agent & module, std::string const & topic, Json:
     return (rc == MOSQ_ERR_SUCCESS);
 }
 
-void AgentManager::report_timing(std::string const & id,
-                                 std::string const & name,
+void AgentManager::report_timing(Agent const & agent,
                                  std::string const & cmd,
-                                 std::chrono::duration<double> const &diff) const
+                                 std::chrono::duration<double> const &diff)
 {
+    if (not agent.knows_command(cmd))
+        return;
+
     std::array<std::string, 1> fields = {"duration"};
 
     auto const num_tags = 4;
@@ -450,7 +775,33 @@ void AgentManager::report_timing(std::string const & id,
     slog() << "[Main] Running " << cmd << " took "
            << utils::format_number(dur.count()) << "μs.";
 
-    timing.insert(dur.count(), {id, name, cmd, "μs"});
+    timing.insert(dur.count(), {agent.id(), agent.name(), cmd, "μs"});
+
+    latencies.get(CommandKey(agent.id(), cmd)).record(dur.count());
+}
+
+void AgentManager::export_latencies()
+{
+    using Latency = utils::TimeSeriesMeasurement<2, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t>;
+
+    Latency latency(ts, "command_latency",
+                    {"count", "p50_us", "p90_us", "p99_us", "max_us"},
+                    {"id", "command"});
+
+    auto now = latencies.snapshot();
+
+    for (auto const & h : now)
+    {
+        auto const d = h.second - latencies_exported[h.first];
+
+        if (d.count() == 0)
+            continue;
+
+        latency.insert(d.count(), d.percentile(50), d.percentile(90), d.percentile(99), d.max(),
+                       {h.first.first, h.first.second});
+    }
+
+    latencies_exported.swap(now);
 }
 
 
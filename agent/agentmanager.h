@@ -4,6 +4,10 @@
 #include "agent.h"
 #include "utils/rpcserver.h"
 #include "utils/rpcclient.h"
+#include "utils/metricstore.h"
+#include "utils/executor.h"
+#include "utils/job.h"
+#include "utils/histogram.h"
 
 class AgentManager
 {
@@ -45,15 +49,16 @@ public:
     // Send a message to the queue specified.
     Json::Value send_message(std::string const &queue, Json::Value const &message);
 
-    // timing for command execution
-    void report_timing(std::string const & id,
-                       std::string const & name,
+    // timing for command execution; commands the module doesn't
+    // know are not timed
+    void report_timing(Agent const & agent,
                        std::string const & cmd,
-                       std::chrono::duration<double> const &diff) const;
+                       std::chrono::duration<double> const &diff);
 
     // accessor
     SiteStore                 &   store()       { return ss; }
     const utils::TimeSeriesDB &    tsdb() const { return ts; }
+    utils::MetricStore        & metrics()       { return ms; }
 
     asio::io_service const & io_service() const { return io; }
     asio::io_service       & io_service()       { return io; }
@@ -85,6 +90,32 @@ private:
     // rpc server msg handler
     void rpc_msg_handler(Json::Value const & msg, RpcProps const & props);
 
+    // answers commands to the "daemon" target
+    Json::Value daemon_command(std::string const & cmd, Json::Value const & params) const;
+
+    // queue depths of the executors, into the metric store
+    void record_executor_metrics();
+
+    // queue a command as a job, and answer with its handle
+    Json::Value submit_job(Agent & agent, std::string const & cmd, Json::Value const & params,
+                           utils::PriorityExecutor & executor, int priority);
+
+    // run a queued job, on its executor
+    void run_job(Agent & agent, std::string const & cmd, Json::Value const & params,
+                 std::shared_ptr<utils::Job> const & job);
+
+    // state and progress of a job, on its topic
+    void publish_job(utils::Job const & job, bool with_result);
+
+    // progress of running jobs that moved, and expiry of old ones
+    void publish_job_progress();
+
+    std::string job_topic(utils::Job const & job) const;
+
+    // percentiles of command latencies since the last export, into
+    // the time series database
+    void export_latencies();
+
 private:
 
     // machine id (first mac address)
@@ -111,9 +142,35 @@ private:
     SiteStore ss;
     utils::TimeSeriesDB ts;
 
+    // recent history of what the modules measure, kept in memory;
+    // "agent.metrics.tiers" sets its resolution and length.
+    utils::MetricStore ms;
+
     // thread pool
     std::vector<std::thread> work_threads;
 
+    // RPC commands run here rather than on io, one executor per
+    // CommandClass, sized by "agent.executors.<class>.threads" and
+    // bounded by "agent.executors.<class>.queue".
+    std::array<std::unique_ptr<utils::PriorityExecutor>, 3> executors;
+
+    // Commands sent with "async": true run as jobs; finished ones are
+    // kept for "agent.jobs.keep_seconds", for their results to be
+    // fetched.
+    utils::JobTable jobs;
+
+    // version of each running job last published; only touched by
+    // publish_job_progress()
+    std::map<std::string, uint64_t> job_versions;
+
+    // latency of every command, by (module id, command)
+    using CommandKey = std::pair<std::string, std::string>;
+
+    utils::LatencyHistogramsBy<CommandKey> latencies;
+
+    // latencies as last exported; only touched by export_latencies()
+    std::map<CommandKey, utils::HistogramSnapshot> latencies_exported;
+
     std::string mq_host;
     int         mq_port;
     Json::Value mq_conf;
@@ -0,0 +1,312 @@
+#include <set>
+#include <stdexcept>
+
+#include "blockchecksums.h"
+
+#include "utils/utils.h"
+#include "utils/checksum.h"
+#include "utils/paths/dirwalker.h"
+
+// ----------------------------------------------------------------------
+
+BlockChecksums::BlockChecksums(sink_t sink, std::chrono::seconds max_wait)
+    : sink_(std::move(sink)),
+      max_wait_(max_wait),
+      stop_(false)
+{
+}
+
+BlockChecksums::~BlockChecksums()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+// ----------------------------------------------------------------------
+
+void
+BlockChecksums::queue(std::string const        &block_id,
+                      BlockChecksums::entries_t files,
+                      BlockChecksums::entries_t dirs,
+                      EVP_MD const             *md,
+                      size_t                    threads,
+                      std::shared_ptr<cache_t>  cache)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+
+    // Forget about finished blocks once in a while; their state is
+    // with the sink anyway.
+    if (state_.size() > 100000)
+    {
+        for (auto it = state_.begin(); it != state_.end(); )
+        {
+            if (it->second["state"] != "pending")
+                it = state_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Nothing to checksum: done already, and so its group says.
+    if (files.empty() and dirs.empty())
+    {
+        state_[block_id]["state"] = "done";
+        cv_.notify_all();
+        return;
+    }
+
+    state_[block_id]["state"] = "pending";
+
+    Job job;
+    job.block_id = block_id;
+    job.files    = std::move(files);
+    job.dirs     = std::move(dirs);
+    job.md       = md;
+    job.threads  = threads;
+    job.cache    = cache ? cache : std::make_shared<cache_t>();
+
+    jobs_.push_back(std::move(job));
+
+    if (not thread_.joinable())
+    {
+        thread_ = std::thread(&BlockChecksums::run, this);
+    }
+
+    cv_.notify_all();
+}
+
+// ----------------------------------------------------------------------
+
+Json::Value
+BlockChecksums::checksum(Job const &job)
+{
+    auto &cache = *job.cache;
+
+    // Regular files under each directory, by canonical name; walking
+    // the tree only stats them.
+    std::vector<std::vector<std::string>> dir_files;
+
+    for (auto const &d : job.dirs)
+    {
+        std::vector<std::string> names;
+
+        for (auto const &p : utils::DirectoryWalker(d.first, true))
+        {
+            if (p.is_regular_file())
+            {
+                names.push_back(p.canonical_name());
+            }
+        }
+
+        dir_files.push_back(std::move(names));
+    }
+
+    std::vector<std::string> file_names;
+
+    for (auto const &f : job.files)
+    {
+        file_names.push_back(f.first.canonical_name());
+    }
+
+    // Read what no earlier block has, each file once.
+    std::set<std::string>    wanted;
+    std::vector<utils::Path> to_read;
+
+    auto want = [&](std::string const &name) {
+        if (cache.find(name) == cache.end() and wanted.insert(name).second)
+        {
+            to_read.emplace_back(name);
+        }
+    };
+
+    for (auto const &n : file_names)
+    {
+        want(n);
+    }
+
+    for (auto const &names : dir_files)
+    {
+        for (auto const &n : names)
+        {
+            want(n);
+        }
+    }
+
+    auto const sums = utils::checksum_files(to_read, job.md, job.threads);
+
+    for (size_t i = 0; i < to_read.size(); i++)
+    {
+        cache[to_read[i].name()] = sums[i];
+    }
+
+    Json::Value checksums{Json::arrayValue};
+
+    for (size_t i = 0; i < job.dirs.size(); i++)
+    {
+        std::vector<std::string> dir_sums;
+        dir_sums.reserve(dir_files[i].size());
+
+        for (auto const &n : dir_files[i])
+        {
+            dir_sums.push_back(cache.at(n));
+        }
+
+        Json::Value v;
+        v.append(job.dirs[i].second);
+        v.append(utils::checksum_of_checksums(dir_sums, job.md));
+
+        checksums.append(v);
+    }
+
+    for (size_t i = 0; i < job.files.size(); i++)
+    {
+        Json::Value v;
+        v.append(job.files[i].second);
+        v.append(cache.at(file_names[i]));
+
+        checksums.append(v);
+    }
+
+    return checksums;
+}
+
+// ----------------------------------------------------------------------
+
+void
+BlockChecksums::run()
+{
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+
+            cv_.wait(lock, [this]() {
+                    return stop_ or not jobs_.empty();
+                });
+
+            if (stop_)
+            {
+                return;
+            }
+
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        Json::Value checksums{Json::arrayValue};
+        std::string state = "done";
+        std::string error;
+
+        try
+        {
+            checksums = checksum(job);
+        }
+        catch (std::exception const &ex)
+        {
+            state = "error";
+            error = ex.what();
+            checksums.clear();
+        }
+
+        try
+        {
+            sink_(job.block_id, checksums, state, error);
+        }
+        catch (std::exception const &ex)
+        {
+            state = "error";
+            error = "could not update block record: " + std::string(ex.what());
+        }
+
+        utils::slog() << "[DTN Agent] Deferred checksums of block "
+                      << job.block_id << " (" << job.files.size()
+                      << " files, " << job.dirs.size()
+                      << " directories): " << state
+                      << (error.empty() ? "" : ", " + error);
+
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+
+            auto &s = state_[job.block_id];
+            s["state"] = state;
+
+            if (not error.empty())
+            {
+                s["error"] = error;
+            }
+        }
+
+        cv_.notify_all();
+    }
+}
+
+// ----------------------------------------------------------------------
+
+Json::Value
+BlockChecksums::state(Json::Value const &blocks, std::chrono::seconds wait)
+{
+    auto any_pending = [&]() {
+        for (auto const &b : blocks)
+        {
+            auto it = state_.find(b.asString());
+
+            if (it != state_.end() and it->second["state"] == "pending")
+            {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    std::unique_lock<std::mutex> lock(mtx_);
+
+    wait = std::min(wait, max_wait_);
+
+    if (wait.count() > 0)
+    {
+        cv_.wait_for(lock, wait, [&]() {
+                return stop_ or not any_pending();
+            });
+    }
+
+    Json::Value result;
+
+    for (auto const &b : blocks)
+    {
+        auto const id = b.asString();
+        auto it = state_.find(id);
+
+        if (it != state_.end())
+        {
+            result["blocks"][id] = it->second;
+        }
+        else
+        {
+            // Not one of ours, or forgotten; the sink will have the
+            // answer.
+            result["blocks"][id]["state"] = "unknown";
+        }
+    }
+
+    result["done"] = not any_pending();
+
+    return result;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,108 @@
+#ifndef BDE_AGENT_BLOCKCHECKSUMS_H
+#define BDE_AGENT_BLOCKCHECKSUMS_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <openssl/evp.h>
+
+#include "utils/json/json.h"
+#include "utils/paths/path.h"
+
+// Deferred checksums of expand_and_group_v2 blocks.
+//
+// Blocks are handed out before their checksums are known; their files
+// and directories are queued here, and one background thread works
+// through the blocks in the order they were queued.  The results go
+// to a sink (in DTN Agent, the block's DB record), and the state of
+// every block can be asked for, waiting until it is no longer pending
+// if need be.
+class BlockChecksums
+{
+public:
+    // Paths, along with their destination names.
+    typedef std::vector<std::pair<utils::Path, std::string>> entries_t;
+
+    // Checksums of the regular files read so far, by canonical name.
+    // Blocks of one expansion share one: a directory's checksum of
+    // checksums, which covers every file under it, is made of the
+    // checksums of files of its own or earlier blocks, and later
+    // blocks reuse those read for it.  No file is read twice.
+    typedef std::map<std::string, std::string> cache_t;
+
+    // Gets a block id, its [destination, checksum] pairs, its state
+    // ("done" or "error") and an error message.  If it throws, the
+    // block is in error.
+    typedef std::function<void(std::string const &block_id,
+                               Json::Value const &checksums,
+                               std::string const &state,
+                               std::string const &error)> sink_t;
+
+    // Waits in state() are cut to @max_wait@.
+    explicit BlockChecksums(sink_t sink,
+                            std::chrono::seconds max_wait = std::chrono::seconds(300));
+    ~BlockChecksums();
+
+    BlockChecksums(BlockChecksums const &) = delete;
+    BlockChecksums & operator=(BlockChecksums const &) = delete;
+
+    // Queue the checksums of a block's regular @files@, and the
+    // checksums of checksums of its @dirs@, computed with up to
+    // @threads@ threads.  A block with neither is done at once, and
+    // the sink hears nothing of it.  Without a @cache@, the block
+    // gets one of its own.
+    void queue(std::string const        &block_id,
+               entries_t                 files,
+               entries_t                 dirs,
+               EVP_MD const             *md,
+               size_t                    threads,
+               std::shared_ptr<cache_t>  cache = nullptr);
+
+    // {"blocks": {id: {"state": "pending" | "done" | "error" |
+    // "unknown", "error": ...}}, "done": false if any is pending},
+    // once none of @blocks@ is pending or @wait@ is over.
+    Json::Value state(Json::Value const &blocks, std::chrono::seconds wait);
+
+private:
+    struct Job
+    {
+        std::string              block_id;
+        entries_t                files;
+        entries_t                dirs;
+        EVP_MD const            *md = nullptr;
+        size_t                   threads = 1;
+        std::shared_ptr<cache_t> cache;
+    };
+
+    void run();
+
+    // [destination, checksum] pairs of the job: directories first,
+    // then files, as in a group checksummed on the spot.
+    static Json::Value checksum(Job const &job);
+
+    sink_t               sink_;
+    std::chrono::seconds max_wait_;
+
+    std::deque<Job>                    jobs_;
+    std::map<std::string, Json::Value> state_;
+    std::mutex                         mtx_;
+    std::condition_variable            cv_;
+    std::thread                        thread_;
+    bool                               stop_;
+};
+
+#endif
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <stdexcept>
 #include <future>
+#include <set>
 
 #include <sys/types.h>
 #include <pwd.h>
@@ -19,6 +20,11 @@
 #include "utils/checksum.h"
 #include "utils/grid-mapfile.h"
 #include "utils/fsusage.h"
+#include "utils/linksampler.h"
+#include "utils/tcpprobe.h"
+#include "utils/tc.h"
+#include "utils/netconfig.h"
+#include "utils/topology.h"
 #include "dtnagent.h"
 
 // deal with ancient glibc-devel on mdtm-server
@@ -89,10 +95,30 @@ static std::set<std::string> networked_fs_ = {
 DTNAgent::DTNAgent(Json::Value const & conf)
     : Agent(conf["id"].asString(), conf["name"].asString(), "DTN"),
       conf_(conf),
-      link_rates_computed_(false)
+      link_rates_computed_(false),
+      link_sampler_interval_ms_(100),
+      link_sampler_history_seconds_(60),
+      metrics_interval_ms_(1000),
+      metrics_last_checksum_bytes_(0),
+      iface_listener_(0),
+      iface_change_pending_(false),
+      block_checksums_([this](std::string const &block_id,
+                              Json::Value const &checksums,
+                              std::string const &state,
+                              std::string const &error) {
+              store().update_block_checksums(block_id, checksums, state, error);
+          })
 {
 }
 
+DTNAgent::~DTNAgent()
+{
+    if (iface_listener_)
+    {
+        utils::IfaceTable::instance().remove_listener(iface_listener_);
+    }
+}
+
 // ----------------------------------------------------------------------
 
 void
@@ -185,16 +211,6 @@ DTNAgent::check_configuration(Json::Value const & conf)
         }
     }
 
-    auto agentconf = manager().get_config();
-    iozone_program_path_ = agentconf["agent"]["programs"]["iozone"].asString();
-
-    if (iozone_program_path_.empty())
-    {
-        utils::slog() << "[DTN Agent] Path to iozone program is not in configured; "
-                      << "assuming iozone will be available in our PATH.";
-        iozone_program_path_ = "iozone";
-    }
-
     transfer_program_path_ = conf["data_transfer_program"]["path"].asString();
     auto args = conf["data_transfer_program"]["args"];
 
@@ -285,6 +301,44 @@ DTNAgent::check_configuration(Json::Value const & conf)
         }
     }
 
+    // Where to run the data transfer program: "none", "nic-local" or
+    // "nic-local-strict" (see utils/topology.h), near the data
+    // interface it uses, which is the first one unless "interface"
+    // says otherwise.
+    auto placement = conf["data_transfer_program"]["placement"];
+    if (not placement.empty() and not transfer_program_path_.empty())
+    {
+        auto const policy = placement.isObject() ?
+            placement["policy"].asString() : placement.asString();
+
+        std::string iface;
+
+        if (policy.empty() or policy == "none")
+        {
+            // runs anywhere; no interface to look up
+        }
+        else if (placement.isObject() and placement.isMember("interface"))
+        {
+            iface = placement["interface"].asString();
+        }
+        else if (not data_ifaces_.empty())
+        {
+            iface = data_ifaces_.front();
+        }
+        else
+        {
+            throw std::runtime_error("No interface to place the data "
+                                     "transfer program near.");
+        }
+
+        transfer_program_placement_ =
+            utils::nic_local_placement(utils::Topology::read(), iface, policy);
+
+        utils::slog() << "[DTN Agent] Data transfer program placement ("
+                      << policy << ", " << iface << "): "
+                      << transfer_program_placement_.describe();
+    }
+
     auto ir = conf["ignore_route_cmds"];
     if ((not ir.empty()) and ir.asBool())
     {
@@ -340,6 +394,43 @@ DTNAgent::check_configuration(Json::Value const & conf)
                   << " threads for files larger than "
                   << checksum_file_size_threshold_
                   << " bytes.";
+
+    // Data interface counters are sampled every "interval_ms"
+    // milliseconds (0 turns sampling off), and "history_seconds"
+    // worth of samples are kept for dtn_link_history command.
+    auto sampler_interval = conf["link_sampler"]["interval_ms"];
+    auto sampler_history  = conf["link_sampler"]["history_seconds"];
+
+    link_sampler_interval_ms_ =
+        sampler_interval.empty() ? 100 : sampler_interval.asLargestUInt();
+    link_sampler_history_seconds_ =
+        sampler_history.empty() ? 60 : sampler_history.asLargestUInt();
+
+    // Recent history goes into the agent's metric store every
+    // "interval_ms" milliseconds (0 turns it off), for the
+    // metrics_fetch command.
+    auto metrics_interval = conf["metrics"]["interval_ms"];
+
+    metrics_interval_ms_ =
+        metrics_interval.empty() ? 1000 : metrics_interval.asLargestUInt();
+
+    // Identical requests of these commands, which the portal and the
+    // scheduler send often, share one computation; its result is kept
+    // for so many milliseconds.  "command_cache_ms" overrides these,
+    // and can add other commands that change nothing.
+    command_cache_ttl_ = {
+        { "dtn_status",          std::chrono::milliseconds(1000) },
+        { "dtn_path_size",       std::chrono::milliseconds(2000) },
+        { "dtn_list",            std::chrono::milliseconds(1000) },
+        { "dtn_get_disk_usage",  std::chrono::milliseconds(2000) }
+    };
+
+    auto const &cache_ms = conf["command_cache_ms"];
+
+    for (auto const &name : cache_ms.getMemberNames())
+    {
+        command_cache_ttl_[name] = std::chrono::milliseconds(cache_ms[name].asLargestUInt());
+    }
 }
 
 // ----------------------------------------------------------------------
@@ -396,12 +487,60 @@ DTNAgent::do_bootstrap()
 void
 DTNAgent::do_init()
 {
+    sysinfo_measurement_.reset(
+        new SysInfoMeasurement(tsdb(), "sysinfo",
+                               { "loadavg-1m",
+                                 "loadavg-5m",
+                                 "loadavg-15m",
+                                 "total-ram",
+                                 "free-ram",
+                                 "total-swap",
+                                 "free-swap" },
+                               { "name", "id" }));
+
+    interface_measurement_.reset(
+        new InterfaceMeasurement(tsdb(), "network",
+                                 { "rx-bytes"   ,
+                                   "rx-packets" ,
+                                   "rx-dropped" ,
+                                   "rx-errors"  ,
+                                   "tx-bytes"   ,
+                                   "tx-packets" ,
+                                   "tx-dropped" ,
+                                   "tx-errors"  },
+                                 { "name", "id", "interface" }));
+
     // init data interface statistics
     for (auto const &iface : data_ifaces_)
     {
         link_rates_.emplace(iface, get_link_stats(iface));
     }
 
+    if (link_sampler_interval_ms_ > 0 and not data_ifaces_.empty())
+    {
+        link_sampler_.reset(new utils::LinkSampler(data_ifaces_,
+                                                   link_sampler_interval_ms_,
+                                                   link_sampler_history_seconds_));
+        link_sampler_->start();
+    }
+
+    if (metrics_interval_ms_ > 0)
+    {
+        auto metrics_interval = std::chrono::milliseconds(metrics_interval_ms_);
+
+        record_metrics();
+
+        manager().add_event([this, metrics_interval](){
+                record_metrics();
+                return metrics_interval;
+            }, metrics_interval);
+    }
+
+    iface_listener_ = utils::IfaceTable::instance().add_listener(
+        [this](utils::IfaceChange const &change) {
+            on_iface_change(change);
+        });
+
     auto delay = std::chrono::milliseconds(expiry_interval_);
 
     // Monitor DTN status periodically.
@@ -458,13 +597,57 @@ DTNAgent::do_init()
         transfer_program_thread_ = std::thread([this]() {
                 utils::supervise_process(transfer_program_path_,
                                          transfer_program_args_,
-                                         transfer_program_env_);
+                                         transfer_program_env_,
+                                         1,
+                                         transfer_program_placement_);
             });
     }
 }
 
 // ----------------------------------------------------------------------
 
+// Called on the netlink thread of utils::IfaceTable.  Registration
+// happens on the agent manager's thread, same as the periodic one,
+// instead of waiting up to expiry_interval_ for it.
+void
+DTNAgent::on_iface_change(utils::IfaceChange const &change)
+{
+    if (change.kind != utils::IfaceChange::resync and
+        change.iface != mgmt_iface_ and
+        std::find(data_ifaces_.begin(), data_ifaces_.end(),
+                  change.iface) == data_ifaces_.end())
+    {
+        return;
+    }
+
+    if (iface_change_pending_.exchange(true))
+    {
+        return;
+    }
+
+    utils::slog() << "[DTN Agent] Interface " << change.iface
+                  << " changed; registering again.";
+
+    manager().dispatch([this]() {
+            iface_change_pending_ = false;
+
+            try
+            {
+                check_network_interfaces();
+                set_dtn_properties();
+                register_dtn();
+                register_all_sdmaps();
+            }
+            catch (std::exception const &ex)
+            {
+                utils::slog() << "[DTN Agent] Error registering after "
+                              << "interface change: " << ex.what();
+            }
+        });
+}
+
+// ----------------------------------------------------------------------
+
 void
 DTNAgent::do_registration()
 {
@@ -844,7 +1027,13 @@ DTNAgent::init_storage_agents()
             v["root-folders"].append(p);
         }
 
-        v["iozone-executable"]  = iozone_program_path_;
+        // Storage agents benchmark their storage in-process (see
+        // utils/storagebench.h), in a work folder that keeps its
+        // old name; "storage-bench" tunes it.
+        if (not conf_["storage_bench"].empty())
+        {
+            v["storage-bench"] = conf_["storage_bench"];
+        }
 
         for (auto const &p : paths)
         {
@@ -1053,6 +1242,97 @@ DTNAgent::update_interface_traffic(std::string const &iface)
     //               << link_rates_[iface];
 }
 
+// ----------------------------------------------------------------------
+
+// Return sampled rates of data interfaces over the last "seconds"
+// seconds (default 10): average, peak, and percentiles of bits/sec,
+// and with "rates" set to true, the per-sample rates too.
+Json::Value
+DTNAgent::handle_link_history_command(Json::Value const &message)
+{
+    if (not link_sampler_)
+    {
+        return json_response(1, "dtn_link_history: link sampling is not enabled");
+    }
+
+    auto const seconds = message["seconds"].empty() ?
+        10 : message["seconds"].asLargestUInt();
+    auto const with_rates = message["rates"].asBool();
+
+    std::vector<std::string> ifaces;
+
+    if (message["interface"].empty())
+    {
+        ifaces = link_sampler_->interfaces();
+    }
+    else
+    {
+        ifaces.push_back(message["interface"].asString());
+    }
+
+    auto stats_json = [](utils::LinkRateStats const &st) {
+        Json::Value v;
+        v["avg"]  = st.avg;
+        v["peak"] = st.peak;
+        v["p50"]  = st.p50;
+        v["p90"]  = st.p90;
+        v["p99"]  = st.p99;
+        return v;
+    };
+
+    // Sample times are from the steady clock; report them as
+    // milliseconds since the epoch.
+    auto const steady_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto const system_now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    Json::Value response = json_response(0, "OK");
+    response["interval_ms"] = static_cast<Json::UInt64>(link_sampler_->interval_ms());
+
+    try
+    {
+        for (auto const &iface : ifaces)
+        {
+            auto const rates = utils::link_rates(link_sampler_->history(iface, seconds));
+
+            Json::Value v;
+
+            v["samples"] = static_cast<Json::UInt64>(rates.size());
+            v["rx_bps"]  = stats_json(utils::link_rate_stats(rates, &utils::LinkRates::rx_bps));
+            v["tx_bps"]  = stats_json(utils::link_rate_stats(rates, &utils::LinkRates::tx_bps));
+            v["rx_pps"]  = stats_json(utils::link_rate_stats(rates, &utils::LinkRates::rx_pps));
+            v["tx_pps"]  = stats_json(utils::link_rate_stats(rates, &utils::LinkRates::tx_pps));
+
+            if (with_rates)
+            {
+                // [time, rx_bps, tx_bps, rx_pps, tx_pps, rx_dropped, tx_dropped]
+                for (auto const &r : rates)
+                {
+                    Json::Value rv;
+                    rv.append(static_cast<Json::Int64>((r.time_ns - steady_now + system_now) / 1000000));
+                    rv.append(r.rx_bps);
+                    rv.append(r.tx_bps);
+                    rv.append(r.rx_pps);
+                    rv.append(r.tx_pps);
+                    rv.append(r.rx_dropped);
+                    rv.append(r.tx_dropped);
+
+                    v["rates"].append(rv);
+                }
+            }
+
+            response["interfaces"][iface] = v;
+        }
+    }
+    catch (std::exception const &ex)
+    {
+        return json_response(1, "dtn_link_history: " + std::string(ex.what()));
+    }
+
+    return response;
+}
+
 void
 DTNAgent::update_time_series_db() const
 {
@@ -1066,6 +1346,70 @@ DTNAgent::update_time_series_db() const
 
 // ----------------------------------------------------------------------
 
+// Rates are over the time since the last call; the first call only
+// takes note of the counters.
+void
+DTNAgent::record_metrics()
+{
+    auto &store = metrics();
+
+    auto const now     = std::chrono::steady_clock::now();
+    auto const seconds = std::chrono::duration<double>(now - metrics_last_time_).count();
+    auto const first   = metrics_last_time_ == std::chrono::steady_clock::time_point();
+
+    struct sysinfo info{0};
+
+    if (sysinfo(&info) == 0)
+    {
+        store.record("load.1m", info.loads[0] / (float)(1 << SI_LOAD_SHIFT));
+        store.record("mem.free", double(info.freeram) * info.mem_unit);
+    }
+
+    auto rate = [seconds](uint64_t before, uint64_t after) {
+        return after >= before ? (after - before) / seconds : 0.0;
+    };
+
+    for (auto const &iface : data_ifaces_)
+    {
+        try
+        {
+            auto const stat = get_link_stats(iface);
+            auto const last = metrics_last_links_.find(iface);
+
+            if (last != metrics_last_links_.end() and seconds > 0)
+            {
+                auto const prefix = "net." + iface + ".";
+
+                store.record(prefix + "rx_bps", 8 * rate(last->second.rx_bytes, stat.rx_bytes));
+                store.record(prefix + "tx_bps", 8 * rate(last->second.tx_bytes, stat.tx_bytes));
+                store.record(prefix + "rx_pps", rate(last->second.rx_packets, stat.rx_packets));
+                store.record(prefix + "tx_pps", rate(last->second.tx_packets, stat.tx_packets));
+            }
+
+            metrics_last_links_[iface] = stat;
+        }
+        catch (std::exception const &)
+        {
+            // The interface may be gone for a while; the periodic
+            // status check reports that.
+            metrics_last_links_.erase(iface);
+        }
+    }
+
+    auto const checksum_bytes = utils::checksum_bytes_read();
+
+    if (not first and seconds > 0)
+    {
+        store.record("checksum.bytes_per_sec",
+                     rate(metrics_last_checksum_bytes_, checksum_bytes));
+    }
+
+    metrics_last_checksum_bytes_ = checksum_bytes;
+    metrics_last_time_           = now;
+}
+
+// ----------------------------------------------------------------------
+
 std::ostream&
 operator<<(std::ostream& out, struct sysinfo const & info)
 {
@@ -1095,27 +1439,10 @@ operator<<(std::ostream& out, struct sysinfo const & info)
 void
 DTNAgent::update_time_series_sysinfo_stats() const
 {
-    std::array<std::string, 7> field_names = { "loadavg-1m",
-                                               "loadavg-5m",
-                                               "loadavg-15m",
-                                               "total-ram",
-                                               "free-ram",
-                                               "total-swap",
-                                               "free-swap" };
-
-    auto const num_tags = 2;
-    std::array<std::string, num_tags> tag_names = { "name", "id" };
-
-    using SysInfo = utils::TimeSeriesMeasurement<num_tags,
-                                                 float,
-                                                 float,
-                                                 float,
-                                                 size_t,
-                                                 size_t,
-                                                 size_t,
-                                                 size_t>;
-
-    SysInfo measure(tsdb(), "sysinfo", field_names, tag_names);
+    if (not sysinfo_measurement_)
+    {
+        return;
+    }
 
     struct sysinfo info{0};
 
@@ -1142,14 +1469,14 @@ DTNAgent::update_time_series_sysinfo_stats() const
 
     try
     {
-        measure.insert(load_avg_1m,
-                       load_avg_5m,
-                       load_avg_15m,
-                       info.totalram,
-                       info.freeram,
-                       info.totalswap,
-                       info.freeswap,
-                       {name(), id()});
+        sysinfo_measurement_->insert(load_avg_1m,
+                                     load_avg_5m,
+                                     load_avg_15m,
+                                     info.totalram,
+                                     info.freeram,
+                                     info.totalswap,
+                                     info.freeswap,
+                                     {name(), id()});
     }
     catch (std::exception const &ex)
     {
@@ -1162,49 +1489,23 @@ DTNAgent::update_time_series_sysinfo_stats() const
 void
 DTNAgent::update_time_series_interface_stats(std::string const &iface) const
 {
+    if (not interface_measurement_)
+    {
+        return;
+    }
+
     try {
         auto stat = get_link_stats(iface);
 
-        std::array<std::string, 8> field_names =
-            { "rx-bytes"   ,
-              "rx-packets" ,
-              "rx-dropped" ,
-              "rx-errors"  ,
-              "tx-bytes"   ,
-              "tx-packets" ,
-              "tx-dropped" ,
-              "tx-errors"  };
-
-        auto const num_tags = 3;
-
-        std::array<std::string, num_tags> tag_names =
-            { "name", "id", "interface" };
-
-        // representation of network interface data "point" for the time
-        // series database.
-        using InterfaceMeasurement =
-            utils::TimeSeriesMeasurement <num_tags,
-                                          size_t, // rx bytes
-                                          size_t, // rx packets
-                                          size_t, // rx dropped
-                                          size_t, // rx errors
-                                          size_t, // tx bytes
-                                          size_t, // tx packets
-                                          size_t, // tx dropped
-                                          size_t  // tx errors
-                                          >;
-
-        InterfaceMeasurement measure(tsdb(), "network", field_names, tag_names);
-
-        measure.insert(stat.rx_bytes    ,
-                       stat.rx_packets  ,
-                       stat.rx_dropped  ,
-                       stat.rx_errors   ,
-                       stat.tx_bytes    ,
-                       stat.tx_packets  ,
-                       stat.tx_dropped  ,
-                       stat.tx_errors   ,
-                       {name(), id(), iface});
+        interface_measurement_->insert(stat.rx_bytes    ,
+                                       stat.rx_packets  ,
+                                       stat.rx_dropped  ,
+                                       stat.rx_errors   ,
+                                       stat.tx_bytes    ,
+                                       stat.tx_packets  ,
+                                       stat.tx_dropped  ,
+                                       stat.tx_errors   ,
+                                       {name(), id(), iface});
     }
     catch (std::exception const &ex)
     {
@@ -1262,7 +1563,17 @@ Json::Value DTNAgent::do_command(std::string const & cmd,
     }
     else if (cmd == "dtn_expand_and_group_v2")
     {
-        return handle_expand_and_group_command_v2(params);
+        // No way to send partial responses from here.
+        RpcResponseStream none;
+        return handle_expand_and_group_command_v2(params, none);
+    }
+    else if (cmd == "dtn_block_checksum_state")
+    {
+        return handle_block_checksum_state_command(params);
+    }
+    else if (cmd == "dtn_link_history")
+    {
+        return handle_link_history_command(params);
     }
     else if (cmd == "dtn_send_icmp_ping")
     {
@@ -1272,6 +1583,10 @@ Json::Value DTNAgent::do_command(std::string const & cmd,
     {
         return handle_send_ping_command(params);
     }
+    else if (cmd == "dtn_probe_throughput")
+    {
+        return handle_probe_throughput_command(params);
+    }
     else if (cmd == "dtn_start_pong")
     {
         return handle_start_pong_command(params);
@@ -1280,6 +1595,18 @@ Json::Value DTNAgent::do_command(std::string const & cmd,
     {
         return handle_stop_pong_command(params);
     }
+    else if (cmd == "dtn_pong_status")
+    {
+        return handle_pong_status_command(params);
+    }
+    else if (cmd == "dtn_set_pacing")
+    {
+        return handle_set_pacing_command(params);
+    }
+    else if (cmd == "dtn_apply_network_config")
+    {
+        return handle_apply_network_config_command(params);
+    }
     else if (cmd == "dtn_list")
     {
         return handle_list_command(params);
@@ -1334,6 +1661,119 @@ Json::Value DTNAgent::do_command(std::string const & cmd,
     }
 }
 
+Json::Value DTNAgent::do_stream_command(std::string const & cmd,
+                                        Json::Value const & params,
+                                        RpcResponseStream & stream)
+{
+    if (cmd == "dtn_expand_and_group_v2")
+    {
+        return handle_expand_and_group_command_v2(params, stream);
+    }
+
+    return do_command(cmd, params);
+}
+
+// ----------------------------------------------------------------------
+
+// Commands not listed here walk file systems, or look things up, and
+// go with the metadata ones.
+CommandClass DTNAgent::do_command_class(std::string const & cmd,
+                                        Json::Value const & params) const
+{
+    static std::set<std::string> const control = {
+        "dtn_status",
+        "dtn_block_checksum_state",
+        "dtn_link_history",
+        "dtn_send_icmp_ping",
+        "dtn_send_ping",
+        "dtn_start_pong",
+        "dtn_stop_pong",
+        "dtn_pong_status",
+        "dtn_set_pacing",
+        "dtn_apply_network_config",
+        "dtn_add_route",
+        "dtn_delete_route",
+        "dtn_add_neighbor",
+        "dtn_delete_neighbor"
+    };
+
+    static std::set<std::string> const bulk = {
+        "dtn_compute_checksums",
+        "dtn_verify_checksums",
+        "dtn_probe_throughput"
+    };
+
+    if (control.count(cmd))
+    {
+        return CommandClass::control;
+    }
+
+    if (bulk.count(cmd))
+    {
+        return CommandClass::bulk;
+    }
+
+    // Unless deferred, checksums are computed before the response.
+    if (cmd == "dtn_expand_and_group_v2" and
+        params["checksum"]["compute"].asBool() and
+        not params["checksum"]["deferred"].asBool())
+    {
+        return CommandClass::bulk;
+    }
+
+    return CommandClass::metadata;
+}
+
+// The commands of do_command(), above.
+bool DTNAgent::do_command_known(std::string const & cmd) const
+{
+    static std::set<std::string> const commands = {
+        "dtn_status",
+        "dtn_expand",
+        "dtn_expand_and_group",
+        "dtn_expand_and_group_v2",
+        "dtn_block_checksum_state",
+        "dtn_link_history",
+        "dtn_send_icmp_ping",
+        "dtn_send_ping",
+        "dtn_probe_throughput",
+        "dtn_start_pong",
+        "dtn_stop_pong",
+        "dtn_pong_status",
+        "dtn_set_pacing",
+        "dtn_apply_network_config",
+        "dtn_list",
+        "dtn_add_route",
+        "dtn_delete_route",
+        "dtn_add_neighbor",
+        "dtn_delete_neighbor",
+        "dtn_path_size",
+        "dtn_compute_checksums",
+        "dtn_verify_checksums",
+        "dtn_get_gridmap_entries",
+        "dtn_push_gridmap_entries",
+        "dtn_get_disk_usage",
+        "dtn_mkdir"
+    };
+
+    return commands.count(cmd) > 0;
+}
+
+bool DTNAgent::do_command_cache(std::string const & cmd,
+                                std::chrono::milliseconds & ttl) const
+{
+    auto c = command_cache_ttl_.find(cmd);
+
+    if (c == command_cache_ttl_.end())
+    {
+        return false;
+    }
+
+    ttl = c->second;
+
+    return true;
+}
+
 // ----------------------------------------------------------------------
 
 Json::Value DTNAgent::handle_dtn_status_command(Json::Value const &message)
@@ -1377,12 +1817,71 @@ Json::Value DTNAgent::handle_dtn_status_command(Json::Value const &message)
         }
     }
 
+    // NUMA placement of the data interfaces.  Reading these is cheap,
+    // and IRQ affinities move (irqbalance), so they are read afresh.
+    try
+    {
+        response["topology"] = get_topology_status();
+    }
+    catch (std::exception const &ex)
+    {
+        utils::slog() << "[DTN Agent] Error reading topology: " << ex.what();
+        response["topology"]["error"] = ex.what();
+    }
+
     // assume that things went well.
     response["code"] = 0;
 
     return response;
 }
 
+Json::Value DTNAgent::get_topology_status() const
+{
+    auto const topology = utils::Topology::read();
+
+    Json::Value v;
+
+    for (auto const &node : topology.nodes())
+    {
+        Json::Value n;
+        n["node"] = node.id;
+        n["cpus"] = utils::format_cpu_list(node.cpus);
+        v["nodes"].append(n);
+    }
+
+    for (auto const &nic : topology.nics(data_ifaces_))
+    {
+        Json::Value n;
+        n["interface"]     = nic.name;
+        n["numa_node"]     = nic.numa_node;
+        n["local_cpus"]    = utils::format_cpu_list(nic.local_cpus);
+        n["irqs_off_node"] = Json::UInt64(nic.irqs_off_node());
+        n["irqs"]          = Json::arrayValue;
+
+        for (auto const &irq : nic.irqs)
+        {
+            Json::Value i;
+            i["irq"]  = irq.irq;
+            i["cpus"] = utils::format_cpu_list(irq.cpus);
+
+            if (not irq.effective.empty())
+                i["effective_cpus"] = utils::format_cpu_list(irq.effective);
+
+            n["irqs"].append(i);
+        }
+
+        v["data_interfaces"].append(n);
+    }
+
+    if (not transfer_program_path_.empty())
+    {
+        v["transfer_program_placement"] =
+            transfer_program_placement_.describe();
+    }
+
+    return v;
+}
+
 Json::Value DTNAgent::get_interface_status(std::string const &ifname)
 {
     Json::Value ifstat;
@@ -1810,31 +2309,51 @@ DTNAgent::decode_expand_and_group_command_v2_params(Json::Value const &message)
         }
     }
 
+    // With "checksum": {"deferred": true}, groups are handed out
+    // before their checksums are computed; see BlockChecksums.  The
+    // results go to the block records in the DB, so this needs
+    // result_in_db.
+    params.checksum_deferred = params.compute_checksum and
+        message["checksum"]["deferred"].asBool();
+
+    if (params.checksum_deferred and not params.result_in_db)
+    {
+        throw std::runtime_error("deferred checksums need result_in_db");
+    }
+
+    // With "stream": {"enable": true}, groups are sent in partial
+    // responses of roughly "chunk_size" bytes each, instead of
+    // building up the whole response in memory.
+    params.stream = message["stream"]["enable"].asBool();
+
+    if (params.stream and !message["stream"]["chunk_size"].empty())
+    {
+        params.chunk_size = message["stream"]["chunk_size"].asLargestUInt();
+        if (params.chunk_size == 0)
+        {
+            throw std::runtime_error("stream chunk_size cannot be zero");
+        }
+    }
+
     utils::slog() << "[DTN Agent] expand_and_group_v2 params: "
                   << "result_in_db: "
                   << (params.result_in_db ? "true" : "false")
                   << ", compute_checksum: "
                   << (params.compute_checksum ? "true" : "false")
                   << ", checksum_algorithm: "
-                  << params.checksum_algorithm;
+                  << params.checksum_algorithm
+                  << ", checksum_deferred: "
+                  << (params.checksum_deferred ? "true" : "false")
+                  << ", stream: "
+                  << (params.stream ? "true" : "false")
+                  << ", chunk_size: "
+                  << params.chunk_size;
 
     return params;
 }
 
 // ----------------------------------------------------------------------
 
-void
-DTNAgent::add_file_checksum(utils::Path const &path,
-                            std::string const &real_dst_path,
-                            DTNAgent::expand_and_group_v2_params const &params,
-                            Json::Value &checksums)
-{
-    Json::Value checksum;
-    checksum.append(real_dst_path);
-    checksum.append(utils::checksum(path.canonical_name(), params.md));
-    checksums.append(checksum);
-}
-
 void
 DTNAgent::add_dir_checksum(utils::Path const &path,
                            std::vector<std::string> const &path_prefixes,
@@ -1895,26 +2414,158 @@ DTNAgent::add_dir_checksum_of_checksums(
 // ----------------------------------------------------------------------
 
 Json::Value
-DTNAgent::handle_expand_and_group_command_v2(Json::Value const &message)
+DTNAgent::make_expand_v2_group(utils::PathGroup const &gp,
+                               DTNAgent::expand_and_group_v2_params const &params,
+                               std::vector<std::string> const &path_prefixes,
+                               size_t &est_size,
+                               DTNAgent::pending_checksums_t &pending,
+                               DTNAgent::pending_checksums_t &pending_dirs)
 {
-    Json::Value response_files;
-    size_t      total_size = 0;
+    Json::Value group; // {Json::arrayValue};
+    Json::Value checksums{Json::arrayValue};
 
-    try
+    for (auto const &path : gp)
     {
-        auto const params = decode_expand_and_group_command_v2_params(message);
-
-        check_expand_params(params.src_paths);
+        Json::Value pv;
 
-        std::vector<std::string> path_prefixes;
-        for (auto const & p : params.src_paths)
+        if (path.is_directory())
         {
-            path_prefixes.push_back(utils::Path(p).dir_name());
-        }
+            // auto real_dst_path = make_dst_path_name(path.dir_name(),
+            //                                         params.dst_path,
+            //                                         path_prefixes);
+            auto real_dst_path = params.dst_path;
 
-        if (params.max_files < 0)
-        {
-            throw std::runtime_error("max_files cannot be < 0");
+            pv.append(path.canonical_name());
+
+            if (real_dst_path.back() != '/')
+                pv.append(real_dst_path + "/");
+            else
+                pv.append(real_dst_path);
+
+            // Deferred, it is left to the checksum thread, which
+            // reuses the checksums of the files under it.
+            if (params.checksum_deferred)
+            {
+                pending_dirs.emplace_back(path,
+                                          utils::join_paths(real_dst_path,
+                                                            path.base_name()) + "/");
+            }
+            else if (params.compute_checksum)
+            {
+                add_dir_checksum_of_checksums(path,
+                                              real_dst_path,
+                                              params,
+                                              checksums);
+            }
+        }
+        else
+        {
+            auto real_dst_path =
+                make_dst_path_name(path.canonical_name(),
+                                   params.dst_path,
+                                   path_prefixes);
+
+            pv.append(path.canonical_name());
+            pv.append(real_dst_path);
+
+            // File checksums are left to the caller, so that files
+            // of all groups can be checksummed in parallel.
+            if (params.compute_checksum)
+            {
+                pending.emplace_back(path, real_dst_path);
+            }
+        }
+
+        pv.append(static_cast<Json::UInt64>(path.size()));
+        pv.append(0);
+
+        // Paths dominate the size of the serialized entry; the
+        // constant accounts for sizes, brackets and quotes.
+        est_size += pv[0].asString().size() + pv[1].asString().size() + 48;
+
+        group["files"].append(pv);
+    }
+
+    if (params.compute_checksum)
+    {
+        for (auto const &c : checksums)
+        {
+            est_size += c[0].asString().size() + c[1].asString().size() + 8;
+        }
+
+        group["checksum"]["algorithm"] = params.checksum_algorithm;
+        group["checksum"]["checksums"] = checksums;
+    }
+
+    group["size"] = static_cast<Json::UInt64>(gp.size());
+
+    return group;
+}
+
+Json::Value
+DTNAgent::make_expand_v2_parent_group(std::set<utils::Path> const &dirs,
+                                      DTNAgent::expand_and_group_v2_params const &params,
+                                      std::vector<std::string> const &path_prefixes)
+{
+    Json::Value head_group{Json::objectValue};
+
+    for (auto const &d : dirs)
+    {
+        auto dir = make_dst_path_name(d.name(),
+                                      params.dst_path,
+                                      path_prefixes);
+
+        Json::Value pv;
+
+        pv.append(d.canonical_name());
+        pv.append(dir + (dir.back() == '/' ? "" : "/"));
+        pv.append(0);
+        pv.append(0);
+
+        head_group["files"].append(pv);
+    }
+
+    if (not head_group.empty())
+    {
+        head_group["parent_folder_list"] = true;
+    }
+
+    return head_group;
+}
+
+Json::Value
+DTNAgent::handle_expand_and_group_command_v2(Json::Value const &message,
+                                             RpcResponseStream &stream)
+{
+    Json::Value response_files;
+    size_t      total_size = 0;
+
+    // Groups to be sent in the next partial response, when streaming.
+    Json::Value chunk(Json::arrayValue);
+    size_t      chunk_est_size = 0;
+    size_t      group_count    = 0;
+
+    try
+    {
+        auto const params = decode_expand_and_group_command_v2_params(message);
+
+        check_expand_params(params.src_paths);
+
+        if (params.stream and not stream.enabled())
+        {
+            throw std::runtime_error("streamed response is not available "
+                                     "for this request");
+        }
+
+        std::vector<std::string> path_prefixes;
+        for (auto const & p : params.src_paths)
+        {
+            path_prefixes.push_back(utils::Path(p).dir_name());
+        }
+
+        if (params.max_files < 0)
+        {
+            throw std::runtime_error("max_files cannot be < 0");
         }
 
         uid_t uid;
@@ -1949,218 +2600,373 @@ DTNAgent::handle_expand_and_group_command_v2(Json::Value const &message)
                           << "running expand_and_group_v2 with default permissions";
         }
 
-        std::vector<Json::Value> groups;
-        std::set<utils::Path>    parent_dirs;
+        Json::Value           res_groups(Json::arrayValue);
+        std::set<utils::Path> parent_dirs;
 
-        // Make a unique set of input paths.  We'll need to refactor
-        // this whole thing a bit to use sets, but that change will be
-        // more pervasive.
-        std::set<std::string> src_paths_set(params.src_paths.begin(),
-                                            params.src_paths.end());
+        // If "result_in_db" is set to true, path groups are written
+        // to DB "bde", collection "block", and only their DB IDs go
+        // in the response.
+        auto to_response = [&](Json::Value const &group) {
+            if (not params.result_in_db)
+            {
+                return group;
+            }
 
-        for (auto const &path : src_paths_set)
-        {
-            utils::DirectoryTree tree(path);
+            Json::Value v;
+            v["id"]   = store().add_block(group);
+            v["size"] = group["size"];
 
-            auto results  = tree.divide(params.group_size, params.max_files);
-            total_size   += tree.size();
+            return v;
+        };
 
-            auto parents = results.get_dir_list();
-            parent_dirs.insert(parents.begin(), parents.end());
+        // Bulk version of to_response(), for a batch of groups.
+        auto insert_blocks = [this](std::vector<Json::Value> const &groups) {
+            auto ids = store().add_blocks(groups);
 
-            for (auto const &gp : results)
+            Json::Value entries(Json::arrayValue);
+
+            for (size_t i = 0; i < ids.size(); i++)
             {
-                Json::Value group; // {Json::arrayValue};
+                Json::Value v;
+                v["id"]   = ids[i];
+                v["size"] = groups[i]["size"];
 
-                for (auto const &path : gp)
-                {
-                    Json::Value pv;
-                    Json::Value checksums;
+                entries.append(v);
+            }
 
-                    // for async checksum of files.
-                    std::map<std::string, std::future<std::string>> futures;
+            return entries;
+        };
 
-                    auto &task_counter = utils::global_task_counter();
+        // Send out the pending groups as a partial response.
+        auto flush_chunk = [&]() {
+            if (chunk.empty())
+            {
+                return;
+            }
 
-                    if (path.is_directory())
-                    {
-                        // auto real_dst_path = make_dst_path_name(path.dir_name(),
-                        //                                         params.dst_path,
-                        //                                         path_prefixes);
-                        auto real_dst_path = params.dst_path;
+            Json::Value partial = json_response(0, "OK");
 
-                        pv.append(path.canonical_name());
+            partial["files"]["groups"] = chunk;
 
-                        if (real_dst_path.back() != '/')
-                            pv.append(real_dst_path + "/");
-                        else
-                            pv.append(real_dst_path);
+            if (params.result_in_db)
+            {
+                partial["files"]["result_in_db"] = true;
+            }
 
-                        if (params.compute_checksum)
-                        {
-                            add_dir_checksum_of_checksums(path,
-                                                          real_dst_path,
-                                                          params,
-                                                          checksums);
-                        }
-                    }
-                    else
-                    {
-                        auto real_dst_path =
-                            make_dst_path_name(path.canonical_name(),
-                                               params.dst_path,
-                                               path_prefixes);
+            stream.send(partial);
 
-                        pv.append(path.canonical_name());
-                        pv.append(real_dst_path);
+            chunk          = Json::Value(Json::arrayValue);
+            chunk_est_size = 0;
+        };
 
-                        if (params.compute_checksum)
-                        {
-                            if (gp.size() > 2 and
-                                path.size() > checksum_file_size_threshold_ and
-                                task_counter.get() < checksum_threads_)
-                            {
-                                // Use async tasks for large files.
-                                utils::slog() << "[DTN Agent] Using an async task "
-                                              << "to compute checksum of "
-                                              << path.canonical_name()
-                                              << " (size:" << path.size() << ")";
-
-                                auto f = std::async(std::launch::async,
-                                                    utils::checksum_file,
-                                                    path.canonical_name(),
-                                                    params.md);
-
-                                task_counter.increment();
-
-                                utils::slog() << "[DTN Agent] Checksum tasks: "
-                                              << task_counter.get();
-
-                                futures.emplace(real_dst_path, std::move(f));
-                            }
-                            else
-                            {
-                                add_file_checksum(path,
-                                                  real_dst_path,
-                                                  params,
-                                                  checksums);
-                            }
-                        }
-                    }
+        // Groups (or their DB entries) are sent on as soon as they
+        // are ready when streaming, so that we only hold up to
+        // chunk_size worth of them.
+        auto add_entry = [&](Json::Value const &entry, size_t est_size) {
+            if (not params.stream)
+            {
+                res_groups.append(entry);
+                return;
+            }
 
-                    pv.append(static_cast<Json::UInt64>(path.size()));
-                    pv.append(0);
+            chunk.append(entry);
+            chunk_est_size += est_size;
 
-                    group["files"].append(pv);
+            if (chunk_est_size >= params.chunk_size)
+            {
+                flush_chunk();
+            }
+        };
+
+        // With result_in_db, groups are written in batches of
+        // block_batch_size(); one batch goes to the DB in the
+        // background while we make the next one.
+        std::vector<Json::Value> db_batch;
+        std::future<Json::Value> db_inflight;
+
+        // Files and directories of the batched groups, for deferred
+        // checksums; all blocks of this request share what the
+        // checksum thread has read.
+        struct deferred_checksums
+        {
+            pending_checksums_t files;
+            pending_checksums_t dirs;
+        };
 
-                    if (params.compute_checksum)
+        std::vector<deferred_checksums> db_batch_files;
+        std::vector<deferred_checksums> db_inflight_files;
+
+        auto const checksum_cache = std::make_shared<BlockChecksums::cache_t>();
+
+        auto drain_inflight = [&]() {
+            if (db_inflight.valid())
+            {
+                auto const entries = db_inflight.get();
+
+                for (Json::ArrayIndex i = 0; i < entries.size(); i++)
+                {
+                    if (params.checksum_deferred)
                     {
-                        // get async computation results.
-                        for (auto &f : futures)
-                        {
-                            auto p = f.first;
-                            auto c = f.second.get();
+                        auto &d = db_inflight_files[i];
+
+                        block_checksums_.queue(entries[i]["id"].asString(),
+                                               std::move(d.files),
+                                               std::move(d.dirs),
+                                               params.md,
+                                               checksum_threads_,
+                                               checksum_cache);
+                    }
 
-                            task_counter.decrement();
+                    add_entry(entries[i], 64);
+                }
 
-                            Json::Value v;
-                            v.append(p);
-                            v.append(c);
+                db_inflight_files.clear();
+            }
+        };
 
-                            utils::slog() << "[DTN Agent] Async computed "
-                                          << "checksum for "
-                                          << p << ": " << c;
+        auto flush_db_batch = [&]() {
+            drain_inflight();
 
-                            checksums.append(v);
-                        }
+            if (not db_batch.empty())
+            {
+                db_inflight = std::async(std::launch::async,
+                                         insert_blocks,
+                                         std::move(db_batch));
+                db_batch.clear();
 
-                        group["checksum"]["algorithm"] = params.checksum_algorithm;
-                        group["checksum"]["checksums"] = checksums;
-                    }
-                }
+                db_inflight_files = std::move(db_batch_files);
+                db_batch_files.clear();
+            }
+        };
 
-                group["size"] = static_cast<Json::UInt64>(gp.size());
-                groups.emplace_back(group);
+        auto emit_group = [&](Json::Value const  &group,
+                              size_t              est_size,
+                              deferred_checksums  deferred) {
+            group_count++;
+
+            if (not params.result_in_db)
+            {
+                add_entry(group, est_size);
+                return;
             }
 
-            Json::Value res_groups;
+            db_batch.push_back(group);
+            db_batch_files.push_back(std::move(deferred));
 
-            if (use_expand_v2_parent_list_)
+            if (db_batch.size() >= store().block_batch_size())
+            {
+                flush_db_batch();
+            }
+        };
+
+        // With compute_checksum, groups are held back here until the
+        // checksums of all their files are in; files[first, last) of
+        // "pending" belong to the group.  When streaming, that is done
+        // a chunk's worth at a time, so that no more than that is
+        // held.
+        struct held_group
+        {
+            Json::Value group;
+            size_t      est_size;
+            size_t      first;
+            size_t      last;
+        };
+
+        std::vector<held_group> held;
+        size_t                  held_est_size = 0;
+        pending_checksums_t     pending;
+        pending_checksums_t     pending_dirs;
+
+        // The checksum stage: files of the held groups go to a pool of
+        // up to checksum_threads_ threads at once, and the results are
+        // joined back to their groups in order.
+        auto checksum_held = [&]() {
+            std::vector<utils::Path> files;
+            files.reserve(pending.size());
+
+            for (auto const &p : pending)
             {
-                Json::Value head_group{Json::objectValue};
+                files.push_back(p.first);
+            }
+
+            auto const sums = utils::checksum_files(files,
+                                                    params.md,
+                                                    checksum_threads_);
 
-                for (auto const &d : parent_dirs)
+            for (auto &h : held)
+            {
+                for (auto i = h.first; i < h.last; i++)
                 {
-                    auto dir = make_dst_path_name(d.name(),
-                                                  params.dst_path,
-                                                  path_prefixes);
+                    Json::Value v;
+                    v.append(pending[i].second);
+                    v.append(sums[i]);
 
-                    Json::Value pv;
+                    h.est_size += pending[i].second.size() + sums[i].size() + 8;
+                    h.group["checksum"]["checksums"].append(v);
+                }
 
-                    pv.append(d.canonical_name());
-                    pv.append(dir + (dir.back() == '/' ? "" : "/"));
-                    pv.append(0);
-                    pv.append(0);
+                emit_group(h.group, h.est_size, deferred_checksums());
+            }
 
-                    head_group["files"].append(pv);
+            held.clear();
+            pending.clear();
+            held_est_size = 0;
+        };
 
-                    // if (parent_dirs.size() == 1)
-                    // {
-                    //     Json::Value pv_dup;
+        auto produce = [&](Json::Value const &group,
+                           size_t              est_size,
+                           size_t              first) {
+            if (not params.compute_checksum)
+            {
+                emit_group(group, est_size, deferred_checksums());
+                return;
+            }
 
-                    //     utils::slog() << "[DTN Agent] "
-                    //                   << "Getting around "
-                    //                   << "directory creation quirk: "
-                    //                   << "adding duplcate entry";
+            if (params.checksum_deferred)
+            {
+                // Hand the group out now; its files and directories
+                // are checksummed in the background once it has a
+                // block id.
+                deferred_checksums deferred;
+                deferred.files.assign(pending.begin() + first, pending.end());
+                deferred.dirs = std::move(pending_dirs);
 
-                    //     pv_dup.append(d.canonical_name());
-                    //     pv_dup.append(dir + (dir.back() == '/' ? "" : "/"));
-                    //     pv_dup.append(0);
-                    //     pv_dup.append(0);
+                pending.clear();
+                pending_dirs.clear();
 
-                    //     head_group["files"].append(pv_dup);
-                    // }
-                }
+                Json::Value g = group;
 
-                if (not head_group.empty())
+                if (g.isMember("checksum"))
                 {
-                    head_group["parent_folder_list"] = true;
-                    res_groups.append(head_group);
+                    g["checksum"]["state"] =
+                        deferred.files.empty() and deferred.dirs.empty() ?
+                        "done" : "pending";
                 }
+
+                emit_group(g, est_size, std::move(deferred));
+                return;
             }
 
-            for (auto const &g : groups)
+            held.push_back({group, est_size, first, pending.size()});
+            held_est_size += est_size;
+
+            if (params.stream and held_est_size >= params.chunk_size)
             {
-                res_groups.append(g);
+                checksum_held();
             }
+        };
 
-            // If "result_in_db" is set to true, write path groups to
-            // DB and add the DB IDs to the response; else append path
-            // groups to the response.
-            if (params.result_in_db)
-            {
-                Json::Value db_groups;
+        // Make a unique set of input paths.  We'll need to refactor
+        // this whole thing a bit to use sets, but that change will be
+        // more pervasive.
+        std::set<std::string> src_paths_set(params.src_paths.begin(),
+                                            params.src_paths.end());
 
-                // Insert results to DB "bde", collection "block".
-                for (auto const &group : res_groups)
-                {
-                    auto id = store().add_block(group);
+        for (auto const &path : src_paths_set)
+        {
+            utils::DirectoryTree tree(path);
 
-                    Json::Value v;
-                    v["id"]   = id;
-                    v["size"] = group["size"];
+            auto results  = tree.divide(params.group_size, params.max_files);
+            total_size   += tree.size();
+
+            auto parents = results.get_dir_list();
 
-                    db_groups.append(v);
+            if (params.stream and use_expand_v2_parent_list_)
+            {
+                // Parent folders must be created before anything
+                // under them is transferred, so they go ahead of
+                // this path's groups.
+                std::set<utils::Path> new_parents;
+
+                for (auto const &d : parents)
+                {
+                    if (parent_dirs.insert(d).second)
+                    {
+                        new_parents.insert(d);
+                    }
                 }
 
-                response_files["result_in_db"] = true;
-                response_files["groups"] = db_groups;
+                auto head_group = make_expand_v2_parent_group(new_parents,
+                                                              params,
+                                                              path_prefixes);
+                if (not head_group.empty())
+                {
+                    produce(head_group, 0, pending.size());
+                }
             }
             else
             {
-                response_files["groups"] = res_groups;
+                parent_dirs.insert(parents.begin(), parents.end());
             }
+
+            for (auto const &gp : results)
+            {
+                size_t est_size = 0;
+                size_t first    = pending.size();
+                auto   group    = make_expand_v2_group(gp,
+                                                       params,
+                                                       path_prefixes,
+                                                       est_size,
+                                                       pending,
+                                                       pending_dirs);
+                produce(group, est_size, first);
+            }
+        }
+
+        if (params.compute_checksum and not params.checksum_deferred)
+        {
+            checksum_held();
+        }
+
+        flush_db_batch();
+        drain_inflight();
+
+        if (params.stream)
+        {
+            flush_chunk();
+
+            Json::Value trailer = json_response(0, "OK");
+
+            trailer["total_size"]  = static_cast<Json::UInt64>(total_size);
+            trailer["group_count"] = static_cast<Json::UInt64>(group_count);
+
+            stream.send(trailer, "trailer");
+
+            Json::Value response  = json_response(0, "OK");
+            response["chunks"]    = static_cast<Json::UInt64>(stream.sequence() - 1);
+
+            utils::slog() << "[DTN Agent] expand_and_group_v2 streamed "
+                          << group_count << " groups, total size "
+                          << total_size << " bytes, in "
+                          << response["chunks"] << " chunks.";
+
+            return response;
+        }
+
+        Json::Value all_groups(Json::arrayValue);
+
+        if (use_expand_v2_parent_list_)
+        {
+            auto head_group = make_expand_v2_parent_group(parent_dirs,
+                                                          params,
+                                                          path_prefixes);
+            if (not head_group.empty())
+            {
+                all_groups.append(to_response(head_group));
+            }
+        }
+
+        for (auto const &g : res_groups)
+        {
+            all_groups.append(g);
+        }
+
+        if (params.result_in_db)
+        {
+            response_files["result_in_db"] = true;
         }
+
+        response_files["groups"] = all_groups;
     }
     catch (std::exception const & ex)
     {
@@ -2178,6 +2984,37 @@ DTNAgent::handle_expand_and_group_command_v2(Json::Value const &message)
     return response;
 }
 
+// ----------------------------------------------------------------------
+
+// Tell the state of deferred checksums of the given blocks.  With
+// "wait" (in seconds), wait until none of them are pending, or until
+// the wait is over.
+Json::Value
+DTNAgent::handle_block_checksum_state_command(Json::Value const &message)
+{
+    auto const &blocks = message["blocks"];
+
+    if (blocks.empty() or not blocks.isArray())
+    {
+        return json_response(1, "dtn_block_checksum_state: "
+                             "blocks should be a list of block ids");
+    }
+
+    auto const wait = std::chrono::seconds(
+        std::min(message["wait"].asLargestUInt(), Json::LargestUInt(300)));
+
+    auto const state = block_checksums_.state(blocks, wait);
+
+    Json::Value response = json_response(0, "OK");
+
+    response["blocks"] = state["blocks"];
+    response["done"]   = state["done"];
+
+    return response;
+}
+
+// ----------------------------------------------------------------------
+
 std::string
 DTNAgent::make_dst_path_name(std::string const &src_path,
                              std::string const &dst_path,
@@ -2507,34 +3344,152 @@ DTNAgent::handle_send_ping_command(Json::Value const &message)
 
 // ----------------------------------------------------------------------
 
+// Measure throughput to a DTN that runs pong (see "dtn_start_pong"),
+// with "streams" parallel TCP streams, for "duration" seconds or
+// "bytes" bytes.  If "expect_gbps" is given, also tell if the path
+// could carry that much.
+Json::Value
+DTNAgent::handle_probe_throughput_command(Json::Value const &message)
+{
+    utils::tcp_probe_params params;
+
+    params.host = message["target"]["ip"].asString();
+    params.port = message["target"]["port"].asInt();
+
+    if (params.host.empty())
+    {
+        auto error = "target IP is not given in probe command";
+        utils::slog() << "[DTN Agent] " << error;
+        return json_response(1, error);
+    }
+
+    if (params.port == 0)
+    {
+        params.port = default_ping_port_;
+    }
+
+    if (not message["streams"].empty())
+        params.streams = message["streams"].asLargestUInt();
+
+    if (not message["duration"].empty())
+        params.duration = message["duration"].asDouble();
+
+    if (not message["bytes"].empty())
+    {
+        params.bytes = message["bytes"].asLargestUInt();
+
+        // Volume only, unless both are given.
+        if (message["duration"].empty())
+            params.duration = 0;
+    }
+
+    if (not message["buffer_size"].empty())
+        params.buffer_size = message["buffer_size"].asLargestUInt();
+
+    params.zerocopy = message["zerocopy"].asBool();
+
+    auto probe_target = params.host + ":" + std::to_string(params.port);
+
+    try
+    {
+        auto const result = utils::tcp_probe(params);
+
+        Json::Value response = result.ok() ?
+            json_response(0, "OK") :
+            json_response(1, "some streams to " + probe_target + " failed");
+
+        response["bytes"]       = static_cast<Json::UInt64>(result.bytes);
+        response["seconds"]     = result.seconds;
+        response["gbps"]        = result.gbps;
+        response["retransmits"] = result.retransmits;
+
+        response["rtt_us"]["min"]     = result.rtt_min;
+        response["rtt_us"]["p50"]     = result.rtt_p50;
+        response["rtt_us"]["p90"]     = result.rtt_p90;
+        response["rtt_us"]["p99"]     = result.rtt_p99;
+        response["rtt_us"]["max"]     = result.rtt_max;
+        response["rtt_us"]["samples"] = static_cast<Json::UInt64>(result.rtt_samples);
+
+        for (auto const &st : result.streams)
+        {
+            Json::Value v;
+
+            v["bytes_sent"]     = static_cast<Json::UInt64>(st.bytes_sent);
+            v["bytes_received"] = static_cast<Json::UInt64>(st.bytes_received);
+            v["seconds"]        = st.seconds;
+            v["gbps"]           = st.gbps;
+            v["retransmits"]    = st.retransmits;
+            v["zerocopy"]       = st.zerocopy;
+
+            if (not st.error.empty())
+                v["error"] = st.error;
+
+            response["streams"].append(v);
+        }
+
+        if (not message["expect_gbps"].empty())
+        {
+            response["meets_rate"] =
+                result.ok() and result.gbps >= message["expect_gbps"].asDouble();
+        }
+
+        utils::slog() << "[DTN Agent] probed " << probe_target << ": "
+                      << result.gbps << " Gbps";
+
+        return response;
+    }
+    catch (std::exception const & ex)
+    {
+        auto error = "error probing " + probe_target +
+            " (" + std::string(ex.what()) + ")";
+        utils::slog() << "[DTN Agent] " << error;
+        return json_response(1, error);
+    }
+}
+
+// ----------------------------------------------------------------------
+
 Json::Value
 DTNAgent::handle_start_pong_command(Json::Value const &message)
 {
     auto port     = message["port"].asInt();
     auto port_str = std::to_string(port);
 
-    Json::Value response;
+    // Sessions are spread over a few threads, so that a scheduler
+    // verifying many paths at once doesn't have its pings queue up
+    // behind each other (and time out).
+    size_t threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 8u);
+
+    if (message.isMember("threads"))
+    {
+        threads = message["threads"].asUInt();
+    }
+
+    if (threads == 0 or threads > 64)
+    {
+        return json_response(1, "dtn_start_pong: threads should be in [1, 64]");
+    }
 
     try
     {
-        auto status = "Attempting to launch pong thread on port "
+        std::lock_guard<std::mutex> lock(pong_mutex_);
+
+        auto status = "Attempting to launch pong server on port "
             + port_str + "...";
         utils::slog() << "[DTN Agent] " << status;
 
-        if (pong_thread_.joinable())
+        if (pong_server_)
         {
-            status = "a pong thread is already running here";
+            status = "a pong server is already running here";
             utils::slog() << "[DTN Agent] " << status;
             return json_response(1, status);
         }
 
-        pong_thread_ = std::thread([this, port](){
-                utils::echo_server server(pong_thread_io_service_, port);
-                pong_thread_io_service_.run();
-            });
+        pong_server_.reset(new utils::pong_server(port, threads));
+        pong_server_->start();
 
-        utils::slog() << "[DTN Agent] created thread with id = "
-                      << pong_thread_.get_id();
+        utils::slog() << "[DTN Agent] pong server started with "
+                      << threads << " thread(s)";
     }
     catch (std::exception const & ex)
     {
@@ -2550,26 +3505,64 @@ DTNAgent::handle_start_pong_command(Json::Value const &message)
 
 // ----------------------------------------------------------------------
 
+static Json::Value
+pong_stats_to_json(utils::pong_server const &server)
+{
+    auto const stats = server.stats();
+
+    Json::Value result;
+
+    result["port"]      = server.port();
+    result["threads"]   = Json::UInt64(server.threads());
+    result["active"]    = Json::UInt64(stats.active);
+    result["sessions"]  = Json::UInt64(stats.sessions);
+    result["pings"]     = Json::UInt64(stats.pings);
+    result["probes"]    = Json::UInt64(stats.probes);
+    result["bytes_in"]  = Json::UInt64(stats.bytes_in);
+    result["bytes_out"] = Json::UInt64(stats.bytes_out);
+
+    result["recent"] = Json::arrayValue;
+
+    for (auto const &s : server.recent_sessions())
+    {
+        Json::Value session;
+
+        session["peer"]      = s.peer;
+        session["kind"]      = s.kind;
+        session["pings"]     = Json::UInt64(s.pings);
+        session["bytes_in"]  = Json::UInt64(s.bytes_in);
+        session["bytes_out"] = Json::UInt64(s.bytes_out);
+        session["seconds"]   = s.seconds;
+
+        result["recent"].append(session);
+    }
+
+    return result;
+}
+
 Json::Value
 DTNAgent::handle_stop_pong_command(Json::Value const &message)
 {
+    Json::Value stats;
+
     try
     {
-        utils::slog() << "[DTN Agent] attempting to stop pong thread (id="
-                      << pong_thread_.get_id() << "); joinable: "
-                      << (pong_thread_.joinable() == false ? "false" : "true");
+        std::lock_guard<std::mutex> lock(pong_mutex_);
 
-        if (pong_thread_.joinable())
-        {
-            pong_thread_io_service_.stop();
-            pong_thread_.join();
-            utils::slog() << "[DTN Agent] stopped pong thread (id="
-                          << pong_thread_.get_id() << ")";
-        }
-        else
+        utils::slog() << "[DTN Agent] attempting to stop pong server; running: "
+                      << (pong_server_ ? "true" : "false");
+
+        if (not pong_server_)
         {
             throw std::runtime_error("no pong is running here");
         }
+
+        pong_server_->stop();
+        stats = pong_stats_to_json(*pong_server_);
+        pong_server_.reset();
+
+        utils::slog() << "[DTN Agent] stopped pong server after "
+                      << stats["sessions"].asUInt64() << " session(s)";
     }
     catch (std::exception& e)
     {
@@ -2580,7 +3573,30 @@ DTNAgent::handle_stop_pong_command(Json::Value const &message)
 
     auto status = "stopped waiting for ping messages";
     utils::slog() << "[DTN Agent] " << status;
-    return json_response(0, status);
+
+    auto response     = json_response(0, status);
+    response["stats"] = stats;
+    return response;
+}
+
+// ----------------------------------------------------------------------
+
+// Counters of the running pong server, and its last few sessions.
+Json::Value
+DTNAgent::handle_pong_status_command(Json::Value const &message)
+{
+    std::lock_guard<std::mutex> lock(pong_mutex_);
+
+    Json::Value result = json_response(0, "OK");
+
+    result["running"] = bool(pong_server_);
+
+    if (pong_server_)
+    {
+        result["stats"] = pong_stats_to_json(*pong_server_);
+    }
+
+    return result;
 }
 
 // ----------------------------------------------------------------------
@@ -3288,14 +4304,16 @@ DTNAgent::handle_unknown_command(std::string const &cmd,
 
 // ----------------------------------------------------------------------
 
+// These used to run tc(8) for every rule, which costs a fork and exec
+// each; utils::TcBatch talks rtnetlink instead.
+
 void
 DTNAgent::add_queue(std::string const & handle,
                     std::string const & device)
 {
-    auto cmd = "/usr/sbin/tc qdisc add dev " + device +
-        " root handle " + handle + " prio";
-    utils::slog() << "[DTN Agent] Running command: \"" << cmd << "\"";
-    run_process(cmd, true);
+    utils::slog() << "[DTN Agent] Adding prio qdisc " << handle
+                  << " to " << device;
+    utils::TcBatch(device).add_prio_qdisc(handle).commit();
 }
 
 void
@@ -3304,19 +4322,280 @@ DTNAgent::add_traffic_to_queue(std::string const & device,
                                std::string const & flowid,
                                int priority)
 {
-    auto cmd = "/usr/sbin/tc filter add dev " + device +
-        " parent 1:0 prio " + std::to_string(priority) +
-        " protocol ip u32 match ip src " + src + " flowid " + flowid;
-    utils::slog() << "[DTN Agent] Running command: \"" << cmd << "\"";
-    utils::run_process(cmd, true);
+    utils::slog() << "[DTN Agent] Adding u32 filter on " << device
+                  << ": src " << src << ", flowid " << flowid
+                  << ", prio " << priority;
+    utils::TcBatch(device).add_u32_filter("1:", priority, src, flowid).commit();
 }
 
 void
-DTNAgent::delete_queue(std::string const & handle)
+DTNAgent::delete_queue(std::string const & device,
+                       std::string const & handle)
+{
+    utils::slog() << "[DTN Agent] Deleting qdisc " << handle
+                  << " of " << device;
+    utils::TcBatch(device).delete_qdisc("root", handle).commit();
+}
+
+// ----------------------------------------------------------------------
+
+// Pace every flow on a data interface to at most "max_rate" bits per
+// second, using the fq qdisc; a "max_rate" of zero removes the limit
+// but keeps pacing, and "enable": false puts back the default qdisc.
+Json::Value
+DTNAgent::handle_set_pacing_command(Json::Value const &message)
+{
+    auto const iface    = message["interface"].asString();
+    auto const enable   = message.get("enable", true).asBool();
+    auto const max_rate = message["max_rate"].asUInt64();
+
+    if (std::find(data_ifaces_.begin(), data_ifaces_.end(), iface) ==
+        data_ifaces_.end())
+    {
+        return json_response(1, "dtn_set_pacing: " + iface +
+                             " is not a data interface");
+    }
+
+    try
+    {
+        utils::TcBatch batch(iface);
+
+        if (enable)
+        {
+            batch.replace_fq_qdisc("1:", "root", max_rate);
+        }
+        else
+        {
+            batch.delete_qdisc("root");
+        }
+
+        batch.commit();
+    }
+    catch (std::exception const &ex)
+    {
+        auto error = "dtn_set_pacing: " + std::string(ex.what());
+        utils::slog() << "[DTN Agent] " << error;
+        return json_response(1, error);
+    }
+
+    utils::slog() << "[DTN Agent] Pacing on " << iface << ": "
+                  << (enable ? "fq, max rate " + std::to_string(max_rate) +
+                      " bps" : "off");
+
+    return json_response(0, "OK");
+}
+
+// ----------------------------------------------------------------------
+
+// Routes, neighbor entries and queues, all at once: the lot goes to
+// the kernel as one batch of rtnetlink requests, and if any of them
+// fails, what was applied is undone.  Parameters:
+//
+//   "routes":    [{"destination", "via", "mask", "dev"}, ...]
+//   "neighbors": [{"ip", "mac", "dev"}, ...]
+//   "queues":    [{"dev", "kind": "prio"|"htb"|"fq", "handle",
+//                  "max_rate", "classes": [{"classid", "parent",
+//                  "rate", "ceil"}, ...], "filters": [{"src"|"dst",
+//                  "flowid", "prio"}, ...]}, ...]
+//
+// The response has a "status" for every item, in the order given:
+// "applied", "existed", "failed", "rolled_back", "rollback_failed",
+// "not_applied" or "ignored".
+Json::Value
+DTNAgent::handle_apply_network_config_command(Json::Value const &message)
 {
-    auto cmd = "/usr/sbin/tc qdisc delete handle " + handle;
-    utils::slog() << "[DTN Agent] Running command: \"" << cmd << "\"";
-    utils::run_process(cmd, true);
+    utils::NetConfigBatch batch;
+
+    Json::Value result;
+    result["routes"]    = Json::arrayValue;
+    result["neighbors"] = Json::arrayValue;
+    result["queues"]    = Json::arrayValue;
+
+    // Where each item of the batch goes in the result.
+    std::vector<Json::Value *> slots;
+
+    auto ignored = [](std::string const &what) {
+        Json::Value v;
+        v["item"]   = what;
+        v["status"] = "ignored";
+        return v;
+    };
+
+    try
+    {
+        for (auto const &r : message["routes"])
+        {
+            auto const dst = r["destination"].asString();
+
+            if (ignore_route_cmds_)
+            {
+                result["routes"].append(ignored("route " + dst));
+                continue;
+            }
+
+            if (dst.empty())
+            {
+                throw std::runtime_error("route with empty destination");
+            }
+
+            batch.add_route(dst,
+                            r["via"].asString(),
+                            r["mask"].asString(),
+                            r["dev"].asString());
+
+            slots.push_back(&result["routes"].append(Json::Value()));
+        }
+
+        for (auto const &n : message["neighbors"])
+        {
+            auto const ip  = n["ip"].asString();
+            auto const mac = n["mac"].asString();
+
+            if (ignore_arp_cmds_)
+            {
+                result["neighbors"].append(ignored("neighbor " + ip));
+                continue;
+            }
+
+            if (ip.empty() or mac.empty())
+            {
+                throw std::runtime_error("neighbor with empty ip or mac");
+            }
+
+            auto const dev = n["dev"].empty() ?
+                data_ifaces_.at(0) : n["dev"].asString();
+
+            batch.add_neighbor(ip, mac, dev);
+
+            slots.push_back(&result["neighbors"].append(Json::Value()));
+        }
+
+        for (auto const &q : message["queues"])
+        {
+            auto const dev    = q["dev"].asString();
+            auto const kind   = q.get("kind", "prio").asString();
+            auto const handle = q.get("handle", "1:").asString();
+
+            utils::TcBatch tc(dev);
+
+            if (kind == "prio")
+            {
+                tc.add_prio_qdisc(handle);
+            }
+            else if (kind == "htb")
+            {
+                tc.add_htb_qdisc(handle);
+
+                for (auto const &c : q["classes"])
+                {
+                    tc.add_htb_class(c["classid"].asString(),
+                                     c.get("parent", handle).asString(),
+                                     c["rate"].asUInt64(),
+                                     c["ceil"].asUInt64());
+                }
+            }
+            else if (kind == "fq")
+            {
+                tc.replace_fq_qdisc(handle, "root", q["max_rate"].asUInt64());
+            }
+            else
+            {
+                throw std::runtime_error("queue on " + dev +
+                                         ": unknown kind \"" + kind + "\"");
+            }
+
+            for (auto const &f : q["filters"])
+            {
+                auto const dst = f.isMember("dst");
+
+                tc.add_u32_filter(handle,
+                                  f.get("prio", 1).asInt(),
+                                  f[dst ? "dst" : "src"].asString(),
+                                  f["flowid"].asString(),
+                                  dst);
+            }
+
+            batch.add_queue(tc);
+
+            slots.push_back(&result["queues"].append(Json::Value()));
+        }
+    }
+    catch (std::exception const &ex)
+    {
+        auto error = "dtn_apply_network_config: " + std::string(ex.what());
+        utils::slog() << "[DTN Agent] " << error << "; nothing applied";
+        return json_response(1, error);
+    }
+
+    std::vector<utils::NetConfigStatus> status;
+    bool                                ok = false;
+
+    try
+    {
+        utils::slog() << "[DTN Agent] Applying network config: "
+                      << batch.size() << " items";
+        ok = batch.apply(status);
+    }
+    catch (std::exception const &ex)
+    {
+        auto error = "dtn_apply_network_config: " + std::string(ex.what());
+        utils::slog() << "[DTN Agent] " << error;
+        return json_response(2, error);
+    }
+
+    bool rolled_back = false;
+
+    for (size_t i = 0; i < status.size(); i++)
+    {
+        auto const &st = status[i];
+        auto       &v  = *slots[i];
+
+        v["item"] = st.what;
+
+        if (st.error != 0)
+        {
+            v["status"] = "failed";
+            v["error"]  = st.message;
+        }
+        else if (st.existed and not st.applied)
+        {
+            v["status"] = "existed";
+        }
+        else if (ok)
+        {
+            v["status"] = "applied";
+        }
+        else if (st.rolled_back)
+        {
+            v["status"] = "rolled_back";
+            rolled_back = true;
+        }
+        else if (not st.rollback_error.empty())
+        {
+            v["status"] = "rollback_failed";
+            v["error"]  = st.rollback_error;
+        }
+        else
+        {
+            v["status"] = "not_applied";
+        }
+    }
+
+    if (not ok)
+    {
+        utils::slog() << "[DTN Agent] Network config failed"
+                      << (rolled_back ? "; rolled back" : "");
+    }
+
+    auto response = ok ? json_response(0, "OK") :
+        json_response(1, "network config failed; see item status");
+
+    response["routes"]      = result["routes"];
+    response["neighbors"]   = result["neighbors"];
+    response["queues"]      = result["queues"];
+    response["rolled_back"] = rolled_back;
+
+    return response;
 }
 
 // ----------------------------------------------------------------------
@@ -3391,9 +4670,7 @@ operator<<(std::ostream& out, DTNAgent const & agent)
     {
         out << d << " ";
     }
-    out << "], ";
-
-    out << "iozone program path: " << agent.iozone_program_path_;
+    out << "]";
 
     return out;
 }
@@ -4,10 +4,12 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 #include <linux/if_link.h>
 
 #include "agentmanager.h"
+#include "blockchecksums.h"
 #include "localstorageagent.h"
 #include "sharedstorageagent.h"
 
@@ -16,7 +18,15 @@
 #include "utils/process.h"
 #include "utils/rpcserver.h"
 #include "utils/paths/path.h"
+#include "utils/paths/dirtree.h"
 #include "utils/checksum.h"
+#include "utils/linksampler.h"
+#include "utils/iftable.h"
+
+namespace utils
+{
+    class pong_server;
+};
 
 // DTN Agent is the component that manages data transfer nodes.
 //
@@ -31,6 +41,7 @@ class DTNAgent : public Agent
 {
 public:
     DTNAgent(Json::Value const & conf);
+    ~DTNAgent();
 
     // Validate JSON configuration given.  Exposing as a public method
     // only for testing; otherwise, please do not call this method
@@ -43,6 +54,14 @@ protected:
     virtual void do_registration();
     virtual Json::Value do_command(std::string const & cmd,
                                    Json::Value const & params);
+    virtual Json::Value do_stream_command(std::string const & cmd,
+                                          Json::Value const & params,
+                                          RpcResponseStream & stream);
+    virtual CommandClass do_command_class(std::string const & cmd,
+                                          Json::Value const & params) const;
+    virtual bool do_command_known(std::string const & cmd) const;
+    virtual bool do_command_cache(std::string const & cmd,
+                                  std::chrono::milliseconds & ttl) const;
 
 private:
     // debugging aid.
@@ -58,10 +77,13 @@ private:
     Json::Value handle_dtn_status_command(Json::Value const &message);
     Json::Value handle_expand_command(Json::Value const &message);
     Json::Value handle_expand_and_group_command(Json::Value const &message);
-    Json::Value handle_expand_and_group_command_v2(Json::Value const &message);
+    Json::Value handle_expand_and_group_command_v2(Json::Value const &message,
+                                                   RpcResponseStream &stream);
     Json::Value handle_send_ping_command(Json::Value const &message);
+    Json::Value handle_probe_throughput_command(Json::Value const &message);
     Json::Value handle_start_pong_command(Json::Value const &message);
     Json::Value handle_stop_pong_command(Json::Value const &message);
+    Json::Value handle_pong_status_command(Json::Value const &message);
     Json::Value handle_list_command(Json::Value const &message);
     Json::Value handle_add_route_command(Json::Value const &message);
     Json::Value handle_delete_route_command(Json::Value const &message);
@@ -87,7 +109,10 @@ private:
             : result_in_db(false)
             , compute_checksum(false)
             , checksum_algorithm("sha1")
-            , md(EVP_get_digestbyname(checksum_algorithm.c_str())) {}
+            , md(EVP_get_digestbyname(checksum_algorithm.c_str()))
+            , checksum_deferred(false)
+            , stream(false)
+            , chunk_size(4 * 1024 * 1024) {}
 
         std::vector<std::string> src_paths;          // mandatory.
         std::string              dst_path;           // mandatory.
@@ -98,16 +123,42 @@ private:
         bool                     compute_checksum;   // optional.
         std::string              checksum_algorithm; // optional.
         EVP_MD const            *md;
+        bool                     checksum_deferred;  // optional.
+        bool                     stream;             // optional.
+        size_t                   chunk_size;         // optional.
     };
 
     // Decode JSON.
     const expand_and_group_v2_params
     decode_expand_and_group_command_v2_params(Json::Value const &message);
 
-    void add_file_checksum(utils::Path const &path,
-                           std::string const &real_dst_path,
-                           DTNAgent::expand_and_group_v2_params const &params,
-                           Json::Value       &checksums);
+    // Files whose checksums are yet to be computed, along with their
+    // destination names.
+    typedef BlockChecksums::entries_t pending_checksums_t;
+
+    // Turn a group of paths into a "files" group of the
+    // expand_and_group_v2 response.  @est_size@ is incremented by an
+    // estimate of the group's serialized size.  With compute_checksum,
+    // the group's regular files are added to @pending@ rather than
+    // checksummed here; with deferred checksums, so are its
+    // directories, to @pending_dirs@.
+    Json::Value make_expand_v2_group(utils::PathGroup const &gp,
+                                     DTNAgent::expand_and_group_v2_params const &params,
+                                     std::vector<std::string> const &path_prefixes,
+                                     size_t &est_size,
+                                     pending_checksums_t &pending,
+                                     pending_checksums_t &pending_dirs);
+
+    // "dtn_block_checksum_state" command handler; see block_checksums_.
+    Json::Value handle_block_checksum_state_command(Json::Value const &message);
+
+    // "dtn_link_history" command handler.
+    Json::Value handle_link_history_command(Json::Value const &message);
+
+    // The "parent folder list" group; see use_expand_v2_parent_list_.
+    Json::Value make_expand_v2_parent_group(std::set<utils::Path> const &dirs,
+                                            DTNAgent::expand_and_group_v2_params const &params,
+                                            std::vector<std::string> const &path_prefixes);
 
     void add_dir_checksum(utils::Path const &path,
                           std::vector<std::string> const &path_prefixes,
@@ -124,8 +175,9 @@ private:
         DTNAgent::expand_and_group_v2_params const &params,
         Json::Value &checksum);
 
-    // method called by dtn_status handler.
+    // methods called by dtn_status handler.
     Json::Value get_interface_status(std::string const &ifname);
+    Json::Value get_topology_status() const;
 
     // methods to manage local data folders.
     void scan_data_folder();
@@ -142,14 +194,21 @@ private:
     void check_network_interface(std::string const &iface);
     void update_interface_traffic(std::string const &iface);
 
-    // traffic control methods.
+    // traffic control methods; see utils/tc.h.
     void add_queue(std::string const & handle,
                    std::string const &device);
     void add_traffic_to_queue(std::string const & device,
                               std::string const & src,
                               std::string const & flowid,
                               int priority);
-    void delete_queue(std::string const & handle);
+    void delete_queue(std::string const & device,
+                      std::string const & handle);
+
+    // "dtn_set_pacing" command handler.
+    Json::Value handle_set_pacing_command(Json::Value const &message);
+
+    // "dtn_apply_network_config" command handler.
+    Json::Value handle_apply_network_config_command(Json::Value const &message);
 
     // "dtn_list" command helpers.
     const std::pair<uid_t, gid_t> get_system_user(std::string const & user) const;
@@ -184,6 +243,10 @@ private:
     void update_time_series_interface_stats(std::string const &iface) const;
     void update_time_series_sysinfo_stats() const;
 
+    // Load, memory, data interface rates and checksum throughput,
+    // into the agent's metric store; see utils/metricstore.h.
+    void record_metrics();
+
     // Let ONOS know of this DTN's existence.
     void ping_with_data_interface() const;
 
@@ -206,13 +269,13 @@ private:
     std::string              mgmt_iface_;
     std::vector<std::string> data_ifaces_;
     std::vector<std::string> storage_ifaces_;
-    std::string              iozone_program_path_;
 
     std::string                       transfer_program_path_;
     std::vector<std::string>          transfer_program_args_;
     std::map<std::string,std::string> transfer_program_env_;
     std::thread                       transfer_program_thread_;
     int                               transfer_program_port_;
+    utils::CpuPlacement               transfer_program_placement_;
 
     // Stats of data interfaces.  Note that values stored are
     // rates/second that we're computing for the previous polling
@@ -221,6 +284,28 @@ private:
     bool                                   link_rates_computed_;
     size_t rate_per_second(size_t n);
 
+    // High resolution samples of data interface counters.
+    std::unique_ptr<utils::LinkSampler> link_sampler_;
+    size_t                              link_sampler_interval_ms_;
+    size_t                              link_sampler_history_seconds_;
+
+    // Commands whose results are shared by identical requests, and
+    // kept this long; see Agent::do_command_cache().
+    std::map<std::string, std::chrono::milliseconds> command_cache_ttl_;
+
+        // What record_metrics() saw last time, every metrics_interval_ms_
+    // (0 turns it off).
+    size_t                                 metrics_interval_ms_;
+    std::chrono::steady_clock::time_point  metrics_last_time_;
+    std::map<std::string, rtnl_link_stats> metrics_last_links_;
+    uint64_t                               metrics_last_checksum_bytes_;
+
+    // Re-register when addresses of our interfaces change; see
+    // utils/iftable.h.  Bursts of changes are handled once.
+    void on_iface_change(utils::IfaceChange const &change);
+    int                                 iface_listener_;
+    std::atomic<bool>                   iface_change_pending_;
+
     enum TaskState {
         NotFound,
         Error,
@@ -237,6 +322,10 @@ private:
     // be delegated to a thread.
     size_t checksum_file_size_threshold_;
 
+    // Deferred checksums of expand_and_group_v2 blocks, written to
+    // the blocks' DB records as they are done.
+    BlockChecksums block_checksums_;
+
     // Table of [Storage Device, [folders]] mappings.
     std::map<std::string, std::set<std::string>> storage_map_;
 
@@ -262,9 +351,34 @@ private:
     // This field is used to update sdmap.
     std::vector<StorageAgent>   storage_agents_;
 
-    // for "pong" handlers.
-    std::thread              pong_thread_;
-    asio::io_service         pong_thread_io_service_;
+    // for "pong" handlers; see utils/echo.h.
+    std::unique_ptr<utils::pong_server> pong_server_;
+    std::mutex                          pong_mutex_;
+
+    // Time series points, defined once in do_init().
+    using SysInfoMeasurement =
+        utils::TimeSeriesMeasurement<2,
+                                     float,     // load average, 1m
+                                     float,     // load average, 5m
+                                     float,     // load average, 15m
+                                     size_t,    // total ram
+                                     size_t,    // free ram
+                                     size_t,    // total swap
+                                     size_t>;   // free swap
+
+    using InterfaceMeasurement =
+        utils::TimeSeriesMeasurement<3,
+                                     size_t,    // rx bytes
+                                     size_t,    // rx packets
+                                     size_t,    // rx dropped
+                                     size_t,    // rx errors
+                                     size_t,    // tx bytes
+                                     size_t,    // tx packets
+                                     size_t,    // tx dropped
+                                     size_t>;   // tx errors
+
+    std::unique_ptr<SysInfoMeasurement>   sysinfo_measurement_;
+    std::unique_ptr<InterfaceMeasurement> interface_measurement_;
 };
 
 #endif
@@ -60,6 +60,31 @@ void LauncherAgent::do_init()
     program_args_ = get_program_args(conf);
     program_env_  = get_program_env(conf);
 
+    // "placement": {"policy": "nic-local", "interface": "ens6f1"}
+    // keeps the program near the NIC it moves data through; see
+    // utils/topology.h.  A plain "placement": "nic-local" names the
+    // policy alone.
+    auto const placement = conf["placement"];
+
+    if (not placement.empty())
+    {
+        auto const policy = placement.isObject() ?
+            placement["policy"].asString() : placement.asString();
+        auto const iface  = placement.isObject() ?
+            placement["interface"].asString() : std::string();
+
+        if (iface.empty() and policy != "none")
+        {
+            throw std::runtime_error("No interface given for placement");
+        }
+
+        program_placement_ =
+            utils::nic_local_placement(utils::Topology::read(), iface, policy);
+
+        utils::slog() << "[LauncherAgent] Placement (" << policy << ", "
+                      << iface << "): " << program_placement_.describe();
+    }
+
     auto program_type = get_program_type(conf);
 
     if (program_type == "mdtm-ftp-client" or program_type.empty())
@@ -343,7 +368,9 @@ LauncherAgent::run_subprocess()
         prog_thread_ = std::thread([this]() {
                 utils::supervise_process(program_path_,
                                          program_args_,
-                                         program_env_);
+                                         program_env_,
+                                         1,
+                                         program_placement_);
             });
     }
 }
@@ -5,6 +5,7 @@
 
 #include "agentmanager.h"
 #include "utils/rpcserver.h"
+#include "utils/topology.h"
 
 class LauncherAgent : public Agent
 {
@@ -43,6 +44,7 @@ private:
     std::string                        program_path_;
     std::vector<std::string>           program_args_;
     std::map<std::string, std::string> program_env_;
+    utils::CpuPlacement                program_placement_;
 
     std::string                bde_server_queue_;
     std::string                mdtm_client_listen_queue_;
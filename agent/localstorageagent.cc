@@ -1,5 +1,7 @@
 #include <sys/statvfs.h>
 
+#include "utils/fsusage.h"
+
 #include "localstorageagent.h"
 
 LocalStorageAgent::LocalStorageAgent(Json::Value const & conf)
@@ -11,19 +13,21 @@ LocalStorageAgent::LocalStorageAgent(Json::Value const & conf)
 LocalStorageAgent::~LocalStorageAgent(){
 }
 
-void LocalStorageAgent::iozone_thread_function(){
-    while(iozone_thread_active){
-        get_potential_bandwidth(m_device, m_iozone_test_dir);
-        sleep(m_iozone_thread_interval);
+// The first sweep is done in do_init(); this one redoes it now and
+// then.
+void LocalStorageAgent::bench_thread_function(){
+    while(bench_thread_active){
+        sleep(m_bench_interval);
+        get_potential_bandwidth(m_device, m_bench_dir);
     }
 }
 
 void LocalStorageAgent::do_init()
 {
-    m_iozone_exe      = m_conf["iozone-executable"].asString();
-    m_iozone_test_dir = m_conf["iozone-work-folder"].asString();
+    // The work folder keeps its old name in configuration.
+    m_bench_dir = m_conf["iozone-work-folder"].asString();
 
-    if (m_iozone_test_dir.empty())
+    if (m_bench_dir.empty())
     {
         slog() << "[LocalStorageAgent] Warning: "
                << "missing iozone-work-folder in configuration. "
@@ -32,14 +36,16 @@ void LocalStorageAgent::do_init()
         return;
     }
 
-    if (m_iozone_exe.empty())
-    {
-        slog() << "[LocalStorageAgent] Warning: "
-               << "missing iozone executable in configuration. "
-               << "Disabling LocalStorageAgent.";
-        active = false;
-        return;
-    }
+    // Optional "storage-bench": {"block-size", "file-size",
+    // "queue-depth", "files", "max-threads"}, sizes in bytes.
+    auto const & bench = m_conf["storage-bench"];
+
+    m_bench_params.dir         = m_bench_dir;
+    m_bench_params.block_size  = bench.get("block-size", Json::UInt64(4 << 20)).asUInt64();
+    m_bench_params.file_size   = bench.get("file-size", Json::UInt64(128 << 20)).asUInt64();
+    m_bench_params.queue_depth = bench.get("queue-depth", 4).asUInt();
+    m_bench_params.files       = bench.get("files", 1).asUInt();
+    m_bench_max_threads        = bench.get("max-threads", m_bench_max_threads).asInt();
 
     m_device = m_conf["device"].asString();
 
@@ -88,6 +94,37 @@ void LocalStorageAgent::do_init()
         }
     }
 
+    // Sample I/O counters of the device; NFS mounts and the like are
+    // not block devices, and are left out.
+    auto interval_ms = m_conf.get("diskstats-interval-ms", 1000).asUInt();
+    // A first sample now, so that the counters are there for
+    // get_realtime_bandwidth() below.
+    m_diskstats.reset(new utils::DiskStatsSampler({m_device}, interval_ms));
+    m_diskstats->sample();
+    m_diskstats->start();
+
+    // NFS mounts have their own counters in /proc/self/mountstats.
+    if (m_diskstats->devices().empty() and not m_root_dirs.empty())
+    {
+        auto const mount = utils::get_mount_point(m_root_dirs[0]);
+
+        if (mount.type.find("nfs") != string::npos)
+        {
+            m_nfs_mount = mount.target;
+            m_nfsstats.reset(new utils::NfsStatsSampler({m_nfs_mount}, interval_ms));
+            m_nfsstats->sample();
+            m_nfsstats->start();
+        }
+    }
+
+    // Recent history, for the metrics_fetch command, as often as
+    // the counters are sampled.
+    auto metrics_interval = std::chrono::milliseconds(interval_ms);
+    manager().add_event([this, metrics_interval](){
+            record_metrics();
+            return metrics_interval;
+        }, metrics_interval);
+
     utils::slog() << "[LocalStorageAgent] Will try to report disk I/O stats for "
                   << m_device << " to time series database.";
     auto interval = std::chrono::seconds(5);
@@ -97,7 +134,13 @@ void LocalStorageAgent::do_init()
             return interval;
         }, interval);
 
-    if(m_iozone_exe == "") m_iozone_exe = "iozone";
+    // Registration, which comes next, needs the capacity: without
+    // it ResourceManager admits nothing to this storage.
+    utils::slog() << "[LocalStorageAgent] Benchmarking " << m_bench_dir << "...";
+    get_potential_bandwidth(m_device, m_bench_dir);
+
+    bench_thread_active = true;
+    bench_thread_handler = make_shared<thread>(&LocalStorageAgent::bench_thread_function, this);
 
     if(get_realtime_bandwidth(m_device) < 0) {
       utils::slog() << "[LocalStorageAgent] Cannot report disk I/O stats for "
@@ -105,94 +148,47 @@ void LocalStorageAgent::do_init()
       return;
     }
     get_usage(m_device);
-
-    iozone_thread_handler = make_shared<thread>(&LocalStorageAgent::iozone_thread_function, this);
-    iozone_thread_active = true;
 }
 
 void LocalStorageAgent::report_disk_io_stats() const
 {
-    static bool errored = false;
-
-    // Just give up if calling this function resulted in error
-    // previously.  We don't want to fill the log files with the same
-    // error messages.
-    if (errored)
-    {
-        return;
-    }
-
-    // One place that we can query for disk I/O rates is sysfs: See
-    // https://www.kernel.org/doc/Documentation/block/stat.txt for
-    // documentation.  Another place is /proc/diskstats.
-    char sys_stat_file[PATH_MAX]{};
-    char *dev = const_cast<char *>(m_device.c_str()) + strlen("/dev/");
-    snprintf(sys_stat_file, PATH_MAX, "/sys/block/%s/stat", dev);
-
-    // TODO: replace fopen() etc with C++ stream I/O.
-
-    FILE *fp = fopen(sys_stat_file, "r");
-    if (!fp) {
-        errored = true;
-        utils::slog() << "[LocalStorageAgent] Error opening " << sys_stat_file
-                      << ", reason: " << strerror(errno) << ".";
-        return;
-    }
-
-    size_t read_ios;
-    size_t read_merges;
-    size_t read_sectors;
-    size_t read_ticks;
-
-    size_t write_ios;
-    size_t write_merges;
-    size_t write_sectors;
-    size_t write_ticks;
-
-    size_t in_flight;
-    size_t io_ticks;
-    size_t time_in_queue;
-
-    fscanf(fp, "%lu %lu %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
-           &read_ios, &read_merges, &read_sectors, &read_ticks,
-           &write_ios, &write_merges, &write_sectors, &write_ticks,
-           &in_flight, &io_ticks, &time_in_queue);
-
-    if (ferror(fp))
+    utils::DiskCounters counters;
+    utils::DiskRates    rates;
+
+    // Nothing to report for devices that are not sampled, or until
+    // there have been two samples.
+    if (not m_diskstats or
+        not m_diskstats->counters(m_device, counters) or
+        not m_diskstats->rates(m_device, rates))
     {
-        utils::slog() << "[LocalStorageAgent] Reading" << sys_stat_file
-                      << " errored, reason: " << strerror(errno);
-        fclose(fp);
-        errored = true;
         return;
     }
 
-    fclose(fp);
-
-    // utils::slog() <<  "[LocalStorageAgent] " << dev << " stats: {"
-    //               <<  "read_ios: "      << read_ios      << ", "
-    //               <<  "read_merges: "   << read_merges   << ", "
-    //               <<  "read_sectors: "  << read_sectors  << ", "
-    //               <<  "read_ticks: "    << read_ticks    << ", "
-    //               <<  "write_ios: "     << write_ios     << ", "
-    //               <<  "write_merges: "  << write_merges  << ", "
-    //               <<  "write_sectors: " << write_sectors << ", "
-    //               <<  "write_ticks: "   << write_ticks   << ", "
-    //               <<  "in_flight: "     << in_flight     << ", "
-    //               <<  "io_ticks: "      << io_ticks      << ", "
-    //               <<  "time_in_queue: " << time_in_queue << "}";
-
     auto const num_tags = 3;
     using DiskInfo = utils::TimeSeriesMeasurement<num_tags,
                                                   size_t,
-                                                  size_t>;
-
-    DiskInfo measure(tsdb(), "disk_io", {"read_ios", "write_ios"},
+                                                  size_t,
+                                                  double,
+                                                  double,
+                                                  double,
+                                                  double,
+                                                  double,
+                                                  double>;
+
+    DiskInfo measure(tsdb(), "disk_io",
+                     {"read_ios", "write_ios",
+                      "read_mbps", "write_mbps",
+                      "read_iops", "write_iops",
+                      "queue_depth", "utilization"},
                      {"name", "id", "device"});
 
     try
     {
-        measure.insert(read_ios, write_ios, {name(), id(), m_device});
+        measure.insert(counters.read_ios, counters.write_ios,
+                       rates.read_mbps, rates.write_mbps,
+                       rates.read_iops, rates.write_iops,
+                       rates.queue_depth, rates.utilization,
+                       {name(), id(), m_device});
     }
     catch (std::exception const &ex)
     {
@@ -201,6 +197,35 @@ void LocalStorageAgent::report_disk_io_stats() const
     }
 }
 
+void LocalStorageAgent::record_metrics() const
+{
+    auto &store = metrics();
+
+    utils::DiskRates rates;
+
+    if (m_diskstats and m_diskstats->rates(m_device, rates))
+    {
+        auto const prefix = "disk." + utils::disk_kernel_name(m_device) + ".";
+
+        store.record(prefix + "read_mbps",   rates.read_mbps);
+        store.record(prefix + "write_mbps",  rates.write_mbps);
+        store.record(prefix + "read_iops",   rates.read_iops);
+        store.record(prefix + "write_iops",  rates.write_iops);
+        store.record(prefix + "utilization", rates.utilization);
+    }
+
+    utils::NfsMountRates nfs;
+
+    if (m_nfsstats and m_nfsstats->rates(m_nfs_mount, nfs))
+    {
+        auto const prefix = "nfs." + m_nfs_mount + ".";
+
+        store.record(prefix + "read_mbps",  nfs.read_bytes_per_sec / 1e6);
+        store.record(prefix + "write_mbps", nfs.write_bytes_per_sec / 1e6);
+        store.record(prefix + "ops",        nfs.ops_per_sec);
+    }
+}
+
 void LocalStorageAgent::report_disk_usage_stats() const
 {
     static bool errored = false;
@@ -258,17 +283,45 @@ void LocalStorageAgent::do_registration()
     v["queue_name"] = queue();
     v["expired_at"] = (Json::Value::UInt64)duration_cast<seconds>(steady_clock::now().time_since_epoch()).count();
 
+    Json::Value base;
+    {
+        std::lock_guard<std::mutex> lock(m_jbase_mutex);
+        base = m_jbase.get(m_device, Json::Value());
+    }
+
     v["device"] = m_device;
     v["root_folders"] = m_conf["root-folders"];
-    v["io_capacity_write"] = m_jbase[m_device]["potential_write_bandwidth"];
-    v["io_capacity_read"] = m_jbase[m_device]["potential_read_bandwidth"];
+    v["io_capacity_write"] = base["potential_write_bandwidth"];
+    v["io_capacity_read"] = base["potential_read_bandwidth"];
+    v["io_capacity_curve"] = base["bandwidth_curve"];
+
+    // What ResourceManager admits transfers against, in bytes/s.
+    v["io_capacity"] = utils::storage_capacity_bps(base["potential_write_bandwidth"].asDouble(),
+                                                   base["potential_read_bandwidth"].asDouble());
 
     store().reg_local_storage(v);
 
     set_prop("device", m_device);
     set_prop("root_folders", m_conf["root-folders"]);
-    set_prop("io_capacity_write", m_jbase[m_device]["potential_write_bandwidth"]);
-    set_prop("io_capacity_read", m_jbase[m_device]["potential_read_bandwidth"]);
+    set_prop("io_capacity_write", base["potential_write_bandwidth"]);
+    set_prop("io_capacity_read", base["potential_read_bandwidth"]);
+    set_prop("io_capacity_curve", base["bandwidth_curve"]);
+}
+
+// Both commands only read what the samplers last saw.
+CommandClass LocalStorageAgent::do_command_class(string const & cmd, Json::Value const & params) const
+{
+    if (cmd == "ls_get_rate" or cmd == "ls_estimate_total_rate")
+    {
+        return CommandClass::control;
+    }
+
+    return CommandClass::metadata;
+}
+
+bool LocalStorageAgent::do_command_known(string const & cmd) const
+{
+    return cmd == "ls_get_rate" or cmd == "ls_estimate_total_rate";
 }
 
 Json::Value LocalStorageAgent::do_command(string const & cmd, Json::Value const & params)
@@ -297,12 +350,28 @@ Json::Value LocalStorageAgent::do_command(string const & cmd, Json::Value const
 
     if (cmd == "ls_get_rate")
     {
-        v["code"]       = get_realtime_bandwidth(m_device);
-        v["rate_read"]  = m_jbase[m_device]["realtime_read_bandwidth"];
-        v["rate_write"] = m_jbase[m_device]["realtime_write_bandwidth"];
+        v["code"]        = get_realtime_bandwidth(m_device);
+
+        std::lock_guard<std::mutex> lock(m_jbase_mutex);
+
+        v["rate_read"]   = m_jbase[m_device]["realtime_read_bandwidth"];
+        v["rate_write"]  = m_jbase[m_device]["realtime_write_bandwidth"];
+        v["iops_read"]   = m_jbase[m_device]["realtime_read_iops"];
+        v["iops_write"]  = m_jbase[m_device]["realtime_write_iops"];
+        v["queue_depth"] = m_jbase[m_device]["queue_depth"];
+        v["utilization"] = m_jbase[m_device]["utilization"];
+
+        // Average RPC round trip times in ms, on NFS.
+        if (m_nfsstats)
+        {
+            v["rtt_read"]  = m_jbase[m_device]["read_rtt"];
+            v["rtt_write"] = m_jbase[m_device]["write_rtt"];
+        }
     }
     else if (cmd == "ls_estimate_total_rate")
     {
+        std::lock_guard<std::mutex> lock(m_jbase_mutex);
+
         v["code"]             = 0;
         v["total_rate_read"]  = m_jbase[m_device]["potential_read_bandwidth"];
         v["total_rate_write"] = m_jbase[m_device]["potential_write_bandwidth"];
@@ -311,193 +380,107 @@ Json::Value LocalStorageAgent::do_command(string const & cmd, Json::Value const
     return v;
 }
 
+// Sizes are in MiB, as "df -h" used to give them.
 int LocalStorageAgent::get_usage(string device){
-    string cmd = "df -h " + device;
-    string ret = run_cmd(cmd);
-    if(ret == ""){
+    if (m_root_dirs.empty()) {
         return -1;
     }
-    vector<string> result = split_string(ret, " ");
-    double size = parse_size(result[1]);
-    double used = parse_size(result[2]);
-    double available = parse_size(result[3]);
-    double percent = parse_size(result[4]);
-    string mount = result[5];
-    m_jbase[device]["size"] = size;
-    m_jbase[device]["used"] = used;
-    m_jbase[device]["available"] = available;
-    m_jbase[device]["percent"] = percent;
-    m_jbase[device]["mount"] = mount;
 
-    return 0;
-}
+    utils::fs_usage usage;
 
-int LocalStorageAgent::get_realtime_bandwidth(string device){
-    vector<string> raw_dev = split_string(device, "/");
+    try {
+        usage = utils::get_fs_usage(m_root_dirs[0]);
+    } catch (std::exception const &ex) {
+        slog() << "[LocalStorageAgent] Can't get usage of " << device
+               << ": " << ex.what();
+        return -1;
+    }
 
-    // NFS has its own command. Therefore we check
-    // the file system type, and determine the command
+    double const mib = 1024.0 * 1024.0;
     MountPointsHelper mph(m_root_dirs[0], false);
-    auto mounts = mph.get_mounts();
 
-    // what if nothing is mounted under this path?
-    if (mounts.empty())
-    {
-        auto mnt = mph.get_parent_mount();
-        mounts.insert(mnt);
-    }
+    std::lock_guard<std::mutex> lock(m_jbase_mutex);
 
-    set<MountPoint>::iterator it = mounts.begin();
-    string ft = it->type(), cmd;
+    m_jbase[device]["size"] = usage.total_size / mib;
+    m_jbase[device]["used"] = (usage.total_size - usage.free_size) / mib;
+    m_jbase[device]["available"] = usage.available_size / mib;
+    m_jbase[device]["percent"] = usage.size_usage;
+    m_jbase[device]["mount"] = mph.get_parent_mount().target();
 
-    if (string::npos != ft.find("nfs")) {
-        cmd = "nfsiostat |grep -A3 read|grep -v read|grep -v write|awk '{print $2}'|awk '{ORS=(NR%2?FS:RS)}1'";
-    }
-    else {
-        cmd = "iostat " + device +" | grep -A1 Device | grep -v Device |awk {'print $3, $4'}";
-    }
+    return 0;
+}
 
-    string ret = run_cmd(cmd);
-    if(ret == ""){
-        return -1;
+// Rates are in MB/s.  Block devices come from m_diskstats, NFS mounts
+// from m_nfsstats.
+int LocalStorageAgent::get_realtime_bandwidth(string device){
+    utils::DiskCounters counters;
+    utils::NfsMountCounters counters_nfs;
+
+    std::lock_guard<std::mutex> lock(m_jbase_mutex);
+
+    if (m_diskstats and m_diskstats->counters(device, counters)) {
+        // Zeros until there have been two samples.
+        utils::DiskRates rates;
+        m_diskstats->rates(device, rates);
+
+        m_jbase[device]["realtime_read_bandwidth"] = rates.read_mbps;
+        m_jbase[device]["realtime_write_bandwidth"] = rates.write_mbps;
+        m_jbase[device]["realtime_read_iops"] = rates.read_iops;
+        m_jbase[device]["realtime_write_iops"] = rates.write_iops;
+        m_jbase[device]["queue_depth"] = rates.queue_depth;
+        m_jbase[device]["utilization"] = rates.utilization;
+        return 0;
     }
-    vector<string> result = split_string(ret, " ");
 
-    if(result.size() <= 0)
-	return -1;
-
-    double readbw, writebw;
-
-    try{
-         readbw = stod(result[0]) / 1000.0;
-         writebw = stod(result[1]) / 1000.0;
-    } catch( ...  )
-    {
-        slog() << "[LocalStorageAgent] iostat returns strings in wrong format!";
+    if (m_nfsstats and m_nfsstats->counters(m_nfs_mount, counters_nfs)) {
+        utils::NfsMountRates rates;
+        m_nfsstats->rates(m_nfs_mount, rates);
+
+        m_jbase[device]["realtime_read_bandwidth"] = rates.read_bytes_per_sec / 1e6;
+        m_jbase[device]["realtime_write_bandwidth"] = rates.write_bytes_per_sec / 1e6;
+        m_jbase[device]["realtime_read_iops"] = rates.read_ops_per_sec;
+        m_jbase[device]["realtime_write_iops"] = rates.write_ops_per_sec;
+        m_jbase[device]["read_rtt"] = rates.read_rtt_ms;
+        m_jbase[device]["write_rtt"] = rates.write_rtt_ms;
+        return 0;
     }
-    m_jbase[device]["realtime_read_bandwidth"] = readbw;
-    m_jbase[device]["realtime_write_bandwidth"] = writebw;
-    return 0;
+
+    slog() << "[LocalStorageAgent] No I/O stats for " << device;
+    return -1;
 }
 
+// Capacity is where bandwidth stops growing with more threads; the
+// whole curve is registered along with it.
 int LocalStorageAgent::get_potential_bandwidth(string device, string dir){
-    stringstream cmd("mkdir -p " + dir);
-    run_cmd(cmd.str());
-    cmd.str("");
-
-    std::vector<string> test_files(m_iozone_max_threads);
-
-    double writebw = 0.0, readbw = 0.0;
+    utils::StorageBenchCurve curve;
 
-    for(int i=0; i<m_iozone_max_threads; i++){
+    auto params = m_bench_params;
+    params.dir  = dir;
 
-        std::stringstream filename;
-        filename << dir << "/testiozone" << i;
-        test_files[i] = filename.str();
-
-        // iozone write tests
-        cmd << m_iozone_exe << " -i0 -w -I -r 4M -s 128M -t ";
-        cmd << i+1;
-        cmd <<" -F ";
-        for(auto j : test_files){
-            cmd << j << " ";
-        }
-        cmd << " 2>&1 | grep 'Children see throughput for'";
-        string ret = run_cmd(cmd.str());
-        cmd.str("");
-        vector<string> result = split_string(ret, " ");
-
-
-        if(result.size() < 8){
-            slog() << "[LocalStorageAgent] Fatal error: iozone did not return results! Please check if iozone executable is configured correctly!";
-            return -1;
-        }
-        try{
-            double bw = stod(result[7]) / 1000.0;
-            if(bw > writebw){
-                writebw = bw;
-            }
-        }
-        catch(...)
-        {
-            slog() << "[LocalStorageAgent] iozone returned strings in wrong format!";
-        }
-
-        // iozone read tests
-        cmd << m_iozone_exe << " -i1 -w -I -r 4M -s 128M -t ";
-        cmd << i+1;
-        cmd <<" -F ";
-        for(auto j : test_files){
-            cmd << j << " ";
-        }
-        cmd << " 2>&1 | grep 'Children see throughput for'";
-        ret = run_cmd(cmd.str());
-        cmd.str("");
-        result = split_string(ret, " ");
-        if(result.size() < 8){
-            slog() << "[LocalStorageAgent] Fatal error: iozone did not return results! Please check if iozone executable is configured correctly!";
-            return -1;
-        }
-        try{
-            double bw = stod(result[7]) / 1000.0;
-            if(bw > writebw){
-                readbw = bw;
-            }
-        }
-        catch(...)
-        {
-            slog() << "[LocalStorageAgent] iozone returned strings in wrong format!";
-        }
+    try {
+        curve = utils::storage_bench_sweep(params, m_bench_max_threads);
+    } catch (std::exception const &ex) {
+        slog() << "[LocalStorageAgent] Storage benchmark failed: " << ex.what();
+        return -1;
     }
 
+    Json::Value points(Json::arrayValue);
 
-    m_jbase[device]["potential_write_bandwidth"] = writebw;
-    m_jbase[device]["potential_read_bandwidth"] = readbw;
-
-    cmd << "rm -f ";
-    for(auto j : test_files){
-        cmd << j << " ";
+    for (auto const & p : curve.points) {
+        Json::Value v;
+        v["threads"] = Json::UInt64(p.threads);
+        v["write"]   = p.write_mbps;
+        v["read"]    = p.read_mbps;
+        v["direct"]  = p.direct;
+        points.append(v);
     }
-    run_cmd(cmd.str());
-    cmd.str("");
 
-    return 0;
-}
+    std::lock_guard<std::mutex> lock(m_jbase_mutex);
 
-vector<string> LocalStorageAgent::split_string(const string& str, const string& delimiter){
-    vector<string> strings;
-    string::size_type pos = 0;
-    string::size_type prev = 0;
-    string topush;
-    while ((pos = str.find(delimiter, prev)) !=  string::npos){
-        topush = str.substr(prev, pos - prev);
-        if(!is_empty(topush)){
-            strings.push_back(topush);
-        }
-        prev = pos + 1;
-    }
-    topush = str.substr(prev);
-    if(!is_empty(topush)){
-        strings.push_back(topush);
-    }
-    return strings;
-}
+    m_jbase[device]["potential_write_bandwidth"] = curve.saturation_write_mbps;
+    m_jbase[device]["potential_read_bandwidth"] = curve.saturation_read_mbps;
+    m_jbase[device]["saturation_threads"] = Json::UInt64(curve.saturation_threads);
+    m_jbase[device]["bandwidth_curve"] = points;
 
-string LocalStorageAgent::run_cmd(string cmd){
-    FILE * pipe = NULL;
-    char buffer[2000];
-    string result;
-    pipe = popen(cmd.c_str(), "r");
-    int len = 0;
-    if (NULL == pipe) {
-        perror("pipe");
-        return "";
-    }
-    while (!feof(pipe)) {
-        if (fgets(buffer, sizeof(buffer), pipe) != NULL)
-            result = buffer;
-    }
-    pclose(pipe);
-    return result;
+    return 0;
 }
-
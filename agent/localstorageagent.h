@@ -3,8 +3,13 @@
 
 #include "utils/utils.h"
 #include "utils/mounts.h"
+#include "utils/diskstats.h"
+#include "utils/mountstats.h"
+#include "utils/storagebench.h"
 #include "utils/json/json.h"
 #include "agentmanager.h"
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
@@ -23,73 +28,45 @@ class LocalStorageAgent : public Agent
         virtual void do_init();
         virtual void do_registration();
         virtual Json::Value do_command(std::string const & cmd, Json::Value const & params);
+        virtual CommandClass do_command_class(std::string const & cmd, Json::Value const & params) const;
+        virtual bool do_command_known(std::string const & cmd) const;
 
     private:
-        string run_cmd(string cmd);
         int get_usage(string device);
         int get_realtime_bandwidth(string device);
         int get_potential_bandwidth(string device, string dir);
-        void iozone_thread_function();
+        void bench_thread_function();
 
         void report_disk_io_stats() const;
         void report_disk_usage_stats() const;
 
-        vector<string> split_string(const string& str, const string& delimiter);
-        inline bool is_empty(string &s){
-            auto unit=s.end()-1;
-            if(*unit == '\n'){
-                s.erase(s.end()-1,s.end());
-            }
-            for(auto i : s){
-                if(!isspace(i)){
-                    return false;
-                }
-            }
-            return true;
-        }
-        inline double parse_size(string s){
-            auto unit=s.end()-1;
-            double c = 0;
-            if(*unit == 'T'){
-                c = 1000000;
-            }
-            else if(*unit == 'G'){
-                c = 1000;
-            }
-            else if(*unit == 'M'){
-                c = 1;
-            }
-            else if(*unit == 'K'){
-                c = 0.001;
-            }
-            else if(*unit == '%'){
-                c = 1;
-            }
-            s.erase(s.end()-1,s.end());
-            if (not s.empty()) {
-                try {
-                    c *= stof(s);
-                } catch (...) {
-                    // XXX: ignore whatever this throws.  We don't
-                    // want to this to crash the agent as a whole.
-                }
-            }
-            return c;
-        }
+        // Latest I/O rates, into the agent's metric store.
+        void record_metrics() const;
 
         Json::Value const & m_conf;
-        string m_iozone_exe;
         string m_device;
         vector<string> m_root_dirs;
-        string m_iozone_test_dir;
-        int m_iozone_max_threads = 8;
+        string m_bench_dir;
+        int m_bench_max_threads = 8;
+        utils::StorageBenchParams m_bench_params;
+
+        // Written by the bench thread and by ls_get_rate, read by
+        // commands and registration.
         Json::Value m_jbase;
+        mutable std::mutex m_jbase_mutex;
 
-        size_t m_iozone_thread_interval = 1000000;
-        shared_ptr<thread> iozone_thread_handler;
-        bool iozone_thread_active=false;
+        size_t m_bench_interval = 1000000;
+        shared_ptr<thread> bench_thread_handler;
+        bool bench_thread_active=false;
         bool active=true;
 
+        // I/O rates of m_device, from /proc/diskstats.
+        unique_ptr<utils::DiskStatsSampler> m_diskstats;
+
+        // Or, if the root folders are on NFS, of their mount.
+        string m_nfs_mount;
+        unique_ptr<utils::NfsStatsSampler> m_nfsstats;
+
 };
 
 #endif
@@ -8,6 +8,7 @@
 #include "scanner.h"
 #include "localstorageagent.h"
 #include "sharedstorageagent.h"
+#include "utils/storagebench.h"
 
 using namespace std;
 using namespace utils;
@@ -41,16 +42,7 @@ Scanner::Scanner(Conf const & conf)
     m_id = conf["id"].asString();
     m_stats_file = m_scan_dir + "/stat-" + m_id;
 
-    // To get the path of iozone
-    auto iozone_path = conf["iozone-executable"];
-    if (iozone_path.empty())
-    {
-        throw runtime_error("[SSA Scanner] iozone path is required.");
-    }
-
-    m_iozone_exe = iozone_path.asString();
-
-    // To get iozone sleep time
+    // To get sleep time between probes
     m_sleep_mins = stoi(conf["sleep time"].asString());
 
     // To get the OST range. Right now, only
@@ -199,110 +191,42 @@ vector<string> Scanner::split_string(const string& str, const string& delimiter)
 
 int Scanner::get_potential_bandwidth()
 {
-    stringstream cmd;
-    double writebw = 0.0, readbw = 0.0;
-
     m_writebw = m_readbw = 0.0;
 
-    vector<string> test_files(m_iozone_max_threads);
+    utils::StorageBenchParams params;
+    params.dir        = m_scan_dir;
+    params.prefix     = "testbench." + m_id;
+    params.block_size = 16 << 20;
+    params.file_size  = 16 << 20;
 
     for (int ostid = m_ost_low; ostid <= m_ost_high; ostid++) {
-        for (int i = 0; i < m_iozone_max_threads; i++) {
-
-            stringstream filename;
-            filename << m_scan_dir << "/testiozone."
-                     << m_id << "." << i;
-            test_files[i] = filename.str();
-
-            // probe the bandwidth of each OST. This is done
-            // via 'lfs setstripe' command.
-            // Once we have the aggregated bandwidth of
-            // the OSTS specified in JSON, write the results
-            // to the stats file.
-            cmd.str("");
-            cmd << "lfs setstripe " + filename.str() + " -c 1 -i ";
-            cmd << ostid;
-
-            run_cmd(cmd.str());
-
-            // iozone write tests
-            cmd.str("");
-            cmd << m_iozone_exe << " -i0 -w -I -r 16M -s 16M -t ";
-            cmd << i + 1;
-            cmd <<" -F ";
-
-            for (auto j : test_files) {
-                cmd << j << " ";
-            }
-
-            cmd << " 2>&1 | grep 'Children see throughput for'";
-            string ret = run_cmd(cmd.str());
-
-            cmd.str("");
-            vector<string> result = split_string(ret, " ");
-
-            if (result.size() < 8) {
-                slog() << "[SSA Scanner] Fatal error 1: "
-                       << "iozone did not return results! "
-                       << "Please check if iozone is configured correctly!";
-                return -1;
-            }
-
-            try {
-                double bw = stod(result[7]) / 1024.0;
-                if (bw > writebw) {
-                    writebw = bw;
-                }
-            }
-
-            catch(...)
-            {
-                slog() << "[SSA Scanner] iozone returned strings in wrong format!";
-            }
-
-            // iozone read tests
-            cmd << m_iozone_exe << " -i1 -w -I -r 16M -s 16M -t ";
-            cmd << i + 1;
-            cmd <<" -F ";
-            for (auto j : test_files) {
-                cmd << j << " ";
-            }
-
-            cmd << " 2>&1 | grep 'Children see throughput for'";
-            ret = run_cmd(cmd.str());
-            cmd.str("");
-            result = split_string(ret, " ");
-            if (result.size() < 8) {
-                slog() << "[SSA Scanner] Fatal error 2: iozone did not return results! Please check if iozone executable is configured correctly!";
-                return -1;
-             }
-
-             try {
-                 double bw = stod(result[7]) / 1024.0;
-                 if (bw > writebw) {
-                     readbw = bw;
-                 }
-             }
-
-             catch(...)
-             {
-                 slog() << "[SSA Scanner] iozone returned strings in wrong format!";
-            }
+        // probe the bandwidth of each OST. This is done by striping
+        // the test files with 'lfs setstripe' before they are
+        // written.  Once we have the aggregated bandwidth of the OSTS
+        // specified in JSON, write the results to the stats file.
+        params.prepare = [this, ostid](std::string const &path) {
+            run_cmd("lfs setstripe " + path + " -c 1 -i " + to_string(ostid));
+        };
+
+        utils::StorageBenchCurve curve;
+
+        try {
+            curve = utils::storage_bench_sweep(params, m_bench_max_threads);
         }
+        catch (std::exception const &ex) {
+            slog() << "[SSA Scanner] Storage benchmark failed: " << ex.what();
+            return -1;
+        }
+
+        // MB/s, as before.
+        double const writebw = curve.saturation_write_mbps;
+        double const readbw  = curve.saturation_read_mbps;
 
         slog() << "[OST:" << ostid << "] writebw: " << writebw
                << " readbw: "  << readbw;
 
         m_writebw += writebw;
         m_readbw  += readbw;
-
-        // delete iozone files
-        cmd << "rm -f ";
-        for (auto j : test_files) {
-            cmd << j << " ";
-        }
-
-        run_cmd(cmd.str());
     }
 
     return 0;
@@ -42,9 +42,8 @@ private:
     string m_scan_dir;
     string m_stats_file;
 
-    int m_iozone_max_threads = 4;
+    int m_bench_max_threads = 4;
     int m_sleep_mins;
-    string m_iozone_exe;
 
     int m_ost_low;
     int m_ost_high;
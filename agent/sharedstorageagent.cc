@@ -1,7 +1,9 @@
 #include <dirent.h>
 
 #include "sharedstorageagent.h"
+#include "agentmanager.h"
 #include "utils/tsdb.h"
+#include "utils/fsusage.h"
 
 SharedStorageAgent::SharedStorageAgent(Json::Value const & conf)
     :Agent(conf["id"].asString(), conf["name"].asString(), "SharedStorage"),
@@ -62,26 +64,6 @@ void SharedStorageAgent::check_configuration(Json::Value const & conf)
         scan_data_folder_ = data_folder_scan.asBool();
     }
 #endif
-    m_iozone_exe = conf["iozone-executable"].asString();
-
-    if (m_iozone_exe.empty() and (not m_data_folders_.empty()))
-    {
-        m_iozone_exe =
-            conf["local_storage_agent"]["iozone-executable"].asString();
-
-        if (m_iozone_exe.empty())
-        {
-            m_iozone_exe =
-                conf["shared_storage_agent"]["iozone-executable"].asString();
-
-            if (m_iozone_exe.empty())
-            {
-                throw std::runtime_error("No iozone-executable configuration found");
-            }
-        }
-
-    }
-
     m_iozone_test_dir = get_iozone_work_folder(m_data_folders_[0]);
 }
 
@@ -96,12 +78,6 @@ void SharedStorageAgent::do_init()
         return;
     }
 
-    if (m_iozone_exe.empty()) {
-        slog() << "[SharedStorageAgent] Fatal error: iozone executable not specified in config file! SharedStorageAgent not functioning...";
-        active = false;
-        return;
-    }
-
     m_device = m_conf["device"].asString();
 
 //    auto const & folders = m_conf["root-folders"];
@@ -149,7 +125,30 @@ void SharedStorageAgent::do_init()
         }
     }
 
-    if (m_iozone_exe == "") m_iozone_exe = "iozone";
+    // Data folders on NFS: sample the client's counters of the mount,
+    // with a first sample now for get_realtime_bandwidth() below.
+    auto const mount = utils::get_mount_point(m_root_dirs[0]);
+
+    if (mount.type.find("nfs") != string::npos)
+    {
+        m_nfs_mount = mount.target;
+        m_nfsstats.reset(new utils::NfsStatsSampler({m_nfs_mount}));
+        m_nfsstats->sample();
+        m_nfsstats->start();
+
+        auto interval = std::chrono::seconds(5);
+        manager().add_event([this, interval](){
+                report_nfs_io_stats();
+                return interval;
+            }, interval);
+
+        // Recent history, for the metrics_fetch command.
+        auto metrics_interval = std::chrono::seconds(1);
+        manager().add_event([this, metrics_interval](){
+                record_metrics();
+                return metrics_interval;
+            }, metrics_interval);
+    }
 
     get_potential_bandwidth(m_device, m_iozone_test_dir);
     get_realtime_bandwidth(m_device);
@@ -179,6 +178,22 @@ void SharedStorageAgent::do_registration()
     store().reg_local_storage(v);
 }
 
+// Both commands only read what the samplers last saw.
+CommandClass SharedStorageAgent::do_command_class(string const & cmd, Json::Value const & params) const
+{
+    if (cmd == "ls_get_rate" or cmd == "ls_estimate_total_rate")
+    {
+        return CommandClass::control;
+    }
+
+    return CommandClass::metadata;
+}
+
+bool SharedStorageAgent::do_command_known(string const & cmd) const
+{
+    return cmd == "ls_get_rate" or cmd == "ls_estimate_total_rate";
+}
+
 Json::Value SharedStorageAgent::do_command(string const & cmd, Json::Value const & params)
 {
     if(!active){
@@ -196,6 +211,16 @@ Json::Value SharedStorageAgent::do_command(string const & cmd, Json::Value const
         v["code"] = get_realtime_bandwidth(m_device);
         v["rate_read"] = m_jbase[m_device]["realtime_read_bandwidth"];
         v["rate_write"] = m_jbase[m_device]["realtime_write_bandwidth"];
+
+        // On NFS, how long the server takes to answer (ms per RPC,
+        // averaged over the last interval), for admission decisions.
+        if (m_nfsstats) {
+            v["rtt_read"] = m_jbase[m_device]["read_rtt"];
+            v["rtt_write"] = m_jbase[m_device]["write_rtt"];
+            v["exe_read"] = m_jbase[m_device]["read_exe"];
+            v["exe_write"] = m_jbase[m_device]["write_exe"];
+            v["retrans"] = m_jbase[m_device]["retrans"];
+        }
     }
     else if (cmd == "ls_estimate_total_rate"){
         v["code"] = 0;
@@ -205,31 +230,58 @@ Json::Value SharedStorageAgent::do_command(string const & cmd, Json::Value const
     return v;
 }
 
+// Sizes are in MiB, as "df -h" used to give them.
 int SharedStorageAgent::get_usage(string device){
-    string cmd = "df -h | grep " + device;
-    string ret = run_cmd(cmd);
-    if(ret == ""){
+    if (m_root_dirs.empty()) {
+        return -1;
+    }
+
+    utils::fs_usage usage;
+
+    try {
+        usage = utils::get_fs_usage(m_root_dirs[0]);
+    } catch (std::exception const &ex) {
+        slog() << "[SharedStorageAgent] Can't get usage of " << device
+               << ": " << ex.what();
         return -1;
     }
-    vector<string> result = split_string(ret, " ");
-    double size = parse_size(result[1]);
-    double used = parse_size(result[2]);
-    double available = parse_size(result[3]);
-    double percent = parse_size(result[4]);
-    string mount = result[5];
-    m_jbase[device]["size"] = size;
-    m_jbase[device]["used"] = used;
-    m_jbase[device]["available"] = available;
-    m_jbase[device]["percent"] = percent;
-    m_jbase[device]["mount"] = mount;
+
+    double const mib = 1024.0 * 1024.0;
+
+    MountPointsHelper mph(m_root_dirs[0], false);
+
+    m_jbase[device]["size"] = usage.total_size / mib;
+    m_jbase[device]["used"] = (usage.total_size - usage.free_size) / mib;
+    m_jbase[device]["available"] = usage.available_size / mib;
+    m_jbase[device]["percent"] = usage.size_usage;
+    m_jbase[device]["mount"] = mph.get_parent_mount().target();
 
     return 0;
 }
 
+// Rates are in MB/s.  On NFS they are what went over the wire, from
+// m_nfsstats; otherwise what the scanner last wrote in .ssa.
 int SharedStorageAgent::get_realtime_bandwidth(string device) {
     double scan_wbw = 0.0 , scan_rbw = 0.0;
 
-    scan_stats(scan_wbw, scan_rbw);
+    utils::NfsMountCounters counters;
+
+    if (m_nfsstats and m_nfsstats->counters(m_nfs_mount, counters)) {
+        // Zeros until there have been two samples.
+        utils::NfsMountRates rates;
+        m_nfsstats->rates(m_nfs_mount, rates);
+
+        scan_rbw = rates.read_bytes_per_sec / 1e6;
+        scan_wbw = rates.write_bytes_per_sec / 1e6;
+
+        m_jbase[device]["read_rtt"] = rates.read_rtt_ms;
+        m_jbase[device]["write_rtt"] = rates.write_rtt_ms;
+        m_jbase[device]["read_exe"] = rates.read_exe_ms;
+        m_jbase[device]["write_exe"] = rates.write_exe_ms;
+        m_jbase[device]["retrans"] = rates.retrans_per_sec;
+    } else {
+        scan_stats(scan_wbw, scan_rbw);
+    }
 
     slog() << "[SharedStorageAgent] device: " << device;
     slog() << "[SharedStorageAgent] Realtime write bandwidth: "
@@ -268,6 +320,68 @@ int SharedStorageAgent::get_realtime_bandwidth(string device) {
     return 0;
 }
 
+// Latest rates of the NFS mount, into the agent's metric store.
+void SharedStorageAgent::record_metrics() const
+{
+    utils::NfsMountRates rates;
+
+    if (not m_nfsstats or not m_nfsstats->rates(m_nfs_mount, rates))
+    {
+        return;
+    }
+
+    auto const prefix = "nfs." + m_nfs_mount + ".";
+
+    metrics().record(prefix + "read_mbps",  rates.read_bytes_per_sec / 1e6);
+    metrics().record(prefix + "write_mbps", rates.write_bytes_per_sec / 1e6);
+    metrics().record(prefix + "ops",        rates.ops_per_sec);
+}
+
+void SharedStorageAgent::report_nfs_io_stats() const
+{
+    utils::NfsMountCounters counters;
+    utils::NfsMountRates    rates;
+
+    if (not m_nfsstats or
+        not m_nfsstats->counters(m_nfs_mount, counters) or
+        not m_nfsstats->rates(m_nfs_mount, rates))
+    {
+        return;
+    }
+
+    auto const num_tags = 4;
+    using NfsInfo = utils::TimeSeriesMeasurement<num_tags,
+                                                 double,
+                                                 double,
+                                                 double,
+                                                 double,
+                                                 double,
+                                                 double,
+                                                 double,
+                                                 double>;
+
+    NfsInfo measure(tsdb(), "nfs_io",
+                    {"read_mbps", "write_mbps",
+                     "ops", "retrans",
+                     "read_rtt", "write_rtt",
+                     "read_exe", "write_exe"},
+                    {"name", "id", "device", "mount"});
+
+    try
+    {
+        measure.insert(rates.read_bytes_per_sec / 1e6,
+                       rates.write_bytes_per_sec / 1e6,
+                       rates.ops_per_sec, rates.retrans_per_sec,
+                       rates.read_rtt_ms, rates.write_rtt_ms,
+                       rates.read_exe_ms, rates.write_exe_ms,
+                       {name(), id(), counters.device, m_nfs_mount});
+    }
+    catch (std::exception const &ex)
+    {
+        utils::slog() << "[SharedStorageAgent] time series reporting error: " << ex.what();
+    }
+}
+
 void SharedStorageAgent::scan_stats(double & w, double & r)
 {
     struct dirent * dp;
@@ -276,6 +390,11 @@ void SharedStorageAgent::scan_stats(double & w, double & r)
     w = r = 0.0;
 
     DIR * dirp = opendir(path.c_str());
+    if (dirp == NULL) {
+        // No scanner has run here (yet).
+        return;
+    }
+
     while ((dp = readdir(dirp)) != NULL)
            if (strstr(dp->d_name, "stat-")) {
                stringstream sf;
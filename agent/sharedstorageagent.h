@@ -3,9 +3,11 @@
 
 #include "utils/utils.h"
 #include "utils/mounts.h"
+#include "utils/mountstats.h"
 #include "utils/json/json.h"
 #include "utils/process.h"
 #include "agent.h"
+#include <memory>
 #include <queue>
 #include <string>
 #include <thread>
@@ -25,6 +27,8 @@ class SharedStorageAgent : public Agent
         virtual void do_init();
         virtual void do_registration();
         virtual Json::Value do_command(std::string const & cmd, Json::Value const & params);
+        virtual CommandClass do_command_class(std::string const & cmd, Json::Value const & params) const;
+        virtual bool do_command_known(std::string const & cmd) const;
 
     private:
         void check_configuration(Json::Value const & conf);
@@ -33,6 +37,8 @@ class SharedStorageAgent : public Agent
         string run_cmd(string cmd);
         int get_usage(string device);
         int get_realtime_bandwidth(string device);
+        void report_nfs_io_stats() const;
+        void record_metrics() const;
         void get_potential_bandwidth(string device, string dir);
         void iozone_thread_function();
         vector<string> split_string(const string& str, const string& delimiter);
@@ -72,7 +78,6 @@ class SharedStorageAgent : public Agent
         }
 
         Json::Value const & m_conf;
-        string m_iozone_exe;
         string m_device;
         vector<string> m_root_dirs;
         string m_iozone_test_dir;
@@ -85,6 +90,11 @@ class SharedStorageAgent : public Agent
         bool iozone_thread_active=false;
         bool active=true;
         vector<std::string> m_data_folders_;
+
+        // RPC rates and latencies of the NFS mount of the data
+        // folders, from /proc/self/mountstats; null if not on NFS.
+        string m_nfs_mount;
+        unique_ptr<utils::NfsStatsSampler> m_nfsstats;
 #if 0
         bool                scan_data_folder_;
 #endif
@@ -1,6 +1,8 @@
 #include "sitestore.h"
 #include "utils/utils.h"
 #include <chrono>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace std;
 using namespace utils;
@@ -10,7 +12,17 @@ SiteStore::SiteStore(Conf const & conf)
 : ms ( conf.get<string>("agent.store.host"),
        conf.get<int>   ("agent.store.port"),
        conf.get<string>("agent.store.db") )
+, block_batch_size_ ( 0 )
 {
+    // read signed, so that a negative size isn't taken for a huge one
+    auto const batch_size = conf.get<int>("agent.store.block_batch_size", 10000);
+
+    if (batch_size <= 0)
+    {
+        throw std::runtime_error("agent.store.block_batch_size must be positive");
+    }
+
+    block_batch_size_ = batch_size;
 }
 
 void SiteStore::reg_local_storage(Json::Value v)
@@ -47,6 +59,70 @@ std::string SiteStore::add_block(Json::Value const &val)
     return ms.insert_one(collection, val);
 }
 
+std::vector<std::string> SiteStore::add_blocks(std::vector<Json::Value> const &vals)
+{
+    const auto collection = "block";
+
+    std::vector<std::string> ids;
+    ids.reserve(vals.size());
+
+    auto   start   = steady_clock::now();
+    size_t batches = 0;
+
+    for (size_t first = 0; first < vals.size(); first += block_batch_size_)
+    {
+        auto last = std::min(first + block_batch_size_, vals.size());
+
+        std::vector<Json::Value> batch(vals.begin() + first,
+                                       vals.begin() + last);
+
+        auto res = ms.insert_many(collection, batch);
+
+        if (res.size() != batch.size())
+        {
+            throw std::runtime_error("SiteStore::add_blocks(): bulk insert of "
+                                     + std::to_string(batch.size())
+                                     + " blocks failed");
+        }
+
+        ids.insert(ids.end(), res.begin(), res.end());
+        batches++;
+    }
+
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start).count();
+
+    utils::slog() << "[Agent/SiteStore] Inserted " << ids.size()
+                  << " blocks in " << batches << " batch(es), "
+                  << elapsed << " ms ("
+                  << (elapsed ? ids.size() * 1000 / elapsed : ids.size())
+                  << " blocks/s)";
+
+    return ids;
+}
+
+void SiteStore::update_block_checksums(std::string const &id,
+                                       Json::Value const &checksums,
+                                       std::string const &state,
+                                       std::string const &error)
+{
+    const auto collection = "block";
+
+    Json::Value update;
+    update["$set"]["checksum.state"] = state;
+
+    if (not error.empty())
+    {
+        update["$set"]["checksum.error"] = error;
+    }
+
+    if (not checksums.empty())
+    {
+        update["$push"]["checksum.checksums"]["$each"] = checksums;
+    }
+
+    ms.update_one_by_id(collection, id, update);
+}
+
 void SiteStore::register_launcher_agent(std::string const & id,
                                         Json::Value const & val)
 {
@@ -4,6 +4,8 @@
 #include "conf.h"
 #include "utils/mongostore.h"
 
+#include <vector>
+
 class SiteStore
 {
 public:
@@ -24,8 +26,25 @@ public:
     // are requested in the DB.
     std::string add_block(Json::Value const &val);
 
+    // Bulk version of the above: blocks are written with ordered
+    // insert_many() calls of up to block_batch_size() documents each,
+    // and the ids are returned in the order of the input.
+    std::vector<std::string> add_blocks(std::vector<Json::Value> const &vals);
+
+    // Record the outcome of deferred checksums of a block: the
+    // checksums are appended to the block's checksum list, and its
+    // checksum state is set to @state@.
+    void update_block_checksums(std::string const &id,
+                                Json::Value const &checksums,
+                                std::string const &state,
+                                std::string const &error = "");
+
+    // Configured with "agent.store.block_batch_size".
+    size_t block_batch_size() const { return block_batch_size_; }
+
 private:
     MongoStore ms;
+    size_t     block_batch_size_;
 };
 
 #endif
@@ -2,6 +2,8 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <chrono>
+#include <vector>
 
 #include <unistd.h>
 #include <getopt.h>
@@ -16,6 +18,7 @@ static const std::string DEFAULT_MQ_CERT    = "cacert.pem";
 static const std::string DEFAULT_MQ_PSK     = "";
 static const std::string DEFAULT_MQ_PSK_ID  = "";
 static const int         DEFAULT_VERBOSE    = 0;
+static const int         DEFAULT_CALLS      = 1;
 
 static const std::string COLOR_RED  = "\033[0;31m";
 static const std::string COLOR_NONE = "\033[0m";
@@ -40,6 +43,8 @@ void print_usage(const char * const progname)
               << "\t(default: " << DEFAULT_MQ_PSK_ID << "'')\n"
               << "\t -v [verbosity]         "
               << "\t(default: " << DEFAULT_VERBOSE << ")\n"
+              << "\t -n [calls in flight]   "
+              << "\t(default: " << DEFAULT_CALLS << ")\n"
               << "Example: rpctest -h yosemite.fnal.gov -p 1883 "
               << "-i easy -k 12345 -q storage ./params.json\n\n";
 }
@@ -54,6 +59,7 @@ int main(int argc, char ** argv)
     std::string mq_psk        = DEFAULT_MQ_PSK;
     std::string mq_psk_id     = DEFAULT_MQ_PSK_ID;
     int         verbose       = DEFAULT_VERBOSE;
+    int         calls         = DEFAULT_CALLS;
     std::string param_file    = "params.json";
 
     bool use_ca  = false;
@@ -61,7 +67,7 @@ int main(int argc, char ** argv)
 
     int c;
 
-    while ((c = getopt (argc, argv, "h:p:c:k:i:q:t:v:?")) != -1)
+    while ((c = getopt (argc, argv, "h:p:c:k:i:q:t:v:n:?")) != -1)
     {
         switch (c)
            {
@@ -92,6 +98,9 @@ int main(int argc, char ** argv)
            case 'v':
                verbose = std::stoi(optarg);
                break;
+           case 'n':
+               calls = std::stoi(optarg);
+               break;
            case '?':
                print_usage(argv[0]);
                exit(1);
@@ -176,6 +185,31 @@ int main(int argc, char ** argv)
 
     client.start();
 
+    // With -n, the same call is sent that many times at once, to see
+    // how many the other end answers per second.
+    if (calls > 1)
+    {
+        std::vector<std::pair<std::string, Json::Value>> batch(calls, {mq_topic_name, params});
+
+        auto start = std::chrono::steady_clock::now();
+        auto rs    = client.call_many(batch, mq_timeout, verbose);
+        auto secs  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        client.stop();
+
+        int timed_out = 0;
+
+        for (auto const & r : rs)
+        {
+            if (r["error"] == "rpc call timed out") timed_out++;
+        }
+
+        std::cout << calls << " calls, " << timed_out << " timed out, in "
+                  << secs << " s (" << (calls - timed_out) / secs << " calls/s)\n";
+
+        return timed_out ? 1 : 0;
+    }
+
     auto r = client.call(mq_topic_name, params, mq_timeout, verbose);
 
     Json::StyledWriter writer;
@@ -191,8 +191,12 @@ void Main::rpc_msg_handler(Json::Value const & msg, RpcProps const & props)
     // response object
     Json::Value res;
 
+    // time from the request to the response
+    auto start = chrono::steady_clock::now();
+
     // response callback
-    auto cb = [this, props](Json::Value const & res) {
+    auto cb = [this, props, cmd, start](Json::Value const & res) {
+        scheduler.record_latency(cmd, chrono::steady_clock::now() - start);
         if (!props.reply_to.empty()) rpcserver.send_response(res, props);
     };
 
@@ -265,6 +269,10 @@ void Main::rpc_msg_handler(Json::Value const & msg, RpcProps const & props)
     {
         res = scheduler.dtn_icmp_ping(params);
     }
+    else if (cmd == "latency_stats")
+    {
+        res = scheduler.latency_stats();
+    }
     /*
     else if (cmd == "mld_status")
     {
@@ -277,10 +285,14 @@ void Main::rpc_msg_handler(Json::Value const & msg, RpcProps const & props)
         res["error"] = "unknown command";
 
         //slog() << "unknow command: " << msg;
+
+        // not timed, so that any name sent does not get a histogram
+        if (!props.reply_to.empty()) rpcserver.send_response(res, props);
+        return;
     }
 
     // send back response only when the "reply_to" field is not empty
-    if (!props.reply_to.empty()) rpcserver.send_response(res, props);
+    cb(res);
 }
 
 
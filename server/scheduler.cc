@@ -49,6 +49,7 @@ Scheduler::Scheduler(Conf const & conf, SiteStore & store, RpcClient & rpc)
 , tsjobs(tsdb, "jobs", {"active_be", "active_rt", "waiting", "error"}, {})
 , tsschedule(tsdb, "schedule", {"scheduled"}, {})
 , ts_site_txrx(tsdb, "site_txrx", {"tx_bytes", "rx_bytes"}, {"id"})
+, ts_latency(tsdb, "command_latency", {"count", "p50_us", "p90_us", "p99_us", "max_us"}, {"id", "command"})
 , site_txrx()
 , work_threads(8)
 , exceptions()
@@ -126,6 +127,7 @@ void Scheduler::run()
     // schedule event
     add_event(std::bind(&Scheduler::schedule, this), chrono::milliseconds(4000));
     add_event(std::bind(&Scheduler::poll_rate, this), chrono::milliseconds(5000));
+    add_event(std::bind(&Scheduler::export_latencies, this), chrono::milliseconds(60000));
 
     // start the service
     for (auto & t : work_threads)
@@ -1618,6 +1620,46 @@ Json::Value Scheduler::network_handling(
 }
 
 
+void Scheduler::record_latency(std::string const & cmd, std::chrono::steady_clock::duration d)
+{
+    auto us = chrono::duration_cast<chrono::microseconds>(d).count();
+    latencies.get(cmd).record(us);
+}
+
+Json::Value Scheduler::latency_stats() const
+{
+    Json::Value res;
+
+    res["code"] = 0;
+    res["commands"] = Json::objectValue;
+
+    for (auto const & h : latencies.snapshot())
+        res["commands"][h.first] = h.second.summary();
+
+    return res;
+}
+
+// tagged with the id "scheduler", next to the agents' own commands
+std::chrono::milliseconds Scheduler::export_latencies()
+{
+    auto now = latencies.snapshot();
+
+    for (auto const & h : now)
+    {
+        auto const d = h.second - latencies_exported[h.first];
+
+        if (d.count() == 0)
+            continue;
+
+        ts_latency.insert(d.count(), d.percentile(50), d.percentile(90), d.percentile(99), d.max(),
+                          {"scheduler", h.first});
+    }
+
+    latencies_exported.swap(now);
+
+    return chrono::milliseconds(60000);
+}
+
 std::chrono::milliseconds Scheduler::poll_rate()
 {
     // number of waiting jobs and error jobs
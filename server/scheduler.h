@@ -19,6 +19,7 @@
 #include "utils/portal.h"
 #include "utils/rpcclient.h"
 #include "utils/tsdb.h"
+#include "utils/histogram.h"
 
 #include <chrono>
 #include <asio.hpp>
@@ -106,6 +107,16 @@ public:
 
     void mld_status(std::string const & task, Json::Value const & params);
 
+    // latency of the RPC commands the server answers, from the
+    // request to the response
+    void record_latency(std::string const & cmd, std::chrono::steady_clock::duration d);
+
+    // count, mean and percentiles of each command since start
+    Json::Value latency_stats() const;
+
+    // percentiles since the last export, into the time series database
+    std::chrono::milliseconds export_latencies();
+
 private:
 
     void bootstrap_transfer_job(
@@ -230,6 +241,11 @@ private:
     utils::TimeSeriesMeasurement<0, int, int, int, int> tsjobs;
     utils::TimeSeriesMeasurement<0, int> tsschedule;
     utils::TimeSeriesMeasurement<1, int64_t, int64_t> ts_site_txrx;
+    utils::TimeSeriesMeasurement<2, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t> ts_latency;
+
+    // latency of each RPC command, and as last exported
+    utils::LatencyHistograms latencies;
+    std::map<std::string, utils::HistogramSnapshot> latencies_exported;
 
     std::map<std::string, std::pair<int64_t, int64_t>> site_txrx;
 
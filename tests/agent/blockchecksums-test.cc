@@ -0,0 +1,316 @@
+//
+// Deferred checksums of expand_and_group_v2 blocks, as DTN Agent
+// queues them, with the block records in the DB replaced by a list of
+// what the sink got.
+//
+
+#include <map>
+#include <mutex>
+#include <future>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <agent/blockchecksums.h>
+
+#include "utils/checksum.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using namespace std::chrono;
+
+struct Record
+{
+    std::string block_id;
+    Json::Value checksums;
+    std::string state;
+    std::string error;
+};
+
+class Sink
+{
+public:
+    void operator()(std::string const &block_id,
+                    Json::Value const &checksums,
+                    std::string const &state,
+                    std::string const &error) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        records_.push_back({block_id, checksums, state, error});
+    }
+
+    std::vector<Record> records() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return records_;
+    }
+
+private:
+    std::mutex          mtx_;
+    std::vector<Record> records_;
+};
+
+// A folder under /tmp, removed when done with.
+class TempDir
+{
+public:
+    TempDir() {
+        char root[] = "/tmp/blockchecksums-XXXXXX";
+        REQUIRE(mkdtemp(root) != nullptr);
+        root_ = root;
+    }
+
+    ~TempDir() {
+        system(("rm -rf " + root_).c_str());
+    }
+
+    std::string const & root() const { return root_; }
+
+    std::string mkdir(std::string const &name) const {
+        auto const dir = root_ + "/" + name;
+        REQUIRE(::mkdir(dir.c_str(), 0700) == 0);
+        return dir;
+    }
+
+    std::string file(std::string const &name, size_t size) const {
+        auto const path = root_ + "/" + name;
+        std::ofstream(path) << std::string(size, name.back());
+        return path;
+    }
+
+private:
+    std::string root_;
+};
+
+static BlockChecksums::entries_t entries(std::vector<std::string> const &paths)
+{
+    BlockChecksums::entries_t e;
+
+    for (auto const &p : paths)
+    {
+        e.emplace_back(utils::Path(p), "/dst" + p);
+    }
+
+    return e;
+}
+
+static Json::Value ids(std::vector<std::string> const &blocks)
+{
+    Json::Value v(Json::arrayValue);
+
+    for (auto const &b : blocks)
+    {
+        v.append(b);
+    }
+
+    return v;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("order", "blocks are checksummed in the order they were queued")
+{
+    TempDir tmp;
+    Sink    sink;
+
+    BlockChecksums checksums(std::ref(sink));
+
+    std::vector<std::string> blocks;
+
+    for (int i = 0; i < 20; i++)
+    {
+        auto const id = "b" + std::to_string(i);
+        auto const f  = tmp.file("f" + std::to_string(i), 1000 * (20 - i));
+
+        checksums.queue(id, entries({f}), {}, EVP_sha1(), 4);
+        blocks.push_back(id);
+    }
+
+    auto const state = checksums.state(ids(blocks), seconds(10));
+
+    REQUIRE(state["done"] == true);
+
+    auto const records = sink.records();
+    REQUIRE(records.size() == blocks.size());
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        auto const f = tmp.root() + "/f" + std::to_string(i);
+
+        REQUIRE(records[i].block_id == blocks[i]);
+        REQUIRE(records[i].state == "done");
+        REQUIRE(records[i].checksums.size() == 1);
+        REQUIRE(records[i].checksums[0][0] == "/dst" + f);
+        REQUIRE(records[i].checksums[0][1] == utils::checksum(f, EVP_sha1()));
+
+        REQUIRE(state["blocks"][blocks[i]]["state"] == "done");
+    }
+}
+
+TEST_CASE("states", "pending until the sink has it, then done or error")
+{
+    TempDir tmp;
+    Sink    sink;
+
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    // The first block holds up the thread until released.
+    BlockChecksums checksums([&](std::string const &block_id,
+                                 Json::Value const &sums,
+                                 std::string const &state,
+                                 std::string const &error) {
+            released.wait();
+            sink(block_id, sums, state, error);
+        });
+
+    auto const f = tmp.file("f", 1000);
+
+    checksums.queue("held", entries({f}), {}, EVP_sha1(), 1);
+    checksums.queue("missing", entries({tmp.root() + "/none"}), {}, EVP_sha1(), 1);
+    checksums.queue("empty", {}, {}, EVP_sha1(), 1);
+
+    auto state = checksums.state(ids({"held", "missing", "empty", "other"}), seconds(0));
+
+    REQUIRE(state["done"] == false);
+    REQUIRE(state["blocks"]["held"]["state"] == "pending");
+    REQUIRE(state["blocks"]["missing"]["state"] == "pending");
+
+    // Nothing to checksum: done at once.
+    REQUIRE(state["blocks"]["empty"]["state"] == "done");
+    REQUIRE(state["blocks"]["other"]["state"] == "unknown");
+
+    REQUIRE(checksums.state(ids({"empty"}), seconds(0))["done"] == true);
+
+    release.set_value();
+
+    state = checksums.state(ids({"held", "missing", "empty"}), seconds(10));
+
+    REQUIRE(state["done"] == true);
+    REQUIRE(state["blocks"]["held"]["state"] == "done");
+    REQUIRE(state["blocks"]["missing"]["state"] == "error");
+    REQUIRE_FALSE(state["blocks"]["missing"]["error"].asString().empty());
+
+    // The sink hears of errors, but not of empty blocks.
+    auto const records = sink.records();
+
+    REQUIRE(records.size() == 2);
+    REQUIRE(records[1].block_id == "missing");
+    REQUIRE(records[1].state == "error");
+    REQUIRE(records[1].checksums.empty());
+}
+
+TEST_CASE("sink errors", "a block whose results can't be kept is in error")
+{
+    TempDir tmp;
+
+    BlockChecksums checksums([](std::string const &, Json::Value const &,
+                                std::string const &, std::string const &) {
+            throw std::runtime_error("no DB");
+        });
+
+    checksums.queue("b", entries({tmp.file("f", 10)}), {}, EVP_sha1(), 1);
+
+    auto const state = checksums.state(ids({"b"}), seconds(10));
+
+    REQUIRE(state["blocks"]["b"]["state"] == "error");
+    REQUIRE(state["blocks"]["b"]["error"] == "could not update block record: no DB");
+}
+
+TEST_CASE("wait", "waits are cut short")
+{
+    TempDir tmp;
+
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    BlockChecksums checksums([&](std::string const &, Json::Value const &,
+                                 std::string const &, std::string const &) {
+            released.wait();
+        }, seconds(1));
+
+    checksums.queue("b", entries({tmp.file("f", 10)}), {}, EVP_sha1(), 1);
+
+    auto const start = steady_clock::now();
+    auto const state = checksums.state(ids({"b"}), seconds(60));
+    auto const took  = steady_clock::now() - start;
+
+    REQUIRE(state["done"] == false);
+    REQUIRE(state["blocks"]["b"]["state"] == "pending");
+    REQUIRE(took >= seconds(1));
+    REQUIRE(took < seconds(10));
+
+    release.set_value();
+}
+
+TEST_CASE("directories", "checksums of checksums reuse the file checksums")
+{
+    TempDir tmp;
+    Sink    sink;
+
+    BlockChecksums checksums(std::ref(sink));
+
+    auto const d = tmp.mkdir("d");
+    auto const e = tmp.mkdir("d/e");
+
+    std::vector<std::string> first, second, third;
+    size_t                   total = 0;
+
+    for (int i = 0; i < 10; i++)
+    {
+        auto const size = 100000 + i;
+        (i < 5 ? first : second).push_back(tmp.file("d/f" + std::to_string(i), size));
+        total += size;
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        auto const size = 200000 + i;
+        third.push_back(tmp.file("d/e/g" + std::to_string(i), size));
+        total += size;
+    }
+
+    // As expand_and_group_v2 hands them out: the folders, and files
+    // under them, some in later blocks.
+    auto cache = std::make_shared<BlockChecksums::cache_t>();
+    auto const before = utils::checksum_bytes_read();
+
+    checksums.queue("b1", entries(first), entries({d}), EVP_sha1(), 4, cache);
+    checksums.queue("b2", entries(second), entries({e}), EVP_sha1(), 4, cache);
+    checksums.queue("b3", entries(third), {}, EVP_sha1(), 4, cache);
+
+    REQUIRE(checksums.state(ids({"b1", "b2", "b3"}), seconds(10))["done"] == true);
+
+    // Every file read once.
+    REQUIRE(utils::checksum_bytes_read() - before == total);
+
+    auto const records = sink.records();
+    REQUIRE(records.size() == 3);
+
+    // Directories first, then files.
+    REQUIRE(records[0].checksums.size() == 1 + first.size());
+    REQUIRE(records[0].checksums[0][0] == "/dst" + d);
+    REQUIRE(records[0].checksums[0][1] ==
+            utils::dir_checksum_of_checksums(utils::Path(d), EVP_sha1(), false));
+
+    REQUIRE(records[1].checksums.size() == 1 + second.size());
+    REQUIRE(records[1].checksums[0][0] == "/dst" + e);
+    REQUIRE(records[1].checksums[0][1] ==
+            utils::dir_checksum_of_checksums(utils::Path(e), EVP_sha1(), false));
+
+    for (size_t i = 0; i < third.size(); i++)
+    {
+        REQUIRE(records[2].checksums[int(i)][0] == "/dst" + third[i]);
+        REQUIRE(records[2].checksums[int(i)][1] == utils::checksum(third[i], EVP_sha1()));
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,145 @@
+//
+// dtn_expand_and_group_v2 with a streamed response, as AgentManager
+// runs it: the groups come in partial responses, each numbered, then
+// a trailer with the totals, then the end of the stream.
+//
+
+#include <set>
+#include <vector>
+#include <fstream>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+// make sa_family_t available with old glibc
+#include <sys/socket.h>
+
+#include <agent/dtnagent.h>
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Copied over to the build directory; it has /tmp as a data folder.
+static char const * const config_file = "dtnagent.sample.conf";
+
+class StreamingAgent : public DTNAgent
+{
+public:
+    StreamingAgent(Json::Value const & conf) : DTNAgent(conf) { }
+
+    using DTNAgent::do_stream_command;
+};
+
+struct Expanded
+{
+    std::vector<Json::Value> messages;      // partials and the trailer.
+    Json::Value              response;
+    std::set<std::string>    files;
+    size_t                   group_count = 0;
+};
+
+static void add_groups(Expanded & e, Json::Value const & groups)
+{
+    for (auto const & g : groups)
+    {
+        for (auto const & f : g["files"])
+        {
+            if (f[2].asUInt64() == 1000)
+                e.files.insert(f[0].asString());
+        }
+
+        e.group_count++;
+    }
+}
+
+static Expanded expand(StreamingAgent & agent, Json::Value const & params)
+{
+    Expanded e;
+
+    RpcResponseStream stream([&e](Json::Value const & v) { e.messages.push_back(v); });
+
+    e.response = stream.finish(agent.do_stream_command("dtn_expand_and_group_v2", params, stream));
+
+    for (auto const & m : e.messages)
+        add_groups(e, m["files"]["groups"]);
+
+    add_groups(e, e.response["files"]["groups"]);
+
+    return e;
+}
+
+TEST_CASE("chunks", "groups are streamed in order, and add up to the whole")
+{
+    Conf conf(config_file);
+    StreamingAgent agent(conf["modules"]["m1"]);
+
+    char root[] = "/tmp/dtnagent-stream-XXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+
+    std::set<std::string> files;
+
+    for (int d = 0; d < 4; d++)
+    {
+        auto const dir = std::string(root) + "/d" + std::to_string(d);
+        REQUIRE(mkdir(dir.c_str(), 0700) == 0);
+
+        for (int f = 0; f < 50; f++)
+        {
+            auto const name = dir + "/f" + std::to_string(f);
+            std::ofstream(name) << std::string(1000, 'x');
+            files.insert(name);
+        }
+    }
+
+    Json::Value params;
+    params["src_path"]   = root;
+    params["dst_path"]   = "/dst";
+    params["group_size"] = 10000;
+
+    auto const whole = expand(agent, params);
+
+    REQUIRE(whole.response["code"] == 0);
+    REQUIRE(whole.messages.empty());
+    REQUIRE_FALSE(whole.response.isMember("stream"));
+    REQUIRE(whole.files == files);
+
+    params["stream"]["enable"]     = true;
+    params["stream"]["chunk_size"] = 1024;
+
+    auto const streamed = expand(agent, params);
+
+    REQUIRE(streamed.response["code"] == 0);
+    REQUIRE(streamed.messages.size() > 2);
+
+    for (size_t i = 0; i < streamed.messages.size(); i++)
+    {
+        auto const & m = streamed.messages[i];
+
+        REQUIRE(m["seq"].asUInt64() == i);
+        REQUIRE(m["stream"] == (i + 1 < streamed.messages.size() ? "partial" : "trailer"));
+    }
+
+    auto const & trailer = streamed.messages.back();
+
+    REQUIRE(streamed.response["stream"] == "end");
+    REQUIRE(streamed.response["seq"].asUInt64() == streamed.messages.size());
+    REQUIRE(streamed.response["chunks"].asUInt64() == streamed.messages.size() - 1);
+
+    REQUIRE(streamed.files == files);
+    REQUIRE(streamed.group_count == trailer["group_count"].asUInt64());
+    REQUIRE(trailer["total_size"] == whole.response["total_size"]);
+
+    // Without a stream to send them on, streaming is refused.
+    RpcResponseStream none;
+    REQUIRE(agent.do_stream_command("dtn_expand_and_group_v2", params, none)["code"] != 0);
+
+    REQUIRE(system(("rm -rf " + std::string(root)).c_str()) == 0);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,85 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils/checksum.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Make a few files of different sizes under a temporary directory.
+static std::vector<utils::Path> make_files(std::string const &dir,
+                                           size_t             count)
+{
+    std::vector<utils::Path> files;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto name = dir + "/file-" + std::to_string(i);
+
+        std::ofstream out(name, std::ios::binary);
+        out << std::string((i * 7919) % 65536 + 1, 'a' + (i % 26));
+        out.close();
+
+        files.emplace_back(utils::Path(name));
+    }
+
+    return files;
+}
+
+static void remove_files(std::string const              &dir,
+                         std::vector<utils::Path> const &files)
+{
+    for (auto const &f : files)
+    {
+        unlink(f.name().c_str());
+    }
+
+    rmdir(dir.c_str());
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("checksum_files", "parallel checksums match serial ones")
+{
+    char tmpl[] = "/tmp/checksum-files-test-XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+
+    std::string dir(tmpl);
+    auto        files = make_files(dir, 37);
+
+    for (size_t threads : {1, 4, 64})
+    {
+        auto sums = utils::checksum_files(files, EVP_sha1(), threads);
+
+        REQUIRE(sums.size() == files.size());
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            REQUIRE(sums[i] == utils::checksum_file(files[i].name(), EVP_sha1()));
+        }
+    }
+
+    REQUIRE(utils::checksum_files({}, EVP_sha1(), 4).empty());
+
+    remove_files(dir, files);
+}
+
+TEST_CASE("checksum_files_error", "errors are passed on to the caller")
+{
+    std::vector<utils::Path> files{utils::Path("/nonexistent/checksum-files-test")};
+
+    REQUIRE_THROWS(utils::checksum_files(files, EVP_sha1(), 4));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
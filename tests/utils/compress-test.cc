@@ -0,0 +1,83 @@
+#include <string>
+
+#include "utils/compress.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// A file list, as expand responses have them.
+static std::string file_list(int files)
+{
+    std::string s;
+
+    for (int i = 0; i < files; i++)
+    {
+        s += "{\"name\":\"/data/run" + std::to_string(i / 100) + "/file_" + std::to_string(i)
+           + ".dat\",\"size\":" + std::to_string(1000003ull * i) + "},";
+    }
+
+    return s;
+}
+
+TEST_CASE("round trip", "what goes in comes out")
+{
+    for (auto const &s : { std::string(), std::string("a"), std::string("a\0b", 3),
+                           std::string(100000, 'x'), file_list(20000) })
+    {
+        auto const z = utils::zlib_compress(s.data(), s.size());
+
+        std::string out;
+        REQUIRE(utils::zlib_decompress(z.data(), z.size(), out));
+        REQUIRE(out == s);
+    }
+}
+
+TEST_CASE("gzip", "the same deflate, with a gzip header")
+{
+    auto const s = file_list(1000);
+    auto const z = utils::gzip_compress(s.data(), s.size());
+
+    REQUIRE(z.compare(0, 2, "\x1f\x8b") == 0);
+    REQUIRE(z.size() < s.size() / 5);
+
+    // Not a zlib stream.
+    std::string out;
+    REQUIRE_FALSE(utils::zlib_decompress(z.data(), z.size(), out));
+}
+
+TEST_CASE("ratio", "file lists shrink by 5x at least, at the fastest level")
+{
+    auto const s = file_list(20000);
+    auto const z = utils::zlib_compress(s.data(), s.size(), 1);
+
+    REQUIRE(z.size() * 5 < s.size());
+}
+
+TEST_CASE("malformed", "truncated, trailing or oversized data is refused")
+{
+    auto const s = file_list(1000);
+    auto const z = utils::zlib_compress(s.data(), s.size());
+
+    std::string out;
+
+    for (size_t n = 0; n < z.size(); n += 13)
+        REQUIRE_FALSE(utils::zlib_decompress(z.data(), n, out));
+
+    auto const trailing = z + "x";
+    REQUIRE_FALSE(utils::zlib_decompress(trailing.data(), trailing.size(), out));
+
+    REQUIRE_FALSE(utils::zlib_decompress(s.data(), s.size(), out));
+
+    // Over the limit, and right at it.
+    REQUIRE_FALSE(utils::zlib_decompress(z.data(), z.size(), out, s.size() - 1));
+    REQUIRE(utils::zlib_decompress(z.data(), z.size(), out, s.size()));
+    REQUIRE(out == s);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,153 @@
+#include <fstream>
+#include <thread>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "utils/diskstats.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// From a 5.x kernel, with discard and flush counters at the end, and
+// from an old one without them.
+static const char *diskstats_text =
+    "   8       0 sda 21044 6226 1577618 11388 93871 71361 6107656 85520 0 91284 103888 0 0 0 0 1523 6980\n"
+    "   8       1 sda1 20857 6226 1571714 11322 93862 71361 6107656 85517 0 91204 96840 0 0 0 0 0 0\n"
+    " 253       0 dm-0 100 0 800 10 200 0 1600 40 2 300 50\n"
+    "garbage line\n";
+
+TEST_CASE("parse diskstats", "counters of /proc/diskstats")
+{
+    auto const all = utils::parse_diskstats(diskstats_text);
+
+    REQUIRE(all.size() == 3);
+
+    auto const &sda = all.at("sda");
+    REQUIRE(sda.name == "sda");
+    REQUIRE(sda.read_ios == 21044);
+    REQUIRE(sda.read_sectors == 1577618);
+    REQUIRE(sda.write_ios == 93871);
+    REQUIRE(sda.write_sectors == 6107656);
+    REQUIRE(sda.io_ticks == 91284);
+    REQUIRE(sda.time_in_queue == 103888);
+
+    auto const &dm = all.at("dm-0");
+    REQUIRE(dm.in_flight == 2);
+    REQUIRE(dm.time_in_queue == 50);
+}
+
+TEST_CASE("parse block stat", "counters of /sys/block/<dev>/stat")
+{
+    utils::DiskCounters c;
+
+    REQUIRE(utils::parse_block_stat("    1 2 3 4 5 6 7 8 9 10 11 12 13 14 15\n", c));
+    REQUIRE(c.read_ios == 1);
+    REQUIRE(c.write_sectors == 7);
+    REQUIRE(c.time_in_queue == 11);
+
+    REQUIRE_FALSE(utils::parse_block_stat("1 2 3", c));
+}
+
+TEST_CASE("rates", "deltas between two readings")
+{
+    utils::DiskCounters a, b;
+
+    b.read_ios      = 200;
+    b.read_sectors  = 2 * 1000 * 1000;      // 1.024 GB
+    b.read_ticks    = 400;
+    b.write_ios     = 100;
+    b.write_sectors = 1000 * 1000;
+    b.write_ticks   = 1000;
+    b.in_flight     = 3;
+    b.io_ticks      = 1500;
+    b.time_in_queue = 4000;
+
+    auto const r = utils::disk_rates(a, b, 2.0);
+
+    REQUIRE(r.read_mbps == Approx(512.0));
+    REQUIRE(r.write_mbps == Approx(256.0));
+    REQUIRE(r.read_iops == Approx(100.0));
+    REQUIRE(r.write_iops == Approx(50.0));
+    REQUIRE(r.read_await == Approx(2.0));
+    REQUIRE(r.write_await == Approx(10.0));
+    REQUIRE(r.queue_depth == Approx(2.0));
+    REQUIRE(r.utilization == Approx(75.0));
+    REQUIRE(r.in_flight == Approx(3.0));
+
+    // Counters going backwards don't make negative rates.
+    auto const back = utils::disk_rates(b, a, 1.0);
+
+    REQUIRE(back.read_mbps == 0);
+    REQUIRE(back.write_iops == 0);
+    REQUIRE(back.utilization == 0);
+}
+
+TEST_CASE("kernel names", "device paths to kernel names")
+{
+    REQUIRE(utils::disk_kernel_name("server:/export") == "");
+    REQUIRE(utils::disk_kernel_name("/etc/passwd") == "");
+    REQUIRE(utils::disk_kernel_name("/dev/no-such-disk") == "");
+}
+
+TEST_CASE("sampler", "sampling a fixture diskstats file")
+{
+    char tmpl[] = "/tmp/diskstats-test-XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+
+    std::string const dir  = tmpl;
+    std::string const path = dir + "/diskstats";
+
+    std::ofstream(path) << "   8 0 sda 0 0 0 0 0 0 0 0 0 0 0\n";
+
+    utils::DiskStatsSampler sampler({"sda", "server:/export"}, 1000, path,
+                                    dir + "/sys");
+
+    REQUIRE(sampler.devices() == std::vector<std::string>{"sda"});
+
+    utils::DiskRates rates;
+    REQUIRE_FALSE(sampler.rates("sda", rates));
+
+    sampler.sample();
+    REQUIRE_FALSE(sampler.rates("sda", rates));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 1 MB read in ~0.1s.
+    std::ofstream(path) << "   8 0 sda 10 0 1953 0 0 0 0 0 0 0 0\n";
+    sampler.sample();
+
+    REQUIRE(sampler.rates("sda", rates));
+    REQUIRE(rates.read_mbps > 2);
+    REQUIRE(rates.read_mbps < 11);
+    REQUIRE(rates.write_mbps == 0);
+
+    utils::DiskCounters counters;
+    REQUIRE(sampler.counters("sda", counters));
+    REQUIRE(counters.read_ios == 10);
+
+    REQUIRE_FALSE(sampler.rates("sdb", rates));
+
+    // Falls back to sysfs when there is no diskstats.
+    unlink(path.c_str());
+    REQUIRE(system(("mkdir -p " + dir + "/sys/class/block/sda").c_str()) == 0);
+    std::ofstream(dir + "/sys/class/block/sda/stat") << "20 0 1953 0 0 0 0 0 0 0 0\n";
+
+    sampler.sample();
+    REQUIRE(sampler.counters("sda", counters));
+    REQUIRE(counters.read_ios == 20);
+
+    // And the thread samples on its own.
+    sampler.start();
+    sampler.stop();
+
+    REQUIRE(system(("rm -rf " + dir).c_str()) == 0);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
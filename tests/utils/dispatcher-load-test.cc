@@ -0,0 +1,168 @@
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "json/json.h"
+#include "utils/dispatcher.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Small RPC responses coming in steadily, with a few multi-MB expand
+// responses among them, as the server's RPC client sees them.  Each
+// message is parsed as Mqtt does; latency is from when a message is
+// due to come in to when it has been parsed and handled.
+
+using namespace std::chrono;
+
+using clock_type = steady_clock;
+
+static size_t const small_count = 4000;
+static size_t const large_every = 1000;
+static auto const   interval    = microseconds(100);
+
+static std::string small_message(size_t i)
+{
+    return "{\"body\":{\"code\":0},\"corr_id\":\"c-" + std::to_string(i) + "\"}";
+}
+
+static std::string large_message(size_t i)
+{
+    Json::Value v;
+
+    for (int f = 0; f < 40000; f++)
+    {
+        Json::Value file;
+        file["name"] = "/data/run" + std::to_string(f / 100) + "/file_" + std::to_string(f) + ".dat";
+        file["size"] = Json::UInt64(1000003) * f;
+
+        v["body"]["files"].append(file);
+    }
+
+    v["corr_id"] = "large-" + std::to_string(i);
+
+    return Json::FastWriter().write(v);
+}
+
+static double percentile(std::vector<double> const &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+struct Run
+{
+    double rate;            // messages a second.
+    double p50, p99, max;   // of the small ones, in ms.
+};
+
+// @workers@ of 0 parses on the posting thread, as Mqtt used to.
+static Run run(size_t workers, std::vector<std::string> const &messages)
+{
+    std::vector<clock_type::time_point> due(messages.size());
+    std::vector<double>                 latency(messages.size(), -1);
+    std::atomic<int>                    failed{0};
+
+    // Small ones are "c-<index of the message>".
+    auto handle = [&](char const *data, size_t len) {
+        Json::Value msg;
+
+        if (not Json::Reader().parse(data, data + len, msg))
+            failed++;
+
+        auto const corr_id = msg["corr_id"].asString();
+
+        if (corr_id.compare(0, 2, "c-") == 0)
+        {
+            auto const i = std::stoul(corr_id.substr(2));
+            latency[i] = duration<double, std::milli>(clock_type::now() - due[i]).count();
+        }
+    };
+
+    std::unique_ptr<utils::MessageDispatcher> dispatcher;
+
+    if (workers > 0)
+    {
+        dispatcher.reset(new utils::MessageDispatcher(workers, [&](std::string const &, char const *data, size_t len) {
+                handle(data, len);
+            }));
+    }
+
+    auto const start = clock_type::now();
+
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        due[i] = start + interval * i;
+
+        std::this_thread::sleep_until(due[i]);
+
+        if (dispatcher)
+            dispatcher->post("rpc-res/x", messages[i].data(), messages[i].size());
+        else
+            handle(messages[i].data(), messages[i].size());
+    }
+
+    if (dispatcher)
+        dispatcher->stop();
+
+    auto const elapsed = duration<double>(clock_type::now() - start).count();
+
+    REQUIRE(failed == 0);
+
+    std::vector<double> small;
+
+    for (auto l : latency)
+    {
+        if (l >= 0)
+            small.push_back(l);
+    }
+
+    REQUIRE(small.size() == small_count);
+
+    std::sort(small.begin(), small.end());
+
+    return Run{ messages.size() / elapsed, percentile(small, 0.50), percentile(small, 0.99), small.back() };
+}
+
+TEST_CASE("mixed sizes", "[.benchmark] small messages are not held up behind large ones")
+{
+    std::vector<std::string> messages;
+    size_t                   large_bytes = 0;
+
+    for (size_t i = 0; i < small_count; i++)
+    {
+        if (i > 0 and i % large_every == 0)
+        {
+            messages.push_back(large_message(i));
+            large_bytes = messages.back().size();
+        }
+
+        messages.push_back(small_message(messages.size()));
+    }
+
+    std::cout << messages.size() << " messages, one in " << large_every << " of "
+              << large_bytes / 1000 << " KB, every " << interval.count() << " us\n";
+
+    for (size_t workers : { 0, 1, 4 })
+    {
+        auto const r = run(workers, messages);
+
+        std::cout << (workers == 0 ? std::string("network thread") : std::to_string(workers) + " workers")
+                  << ": " << std::lround(r.rate) << " msgs/s, "
+                  << "p50 " << r.p50 << " ms, "
+                  << "p99 " << r.p99 << " ms, "
+                  << "max " << r.max << " ms\n";
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
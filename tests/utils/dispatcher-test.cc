@@ -0,0 +1,203 @@
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "utils/mpscqueue.h"
+#include "utils/dispatcher.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using namespace std::chrono;
+
+static std::string message(std::string const &corr_id, int seq)
+{
+    return "{\"body\":{\"seq\":" + std::to_string(seq) + "},\"corr_id\":\"" + corr_id + "\"}";
+}
+
+static int seq_of(char const *data, size_t len)
+{
+    std::string const s(data, len);
+    return std::stoi(s.substr(s.find(':', 8) + 1));
+}
+
+TEST_CASE("queue", "many producers, one consumer, nothing lost or reordered")
+{
+    utils::MpscQueue<std::pair<int, int>> queue;
+
+    int const producers = 4;
+    int const each      = 100000;
+
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; p++)
+    {
+        threads.emplace_back([&queue, p]() {
+                for (int i = 0; i < each; i++)
+                    queue.push(std::make_pair(p, i));
+            });
+    }
+
+    std::vector<int>    next(producers, 0);
+    int                 popped = 0;
+    std::pair<int, int> v;
+
+    while (popped < producers * each)
+    {
+        if (not queue.pop(v))
+            continue;
+
+        REQUIRE(v.second == next[v.first]);
+        next[v.first]++;
+        popped++;
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    REQUIRE(queue.empty());
+    REQUIRE_FALSE(queue.pop(v));
+}
+
+TEST_CASE("order", "messages of the same call are handled in order, calls in parallel")
+{
+    std::mutex                              mutex;
+    std::map<std::string, std::vector<int>> seen;
+    std::map<std::string, std::thread::id>  threads;
+
+    utils::MessageDispatcher dispatcher(4, [&](std::string const &topic, char const *data, size_t len) {
+            std::string const s(data, len);
+            auto const corr_id = s.substr(s.find("corr_id") + 10, 4);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            seen[corr_id].push_back(seq_of(data, len));
+            threads[corr_id] = std::this_thread::get_id();
+        });
+
+    REQUIRE(dispatcher.workers() == 4);
+
+    for (int seq = 0; seq < 1000; seq++)
+    {
+        for (int call = 0; call < 16; call++)
+        {
+            auto const m = message("c-" + std::to_string(call / 10) + std::to_string(call % 10), seq);
+            dispatcher.post("rpc-res/x", m.data(), m.size());
+        }
+    }
+
+    dispatcher.stop();
+
+    REQUIRE(dispatcher.queued() == 0);
+    REQUIRE(seen.size() == 16);
+
+    for (auto const &s : seen)
+    {
+        REQUIRE(s.second.size() == 1000);
+
+        for (int seq = 0; seq < 1000; seq++)
+            REQUIRE(s.second[seq] == seq);
+    }
+
+    // Spread over more than one worker.
+    std::map<std::thread::id, int> used;
+
+    for (auto const &t : threads)
+        used[t.second]++;
+
+    REQUIRE(used.size() > 1);
+}
+
+TEST_CASE("slow", "a large message being handled holds up its own call only")
+{
+    std::atomic<int>  handled{0};
+    std::atomic<bool> release{false};
+
+    utils::MessageDispatcher dispatcher(4, [&](std::string const &topic, char const *data, size_t len) {
+            if (topic == "slow")
+            {
+                while (not release)
+                    std::this_thread::sleep_for(milliseconds(1));
+            }
+
+            handled++;
+        });
+
+    // No corr_id: routed by topic.
+    std::string const large = "[\"" + std::string(1 << 20, 'x') + "\"]";
+    dispatcher.post("slow", large.data(), large.size());
+
+    int const fast = 200;
+
+    for (int i = 0; i < fast; i++)
+    {
+        auto const m = message("f-" + std::to_string(i), i);
+        dispatcher.post("fast", m.data(), m.size());
+    }
+
+    auto const until = steady_clock::now() + seconds(5);
+
+    while (handled < fast and steady_clock::now() < until)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    REQUIRE(handled == fast);
+    REQUIRE(dispatcher.queued() == 1);
+
+    // More of the slow topic wait for it.
+    dispatcher.post("slow", "[]", 2);
+
+    std::this_thread::sleep_for(milliseconds(20));
+    REQUIRE(handled == fast);
+
+    release = true;
+    dispatcher.stop();
+
+    REQUIRE(handled == fast + 2);
+}
+
+TEST_CASE("stop", "messages posted are handled before stopping, later ones dropped")
+{
+    std::atomic<int> handled{0};
+
+    {
+        utils::MessageDispatcher dispatcher(1, [&](std::string const &, char const *, size_t) {
+                std::this_thread::sleep_for(microseconds(100));
+                handled++;
+            });
+
+        for (int i = 0; i < 100; i++)
+            dispatcher.post("t", "{}", 2);
+
+        dispatcher.stop();
+        REQUIRE(handled == 100);
+
+        dispatcher.post("t", "{}", 2);
+    }
+
+    REQUIRE(handled == 100);
+
+    // Handlers that throw don't take the worker down.
+    {
+        utils::MessageDispatcher dispatcher(1, [&](std::string const &, char const *data, size_t) {
+                if (data[0] == 'x')
+                    throw std::runtime_error("bad message");
+                handled++;
+            });
+
+        dispatcher.post("t", "x", 1);
+        dispatcher.post("t", "{}", 2);
+    }
+
+    REQUIRE(handled == 101);
+    REQUIRE_THROWS(utils::MessageDispatcher(0, [](std::string const &, char const *, size_t) { }));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,145 @@
+#include <string>
+
+#include "utils/msgpack.h"
+#include "utils/envelope.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+static bool peek(std::string const &msg, char const *key, std::string &value)
+{
+    char const *v   = nullptr;
+    size_t      len = 0;
+
+    if (not utils::envelope_peek(msg.data(), msg.size(), key, v, len))
+        return false;
+
+    value.assign(v, len);
+    return true;
+}
+
+// A response, as RpcServer sends it: the body comes first.
+static Json::Value response(int files)
+{
+    Json::Value v;
+
+    v["corr_id"]  = "4f1c-77";
+    v["reply_to"] = "rpc-res/x";
+    v["body"]["code"] = 0;
+
+    for (int i = 0; i < files; i++)
+    {
+        Json::Value f;
+        f["name"] = "/data/\"q\" {[file_" + std::to_string(i) + "]},";
+        f["size"] = i * 1.5;
+        f["ok"]   = i % 2 == 0;
+        f["none"] = Json::Value();
+
+        v["body"]["files"].append(f);
+    }
+
+    return v;
+}
+
+TEST_CASE("json", "members are found past the ones before them")
+{
+    std::string value;
+
+    auto const msg = Json::FastWriter().write(response(100));
+
+    REQUIRE(msg.compare(0, 8, "{\"body\":") == 0);
+    REQUIRE(peek(msg, "corr_id", value));
+    REQUIRE(value == "4f1c-77");
+    REQUIRE(peek(msg, "reply_to", value));
+    REQUIRE(value == "rpc-res/x");
+
+    auto const styled = Json::StyledWriter().write(response(3));
+
+    REQUIRE(peek(styled, "corr_id", value));
+    REQUIRE(value == "4f1c-77");
+
+    // Escapes left as they are.
+    REQUIRE(peek(R"( { "a" : [1, "]"], "b": -1e5, "k": "x\"y\\" } )", "k", value));
+    REQUIRE(value == R"(x\"y\\)");
+
+    REQUIRE_FALSE(peek(msg, "code", value));        // not at the top.
+    REQUIRE_FALSE(peek(msg, "body", value));        // not a string.
+    REQUIRE_FALSE(peek(msg, "none", value));
+    REQUIRE_FALSE(peek("{}", "corr_id", value));
+    REQUIRE_FALSE(peek("[\"corr_id\"]", "corr_id", value));
+    REQUIRE_FALSE(peek("", "corr_id", value));
+
+    // Cut short anywhere before the member.
+    auto const at = msg.find("\"corr_id\"");
+
+    for (size_t n = 0; n < at + 12; n += 11)
+        REQUIRE_FALSE(peek(msg.substr(0, n), "corr_id", value));
+}
+
+TEST_CASE("json from the end", "members after the body, which is not looked into")
+{
+    std::string value;
+
+    // Found past the body, and not inside it.
+    REQUIRE(peek(R"({"body":{"corr_id":"b"},"corr_id":"a"})", "corr_id", value));
+    REQUIRE(value == "a");
+    REQUIRE(peek(R"({"corr_id":"a","body":{"corr_id":"b"}})", "corr_id", value));
+    REQUIRE(value == "a");
+    REQUIRE(peek(R"({"body":""corr_id":"b"","corr_id":"a"} )", "corr_id", value));
+    REQUIRE(value == "a");
+    REQUIRE(peek(R"({"body":[],"corr_id":"a\","n":-1,"t":true})", "corr_id", value));
+    REQUIRE(value == R"(a\)");
+
+    // The last of the same name, as JsonCpp keeps it.
+    REQUIRE(peek(R"({"corr_id":"a","corr_id":"b"})", "corr_id", value));
+    REQUIRE(value == "b");
+
+    REQUIRE_FALSE(peek(R"({"corr_id":1})", "corr_id", value));
+    REQUIRE_FALSE(peek(R"({"corr_id":"a","x":2})", "y", value));
+    REQUIRE_FALSE(peek(R"({"body":{"corr_id":"b"}})", "corr_id", value));
+    REQUIRE_FALSE(peek(R"(["a",{"corr_id":"b"}])", "corr_id", value));
+}
+
+TEST_CASE("msgpack", "the same, in MessagePack")
+{
+    std::string value;
+
+    auto const msg = utils::msgpack_encode(response(100));
+
+    REQUIRE(peek(msg, "corr_id", value));
+    REQUIRE(value == "4f1c-77");
+    REQUIRE(peek(msg, "reply_to", value));
+    REQUIRE(value == "rpc-res/x");
+
+    REQUIRE_FALSE(peek(msg, "code", value));
+    REQUIRE_FALSE(peek(msg, "body", value));
+    REQUIRE_FALSE(peek(utils::msgpack_encode(Json::Value(Json::objectValue)), "corr_id", value));
+
+    // Every kind of value skipped over.
+    Json::Value all;
+    all["a"] = Json::Value::minInt64;
+    all["b"] = Json::Value::maxUInt64;
+    all["c"] = std::string(300, 'x');
+    all["d"] = std::string(70000, 'y');
+    all["e"] = 0.25;
+    all["f"] = Json::Value(Json::arrayValue);
+    all["g"] = response(20)["body"];
+    all["h"] = false;
+    all["z"] = "last";
+
+    REQUIRE(peek(utils::msgpack_encode(all), "z", value));
+    REQUIRE(value == "last");
+
+    auto const at = msg.find("corr_id");
+
+    for (size_t n = 0; n < at + 12; n += 11)
+        REQUIRE_FALSE(peek(msg.substr(0, n), "corr_id", value));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils/executor.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("priority", "higher priority first, then first come first served")
+{
+    utils::PriorityExecutor ex("test", 1);
+
+    // Hold the only thread until everything is queued.
+    std::promise<void> gate;
+    auto               opened = gate.get_future().share();
+
+    REQUIRE(ex.post([opened]() { opened.wait(); }));
+
+    while (ex.stats().running == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::mutex       mutex;
+    std::vector<int> order;
+
+    auto task = [&](int n) {
+        return [&, n]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(n);
+        };
+    };
+
+    ex.post(task(1), 0);
+    ex.post(task(2), 0);
+    ex.post(task(3), 10);
+    ex.post(task(4), -5);
+    ex.post(task(5), 10);
+
+    REQUIRE(ex.stats().queued == 5);
+
+    gate.set_value();
+
+    while (ex.stats().completed < 6)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(order == std::vector<int>({3, 5, 1, 2, 4}));
+
+    auto const stats = ex.stats();
+
+    REQUIRE(stats.threads == 1);
+    REQUIRE(stats.queued == 0);
+    REQUIRE(stats.running == 0);
+    REQUIRE(stats.max_queued == 5);
+    REQUIRE(stats.max_wait_ms > 0);
+}
+
+TEST_CASE("concurrency", "no more tasks at a time than threads")
+{
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+
+    {
+        utils::PriorityExecutor ex("test", 3);
+
+        for (int i = 0; i < 30; i++)
+        {
+            ex.post([&]() {
+                    int now = ++running;
+                    int p   = peak;
+
+                    while (now > p and not peak.compare_exchange_weak(p, now))
+                        ;
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    running--;
+                });
+        }
+
+        while (ex.stats().completed < 30)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    REQUIRE(peak == 3);
+}
+
+TEST_CASE("bounds", "a full queue refuses tasks; exceptions don't kill threads")
+{
+    utils::PriorityExecutor ex("test", 1, 2);
+
+    std::promise<void> gate;
+    auto               opened = gate.get_future().share();
+
+    REQUIRE(ex.post([opened]() { opened.wait(); }));
+
+    // The first task may not have been picked up yet.
+    while (ex.stats().running == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(ex.post([]() { throw std::runtime_error("oops"); }));
+    REQUIRE(ex.post([]() { }));
+    REQUIRE_FALSE(ex.post([]() { }));
+    REQUIRE(ex.stats().rejected == 1);
+
+    gate.set_value();
+
+    while (ex.stats().completed < 3)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    REQUIRE(ex.post([]() { }));
+
+    ex.stop();
+
+    REQUIRE_FALSE(ex.post([]() { }));
+    REQUIRE_THROWS(utils::PriorityExecutor("none", 0));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
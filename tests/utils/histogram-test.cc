@@ -0,0 +1,138 @@
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+
+#include "utils/histogram.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using utils::LatencyHistogram;
+
+TEST_CASE("buckets", "every value falls within its bucket, which is narrow")
+{
+    REQUIRE(LatencyHistogram::bucket_of(0) == 0);
+    REQUIRE(LatencyHistogram::bucket_of(63) == 63);
+    REQUIRE(LatencyHistogram::bucket_of(64) == 64);
+    REQUIRE(LatencyHistogram::bucket_of(65) == 64);
+    REQUIRE(LatencyHistogram::bucket_of(LatencyHistogram::max_value) == LatencyHistogram::num_buckets - 1);
+    REQUIRE(LatencyHistogram::bucket_of(uint64_t(-1)) == LatencyHistogram::num_buckets - 1);
+
+    bool ok = true;
+
+    for (uint64_t v = 1; v < LatencyHistogram::max_value; v = v * 3 / 2 + 1)
+    {
+        auto const b  = LatencyHistogram::bucket_of(v);
+        auto const lo = LatencyHistogram::bucket_lowest(b);
+        auto const hi = LatencyHistogram::bucket_highest(b);
+
+        ok = ok and lo <= v and v <= hi and (hi - lo) <= v / 32;
+    }
+
+    REQUIRE(ok);
+
+    // Buckets follow each other.
+    for (size_t b = 1; b < LatencyHistogram::num_buckets; b++)
+    {
+        ok = ok and LatencyHistogram::bucket_lowest(b) == LatencyHistogram::bucket_highest(b - 1) + 1;
+    }
+
+    REQUIRE(ok);
+}
+
+TEST_CASE("percentiles", "within a bucket of the exact ones")
+{
+    LatencyHistogram h;
+
+    REQUIRE(h.snapshot().percentile(99) == 0);
+
+    for (uint64_t v = 1; v <= 10000; v++)
+    {
+        h.record(v);
+    }
+
+    auto const s = h.snapshot();
+
+    REQUIRE(s.count() == 10000);
+    REQUIRE(s.max() == 10000);
+    REQUIRE(s.mean() == Approx(5000.5));
+
+    REQUIRE(s.percentile(50) >= 5000);
+    REQUIRE(s.percentile(50) <= 5000 * 33 / 32);
+    REQUIRE(s.percentile(99) >= 9900);
+    REQUIRE(s.percentile(99) <= 10000);
+    REQUIRE(s.percentile(100) == 10000);
+    REQUIRE(s.percentile(0) == 1);
+
+    auto const v = s.summary();
+
+    REQUIRE(v["count"].asUInt64() == 10000);
+    REQUIRE(v["max_us"].asUInt64() == 10000);
+    REQUIRE(v["p99_us"].asUInt64() == s.percentile(99));
+}
+
+TEST_CASE("intervals", "differences of snapshots, and concurrent recording")
+{
+    utils::LatencyHistograms hs;
+
+    auto &h = hs.get("m1 dtn_list");
+
+    REQUIRE(&hs.get("m1 dtn_list") == &h);
+
+    h.record(100);
+    auto const before = h.snapshot();
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&h]() {
+                for (int i = 0; i < 10000; i++)
+                    h.record(1000);
+            });
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    auto const d = h.snapshot() - before;
+
+    REQUIRE(d.count() == 40000);
+    REQUIRE(d.sum() == 40000 * 1000);
+    REQUIRE(d.percentile(1) >= 1000);
+    REQUIRE(d.max() >= 1000);
+    REQUIRE(d.max() <= 1000 * 33 / 32);
+
+    auto const all = hs.snapshot();
+
+    REQUIRE(all.size() == 1);
+    REQUIRE(all.at("m1 dtn_list").count() == 40001);
+}
+
+TEST_CASE("keys", "histograms named by a pair, which may hold spaces")
+{
+    using Key = std::pair<std::string, std::string>;
+
+    utils::LatencyHistogramsBy<Key> hs;
+
+    hs.get(Key("m 1", "dtn_list")).record(10);
+    hs.get(Key("m", "1 dtn_list")).record(20);
+    hs.get(Key("m 1", "dtn_list")).record(30);
+
+    auto const all = hs.snapshot();
+
+    REQUIRE(all.size() == 2);
+    REQUIRE(all.at(Key("m 1", "dtn_list")).count() == 2);
+    REQUIRE(all.at(Key("m", "1 dtn_list")).max() == 20);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+#include "utils/network.h"
+#include "utils/iftable.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("snapshot", "the table agrees with getifaddrs()")
+{
+    auto &table = utils::IfaceTable::instance();
+
+    REQUIRE(table.ready());
+
+    auto snapshot = table.snapshot();
+
+    for (auto const &iface : utils::get_interfaces())
+    {
+        std::string ipv4;
+
+        for (auto const &a : iface.addresses())
+        {
+            if (a.family() == AF_INET)
+            {
+                ipv4 = a.address_string();
+                break;
+            }
+        }
+
+        auto it = snapshot->find(iface.name());
+
+        REQUIRE(it != snapshot->end());
+
+        std::cout << iface.name() << ": index " << it->second.index
+                  << ", mac " << it->second.mac
+                  << ", " << it->second.ipv4.size() << " ipv4, "
+                  << it->second.ipv6.size() << " ipv6 address(es)\n";
+
+        if (not ipv4.empty())
+        {
+            REQUIRE(it->second.ipv4.front() == ipv4);
+        }
+    }
+}
+
+TEST_CASE("lookups", "network.cc helpers read the table")
+{
+    utils::IfaceEntry lo;
+
+    REQUIRE(utils::IfaceTable::instance().lookup("lo", lo));
+    REQUIRE(lo.up_and_running());
+    REQUIRE(lo.link.empty());
+
+    REQUIRE(utils::get_first_ipv4_address("lo") == "127.0.0.1");
+    REQUIRE(utils::iface_up_and_running("lo"));
+
+    REQUIRE_THROWS(utils::get_first_ipv4_address("no-such-iface0"));
+    REQUIRE_THROWS(utils::iface_up_and_running("no-such-iface0"));
+
+    utils::IfaceEntry none;
+    REQUIRE_FALSE(utils::IfaceTable::instance().lookup("no-such-iface0", none));
+}
+
+// Needs CAP_NET_ADMIN; skipped when we can't add addresses.
+TEST_CASE("changes", "listeners hear about address changes")
+{
+    auto &table = utils::IfaceTable::instance();
+
+    std::atomic<int> added(0);
+    std::atomic<int> removed(0);
+
+    auto id = table.add_listener([&](utils::IfaceChange const &change) {
+            if (change.iface == "lo" and change.address == "127.0.0.42")
+            {
+                if (change.kind == utils::IfaceChange::address_added)
+                    added++;
+                if (change.kind == utils::IfaceChange::address_removed)
+                    removed++;
+            }
+        });
+
+    auto wait_for = [](std::atomic<int> &count) {
+        for (int i = 0; i < 200 and count == 0; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return count.load();
+    };
+
+    if (system("ip addr add 127.0.0.42/8 dev lo 2>/dev/null") != 0)
+    {
+        WARN("could not add an address to lo; not testing changes");
+        table.remove_listener(id);
+        return;
+    }
+
+    REQUIRE(wait_for(added) == 1);
+
+    utils::IfaceEntry lo;
+    REQUIRE(table.lookup("lo", lo));
+    REQUIRE(std::find(lo.ipv4.begin(), lo.ipv4.end(), "127.0.0.42") != lo.ipv4.end());
+
+    REQUIRE(system("ip addr del 127.0.0.42/8 dev lo") == 0);
+    REQUIRE(wait_for(removed) == 1);
+
+    REQUIRE(table.lookup("lo", lo));
+    REQUIRE(std::find(lo.ipv4.begin(), lo.ipv4.end(), "127.0.0.42") == lo.ipv4.end());
+
+    table.remove_listener(id);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,217 @@
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "utils/job.h"
+#include "utils/paths/dirwalker.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("lifecycle", "queued, running, done, with progress")
+{
+    utils::JobTable jobs;
+
+    auto job = jobs.create("dtn", "dtn_compute_checksums");
+
+    REQUIRE(jobs.find(job->id()) == job);
+    REQUIRE(jobs.find("nope") == nullptr);
+    REQUIRE(job->state() == utils::Job::State::queued);
+    REQUIRE(job->status()["state"].asString() == "queued");
+
+    job->start();
+    job->add_total(1000, 2);
+    job->add_done(250, 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    auto s = job->status();
+
+    REQUIRE(s["state"].asString() == "running");
+    REQUIRE(s["progress"]["bytes_done"].asUInt64() == 250);
+    REQUIRE(s["progress"]["bytes_total"].asUInt64() == 1000);
+    REQUIRE(s["progress"]["files_done"].asUInt64() == 1);
+    REQUIRE(s["progress"]["eta_s"].asDouble() > 0);
+    REQUIRE_FALSE(s.isMember("result"));
+
+    Json::Value result;
+    result["code"] = 0;
+
+    job->finish(result);
+
+    s = job->status();
+
+    REQUIRE(job->finished());
+    REQUIRE(s["state"].asString() == "done");
+    REQUIRE(s["result"]["code"].asInt() == 0);
+    REQUIRE_FALSE(s["progress"].isMember("eta_s"));
+
+    // Finished is final.
+    job->fail("late");
+    REQUIRE(job->state() == utils::Job::State::done);
+}
+
+TEST_CASE("cancel", "cancelled work stops at its next check, in every thread of the job")
+{
+    utils::JobTable jobs;
+
+    auto job = jobs.create("dtn", "dtn_verify_checksums");
+
+    REQUIRE(utils::current_job() == nullptr);
+    REQUIRE_NOTHROW(utils::check_cancelled());
+
+    job->start();
+
+    bool stopped = false;
+
+    {
+        utils::JobScope scope(job);
+
+        REQUIRE(utils::current_job() == job);
+
+        auto worker = utils::current_job();
+
+        std::thread t([&, worker]() {
+                utils::JobScope scope(worker);
+
+                try
+                {
+                    while (true)
+                    {
+                        utils::check_cancelled();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+                catch (utils::JobCancelled const &)
+                {
+                    stopped = true;
+                }
+            });
+
+        job->cancel();
+        t.join();
+
+        REQUIRE_THROWS_AS(utils::check_cancelled(), utils::JobCancelled);
+    }
+
+    REQUIRE(stopped);
+    REQUIRE(utils::current_job() == nullptr);
+
+    // Whatever the handler made of it, the job is cancelled.
+    job->fail("Error when verifying checksums: job cancelled");
+
+    REQUIRE(job->state() == utils::Job::State::cancelled);
+    REQUIRE(job->status()["state"].asString() == "cancelled");
+}
+
+static size_t open_fds()
+{
+    size_t n = 0;
+
+    DIR *d = opendir("/proc/self/fd");
+
+    while (readdir(d) != nullptr)
+        n++;
+
+    closedir(d);
+
+    return n;
+}
+
+TEST_CASE("cancelled walk", "a walk cancelled deep in a tree closes the folders above")
+{
+    char root[] = "/tmp/job-test-XXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+
+    std::string path = root;
+
+    for (int i = 0; i < 50; i++)
+    {
+        path += "/d";
+        REQUIRE(mkdir(path.c_str(), 0700) == 0);
+    }
+
+    auto const before = open_fds();
+
+    utils::JobTable jobs;
+
+    // Walk until the job is cancelled under us, mostly some folders
+    // down.
+    for (int round = 0; round < 20; round++)
+    {
+        auto job = jobs.create("dtn", "dtn_expand");
+        job->start();
+
+        std::atomic<bool> walking{false};
+        bool              cancelled = false;
+
+        std::thread t([&, job]() {
+                utils::JobScope scope(job);
+
+                try
+                {
+                    while (true)
+                    {
+                        walking = true;
+                        utils::DirectoryWalker walk(root, true);
+                    }
+                }
+                catch (utils::JobCancelled const &)
+                {
+                    cancelled = true;
+                }
+            });
+
+        while (not walking)
+            std::this_thread::yield();
+
+        job->cancel();
+        t.join();
+
+        REQUIRE(cancelled);
+    }
+
+    REQUIRE(open_fds() == before);
+
+    REQUIRE(system(("rm -rf " + std::string(root)).c_str()) == 0);
+}
+
+TEST_CASE("expire", "finished jobs are kept for a while, and not too many")
+{
+    utils::JobTable jobs(3600, 2);
+
+    auto running = jobs.create("dtn", "a");
+    running->start();
+
+    for (int i = 0; i < 4; i++)
+    {
+        jobs.create("dtn", "b")->finish(Json::Value());
+    }
+
+    REQUIRE(jobs.list().size() == 5);
+
+    jobs.expire();
+
+    REQUIRE(jobs.list().size() == 3);
+    REQUIRE(jobs.find(running->id()) == running);
+
+    utils::JobTable soon(0);
+
+    soon.create("dtn", "c")->finish(Json::Value());
+    soon.create("dtn", "d");
+    soon.expire();
+
+    REQUIRE(soon.list().size() == 1);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
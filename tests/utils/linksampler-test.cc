@@ -0,0 +1,136 @@
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+
+#include "utils/linksampler.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+static utils::LinkSample make_sample(uint64_t time_ms, uint64_t bytes)
+{
+    utils::LinkSample s{};
+
+    s.time_ns    = time_ms * 1000 * 1000;
+    s.rx_bytes   = bytes;
+    s.tx_bytes   = bytes * 2;
+    s.rx_packets = bytes / 100;
+    s.tx_packets = bytes / 100;
+
+    return s;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("ring", "samples come back oldest first, and old ones are dropped")
+{
+    utils::LinkSampleRing ring(4);
+
+    REQUIRE(ring.latest(10).empty());
+
+    for (uint64_t i = 1; i <= 6; i++)
+    {
+        ring.push(make_sample(i * 100, i));
+    }
+
+    auto all = ring.latest(10);
+    REQUIRE(all.size() == 4);
+    REQUIRE(all.front().rx_bytes == 3);
+    REQUIRE(all.back().rx_bytes  == 6);
+
+    auto two = ring.latest(2);
+    REQUIRE(two.size() == 2);
+    REQUIRE(two[0].rx_bytes == 5);
+    REQUIRE(two[1].rx_bytes == 6);
+}
+
+TEST_CASE("ring_concurrent", "readers only see whole samples")
+{
+    utils::LinkSampleRing ring(8);
+    std::atomic_bool      done{false};
+
+    std::thread writer([&]() {
+            for (uint64_t i = 1; i <= 200000; i++)
+            {
+                ring.push(make_sample(i, i * 100));
+            }
+            done = true;
+        });
+
+    while (not done)
+    {
+        for (auto const &s : ring.latest(8))
+        {
+            REQUIRE(s.rx_bytes   == s.time_ns / 1000 / 1000 * 100);
+            REQUIRE(s.tx_bytes   == s.rx_bytes * 2);
+            REQUIRE(s.rx_packets == s.rx_bytes / 100);
+        }
+    }
+
+    writer.join();
+}
+
+TEST_CASE("rates", "rates, peaks and percentiles")
+{
+    std::vector<utils::LinkSample> samples;
+
+    // 100 ms apart; bytes grow by 1000 * i in the i-th interval.
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; i <= 100; i++)
+    {
+        bytes += 1000 * i;
+        samples.push_back(make_sample(i * 100, bytes));
+    }
+
+    auto rates = utils::link_rates(samples);
+    REQUIRE(rates.size() == 100);
+
+    // 1000 bytes in 100 ms = 80000 bits/s.
+    REQUIRE(rates.front().rx_bps == Approx(80000.0));
+    REQUIRE(rates.back().tx_bps  == Approx(2 * 100 * 80000.0));
+
+    auto rx = utils::link_rate_stats(rates, &utils::LinkRates::rx_bps);
+    REQUIRE(rx.peak == Approx(100 * 80000.0));
+    REQUIRE(rx.p50  == Approx(50 * 80000.0));
+    REQUIRE(rx.p90  == Approx(90 * 80000.0));
+    REQUIRE(rx.p99  == Approx(99 * 80000.0));
+    REQUIRE(rx.avg  == Approx(50.5 * 80000.0));
+
+    // A counter going backwards (reset) gives a zero rate.
+    samples.push_back(make_sample(10200, 0));
+    REQUIRE(utils::link_rates(samples).back().rx_bps == 0);
+}
+
+TEST_CASE("sampler", "sample the loopback interface")
+{
+    if (access("/sys/class/net/lo/statistics/rx_bytes", R_OK) != 0)
+    {
+        return;
+    }
+
+    utils::LinkSampler sampler({"lo", "no-such-iface"}, 10, 1);
+
+    REQUIRE(sampler.interfaces() == std::vector<std::string>{"lo"});
+    REQUIRE_THROWS(sampler.history("no-such-iface", 1));
+
+    sampler.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    sampler.stop();
+
+    auto history = sampler.history("lo", 1);
+    REQUIRE(history.size() >= 5);
+
+    for (size_t i = 1; i < history.size(); i++)
+    {
+        REQUIRE(history[i].time_ns  >  history[i-1].time_ns);
+        REQUIRE(history[i].rx_bytes >= history[i-1].rx_bytes);
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,141 @@
+#include <thread>
+#include <vector>
+
+#include "utils/metricstore.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("tiers", "parsing tier specs")
+{
+    auto const tiers = utils::parse_metric_tiers("500ms:1m,10s:6h,1d:7d");
+
+    REQUIRE(tiers.size() == 3);
+    REQUIRE(tiers[0].resolution_ms == 500);
+    REQUIRE(tiers[0].buckets == 120);
+    REQUIRE(tiers[1].resolution_ms == 10000);
+    REQUIRE(tiers[1].buckets == 2160);
+    REQUIRE(tiers[2].buckets == 7);
+
+    REQUIRE(utils::default_metric_tiers().size() == 3);
+
+    REQUIRE_THROWS(utils::parse_metric_tiers(""));
+    REQUIRE_THROWS(utils::parse_metric_tiers("1s"));
+    REQUIRE_THROWS(utils::parse_metric_tiers("1x:1h"));
+    REQUIRE_THROWS(utils::parse_metric_tiers("1h:1s"));
+    REQUIRE_THROWS(utils::parse_metric_tiers("10s:1h,1s:1m"));
+}
+
+TEST_CASE("buckets", "values are aggregated per bucket")
+{
+    utils::MetricSeries s({{1000, 10}});
+
+    s.record(10000, 1);
+    s.record(10500, 3);
+    s.record(11000, 5);
+    s.record(10999, 100);   // late: dropped.
+    s.record(12000, NAN);   // dropped.
+
+    auto const r = s.fetch(0, 20000);
+
+    REQUIRE(r.resolution_ms == 1000);
+    REQUIRE(r.points.size() == 2);
+    REQUIRE(r.points[0].time_ms == 10000);
+    REQUIRE(r.points[0].min == 1);
+    REQUIRE(r.points[0].max == 3);
+    REQUIRE(r.points[0].avg == 2);
+    REQUIRE(r.points[0].count == 2);
+    REQUIRE(r.points[1].time_ms == 11000);
+    REQUIRE(r.points[1].count == 1);
+
+    // The range takes buckets that overlap it.
+    REQUIRE(s.fetch(10999, 11000).points.size() == 2);
+    REQUIRE(s.fetch(11000, 20000).points.size() == 1);
+    REQUIRE(s.fetch(20000, 30000).points.empty());
+}
+
+TEST_CASE("rings", "old buckets are overwritten, coarser tiers keep them")
+{
+    // 1 s for 10 s, 10 s for 100 s.
+    utils::MetricSeries s({{1000, 10}, {10000, 10}});
+
+    REQUIRE(s.memory() > 0);
+
+    for (uint64_t t = 0; t < 60000; t += 500)
+        s.record(t, t / 1000);
+
+    // Recent: the fine tier.
+    auto recent = s.fetch(55000, 60000);
+
+    REQUIRE(recent.resolution_ms == 1000);
+    REQUIRE(recent.points.size() == 5);
+    REQUIRE(recent.points.front().time_ms == 55000);
+    REQUIRE(recent.points.back().time_ms == 59000);
+    REQUIRE(recent.points.back().count == 2);
+
+    // Further back than the fine tier holds: the coarse one.
+    auto older = s.fetch(0, 60000);
+
+    REQUIRE(older.resolution_ms == 10000);
+    REQUIRE(older.points.size() == 6);
+    REQUIRE(older.points[0].count == 20);
+    REQUIRE(older.points[0].min == 0);
+    REQUIRE(older.points[0].max == 9);
+    REQUIRE(older.points[0].avg == 4.5);
+
+    // Or when asked for.
+    REQUIRE(s.fetch(55000, 60000, 5000).resolution_ms == 10000);
+    REQUIRE(s.fetch(55000, 60000, 60000).resolution_ms == 10000);
+
+    // Past what any tier holds: what the coarsest has.
+    for (uint64_t t = 60000; t < 1000000; t += 1000)
+        s.record(t, 1);
+
+    auto const all = s.fetch(0, 1000000);
+
+    REQUIRE(all.resolution_ms == 10000);
+    REQUIRE(all.points.size() == 10);
+    REQUIRE(all.points.front().time_ms == 900000);
+}
+
+TEST_CASE("store", "named series, from several threads")
+{
+    utils::MetricStore store(utils::parse_metric_tiers("1s:1m"));
+
+    REQUIRE_THROWS_AS(store.fetch("none", 0, 1), std::out_of_range);
+
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 4; i++)
+    {
+        threads.emplace_back([&store, i]() {
+                for (int j = 0; j < 1000; j++)
+                    store.record(i % 2 ? "odd" : "even", 5000, j);
+            });
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    REQUIRE(store.series() == std::vector<std::string>({"even", "odd"}));
+
+    auto const r = store.fetch("odd", 0, 10000);
+
+    REQUIRE(r.points.size() == 1);
+    REQUIRE(r.points[0].count == 2000);
+    REQUIRE(r.points[0].max == 999);
+
+    REQUIRE(store.memory() == 2 * utils::MetricSeries({{1000, 60}}).memory());
+
+    store.record("now", 1);
+    auto const now = utils::MetricStore::now_ms();
+    REQUIRE(store.fetch("now", now - 2000, now).points.size() == 1);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,151 @@
+#include <fstream>
+#include <thread>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "utils/mountstats.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Trimmed from a 5.x kernel: a local mount, then an NFSv4 mount with a
+// few of its per-op lines.
+static std::string mountstats_text(uint64_t read_bytes,
+                                   uint64_t read_ops,
+                                   uint64_t read_rtt)
+{
+    return
+        "device /dev/sda1 mounted on / with fstype ext4\n"
+        "device proc mounted on /proc with fstype proc\n"
+        "device fs01:/export/data mounted on /mnt/data with fstype nfs4 statvers=1.1\n"
+        "\topts:\trw,vers=4.2,rsize=1048576,wsize=1048576,proto=tcp\n"
+        "\tage:\t86400\n"
+        "\tevents:\t1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27\n"
+        "\tbytes:\t1000 2000 300 400 " + std::to_string(read_bytes) + " 2400 10 20\n"
+        "\tRPC iostats version: 1.1  p/v: 100003/4 (nfs)\n"
+        "\txprt:\ttcp 0 0 1 0 16 100 100 0 100 0 2 0 0\n"
+        "\tper-op statistics\n"
+        "\t        NULL: 1 1 0 44 24 0 0 0 0\n"
+        "\t        READ: " + std::to_string(read_ops) + " " + std::to_string(read_ops + 2) +
+        " 0 9600 " + std::to_string(read_bytes) + " 5 " + std::to_string(read_rtt) +
+        " " + std::to_string(read_rtt + 10) + " 0\n"
+        "\t       WRITE: 4 4 0 2800 640 0 40 44 0\n"
+        "\n";
+}
+
+TEST_CASE("parse mountstats", "counters of /proc/self/mountstats")
+{
+    auto const all = utils::parse_mountstats(mountstats_text(1300, 100, 500));
+
+    // Only NFS mounts.
+    REQUIRE(all.size() == 1);
+
+    auto const &m = all.at("/mnt/data");
+    REQUIRE(m.device == "fs01:/export/data");
+    REQUIRE(m.fstype == "nfs4");
+    REQUIRE(m.app_read_bytes == 1300);
+    REQUIRE(m.app_write_bytes == 2400);
+    REQUIRE(m.server_read_bytes == 1300);
+    REQUIRE(m.server_write_bytes == 2400);
+
+    REQUIRE(m.ops.size() == 3);
+
+    auto const &read = m.ops.at("READ");
+    REQUIRE(read.ops == 100);
+    REQUIRE(read.trans == 102);
+    REQUIRE(read.bytes_sent == 9600);
+    REQUIRE(read.queue_ms == 5);
+    REQUIRE(read.rtt_ms == 500);
+    REQUIRE(read.exe_ms == 510);
+
+    REQUIRE(m.ops.at("WRITE").rtt_ms == 40);
+
+    REQUIRE(utils::parse_mountstats("").empty());
+    REQUIRE(utils::parse_mountstats("garbage\n\tREAD: 1 2 3\n").empty());
+}
+
+TEST_CASE("rates", "deltas between two readings")
+{
+    auto const a = utils::parse_mountstats(mountstats_text(1000000, 100, 500)).at("/mnt/data");
+    auto const b = utils::parse_mountstats(mountstats_text(3000000, 300, 1500)).at("/mnt/data");
+
+    auto const r = utils::nfs_mount_rates(a, b, 2);
+
+    REQUIRE(r.read_bytes_per_sec == Approx(1000000));
+    REQUIRE(r.write_bytes_per_sec == 0);
+    REQUIRE(r.read_ops_per_sec == Approx(100));
+    REQUIRE(r.write_ops_per_sec == 0);
+    REQUIRE(r.ops_per_sec == Approx(100));
+    REQUIRE(r.retrans_per_sec == 0);
+    REQUIRE(r.read_rtt_ms == Approx(5));
+    REQUIRE(r.read_exe_ms == Approx(5));
+
+    // No writes in the interval: no average.
+    REQUIRE(r.write_rtt_ms == 0);
+
+    // Counters that went backwards (remount) count as zero.
+    auto const back = utils::nfs_mount_rates(b, a, 2);
+    REQUIRE(back.read_bytes_per_sec == 0);
+    REQUIRE(back.read_rtt_ms == 0);
+
+    REQUIRE(utils::nfs_mount_rates(a, b, 0).read_bytes_per_sec == 0);
+}
+
+TEST_CASE("sampler", "sampling a fixture mountstats file")
+{
+    char tmpl[] = "/tmp/mountstats-test-XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+
+    std::string const dir  = tmpl;
+    std::string const path = dir + "/mountstats";
+
+    std::ofstream(path) << mountstats_text(0, 0, 0);
+
+    utils::NfsStatsSampler sampler({"/mnt/data", "/"}, 1000, path);
+
+    utils::NfsMountRates rates;
+    REQUIRE_FALSE(sampler.rates("/mnt/data", rates));
+
+    sampler.sample();
+    REQUIRE_FALSE(sampler.rates("/mnt/data", rates));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 1 MB read in ~0.1s, 10 ms a read.
+    std::ofstream(path) << mountstats_text(1000000, 10, 100);
+    sampler.sample();
+
+    REQUIRE(sampler.rates("/mnt/data", rates));
+    REQUIRE(rates.read_bytes_per_sec > 2e6);
+    REQUIRE(rates.read_bytes_per_sec < 11e6);
+    REQUIRE(rates.read_rtt_ms == Approx(10));
+
+    utils::NfsMountCounters counters;
+    REQUIRE(sampler.counters("/mnt/data", counters));
+    REQUIRE(counters.ops.at("READ").ops == 10);
+
+    // Not NFS.
+    REQUIRE_FALSE(sampler.rates("/", rates));
+    REQUIRE_FALSE(sampler.rates("/mnt/other", rates));
+
+    // Unmounted: no rates until two samples again.
+    std::ofstream(path) << "device proc mounted on /proc with fstype proc\n";
+    sampler.sample();
+    REQUIRE_FALSE(sampler.rates("/mnt/data", rates));
+    REQUIRE_FALSE(sampler.counters("/mnt/data", counters));
+
+    sampler.start();
+    sampler.stop();
+
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
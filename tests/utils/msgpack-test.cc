@@ -0,0 +1,149 @@
+#include <string>
+#include <limits>
+
+#include "utils/msgpack.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+static Json::Value from_json(std::string const &text)
+{
+    Json::Value v;
+    REQUIRE(Json::Reader().parse(text, v));
+    return v;
+}
+
+static Json::Value round_trip(Json::Value const &v)
+{
+    auto const packed = utils::msgpack_encode(v);
+
+    Json::Value out;
+    REQUIRE(utils::msgpack_decode(packed.data(), packed.size(), out));
+
+    return out;
+}
+
+// An expand response, as DTN agents send them.
+static Json::Value expand_response(int files)
+{
+    Json::Value v;
+
+    v["code"]       = 0;
+    v["total_size"] = Json::UInt64(0);
+
+    for (int i = 0; i < files; i++)
+    {
+        Json::Value f;
+        f["name"] = "/data/run" + std::to_string(i / 100) + "/file_" + std::to_string(i) + ".dat";
+        f["size"] = Json::UInt64(1000003) * i;
+
+        v["files"].append(f);
+    }
+
+    return v;
+}
+
+TEST_CASE("round trip", "values come back as Json::Reader reads them")
+{
+    auto const v = from_json(R"({
+        "cmd": "dtn_expand",
+        "params": { "path": "/data/x", "user": "", "recurse": true, "none": null },
+        "ints": [0, 1, 127, 128, 255, 256, 65535, 65536, 2147483647, 2147483648,
+                 4294967296, 18446744073709551615,
+                 -1, -32, -33, -128, -129, -32768, -32769, -2147483648, -2147483649,
+                 -9223372036854775808],
+        "reals": [0.5, -1e-300, 1e300, 3.0],
+        "strings": ["", "a", "0123456789012345678901234567890", "ünïcödé"],
+        "nested": [[[]], {}, [{"a": [1, {"b": {}}]}]]
+    })");
+
+    auto const out = round_trip(v);
+
+    REQUIRE(out == v);
+
+    // Same types as parsing gives, not only equal values.
+    REQUIRE(out["ints"][0].type() == Json::intValue);
+    REQUIRE(out["ints"][8].type() == Json::intValue);
+    REQUIRE(out["ints"][9].type() == Json::uintValue);
+    REQUIRE(out["ints"][12].type() == Json::intValue);
+    REQUIRE(out["reals"][3].type() == Json::realValue);
+
+    // Long strings and containers.
+    Json::Value big;
+    big["s"] = std::string(70000, 'x');
+
+    for (int i = 0; i < 70000; i++)
+        big["a"].append(i);
+
+    REQUIRE(round_trip(big) == big);
+
+    std::string with_nul("a\0b", 3);
+    Json::Value nul(with_nul.data(), with_nul.data() + with_nul.size());
+
+    REQUIRE(round_trip(nul) == nul);
+}
+
+TEST_CASE("detection", "MessagePack maps are told from JSON by their first byte")
+{
+    auto const packed = utils::msgpack_encode(from_json(R"({"corr_id": "x", "body": {}})"));
+    std::string const json = "{\"corr_id\":\"x\"}";
+
+    REQUIRE(utils::is_msgpack(packed.data(), packed.size()));
+    REQUIRE_FALSE(utils::is_msgpack(json.data(), json.size()));
+    REQUIRE_FALSE(utils::is_msgpack(" {}", 3));
+    REQUIRE_FALSE(utils::is_msgpack("", 0));
+
+    Json::Value big;
+    for (int i = 0; i < 20; i++)
+        big["k" + std::to_string(i)] = i;
+
+    auto const map16 = utils::msgpack_encode(big);
+    REQUIRE(utils::is_msgpack(map16.data(), map16.size()));
+}
+
+TEST_CASE("malformed", "truncated or trailing data is refused")
+{
+    auto const packed = utils::msgpack_encode(expand_response(10));
+
+    Json::Value v;
+
+    for (size_t n = 0; n < packed.size(); n += 7)
+        REQUIRE_FALSE(utils::msgpack_decode(packed.data(), n, v));
+
+    auto const trailing = packed + "x";
+    REQUIRE_FALSE(utils::msgpack_decode(trailing.data(), trailing.size(), v));
+
+    // A map key must be a string.
+    char const bad_key[] = { char(0x81), 0x01, 0x02 };
+    REQUIRE_FALSE(utils::msgpack_decode(bad_key, sizeof(bad_key), v));
+
+    // An array claiming more elements than there are bytes.
+    char const huge[] = { char(0xdd), char(0xff), char(0xff), char(0xff), char(0xff) };
+    REQUIRE_FALSE(utils::msgpack_decode(huge, sizeof(huge), v));
+
+    // Too deep.
+    std::string deep(1000, char(0x91));
+    deep.push_back(char(0xc0));
+    REQUIRE_FALSE(utils::msgpack_decode(deep.data(), deep.size(), v));
+}
+
+TEST_CASE("size", "expand responses are smaller than as JSON")
+{
+    auto const v      = expand_response(5000);
+    auto const json   = Json::FastWriter().write(v);
+    auto const packed = utils::msgpack_encode(v);
+
+    REQUIRE(packed.size() < json.size() * 85 / 100);
+
+    // Sizes were made UInt64, and read back as ints, as they are
+    // from JSON.
+    REQUIRE(round_trip(v) == from_json(json));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,174 @@
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+#include <sched.h>
+
+#include "utils/netconfig.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Like tc-test.cc, changes are made in a network namespace of our
+// own, and skipped if we can't have one.
+static bool in_own_netns()
+{
+    static int result = -1;
+
+    if (result < 0)
+    {
+        result = unshare(CLONE_NEWNET) == 0 and
+            system("ip link set lo up") == 0 ? 1 : 0;
+    }
+
+    if (result == 0)
+    {
+        WARN("could not set up a network namespace; not testing changes");
+    }
+
+    return result == 1;
+}
+
+// Routes in /proc/net/route are in hex, in network byte order.
+static bool has_route(std::string const &dest_hex)
+{
+    std::ifstream in("/proc/net/route");
+    std::string   line;
+
+    while (std::getline(in, line))
+    {
+        std::istringstream ss(line);
+        std::string        iface, dest;
+
+        if (ss >> iface >> dest and dest == dest_hex)
+            return true;
+    }
+
+    return false;
+}
+
+static bool has_neighbor(std::string const &ip)
+{
+    std::ifstream in("/proc/net/arp");
+    std::string   line;
+
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, ip.size() + 1, ip + " ") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("arguments", "malformed items are refused up front")
+{
+    utils::NetConfigBatch batch;
+
+    REQUIRE_THROWS(batch.add_route("10.0.0.300", "", "", "lo"));
+    REQUIRE_THROWS(batch.add_route("10.0.0.0/33", "", "", "lo"));
+    REQUIRE_THROWS(batch.add_route("10.0.0.0", "", "255.0.255.0", "lo"));
+    REQUIRE_THROWS(batch.add_route("10.0.0.0/8", "", "", ""));
+    REQUIRE_THROWS(batch.add_route("10.0.0.0/8", "", "", "no-such-dev0"));
+    REQUIRE_THROWS(batch.add_neighbor("10.0.0.1", "00:11:22:33:44", "lo"));
+    REQUIRE_THROWS(batch.add_neighbor("10.0.0.1", "00:11:22:33:44:55", "no-such-dev0"));
+
+    REQUIRE(batch.size() == 0);
+}
+
+TEST_CASE("apply", "routes are applied in one batch")
+{
+    if (not in_own_netns())
+        return;
+
+    utils::NetConfigBatch batch;
+    batch.add_route("10.1.0.0/16", "", "", "lo");
+    batch.add_route("10.2.0.0", "", "255.255.0.0", "lo");
+    batch.add_route("10.3.0.0/16", "10.1.0.1", "", "");
+
+    std::vector<utils::NetConfigStatus> status;
+
+    REQUIRE(batch.apply(status));
+    REQUIRE(status.size() == 3);
+
+    for (auto const &st : status)
+    {
+        REQUIRE(st.error == 0);
+        REQUIRE(st.applied);
+    }
+
+    REQUIRE(has_route("0000010A"));
+    REQUIRE(has_route("0000020A"));
+    REQUIRE(has_route("0000030A"));
+
+    // Applying it again finds them there.
+    REQUIRE(batch.apply(status));
+
+    for (auto const &st : status)
+    {
+        REQUIRE(st.existed);
+        REQUIRE_FALSE(st.applied);
+    }
+}
+
+TEST_CASE("rollback", "a failed item undoes the others")
+{
+    if (not in_own_netns())
+        return;
+
+    utils::NetConfigBatch batch;
+    batch.add_route("10.4.0.0/16", "", "", "lo");
+    batch.add_route("10.5.0.0/16", "192.0.2.1", "", "");   // no route to gateway.
+    batch.add_route("10.6.0.0/16", "", "", "lo");
+
+    std::vector<utils::NetConfigStatus> status;
+
+    REQUIRE_FALSE(batch.apply(status));
+    REQUIRE(status.size() == 3);
+
+    REQUIRE(status[0].rolled_back);
+    REQUIRE(status[1].error != 0);
+    REQUIRE_FALSE(status[1].message.empty());
+    REQUIRE_FALSE(status[1].rolled_back);
+    REQUIRE(status[2].rolled_back);
+
+    REQUIRE_FALSE(has_route("0000040A"));
+    REQUIRE_FALSE(has_route("0000060A"));
+}
+
+TEST_CASE("neighbors", "neighbor entries are added, and rolled back")
+{
+    if (not in_own_netns() or system("ip link add nc0 type dummy 2>/dev/null") != 0)
+    {
+        WARN("no dummy device; not testing neighbors");
+        return;
+    }
+
+    REQUIRE(system("ip link set nc0 up") == 0);
+
+    utils::NetConfigBatch batch;
+    batch.add_neighbor("10.7.0.1", "00:11:22:33:44:55", "nc0");
+
+    std::vector<utils::NetConfigStatus> status;
+
+    REQUIRE(batch.apply(status));
+    REQUIRE(has_neighbor("10.7.0.1"));
+
+    utils::NetConfigBatch failing;
+    failing.add_neighbor("10.7.0.2", "00:11:22:33:44:56", "nc0");
+    failing.add_route("10.8.0.0/16", "192.0.2.1", "", "");
+
+    REQUIRE_FALSE(failing.apply(status));
+    REQUIRE(status[0].rolled_back);
+    REQUIRE_FALSE(has_neighbor("10.7.0.2"));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,167 @@
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "utils/echo.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Many DTN pairs being verified at once: every client connects, sends
+// a ping, and waits for the reversed reply, all at about the same
+// time.  Latency is from connect() to the reply.
+
+static double ping_latency(int port, std::string const &message)
+{
+    auto const start = std::chrono::steady_clock::now();
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sock < 0)
+    {
+        return -1;
+    }
+
+    timeval tv{5, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    std::string reply;
+
+    if (connect(sock, (sockaddr *) &addr, sizeof(addr)) == 0 and
+        write(sock, message.data(), message.size()) == ssize_t(message.size()))
+    {
+        char buf[64];
+
+        while (reply.size() < message.size())
+        {
+            auto n = read(sock, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            reply.append(buf, n);
+        }
+    }
+
+    close(sock);
+
+    if (reply != std::string(message.rbegin(), message.rend()))
+    {
+        return -1;
+    }
+
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> const &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// ----------------------------------------------------------------------
+
+// Pings from @clients@ threads at once; latencies sorted, -1 for the
+// pings that failed.
+static std::vector<double> concurrent_pings(int port, size_t clients)
+{
+    std::vector<double>      latencies(clients, -1);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < clients; i++)
+    {
+        threads.emplace_back([&, i]() {
+                latencies[i] = ping_latency(port, "ping " + std::to_string(i));
+            });
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    std::sort(latencies.begin(), latencies.end());
+
+    return latencies;
+}
+
+TEST_CASE("concurrent pings", "many pings at once all get replies")
+{
+    size_t const clients = 100;
+
+    utils::pong_server server(0, 4);
+    server.start();
+
+    auto const latencies = concurrent_pings(server.port(), clients);
+
+    REQUIRE(latencies.front() >= 0);
+
+    // Sessions report when they end, which may be just after the
+    // client got its reply.
+    for (int i = 0; i < 100 and server.stats().active > 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    auto const stats = server.stats();
+
+    REQUIRE(stats.active == 0);
+    REQUIRE(stats.sessions == clients);
+    REQUIRE(stats.pings == clients);
+    REQUIRE(stats.probes == 0);
+    REQUIRE(stats.bytes_in == stats.bytes_out);
+    REQUIRE(server.recent_sessions().size() > 0);
+}
+
+TEST_CASE("latency", "[.benchmark] reply latency of hundreds of pings at once")
+{
+    size_t const clients = 400;
+
+    utils::pong_server server(0, 4);
+    server.start();
+
+    auto const latencies = concurrent_pings(server.port(), clients);
+
+    REQUIRE(latencies.front() >= 0);
+
+    std::cout << clients << " concurrent pings: "
+              << "p50 " << percentile(latencies, 0.50) * 1e3 << " ms, "
+              << "p90 " << percentile(latencies, 0.90) * 1e3 << " ms, "
+              << "p99 " << percentile(latencies, 0.99) * 1e3 << " ms, "
+              << "max " << latencies.back() * 1e3 << " ms\n";
+}
+
+TEST_CASE("restart", "a stopped server can be started again")
+{
+    utils::pong_server server(0, 2);
+
+    server.start();
+    REQUIRE(ping_latency(server.port(), "one") >= 0);
+
+    server.stop();
+    server.start();
+    REQUIRE(ping_latency(server.port(), "two") >= 0);
+
+    server.stop();
+    REQUIRE(server.stats().sessions == 2);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
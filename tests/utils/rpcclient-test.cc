@@ -0,0 +1,37 @@
+#include <atomic>
+
+#include "utils/rpcclient.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// No broker needed: the client is never started, so requests go
+// nowhere and no response comes.
+
+TEST_CASE("destroyed", "calls in flight get the timed out reply when the client goes")
+{
+    std::atomic<int> called{0};
+    Json::Value      res;
+
+    {
+        RpcClient client("localhost", 1883);
+
+        client.call_async("nowhere", Json::Value(), [&](Json::Value const & v) {
+                res = v;
+                called++;
+            }, 60);
+
+        REQUIRE(called == 0);
+    }
+
+    REQUIRE(called == 1);
+    REQUIRE(res["timed_out"].asBool());
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
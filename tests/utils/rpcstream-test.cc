@@ -0,0 +1,186 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "utils/rpcserver.h"
+#include "utils/rpcclient.h"
+#include "utils/dispatcher.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// The two ends of a streamed response, without a broker between
+// them: what RpcResponseStream sends is pushed to an RpcStreamReader
+// as RpcClient::on_msg() would.
+
+using namespace std::chrono;
+
+static Json::Value chunk(int n)
+{
+    Json::Value v;
+    v["code"]  = 0;
+    v["chunk"] = n;
+    return v;
+}
+
+TEST_CASE("response stream", "partials, a trailer and the end are numbered in order")
+{
+    std::vector<Json::Value> sent;
+
+    RpcResponseStream stream([&sent](Json::Value const &v) { sent.push_back(v); });
+
+    REQUIRE(stream.enabled());
+    REQUIRE_FALSE(stream.started());
+
+    stream.send(chunk(0));
+    stream.send(chunk(1));
+    stream.send(chunk(2), "trailer");
+
+    auto const end = stream.finish(chunk(3));
+
+    REQUIRE(sent.size() == 3);
+
+    for (int i = 0; i < 3; i++)
+    {
+        REQUIRE(sent[i]["seq"].asInt() == i);
+        REQUIRE(sent[i]["chunk"].asInt() == i);
+    }
+
+    REQUIRE(sent[0]["stream"] == "partial");
+    REQUIRE(sent[1]["stream"] == "partial");
+    REQUIRE(sent[2]["stream"] == "trailer");
+    REQUIRE(end["stream"] == "end");
+    REQUIRE(end["seq"].asInt() == 3);
+    REQUIRE(stream.sequence() == 4);
+
+    // Nothing streamed: the reply goes as it is.
+    RpcResponseStream unused([](Json::Value const &) { });
+    REQUIRE(unused.finish(chunk(0)) == chunk(0));
+
+    RpcResponseStream disabled;
+    REQUIRE_FALSE(disabled.enabled());
+    REQUIRE_THROWS(disabled.send(chunk(0)));
+    REQUIRE(disabled.finish(chunk(0)) == chunk(0));
+}
+
+TEST_CASE("reader", "the timeout is between two messages, not for the whole call")
+{
+    RpcStreamReader reader;
+    RpcResponseStream stream([&reader](Json::Value const &v) { reader.push(v); });
+
+    int const chunks = 10;
+
+    // Half a second in all, a message every 50 ms.
+    std::thread server([&]() {
+            for (int i = 0; i < chunks; i++)
+            {
+                std::this_thread::sleep_for(milliseconds(50));
+                stream.send(chunk(i), i + 1 < chunks ? "partial" : "trailer");
+            }
+
+            std::this_thread::sleep_for(milliseconds(50));
+            reader.push(stream.finish(chunk(chunks)));
+        });
+
+    std::vector<int> seen;
+
+    auto const res = reader.read([&seen](Json::Value const &v) {
+            REQUIRE(v["seq"].asInt() == static_cast<int>(seen.size()));
+            seen.push_back(v["chunk"].asInt());
+        }, milliseconds(200));
+
+    server.join();
+
+    REQUIRE(seen.size() == chunks);
+    REQUIRE(seen.back() == chunks - 1);
+    REQUIRE(res["stream"] == "end");
+    REQUIRE(res["seq"].asInt() == chunks);
+}
+
+TEST_CASE("timeout", "a stream that stops coming times out")
+{
+    RpcStreamReader reader;
+    RpcResponseStream stream([&reader](Json::Value const &v) { reader.push(v); });
+
+    stream.send(chunk(0));
+    stream.send(chunk(1));
+
+    int seen = 0;
+
+    auto const start = steady_clock::now();
+    auto const res   = reader.read([&seen](Json::Value const &) { seen++; }, milliseconds(100));
+
+    REQUIRE(res.isNull());
+    REQUIRE(seen == 2);
+    REQUIRE(steady_clock::now() - start >= milliseconds(100));
+}
+
+TEST_CASE("not streamed", "a plain reply ends the call")
+{
+    RpcStreamReader reader;
+
+    // What a server that does not stream the command sends.
+    reader.push(chunk(0));
+
+    int seen = 0;
+
+    auto const res = reader.read([&seen](Json::Value const &) { seen++; }, milliseconds(100));
+
+    REQUIRE(seen == 0);
+    REQUIRE(res == chunk(0));
+}
+
+TEST_CASE("order", "chunks handed to MQTT workers come out in order")
+{
+    RpcStreamReader reader;
+
+    // Parsed and handed over as Mqtt and RpcClient::on_msg() do.
+    utils::MessageDispatcher dispatcher(4, [&reader](std::string const &, char const *data, size_t len) {
+            Json::Value msg;
+
+            if (Json::Reader().parse(data, data + len, msg) and msg["corr_id"] == "stream")
+                reader.push(msg["body"]);
+        });
+
+    auto post = [&dispatcher](std::string const &corr_id, Json::Value const &body) {
+        Json::Value msg;
+        msg["corr_id"] = corr_id;
+        msg["body"]    = body;
+
+        auto const s = Json::FastWriter().write(msg);
+        dispatcher.post("rpc-res/x", s.data(), s.size());
+    };
+
+    RpcResponseStream stream([&post](Json::Value const &v) { post("stream", v); });
+
+    int const chunks = 2000;
+
+    for (int i = 0; i < chunks; i++)
+    {
+        stream.send(chunk(i), i + 1 < chunks ? "partial" : "trailer");
+
+        // Responses to other calls in between.
+        post("other-" + std::to_string(i % 7), chunk(i));
+    }
+
+    post("stream", stream.finish(chunk(chunks)));
+
+    int next = 0;
+
+    auto const res = reader.read([&next](Json::Value const &v) {
+            REQUIRE(v["chunk"].asInt() == next);
+            next++;
+        }, seconds(5));
+
+    REQUIRE(next == chunks);
+    REQUIRE(res["stream"] == "end");
+    REQUIRE(res["chunk"].asInt() == chunks);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,136 @@
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "utils/singleflight.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using namespace std::chrono;
+
+TEST_CASE("coalescing", "concurrent identical requests are computed once")
+{
+    utils::SingleFlight<int> flight;
+
+    std::atomic<int>   calls{0};
+    std::promise<void> gate;
+    auto               opened = gate.get_future().share();
+
+    auto slow = [&]() {
+        calls++;
+        opened.wait();
+        return 42;
+    };
+
+    std::vector<std::future<int>> results;
+
+    results.push_back(std::async(std::launch::async, [&]() {
+                return flight.get("k", milliseconds(0), slow);
+            }));
+
+    // The first one is in flight before the others ask.
+    while (calls == 0)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    for (int i = 0; i < 7; i++)
+    {
+        results.push_back(std::async(std::launch::async, [&]() {
+                    return flight.get("k", milliseconds(0), slow);
+                }));
+    }
+
+    while (flight.stats().coalesced < 7)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    // A different key is not held up.
+    REQUIRE(flight.get("other", milliseconds(0), []() { return 1; }) == 1);
+
+    gate.set_value();
+
+    for (auto &r : results)
+        REQUIRE(r.get() == 42);
+
+    REQUIRE(calls == 1);
+
+    auto const stats = flight.stats();
+
+    REQUIRE(stats.misses == 2);
+    REQUIRE(stats.coalesced == 7);
+    REQUIRE(stats.hits == 0);
+    REQUIRE(stats.entries == 0);    // nothing kept with no ttl.
+}
+
+TEST_CASE("ttl", "results are kept for a while")
+{
+    utils::SingleFlight<int> flight;
+
+    int calls = 0;
+    auto count = [&]() { return ++calls; };
+
+    REQUIRE(flight.get("k", milliseconds(50), count) == 1);
+    REQUIRE(flight.get("k", milliseconds(50), count) == 1);
+    REQUIRE(flight.stats().hits == 1);
+    REQUIRE(flight.stats().entries == 1);
+
+    std::this_thread::sleep_for(milliseconds(60));
+
+    REQUIRE(flight.get("k", milliseconds(50), count) == 2);
+
+    flight.clear();
+    REQUIRE(flight.get("k", milliseconds(50), count) == 3);
+
+    // Not worth keeping.
+    auto odd = [](int const &v) { return v % 2 == 1; };
+
+    REQUIRE(flight.get("j", milliseconds(1000), count, odd) == 4);
+    REQUIRE(flight.get("j", milliseconds(1000), count, odd) == 5);
+    REQUIRE(flight.get("j", milliseconds(1000), count, odd) == 5);
+}
+
+TEST_CASE("errors", "are shared, but not kept")
+{
+    utils::SingleFlight<int> flight;
+
+    std::atomic<int>   calls{0};
+    std::promise<void> gate;
+    auto               opened = gate.get_future().share();
+
+    auto failing = [&]() -> int {
+        calls++;
+        opened.wait();
+        throw std::runtime_error("no");
+    };
+
+    auto first = std::async(std::launch::async, [&]() {
+            return flight.get("k", seconds(10), failing);
+        });
+
+    while (calls == 0)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    auto second = std::async(std::launch::async, [&]() {
+            return flight.get("k", seconds(10), failing);
+        });
+
+    while (flight.stats().coalesced < 1)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    gate.set_value();
+
+    REQUIRE_THROWS_AS(first.get(), std::runtime_error);
+    REQUIRE_THROWS_AS(second.get(), std::runtime_error);
+    REQUIRE(calls == 1);
+
+    REQUIRE(flight.get("k", seconds(10), []() { return 7; }) == 7);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,146 @@
+#include <cstdlib>
+#include <set>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "utils/storagebench.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+class WorkDir
+{
+public:
+    WorkDir()
+    {
+        // Not /tmp, which may be tmpfs, where O_DIRECT is refused.
+        char tmpl[] = "./storagebench-test-XXXXXX";
+        REQUIRE(mkdtemp(tmpl) != nullptr);
+        path_ = tmpl;
+    }
+
+    ~WorkDir()
+    {
+        rmdir(path_.c_str());
+    }
+
+    std::string const &path() const { return path_; }
+
+    size_t entries() const
+    {
+        size_t count = 0;
+        DIR   *d     = opendir(path_.c_str());
+
+        while (auto *ent = readdir(d))
+        {
+            if (ent->d_name[0] != '.')
+                count++;
+        }
+
+        closedir(d);
+        return count;
+    }
+
+private:
+    std::string path_;
+};
+
+static utils::StorageBenchParams small_params(std::string const &dir)
+{
+    utils::StorageBenchParams params;
+    params.dir         = dir;
+    params.block_size  = 256 << 10;
+    params.file_size   = 4 << 20;
+    params.queue_depth = 4;
+    params.files       = 2;
+    return params;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("bench", "write and read files, and clean up")
+{
+    WorkDir dir;
+
+    std::set<std::string> prepared;
+
+    auto params = small_params(dir.path());
+    params.prepare = [&prepared](std::string const &path) {
+        prepared.insert(path);
+    };
+
+    auto const r = utils::run_storage_bench(params, 2);
+
+    REQUIRE(r.threads == 2);
+    REQUIRE(r.write_mbps > 0);
+    REQUIRE(r.read_mbps > 0);
+
+    // Two files on each of two threads.
+    REQUIRE(prepared.size() == 4);
+    REQUIRE(dir.entries() == 0);
+}
+
+TEST_CASE("odd sizes", "sizes are rounded up to what O_DIRECT takes")
+{
+    WorkDir dir;
+
+    auto params = small_params(dir.path());
+    params.block_size  = 1000;
+    params.file_size   = 10000;
+    params.queue_depth = 1;
+    params.files       = 1;
+
+    auto const r = utils::run_storage_bench(params, 1);
+
+    REQUIRE(r.write_mbps > 0);
+    REQUIRE(dir.entries() == 0);
+}
+
+TEST_CASE("errors", "bad parameters and missing folders throw")
+{
+    WorkDir dir;
+
+    auto params = small_params(dir.path());
+
+    REQUIRE_THROWS(utils::run_storage_bench(params, 0));
+
+    params.dir = dir.path() + "/no-such-folder";
+    REQUIRE_THROWS(utils::run_storage_bench(params, 1));
+}
+
+TEST_CASE("sweep", "bandwidth against thread count")
+{
+    WorkDir dir;
+
+    auto const curve = utils::storage_bench_sweep(small_params(dir.path()), 4);
+
+    REQUIRE_FALSE(curve.points.empty());
+    REQUIRE(curve.points.size() <= 3);
+    REQUIRE(curve.points[0].threads == 1);
+    REQUIRE(curve.saturation_threads >= 1);
+    REQUIRE(curve.saturation_threads <= 4);
+    REQUIRE(curve.peak_write_mbps >= curve.saturation_write_mbps);
+    REQUIRE(curve.peak_read_mbps >= curve.saturation_read_mbps);
+    REQUIRE(dir.entries() == 0);
+}
+
+TEST_CASE("capacity", "storage capacity is in bytes/s, as admission control takes it")
+{
+    // 1200 MB/s writes, 800 MB/s reads: 800e6 bytes/s.
+    REQUIRE(utils::storage_capacity_bps(1200, 800) == Approx(800e6));
+    REQUIRE(utils::storage_capacity_bps(500, 900) == Approx(500e6));
+
+    // Against a 100 MB/s transfer, as ResourceManager compares them.
+    double const rate = 100e6;
+    REQUIRE(utils::storage_capacity_bps(1200, 800) > rate);
+    REQUIRE(utils::storage_capacity_bps(50, 800) < rate);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,219 @@
+#include <chrono>
+#include <iostream>
+
+#include <sched.h>
+
+#include "utils/tc.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Changes go to the loopback device of a network namespace of our
+// own, so that the host's traffic control is left alone.  That needs
+// CAP_SYS_ADMIN; without it, the tests that change things are
+// skipped.
+static bool in_own_netns()
+{
+    static int result = -1;
+
+    if (result < 0)
+    {
+        result = unshare(CLONE_NEWNET) == 0 ? 1 : 0;
+    }
+
+    if (result == 0)
+    {
+        WARN("could not create a network namespace; not testing changes");
+    }
+
+    return result == 1;
+}
+
+// Not every kernel has every qdisc built or loadable.
+static bool qdisc_available(std::string const &kind)
+{
+    try
+    {
+        utils::TcBatch batch("lo");
+
+        if (kind == "prio")
+            batch.add_prio_qdisc("ffff:");
+        else if (kind == "fq")
+            batch.replace_fq_qdisc("ffff:");
+        else
+            batch.add_htb_qdisc("ffff:");
+
+        batch.commit();
+        utils::TcBatch("lo").delete_qdisc("root").commit();
+        return true;
+    }
+    catch (std::exception const &ex)
+    {
+        WARN("no " + kind + " qdisc here (" + ex.what() + "); not testing it");
+        return false;
+    }
+}
+
+static bool has_qdisc(std::string const &kind, std::string const &handle)
+{
+    for (auto const &q : utils::tc_list_qdiscs("lo"))
+    {
+        if (q.kind == kind and utils::tc_format_handle(q.handle) == handle)
+            return true;
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("handles", "tc handles are parsed the way tc(8) does")
+{
+    REQUIRE(utils::tc_parse_handle("1:")    == 0x00010000);
+    REQUIRE(utils::tc_parse_handle("1:0")   == 0x00010000);
+    REQUIRE(utils::tc_parse_handle("1:10")  == 0x00010010);
+    REQUIRE(utils::tc_parse_handle("ffff:") == 0xffff0000);
+
+    REQUIRE(utils::tc_format_handle(0x00010010) == "1:10");
+    REQUIRE(utils::tc_format_handle(0x00200000) == "20:");
+
+    REQUIRE_THROWS(utils::tc_parse_handle("1"));
+    REQUIRE_THROWS(utils::tc_parse_handle(":1"));
+    REQUIRE_THROWS(utils::tc_parse_handle("1:xyz"));
+    REQUIRE_THROWS(utils::tc_parse_handle("10000:"));
+
+    // fq can't pace above 32 bits of bytes per second.
+    REQUIRE_THROWS(utils::TcBatch("lo").replace_fq_qdisc("1:", "root", 8ull * UINT32_MAX));
+    REQUIRE_NOTHROW(utils::TcBatch("lo").replace_fq_qdisc("1:", "root", 8ull * (UINT32_MAX - 1)));
+
+    REQUIRE_THROWS(utils::TcBatch("no-such-dev0"));
+}
+
+// An htb qdisc, two classes, and @nfilters@ u32 filters.
+static void add_filters(utils::TcBatch &batch, size_t nfilters)
+{
+    batch.add_htb_qdisc("1:");
+    batch.add_htb_class("1:1", "1:", 1000000000ull);
+    batch.add_htb_class("1:2", "1:", 1000000000ull);
+
+    for (size_t i = 0; i < nfilters; i++)
+    {
+        auto src = "10.0." + std::to_string(i / 250) + "." + std::to_string(i % 250 + 1);
+        batch.add_u32_filter("1:", 1, src, "1:" + std::to_string(i % 2 + 1));
+    }
+}
+
+TEST_CASE("batch", "a qdisc with many u32 filters, in one batch")
+{
+    if (not in_own_netns() or not qdisc_available("htb"))
+        return;
+
+    size_t const nfilters = 200;
+
+    utils::TcBatch batch("lo");
+    add_filters(batch, nfilters);
+
+    REQUIRE(batch.size() == nfilters + 3);
+
+    batch.commit();
+
+    REQUIRE(batch.size() == 0);
+    REQUIRE(has_qdisc("htb", "1:"));
+
+    // Adding it again fails, and says what failed.
+    try
+    {
+        utils::TcBatch("lo").add_htb_qdisc("1:").commit();
+        FAIL("adding the same qdisc twice should fail");
+    }
+    catch (std::runtime_error const &ex)
+    {
+        REQUIRE(std::string(ex.what()).find("add htb qdisc 1:") != std::string::npos);
+    }
+
+    utils::TcBatch("lo").delete_qdisc("root").commit();
+    REQUIRE_FALSE(has_qdisc("htb", "1:"));
+}
+
+TEST_CASE("batch timing", "[.benchmark] how long a large batch takes")
+{
+    if (not in_own_netns() or not qdisc_available("htb"))
+        return;
+
+    size_t const nfilters = 200;
+
+    utils::TcBatch batch("lo");
+    add_filters(batch, nfilters);
+
+    auto const start = std::chrono::steady_clock::now();
+    batch.commit();
+    auto const usecs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << nfilters + 3 << " tc changes in " << usecs << " us, "
+              << double(usecs) / (nfilters + 3) << " us each\n";
+
+    utils::TcBatch("lo").delete_qdisc("root").commit();
+}
+
+TEST_CASE("prio", "a prio qdisc, as DTNAgent::add_queue() makes")
+{
+    if (not in_own_netns() or not qdisc_available("prio"))
+        return;
+
+    utils::TcBatch("lo")
+        .add_prio_qdisc("1:")
+        .add_u32_filter("1:", 1, "10.0.0.1", "1:1")
+        .commit();
+
+    REQUIRE(has_qdisc("prio", "1:"));
+
+    utils::TcBatch("lo").delete_qdisc("root").commit();
+    REQUIRE_FALSE(has_qdisc("prio", "1:"));
+}
+
+TEST_CASE("htb", "htb classes, including rates that need 64 bits")
+{
+    if (not in_own_netns() or not qdisc_available("htb"))
+        return;
+
+    utils::TcBatch("lo")
+        .add_htb_qdisc("1:", "root", 0x10)
+        .add_htb_class("1:1", "1:", 100000000000ull)
+        .add_htb_class("1:10", "1:1", 10000000000ull, 40000000000ull)
+        .add_htb_class("1:20", "1:1", 1000000000ull)
+        .add_u32_filter("1:", 1, "10.1.0.0/16", "1:20")
+        .add_u32_filter("1:", 1, "10.2.0.0/16", "1:20", true)
+        .commit();
+
+    REQUIRE(has_qdisc("htb", "1:"));
+
+    REQUIRE_THROWS(utils::TcBatch("lo").add_htb_class("1:30", "1:1", 0));
+    REQUIRE_THROWS(utils::TcBatch("lo").add_u32_filter("1:", 1, "10.300.0.0", "1:10"));
+
+    utils::TcBatch("lo").delete_qdisc("root").commit();
+}
+
+TEST_CASE("fq", "pacing with fq can be set up, changed, and removed")
+{
+    if (not in_own_netns() or not qdisc_available("fq"))
+        return;
+
+    utils::TcBatch("lo").replace_fq_qdisc("1:", "root", 1000000000ull).commit();
+    REQUIRE(has_qdisc("fq", "1:"));
+
+    // Replacing works when it's there already.
+    utils::TcBatch("lo").replace_fq_qdisc("1:", "root", 0).commit();
+    REQUIRE(has_qdisc("fq", "1:"));
+
+    utils::TcBatch("lo").delete_qdisc("root").commit();
+    REQUIRE_FALSE(has_qdisc("fq", "1:"));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
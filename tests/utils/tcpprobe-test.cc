@@ -0,0 +1,143 @@
+#include <thread>
+#include <memory>
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "utils/echo.h"
+#include "utils/tcpprobe.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// A pong server on a loopback port of its own, for the duration of
+// a test.
+class pong_fixture
+{
+public:
+    pong_fixture()
+        : server_(0, 2) {
+        server_.start();
+    }
+
+    int port() const { return server_.port(); }
+
+    utils::pong_server &server() { return server_; }
+
+private:
+    utils::pong_server server_;
+};
+
+static std::string ping(int port, std::string const &message)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (connect(sock, (sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return "";
+    }
+
+    write(sock, message.data(), message.size());
+
+    char buf[64] = {0};
+    auto n = read(sock, buf, message.size());
+    close(sock);
+
+    return n > 0 ? std::string(buf, n) : "";
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("ping", "pings still get a reversed reply")
+{
+    pong_fixture pong;
+
+    REQUIRE(ping(pong.port(), "Hello Big Data Express 1.0!") ==
+            "!0.1 sserpxE ataD giB olleH");
+}
+
+TEST_CASE("volume", "a fixed volume is all received")
+{
+    pong_fixture pong;
+
+    utils::tcp_probe_params params;
+    params.host        = "127.0.0.1";
+    params.port        = pong.port();
+    params.streams     = 3;
+    params.duration    = 0;
+    params.bytes       = 10 * 1000 * 1000 + 1;
+    params.buffer_size = 64 * 1024;
+
+    auto result = utils::tcp_probe(params);
+
+    REQUIRE(result.ok());
+    REQUIRE(result.streams.size() == 3);
+    REQUIRE(result.bytes == params.bytes);
+    REQUIRE(result.gbps > 0);
+
+    for (auto const &s : result.streams)
+    {
+        REQUIRE(s.bytes_sent == s.bytes_received);
+    }
+}
+
+TEST_CASE("duration", "streams run for the given time")
+{
+    pong_fixture pong;
+
+    utils::tcp_probe_params params;
+    params.host     = "127.0.0.1";
+    params.port     = pong.port();
+    params.streams  = 4;
+    params.duration = 0.5;
+    params.zerocopy = true;
+
+    auto result = utils::tcp_probe(params);
+
+    REQUIRE(result.ok());
+    REQUIRE(result.seconds >= 0.5);
+    REQUIRE(result.bytes > 0);
+    REQUIRE(result.rtt_samples > 0);
+    REQUIRE(result.rtt_min <= result.rtt_p50);
+    REQUIRE(result.rtt_p50 <= result.rtt_max);
+}
+
+TEST_CASE("errors", "bad parameters and unreachable servers")
+{
+    utils::tcp_probe_params params;
+    REQUIRE_THROWS(utils::tcp_probe(params));
+
+    int port = 0;
+    {
+        pong_fixture pong;
+        port = pong.port();
+    }
+
+    params.host     = "127.0.0.1";
+    params.port     = port;
+    params.streams  = 2;
+    params.duration = 0.1;
+
+    auto result = utils::tcp_probe(params);
+
+    REQUIRE_FALSE(result.ok());
+    REQUIRE_FALSE(result.streams[0].error.empty());
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
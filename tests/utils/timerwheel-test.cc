@@ -0,0 +1,101 @@
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "utils/timerwheel.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using namespace std::chrono;
+
+TEST_CASE("order", "timers run once, in the order they are due, never early")
+{
+    utils::TimerWheel wheel(milliseconds(5), 8);
+
+    auto const start = steady_clock::now();
+
+    std::mutex                 mutex;
+    std::vector<int>           order;
+    std::vector<milliseconds>  waited;
+
+    auto timer = [&](int n) {
+        return [&, n]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(n);
+            waited.push_back(duration_cast<milliseconds>(steady_clock::now() - start));
+        };
+    };
+
+    // Longer than the wheel goes round, too.
+    wheel.schedule(milliseconds(120), timer(3));
+    wheel.schedule(milliseconds(10), timer(1));
+    wheel.schedule(milliseconds(45), timer(2));
+    wheel.schedule(milliseconds(0), timer(0));
+
+    REQUIRE(wheel.pending() == 4);
+
+    while (wheel.pending() > 0)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    REQUIRE(order == std::vector<int>({0, 1, 2, 3}));
+    REQUIRE(waited[1] >= milliseconds(10));
+    REQUIRE(waited[2] >= milliseconds(45));
+    REQUIRE(waited[3] >= milliseconds(120));
+}
+
+TEST_CASE("many", "thousands of timers from many threads")
+{
+    std::atomic<int> fired{0};
+
+    utils::TimerWheel wheel(milliseconds(2), 64);
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&wheel, &fired, t]() {
+                for (int i = 0; i < 2500; i++)
+                    wheel.schedule(milliseconds((i * 7 + t) % 50), [&fired]() { fired++; });
+            });
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    while (wheel.pending() > 0)
+        std::this_thread::sleep_for(milliseconds(1));
+
+    REQUIRE(fired == 10000);
+}
+
+TEST_CASE("stop", "timers not due are dropped")
+{
+    std::atomic<int> fired{0};
+
+    utils::TimerWheel wheel(milliseconds(5), 8);
+
+    wheel.schedule(seconds(10), [&fired]() { fired++; });
+    wheel.stop();
+
+    REQUIRE(wheel.pending() == 0);
+
+    wheel.schedule(milliseconds(0), [&fired]() { fired++; });
+
+    REQUIRE(wheel.pending() == 0);
+    REQUIRE(fired == 0);
+    REQUIRE_THROWS(utils::TimerWheel(milliseconds(0), 8));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,191 @@
+#include <fstream>
+#include <thread>
+#include <cstdlib>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "utils/topology.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// A fixture sysfs/procfs tree of a dual-socket host, with eth2 on node
+// 1 and two of its three IRQs routed to node 0.
+class FixtureTree
+{
+public:
+    FixtureTree()
+    {
+        char tmpl[] = "/tmp/topology-test-XXXXXX";
+        REQUIRE(mkdtemp(tmpl) != nullptr);
+        root_ = tmpl;
+
+        write("sys/devices/system/node/node0/cpulist", "0-7,16-23\n");
+        write("sys/devices/system/node/node1/cpulist", "8-15,24-31\n");
+        write("sys/devices/system/node/possible", "0-1\n");
+        write("sys/devices/system/cpu/online", "0-31\n");
+
+        write("sys/class/net/eth2/device/numa_node", "1\n");
+        write("sys/class/net/eth2/device/local_cpulist", "8-15,24-31\n");
+        write("sys/class/net/eth2/device/msi_irqs/120", "msix\n");
+        write("sys/class/net/eth2/device/msi_irqs/121", "msix\n");
+        write("sys/class/net/eth2/device/msi_irqs/99", "msix\n");
+        write("proc/irq/99/smp_affinity_list", "8\n");
+        write("proc/irq/120/smp_affinity_list", "0-31\n");
+        write("proc/irq/120/effective_affinity_list", "3\n");
+        write("proc/irq/121/smp_affinity_list", "0-7\n");
+
+        // virtual interfaces have no device.
+        write("sys/class/net/lo/mtu", "65536\n");
+    }
+
+    ~FixtureTree()
+    {
+        REQUIRE(system(("rm -rf " + root_).c_str()) == 0);
+    }
+
+    std::string sysfs() const  { return root_ + "/sys"; }
+    std::string procfs() const { return root_ + "/proc"; }
+
+    void write(std::string const &path, std::string const &text)
+    {
+        auto const full = root_ + "/" + path;
+        auto const dir  = full.substr(0, full.rfind('/'));
+
+        REQUIRE(system(("mkdir -p " + dir).c_str()) == 0);
+        std::ofstream(full) << text;
+    }
+
+private:
+    std::string root_;
+};
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("cpu lists", "parse and format kernel CPU lists")
+{
+    using utils::parse_cpu_list;
+    using utils::format_cpu_list;
+
+    REQUIRE(parse_cpu_list("") == std::vector<int>{});
+    REQUIRE(parse_cpu_list("3\n") == std::vector<int>{3});
+    REQUIRE(parse_cpu_list("0-3,8,10-11") ==
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    REQUIRE(parse_cpu_list("5,1-2,2") == (std::vector<int>{1, 2, 5}));
+
+    REQUIRE_THROWS(parse_cpu_list("3-1"));
+    REQUIRE_THROWS(parse_cpu_list("a-b"));
+    REQUIRE_THROWS(parse_cpu_list("1-2-3"));
+
+    REQUIRE(format_cpu_list({}) == "");
+    REQUIRE(format_cpu_list({4}) == "4");
+    REQUIRE(format_cpu_list({0, 1, 2, 3, 8, 10, 11}) == "0-3,8,10-11");
+}
+
+TEST_CASE("fixture topology", "nodes, NIC node, and IRQ affinities")
+{
+    FixtureTree tree;
+
+    auto const t = utils::Topology::read(tree.sysfs(), tree.procfs());
+
+    REQUIRE(t.nodes().size() == 2);
+    REQUIRE(t.nodes()[1].id == 1);
+    REQUIRE(utils::format_cpu_list(t.node_cpus(1)) == "8-15,24-31");
+    REQUIRE(t.node_cpus(7).empty());
+
+    auto const nic = t.nic("eth2");
+
+    REQUIRE(nic.numa_node == 1);
+    REQUIRE(utils::format_cpu_list(nic.local_cpus) == "8-15,24-31");
+    REQUIRE(nic.irqs.size() == 3);
+    REQUIRE(nic.irqs[0].irq == 99);
+    REQUIRE(nic.irqs[1].irq == 120);
+    REQUIRE(nic.irqs[1].effective == std::vector<int>{3});
+    REQUIRE(nic.irqs[2].effective.empty());
+
+    // 120 really goes to CPU 3, and 121 may go anywhere on node 0.
+    REQUIRE(nic.irqs_off_node() == 2);
+
+    auto const lo = t.nic("lo");
+
+    REQUIRE(lo.numa_node == -1);
+    REQUIRE(lo.irqs.empty());
+    REQUIRE(lo.irqs_off_node() == 0);
+}
+
+TEST_CASE("no numa", "hosts without NUMA are a single node")
+{
+    FixtureTree tree;
+
+    REQUIRE(system(("rm -rf " + tree.sysfs() + "/devices/system/node").c_str()) == 0);
+    tree.write("sys/class/net/eth2/device/numa_node", "-1\n");
+
+    auto const t = utils::Topology::read(tree.sysfs(), tree.procfs());
+
+    REQUIRE(t.nodes().size() == 1);
+    REQUIRE(utils::format_cpu_list(t.nodes()[0].cpus) == "0-31");
+    REQUIRE(t.nic("eth2").numa_node == 0);
+
+    // and there is nowhere better to be.
+    REQUIRE(utils::nic_local_placement(t, "eth2", "nic-local").empty());
+}
+
+TEST_CASE("placement policies", "placement near a NIC")
+{
+    FixtureTree tree;
+
+    auto const t = utils::Topology::read(tree.sysfs(), tree.procfs());
+
+    REQUIRE(utils::nic_local_placement(t, "eth2", "none").empty());
+    REQUIRE(utils::nic_local_placement(t, "eth2", "").empty());
+    REQUIRE(utils::nic_local_placement(t, "lo", "nic-local").empty());
+    REQUIRE_THROWS(utils::nic_local_placement(t, "eth2", "socket-0"));
+
+    auto const p = utils::nic_local_placement(t, "eth2", "nic-local");
+
+    REQUIRE(utils::format_cpu_list(p.cpus) == "8-15,24-31");
+    REQUIRE(p.mem_nodes == std::vector<int>{1});
+    REQUIRE_FALSE(p.strict);
+
+    auto const s = utils::nic_local_placement(t, "eth2", "nic-local-strict");
+
+    REQUIRE(s.strict);
+    REQUIRE(s.describe() == "cpus 8-15,24-31, memory on node 1");
+}
+
+TEST_CASE("apply placement", "affinity is applied to the calling thread")
+{
+    cpu_set_t before;
+    REQUIRE(sched_getaffinity(0, sizeof(before), &before) == 0);
+
+    int cpu = 0;
+    while (not CPU_ISSET(cpu, &before))
+        cpu++;
+
+    std::string error;
+    cpu_set_t   after;
+
+    // On a thread of its own, so the rest of the tests are left alone.
+    std::thread([&]() {
+        utils::CpuPlacement p;
+        p.cpus = {cpu};
+        p.mem_nodes = {0};
+
+        error = utils::apply_placement(p);
+        sched_getaffinity(0, sizeof(after), &after);
+    }).join();
+
+    INFO(error);
+    REQUIRE(error.empty());
+    REQUIRE(CPU_COUNT(&after) == 1);
+    REQUIRE(CPU_ISSET(cpu, &after));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,249 @@
+#include <chrono>
+#include <climits>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+
+#include "utils/tsdb-helpers.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+using Encoder = utils::LineEncoder<3,
+                                   size_t, size_t, size_t, size_t,
+                                   size_t, size_t, size_t, size_t>;
+
+static std::array<std::string, 8> const interface_fields =
+    { "rx-bytes", "rx-packets", "rx-dropped", "rx-errors",
+      "tx-bytes", "tx-packets", "tx-dropped", "tx-errors" };
+
+static std::array<std::string, 3> const interface_tags =
+    { "name", "id", "interface" };
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("encode", "a point in line protocol")
+{
+    Encoder enc("network", interface_fields, interface_tags);
+
+    std::string out;
+
+    REQUIRE(enc.encode(out, 1, 2, 3, 4, 5, 6, 7, 8,
+                       {"DTN Agent", "id-1", "eth0"}, 1500000000000000000LL));
+
+    REQUIRE(out == "network,name=DTN\\ Agent,id=id-1,interface=eth0 "
+            "rx-bytes=1,rx-packets=2,rx-dropped=3,rx-errors=4,"
+            "tx-bytes=5,tx-packets=6,tx-dropped=7,tx-errors=8 "
+            "1500000000000000000");
+
+    // Appends, and tags with no value are left out.
+    out = "x\n";
+
+    REQUIRE(enc.encode(out, 0, 0, 0, 0, 0, 0, 0, SIZE_MAX,
+                       {"", "id-1", ""}, 0));
+    REQUIRE(out == "x\nnetwork,id=id-1 rx-bytes=0,rx-packets=0,rx-dropped=0,"
+            "rx-errors=0,tx-bytes=0,tx-packets=0,tx-dropped=0,"
+            "tx-errors=18446744073709551615 0");
+}
+
+TEST_CASE("escaping", "names and values with special characters")
+{
+    utils::LineEncoder<1, std::string, int> enc("my measure,x=1",
+                                                {"a field", "b=c"},
+                                                {"t,k"});
+    std::string out;
+
+    REQUIRE(enc.encode(out, "say \"hi\" \\o/", -1, {"v=1 2"}, 5));
+    REQUIRE(out == "my\\ measure\\,x=1,t\\,k=v\\=1\\ 2 "
+            "a\\ field=\"say \\\"hi\\\" \\\\o/\",b\\=c=-1 5");
+
+    REQUIRE(utils::escape("has\ttab") == "has\\\ttab");
+}
+
+TEST_CASE("values", "numbers and booleans")
+{
+    auto one = [](double v) {
+        utils::LineEncoder<0, double> enc("m", {"f"}, {});
+        std::string out;
+        enc.encode(out, v, {}, 0);
+        return out;
+    };
+
+    REQUIRE(one(0.5) == "m f=0.5 0");
+    REQUIRE(one(3) == "m f=3 0");
+    REQUIRE(one(-2.25) == "m f=-2.25 0");
+    REQUIRE(one(0.1) == "m f=0.1 0");
+    REQUIRE(std::stod(one(DBL_MAX).substr(4)) == DBL_MAX);
+    REQUIRE(std::stod(one(DBL_MIN).substr(4)) == DBL_MIN);
+
+    // No field left: no point.
+    REQUIRE(one(NAN) == "");
+    REQUIRE(one(INFINITY) == "");
+
+    utils::LineEncoder<0, bool, float, int64_t, char const *> mixed("m", {"b", "f", "i", "s"}, {});
+    std::string out;
+
+    REQUIRE(mixed.encode(out, true, 1.1f, LLONG_MIN, "x", {}, 7));
+    REQUIRE(out == "m b=true,f=1.1,i=-9223372036854775808,s=\"x\" 7");
+
+    // A field without a value is left out; the rest stay.
+    out.clear();
+    REQUIRE(mixed.encode(out, false, NAN, 1, "", {}, 7));
+    REQUIRE(out == "m b=false,i=1,s=\"\" 7");
+}
+
+// ----------------------------------------------------------------------
+
+// What TimeSeriesMeasurement used to do for every point: build the
+// measurement object, then the line, by string concatenation.
+namespace legacy
+{
+    template<typename T>
+    static std::string format(T const &v) {
+        return std::to_string(v);
+    }
+
+    template <typename Tuple, size_t TupleSize, size_t FieldsSize>
+    struct field_set_builder {
+        static void build(std::string &str,
+                          Tuple const &tup,
+                          std::array<std::string, FieldsSize> const &fs) {
+
+            field_set_builder<Tuple, TupleSize-1, FieldsSize>::build(str, tup, fs);
+
+            auto key = fs.at(TupleSize-1);
+            auto val = format(std::get<TupleSize-1>(tup));
+
+            if (!key.empty() and !val.empty()) {
+                str += "," + key + "=" + val;
+            }
+        }
+    };
+
+    template <typename Tuple, size_t FieldsSize>
+    struct field_set_builder<Tuple, 1, FieldsSize> {
+        static void build(std::string &str,
+                          Tuple const &tup,
+                          std::array<std::string, FieldsSize> const &fs) {
+            auto key = fs.at(0);
+            auto val = format(std::get<0>(tup));
+
+            if (!key.empty() and !val.empty()) {
+                str += utils::escape(key) + "=" + val;
+            }
+        }
+    };
+
+    template <size_t NumTags>
+    struct tag_set_builder {
+        static std::string build(std::array<std::string, NumTags> const &tag_names,
+                                 std::array<std::string, NumTags> const &tag_values) {
+            std::string str{};
+
+            for (size_t i = 0; i < NumTags; ++i) {
+                auto key = tag_names.at(i);
+                auto val = tag_values.at(i);
+
+                if (!key.empty() and !val.empty()) {
+                    str += "," + utils::escape(key) + "=" + utils::escape(val);
+                }
+            }
+
+            return str;
+        }
+    };
+
+    template<size_t NUM_TAGS, typename... Fields>
+    class Measurement {
+        static constexpr auto NUM_FIELDS = sizeof...(Fields);
+
+    public:
+        Measurement(std::string const                         &measurement,
+                    std::array<std::string, NUM_FIELDS> const &field_names,
+                    std::array<std::string, NUM_TAGS> const   &tag_names)
+            : measurement_(measurement)
+            , field_names_(field_names)
+            , tag_names_(tag_names) { }
+
+        std::string line(Fields const ... field_values,
+                         std::array<std::string, NUM_TAGS> const &tag_values) {
+            auto query = measurement_;
+            query += tag_set_builder<NUM_TAGS>::build(tag_names_, tag_values);
+
+            std::string val_str{};
+            auto row = std::make_tuple(field_values...);
+
+            field_set_builder<std::tuple<Fields...>,
+                              NUM_FIELDS, NUM_FIELDS>::build(val_str,
+                                                             row,
+                                                             field_names_);
+
+            query += " " + val_str;
+            query += " " + std::to_string(0);
+
+            return query;
+        }
+
+    private:
+        std::string const                   measurement_;
+        std::array<std::string, NUM_FIELDS> field_names_;
+        std::array<std::string, NUM_TAGS>   tag_names_;
+    };
+}
+
+TEST_CASE("benchmark", "[.benchmark] points per second, before and after")
+{
+    size_t const points = 200000;
+    size_t       bytes  = 0;
+
+    using clock = std::chrono::steady_clock;
+
+    auto const t0 = clock::now();
+
+    for (size_t i = 0; i < points; i++)
+    {
+        legacy::Measurement<3,
+                            size_t, size_t, size_t, size_t,
+                            size_t, size_t, size_t, size_t>
+            m("network", interface_fields, interface_tags);
+
+        bytes += m.line(i, i + 1, 0, 0, i * 1500, i * 2, 0, 0,
+                        {"DTN Agent", "id-1", "eth0"}).size();
+    }
+
+    auto const t1 = clock::now();
+
+    Encoder     enc("network", interface_fields, interface_tags);
+    std::string buffer;
+
+    for (size_t i = 0; i < points; i++)
+    {
+        buffer.clear();
+        enc.encode(buffer, i, i + 1, 0, 0, i * 1500, i * 2, 0, 0,
+                   {"DTN Agent", "id-1", "eth0"}, 0);
+        bytes -= buffer.size();
+    }
+
+    auto const t2 = clock::now();
+
+    // Same lines, as long as the numbers are whole.
+    REQUIRE(bytes == 0);
+
+    double const before = points / std::chrono::duration<double>(t1 - t0).count();
+    double const after  = points / std::chrono::duration<double>(t2 - t1).count();
+
+    std::cout << "line protocol encoding, " << points << " points:\n"
+              << "  before: " << size_t(before) << " points/s\n"
+              << "  after:  " << size_t(after) << " points/s ("
+              << after / before << "x)\n";
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -161,6 +161,7 @@ TEST_CASE("tsdb", "simple insertion test")
         REQUIRE(tsdb.raw_query(deleteq).first == 200);
         REQUIRE(tsdb.raw_query(selectq).first == 200);
         REQUIRE(test_insert_00(tsdb, measure) == true);
+        tsdb.flush();
         REQUIRE(tsdb.raw_query(selectq).first == 200);
         REQUIRE(tsdb.raw_query(deleteq).first == 200);
     }
@@ -177,6 +178,7 @@ TEST_CASE("tsdb", "simple insertion test")
         REQUIRE(tsdb.raw_query(deleteq).first                  == 200);
         REQUIRE(tsdb.raw_query(selectq).first                  == 200);
         REQUIRE(test_insert_01(tsdb, host, measure, id, iface) == true);
+        tsdb.flush();
         REQUIRE(tsdb.raw_query(selectq).first                  == 200);
         REQUIRE(tsdb.raw_query(deleteq).first                  == 200);
     }
@@ -191,6 +193,7 @@ TEST_CASE("tsdb", "simple insertion test")
         REQUIRE(tsdb.raw_query(deleteq).first     == 200);
         REQUIRE(tsdb.raw_query(selectq).first     == 200);
         REQUIRE(test_insert_02(tsdb, measure, id) == true);
+        tsdb.flush();
         REQUIRE(tsdb.raw_query(selectq).first     == 200);
         REQUIRE(tsdb.raw_query(deleteq).first     == 200);
     }
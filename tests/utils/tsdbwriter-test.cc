@@ -0,0 +1,290 @@
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "utils/compress.h"
+#include "utils/tsdbwriter.h"
+
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+// ----------------------------------------------------------------------
+
+// Stands in for the database: records the batches it gets, or refuses
+// them while down.
+class FakeDatabase
+{
+public:
+    utils::TimeSeriesWriter::Post post()
+    {
+        return [this](std::string const &body, bool gzipped) {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (down)
+                return false;
+
+            batches_.push_back(gzipped ? gunzip(body) : body);
+            gzipped_ += gzipped;
+
+            return true;
+        };
+    }
+
+    std::vector<std::string> batches() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_;
+    }
+
+    // All points received, in order.
+    std::string points() const
+    {
+        std::string all;
+
+        for (auto const &b : batches())
+            all += b;
+
+        return all;
+    }
+
+    size_t gzipped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return gzipped_;
+    }
+
+    std::atomic<bool> down{false};
+
+private:
+    static std::string gunzip(std::string const &data)
+    {
+        z_stream zs{};
+        REQUIRE(inflateInit2(&zs, 15 + 16) == Z_OK);
+
+        std::string out(1 << 20, '\0');
+
+        zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        zs.avail_in  = data.size();
+        zs.next_out  = reinterpret_cast<Bytef *>(&out[0]);
+        zs.avail_out = out.size();
+
+        REQUIRE(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+
+        return out;
+    }
+
+    mutable std::mutex       mutex_;
+    std::vector<std::string> batches_;
+    size_t                   gzipped_ = 0;
+};
+
+static std::string point(int i)
+{
+    return "test,tag=t value=" + std::to_string(i) + " " + std::to_string(1000 + i);
+}
+
+static std::string spool_path()
+{
+    char tmpl[] = "/tmp/tsdbwriter-test-XXXXXX";
+    int  fd     = mkstemp(tmpl);
+    REQUIRE(fd >= 0);
+    close(fd);
+    unlink(tmpl);
+    return tmpl;
+}
+
+// ----------------------------------------------------------------------
+
+TEST_CASE("batch by count", "points go out in batches of batch_points")
+{
+    FakeDatabase db;
+
+    utils::TimeSeriesWriterConf conf;
+    conf.batch_points = 10;
+    conf.flush_ms     = 60000;
+
+    utils::TimeSeriesWriter writer(db.post(), conf);
+
+    for (int i = 0; i < 25; i++)
+        writer.write(point(i));
+
+    writer.flush();
+
+    auto const batches = db.batches();
+
+    REQUIRE(batches.size() == 3);
+    REQUIRE(batches[0] == [] {
+            std::string s;
+            for (int i = 0; i < 10; i++)
+                s += point(i) + "\n";
+            return s;
+        }());
+
+    auto const stats = writer.stats();
+    REQUIRE(stats.points_sent == 25);
+    REQUIRE(stats.batches_sent == 3);
+    REQUIRE(stats.queued == 0);
+}
+
+TEST_CASE("batch by time", "a lone point goes out after flush_ms")
+{
+    FakeDatabase db;
+
+    utils::TimeSeriesWriterConf conf;
+    conf.flush_ms = 50;
+
+    utils::TimeSeriesWriter writer(db.post(), conf);
+
+    writer.write(point(1));
+
+    for (int i = 0; i < 100 and db.batches().empty(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    REQUIRE(db.points() == point(1) + "\n");
+}
+
+TEST_CASE("gzip", "large batches are compressed")
+{
+    FakeDatabase db;
+
+    utils::TimeSeriesWriterConf conf;
+    conf.gzip       = true;
+    conf.gzip_bytes = 100;
+
+    utils::TimeSeriesWriter writer(db.post(), conf);
+
+    writer.write(point(1));
+    writer.flush();
+
+    for (int i = 0; i < 100; i++)
+        writer.write(point(i));
+    writer.flush();
+
+    REQUIRE(db.batches().size() == 2);
+    REQUIRE(db.gzipped() == 1);
+    REQUIRE(db.batches()[1].size() > 100 * point(0).size());
+
+    REQUIRE(utils::gzip_compress("", 0).size() > 0);
+}
+
+TEST_CASE("spool", "points are spooled while the database is down, then replayed")
+{
+    FakeDatabase db;
+    db.down = true;
+
+    auto const spool = spool_path();
+
+    utils::TimeSeriesWriterConf conf;
+    conf.batch_points = 5;
+    conf.spool        = spool;
+    conf.retry_ms     = 50;
+
+    std::string expected;
+
+    {
+        utils::TimeSeriesWriter writer(db.post(), conf);
+
+        for (int i = 0; i < 12; i++)
+        {
+            writer.write(point(i));
+            expected += point(i) + "\n";
+        }
+
+        writer.flush();
+
+        auto const stats = writer.stats();
+        REQUIRE(stats.points_spooled == 12);
+        REQUIRE(stats.points_sent == 0);
+        REQUIRE(stats.post_failures >= 1);
+        REQUIRE(stats.spool_bytes == expected.size());
+
+        // Back up: the spool goes first, in order.
+        db.down = false;
+
+        for (int i = 0; i < 100 and writer.stats().spool_bytes > 0; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        REQUIRE(writer.stats().points_replayed == 12);
+        REQUIRE(access(spool.c_str(), F_OK) != 0);
+
+        writer.write(point(12));
+        expected += point(12) + "\n";
+        writer.flush();
+    }
+
+    REQUIRE(db.points() == expected);
+}
+
+TEST_CASE("spool on restart", "a spool left behind is replayed")
+{
+    FakeDatabase db;
+
+    auto const spool = spool_path();
+
+    std::ofstream(spool) << point(1) << "\n" << point(2) << "\n";
+
+    utils::TimeSeriesWriterConf conf;
+    conf.spool = spool;
+
+    utils::TimeSeriesWriter writer(db.post(), conf);
+
+    for (int i = 0; i < 100 and writer.stats().points_replayed < 2; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    REQUIRE(db.points() == point(1) + "\n" + point(2) + "\n");
+    REQUIRE(access(spool.c_str(), F_OK) != 0);
+}
+
+TEST_CASE("bounds", "what does not fit is dropped")
+{
+    FakeDatabase db;
+    db.down = true;
+
+    auto const spool = spool_path();
+
+    utils::TimeSeriesWriterConf conf;
+    conf.batch_points = 1;
+    conf.spool        = spool;
+    conf.spool_bytes  = point(0).size() * 2 + 2;
+
+    {
+        utils::TimeSeriesWriter writer(db.post(), conf);
+
+        for (int i = 0; i < 5; i++)
+            writer.write(point(i));
+
+        writer.flush();
+
+        auto const stats = writer.stats();
+        REQUIRE(stats.points_spooled == 2);
+        REQUIRE(stats.points_dropped == 3);
+    }
+
+    // And with no spool at all.
+    conf.spool = "";
+
+    {
+        utils::TimeSeriesWriter writer(db.post(), conf);
+
+        writer.write(point(0));
+        writer.flush();
+
+        REQUIRE(writer.stats().points_dropped == 1);
+    }
+
+    unlink(spool.c_str());
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -1,7 +1,12 @@
 #include <stdexcept>
 #include <future>
+#include <thread>
+#include <chrono>
+#include <mutex>
 #include <vector>
+#include <numeric>
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -20,12 +25,38 @@
 #include <zlib.h>
 
 #include "utils.h"
+#include "job.h"
 #include "paths/dirtree.h"
 #include "paths/dirwalker.h"
 #include "checksum.h"
 
 // ----------------------------------------------------------------------
 
+// Bytes read by checksum() and checksum_adler32(), for
+// checksum_bytes_read().  Readers add to it a megabyte or so at a
+// time, so that many of them don't fight over it.
+static std::atomic<uint64_t> bytes_read(0);
+static const size_t          bytes_read_batch = 1 << 20;
+
+uint64_t utils::checksum_bytes_read()
+{
+    return bytes_read.load(std::memory_order_relaxed);
+}
+
+// The same batches count as progress of the job, if the reader works
+// for one; @files@ is 1 once a file is read through.
+static void report_bytes_read(utils::Job *job, size_t bytes, size_t files = 0)
+{
+    bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+
+    if (job)
+    {
+        job->add_done(bytes, files);
+    }
+}
+
+// ----------------------------------------------------------------------
+
 // Repeated invocations of OpenSSL_add_all_digests() seem to result in
 // a double free (followed by a crash), at least with OpenSSL 1.0.2k.
 //
@@ -105,6 +136,9 @@ std::string utils::checksum(std::string const &path, EVP_MD const *md)
         throw std::runtime_error("EVP_DigestInit_ex() failed");
     }
 
+    auto const job        = utils::current_job();
+    size_t     unreported = 0;
+
     while (!instream.eof())
     {
         char buf[BUFSIZ]{0};
@@ -130,8 +164,27 @@ std::string utils::checksum(std::string const &path, EVP_MD const *md)
 #endif
             throw std::runtime_error("EVP_DigestUpdate() failed");
         }
+
+        unreported += sz;
+
+        if (unreported >= bytes_read_batch)
+        {
+            report_bytes_read(job.get(), unreported);
+            unreported = 0;
+
+            if (job and job->cancelled())
+            {
+                instream.close();
+#if OPENSSL_VERSION_NUMBER > 0x10100000L
+                EVP_MD_CTX_free(mdctx);
+#endif
+                throw utils::JobCancelled();
+            }
+        }
     }
 
+    report_bytes_read(job.get(), unreported, 1);
+
     unsigned char md_value[EVP_MAX_MD_SIZE]{0};
     unsigned int md_len = 0;
 
@@ -171,6 +224,9 @@ std::string utils::checksum_adler32(std::string const& path)
 
     auto cs = adler32(0, NULL, 0);
 
+    auto const job        = utils::current_job();
+    size_t     unreported = 0;
+
     while (!instream.eof())
     {
         char buf[BUFSIZ]{0};
@@ -189,8 +245,24 @@ std::string utils::checksum_adler32(std::string const& path)
         {
             cs = adler32(cs, (uint8_t*)buf, sz);
         }
+
+        unreported += sz;
+
+        if (unreported >= bytes_read_batch)
+        {
+            report_bytes_read(job.get(), unreported);
+            unreported = 0;
+
+            if (job and job->cancelled())
+            {
+                instream.close();
+                throw utils::JobCancelled();
+            }
+        }
     }
 
+    report_bytes_read(job.get(), unreported, 1);
+
     instream.close();
 
     // adler is a ulong type, a.k.a, uint32_t
@@ -292,6 +364,121 @@ utils::AtomicCounter& utils::global_task_counter()
 
 // ----------------------------------------------------------------------
 
+std::vector<std::string> utils::checksum_files(std::vector<utils::Path> const &files,
+                                               EVP_MD const                   *md,
+                                               size_t const                    max_threads)
+{
+    std::vector<std::string> results(files.size());
+
+    if (files.empty())
+    {
+        return results;
+    }
+
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+            return files[a].size() > files[b].size();
+        });
+
+    // Stay within the global limit, but always make progress on the
+    // calling thread.
+    auto const running  = task_counter.get();
+    auto const nthreads = std::min(files.size(),
+                                   running < max_threads ? max_threads - running : 1);
+
+    std::atomic_size_t next{0};
+    std::atomic_bool   failed{false};
+    std::mutex         error_mtx;
+    std::exception_ptr error;
+
+    auto const job = utils::current_job();
+
+    if (job)
+    {
+        uint64_t bytes = 0;
+
+        for (auto const &f : files)
+        {
+            bytes += f.size();
+        }
+
+        job->add_total(bytes, files.size());
+    }
+
+    auto worker = [&]() {
+        utils::JobScope scope(job);
+
+        while (not failed)
+        {
+            auto const i = next++;
+
+            if (i >= order.size())
+            {
+                break;
+            }
+
+            try
+            {
+                auto const &file   = files[order[i]];
+                results[order[i]] = checksum_file(file.canonical_name(), md);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mtx);
+
+                if (not error)
+                {
+                    error = std::current_exception();
+                }
+
+                failed = true;
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+
+    for (size_t t = 1; t < nthreads; t++)
+    {
+        task_counter.increment();
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto &t : threads)
+    {
+        t.join();
+        task_counter.decrement();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    size_t total = 0;
+    for (auto const &f : files)
+    {
+        total += f.size();
+    }
+
+    utils::slog() << "[checksum] Computed checksums of " << files.size()
+                  << " files, " << total << " bytes, using "
+                  << nthreads << " threads in " << elapsed << " ms.";
+
+    return results;
+}
+
+// ----------------------------------------------------------------------
+
 std::string utils::dir_checksum_of_checksums(utils::Path const &path,
                                              std::string const &algorithm,
                                              bool const         parallel,
@@ -332,6 +519,8 @@ static std::vector<std::string> checksum_group(utils::PathGroup const &group,
     {
         if (p.is_regular_file())
         {
+            utils::check_cancelled();
+
             auto checksum = utils::checksum_file(p.name(), md);
             // std::cout << __func__ << " "
             //           << p.name() << " "
@@ -353,10 +542,17 @@ sequential_directory_checksum(utils::Path const &path,
 
     auto tree = utils::DirectoryWalker(path, true);
 
+    if (auto job = utils::current_job())
+    {
+        job->add_total(tree.size(), tree.count_regular_files());
+    }
+
     for (auto const &p : tree)
     {
         if (p.is_regular_file())
         {
+            utils::check_cancelled();
+
             auto const checksum = utils::checksum_file(p.name(), md);
             // std::cout << __func__ << " "
             //           << p.name() << " "
@@ -386,6 +582,8 @@ parallel_directory_checksum(utils::Path const &path,
 
     std::vector<utils::PathGroup> remainders{};
 
+    auto const job = utils::current_job();
+
     for (auto const &group : groups)
     {
         // Don't spawn a thread for groups with no files.
@@ -394,12 +592,19 @@ parallel_directory_checksum(utils::Path const &path,
             continue;
         }
 
+        if (job)
+        {
+            job->add_total(group.size(), group.count());
+        }
+
         if (task_counter.get() < max_threads)
         {
+            // The task works for the caller's job, if any.
             auto handle = std::async(std::launch::async,
-                                     checksum_group,
-                                     group,
-                                     md);
+                                     [group, md, job]() {
+                                         utils::JobScope scope(job);
+                                         return checksum_group(group, md);
+                                     });
 
             // std::future can't be copied, but it can be std::move()-d.
             futures.emplace_back(std::move(handle));
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <atomic>
+#include <cstdint>
 #include <openssl/evp.h>
 
 #include "paths/path.h"
@@ -71,6 +72,21 @@ namespace utils
         size_t const       max_threads    = 256,
         size_t const       min_group_size = 1 * 1024 * 1024 * 1024);
 
+    // Compute checksums of a list of regular files, using up to
+    // max_threads threads (including the calling one).  Files are
+    // handed out largest first, so that a big file picked up late
+    // does not leave the other threads idle at the end.  Results are
+    // in the order of the input; the first error is rethrown once
+    // all threads are done.
+    std::vector<std::string> checksum_files(
+        std::vector<utils::Path> const &files,
+        EVP_MD const                   *md,
+        size_t const                    max_threads = 256);
+
+    // Bytes of files read to compute checksums, by this process so
+    // far.  Sampling it over time gives checksum throughput.
+    uint64_t checksum_bytes_read();
+
     // An atomic counter.  A static instance of this counter will keep
     // track of the number of async tasks we launch.
     class AtomicCounter
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "compress.h"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // zlib's window bits pick the wrapper: 15 for zlib, and 16 more
+    // for gzip.
+    std::string deflate_all(char const *data, size_t len, int level, int window_bits)
+    {
+        z_stream zs{};
+
+        if (deflateInit2(&zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2() failed");
+        }
+
+        // deflateBound() leaves out the gzip header and trailer.
+        std::string out(deflateBound(&zs, len) + 32, '\0');
+
+        zs.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in  = len;
+        zs.next_out  = reinterpret_cast<Bytef *>(&out[0]);
+        zs.avail_out = out.size();
+
+        auto const rc = deflate(&zs, Z_FINISH);
+
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+
+        if (rc != Z_STREAM_END)
+        {
+            throw std::runtime_error("deflate() failed");
+        }
+
+        return out;
+    }
+}
+
+// ----------------------------------------------------------------------
+
+std::string utils::zlib_compress(char const *data, size_t len, int level)
+{
+    return deflate_all(data, len, level, 15);
+}
+
+std::string utils::gzip_compress(char const *data, size_t len, int level)
+{
+    return deflate_all(data, len, level, 15 + 16);
+}
+
+bool utils::zlib_decompress(char const *data, size_t len, std::string &out, size_t max_len)
+{
+    z_stream zs{};
+
+    if (inflateInit(&zs) != Z_OK)
+        return false;
+
+    zs.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = len;
+
+    // Grown as it fills; what we compress mostly shrinks by 5-10x.
+    out.resize(std::min(std::max(len * 8, size_t(4096)), max_len));
+
+    int rc = Z_OK;
+
+    while (rc == Z_OK)
+    {
+        if (zs.total_out == out.size())
+        {
+            if (out.size() == max_len)
+                break;
+
+            out.resize(std::min(out.size() * 2, max_len));
+        }
+
+        zs.next_out  = reinterpret_cast<Bytef *>(&out[zs.total_out]);
+        zs.avail_out = out.size() - zs.total_out;
+
+        rc = inflate(&zs, Z_NO_FLUSH);
+    }
+
+    out.resize(zs.total_out);
+    inflateEnd(&zs);
+
+    // Nothing after the end of the stream.
+    return rc == Z_STREAM_END and zs.avail_in == 0;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,39 @@
+//
+//  zlib (RFC 1950) compression of message payloads.  Path-heavy
+//  responses, file lists and groups, shrink by 5-10x even at the
+//  fastest level, which is what RPC responses are compressed with.
+//
+//  The same deflate, in the gzip format (RFC 1952), for HTTP bodies.
+//
+
+#ifndef BDE_UTILS_COMPRESS_H
+#define BDE_UTILS_COMPRESS_H
+
+#include <string>
+#include <cstddef>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // @level@ as zlib has it, 1 (fastest) to 9 (smallest).  Throws on
+    // zlib errors.
+    std::string zlib_compress(char const *data, size_t len, int level = 1);
+
+    // As InfluxDB takes it with "Content-Encoding: gzip"; -1 is zlib's
+    // default level.  Throws on zlib errors.
+    std::string gzip_compress(char const *data, size_t len, int level = -1);
+
+    // False if @data@ is not one whole zlib stream, or if it inflates
+    // to more than @max_len@ bytes.
+    bool zlib_decompress(char const *data, size_t len, std::string &out,
+                         size_t max_len = size_t(1) << 30);
+};
+
+#endif // BDE_UTILS_COMPRESS_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "diskstats.h"
+
+// ----------------------------------------------------------------------
+
+static uint64_t now_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string read_file(std::string const &path, bool &ok)
+{
+    std::ifstream in(path);
+
+    ok = in.is_open();
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+
+    return ss.str();
+}
+
+// The eleven counters common to /proc/diskstats and sysfs stat files;
+// newer kernels add discard and flush counters after them, which we
+// don't use.
+static bool parse_counters(std::istream &in, utils::DiskCounters &c)
+{
+    return static_cast<bool>(in >> c.read_ios >> c.read_merges
+                             >> c.read_sectors >> c.read_ticks
+                             >> c.write_ios >> c.write_merges
+                             >> c.write_sectors >> c.write_ticks
+                             >> c.in_flight >> c.io_ticks
+                             >> c.time_in_queue);
+}
+
+// ----------------------------------------------------------------------
+
+std::map<std::string, utils::DiskCounters>
+utils::parse_diskstats(std::string const &text)
+{
+    std::map<std::string, DiskCounters> result;
+
+    std::istringstream lines(text);
+    std::string        line;
+
+    while (std::getline(lines, line))
+    {
+        std::istringstream in(line);
+
+        unsigned     major, minor;
+        DiskCounters c;
+
+        if (in >> major >> minor >> c.name and parse_counters(in, c))
+        {
+            result[c.name] = c;
+        }
+    }
+
+    return result;
+}
+
+bool utils::parse_block_stat(std::string const &text, DiskCounters &counters)
+{
+    std::istringstream in(text);
+    return parse_counters(in, counters);
+}
+
+std::string utils::disk_kernel_name(std::string const &device)
+{
+    char resolved[PATH_MAX];
+
+    if (realpath(device.c_str(), resolved) == nullptr)
+    {
+        return "";
+    }
+
+    struct stat st;
+
+    if (stat(resolved, &st) < 0 or not S_ISBLK(st.st_mode))
+    {
+        return "";
+    }
+
+    std::string const path = resolved;
+    return path.substr(path.rfind('/') + 1);
+}
+
+utils::DiskRates utils::disk_rates(DiskCounters const &a,
+                                   DiskCounters const &b,
+                                   double              seconds)
+{
+    DiskRates r;
+
+    r.in_flight = b.in_flight;
+
+    if (seconds <= 0)
+    {
+        return r;
+    }
+
+    auto delta = [](uint64_t from, uint64_t to) -> double {
+        return to >= from ? to - from : 0;
+    };
+
+    double const read_ios  = delta(a.read_ios, b.read_ios);
+    double const write_ios = delta(a.write_ios, b.write_ios);
+    double const ms        = seconds * 1000;
+
+    r.read_mbps   = delta(a.read_sectors, b.read_sectors) * 512 / 1e6 / seconds;
+    r.write_mbps  = delta(a.write_sectors, b.write_sectors) * 512 / 1e6 / seconds;
+    r.read_iops   = read_ios / seconds;
+    r.write_iops  = write_ios / seconds;
+    r.read_await  = read_ios > 0 ? delta(a.read_ticks, b.read_ticks) / read_ios : 0;
+    r.write_await = write_ios > 0 ? delta(a.write_ticks, b.write_ticks) / write_ios : 0;
+    r.queue_depth = delta(a.time_in_queue, b.time_in_queue) / ms;
+    r.utilization = std::min(100.0, delta(a.io_ticks, b.io_ticks) * 100 / ms);
+
+    return r;
+}
+
+// ----------------------------------------------------------------------
+
+utils::DiskStatsSampler::DiskStatsSampler(std::vector<std::string> const &devices,
+                                          size_t                          interval_ms,
+                                          std::string const              &diskstats,
+                                          std::string const              &sysfs)
+    : interval_ms_(interval_ms)
+    , diskstats_(diskstats)
+    , sysfs_(sysfs)
+    , stop_(false)
+{
+    if (interval_ms == 0)
+    {
+        throw std::runtime_error("DiskStatsSampler: interval cannot be zero");
+    }
+
+    for (auto const &device : devices)
+    {
+        // Kernel names ("sda") are taken as they are.
+        auto name = device.find('/') == std::string::npos ?
+            device : disk_kernel_name(device);
+
+        if (name.empty())
+        {
+            utils::slog() << "[DiskStatsSampler] Not sampling " << device
+                          << ": not a block device";
+            continue;
+        }
+
+        disks_[device].name = name;
+    }
+}
+
+utils::DiskStatsSampler::~DiskStatsSampler()
+{
+    stop();
+}
+
+void utils::DiskStatsSampler::start()
+{
+    if (thread_.joinable() or disks_.empty())
+    {
+        return;
+    }
+
+    stop_   = false;
+    thread_ = std::thread(&DiskStatsSampler::run, this);
+
+    utils::slog() << "[DiskStatsSampler] Sampling " << disks_.size()
+                  << " device(s) every " << interval_ms_ << " ms.";
+}
+
+void utils::DiskStatsSampler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void utils::DiskStatsSampler::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (not stop_)
+    {
+        lock.unlock();
+        sample();
+        lock.lock();
+
+        cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_),
+                     [this]() { return stop_; });
+    }
+}
+
+void utils::DiskStatsSampler::sample()
+{
+    bool ok = false;
+
+    auto const text = read_file(diskstats_, ok);
+    auto const time = now_ns();
+    auto const all  = ok ? parse_diskstats(text) :
+        std::map<std::string, DiskCounters>();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &d : disks_)
+    {
+        auto &disk = d.second;
+
+        DiskCounters current;
+        auto         found = all.find(disk.name);
+
+        if (found != all.end())
+        {
+            current = found->second;
+        }
+        else
+        {
+            bool       stat_ok = false;
+            auto const stat    = read_file(sysfs_ + "/class/block/" +
+                                           disk.name + "/stat", stat_ok);
+
+            if (not stat_ok or not parse_block_stat(stat, current))
+                continue;
+
+            current.name = disk.name;
+        }
+
+        if (disk.samples > 0 and time > disk.last_ns)
+        {
+            disk.rates = disk_rates(disk.last, current,
+                                    (time - disk.last_ns) / 1e9);
+        }
+
+        disk.last    = current;
+        disk.last_ns = time;
+        disk.samples++;
+    }
+}
+
+std::vector<std::string> utils::DiskStatsSampler::devices() const
+{
+    std::vector<std::string> result;
+
+    for (auto const &d : disks_)
+    {
+        result.push_back(d.first);
+    }
+
+    return result;
+}
+
+bool utils::DiskStatsSampler::rates(std::string const &device,
+                                    DiskRates         &rates) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto d = disks_.find(device);
+
+    if (d == disks_.end() or d->second.samples < 2)
+    {
+        return false;
+    }
+
+    rates = d->second.rates;
+
+    return true;
+}
+
+bool utils::DiskStatsSampler::counters(std::string const &device,
+                                       DiskCounters      &counters) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto d = disks_.find(device);
+
+    if (d == disks_.end() or d->second.samples < 1)
+    {
+        return false;
+    }
+
+    counters = d->second.last;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
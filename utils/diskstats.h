@@ -0,0 +1,137 @@
+//
+//  Block device I/O statistics from /proc/diskstats, sampled on an
+//  interval, so that storage agents need not run iostat(1) and parse
+//  its output.  See Documentation/admin-guide/iostats.rst in the
+//  kernel sources for what the counters mean.
+//
+
+#ifndef BDE_UTILS_DISKSTATS_H
+#define BDE_UTILS_DISKSTATS_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // Counters of a block device, since boot.  Times are in
+    // milliseconds; sectors are 512 bytes, whatever the device's.
+    struct DiskCounters
+    {
+        std::string name;
+        uint64_t    read_ios       = 0;
+        uint64_t    read_merges    = 0;
+        uint64_t    read_sectors   = 0;
+        uint64_t    read_ticks     = 0;
+        uint64_t    write_ios      = 0;
+        uint64_t    write_merges   = 0;
+        uint64_t    write_sectors  = 0;
+        uint64_t    write_ticks    = 0;
+        uint64_t    in_flight      = 0;
+        uint64_t    io_ticks       = 0;
+        uint64_t    time_in_queue  = 0;
+    };
+
+    // Parse the contents of /proc/diskstats.  Lines that don't parse
+    // are skipped.
+    std::map<std::string, DiskCounters>
+    parse_diskstats(std::string const &text);
+
+    // Parse the contents of /sys/block/<name>/stat, which has the same
+    // counters without major, minor and name.  Returns false if it
+    // does not parse.
+    bool parse_block_stat(std::string const &text, DiskCounters &counters);
+
+    // Kernel name of a block device: "/dev/sda1" -> "sda1", and
+    // "/dev/mapper/vg-data" -> "dm-0", following symlinks.  Returns an
+    // empty string for things that are not block devices, like
+    // "server:/export".
+    std::string disk_kernel_name(std::string const &device);
+
+    // What iostat -x would say about an interval.
+    struct DiskRates
+    {
+        double read_mbps     = 0;   // 10^6 bytes per second.
+        double write_mbps    = 0;
+        double read_iops     = 0;
+        double write_iops    = 0;
+        double read_await    = 0;   // ms per completed read.
+        double write_await   = 0;
+        double queue_depth   = 0;   // average requests in queue.
+        double utilization   = 0;   // percent of time busy.
+        double in_flight     = 0;   // at the end of the interval.
+    };
+
+    // Rates between two readings @seconds@ apart.  Counters that went
+    // backwards (wrapped, or device replaced) count as zero.
+    DiskRates disk_rates(DiskCounters const &before,
+                         DiskCounters const &after,
+                         double              seconds);
+
+    // Samples the given devices every @interval_ms@ milliseconds on a
+    // thread of its own, keeping the latest counters and rates of each.
+    // /proc/diskstats is read once for all devices; if it can't be,
+    // /sys/class/block/<name>/stat is read for each instead.
+    class DiskStatsSampler
+    {
+    public:
+        DiskStatsSampler(std::vector<std::string> const &devices,
+                         size_t                          interval_ms = 1000,
+                         std::string const              &diskstats   = "/proc/diskstats",
+                         std::string const              &sysfs       = "/sys");
+        ~DiskStatsSampler();
+
+        void start();
+        void stop();
+
+        // Take one sample now; the thread does this every interval.
+        void sample();
+
+        size_t interval_ms() const { return interval_ms_; }
+
+        // Devices as given, that are being sampled.
+        std::vector<std::string> devices() const;
+
+        // Rates over the last interval, and the counters at its end.
+        // Return false until there have been two samples, and for
+        // devices that are not sampled.
+        bool rates(std::string const &device, DiskRates &rates) const;
+        bool counters(std::string const &device, DiskCounters &counters) const;
+
+    private:
+        void run();
+
+        struct Disk
+        {
+            std::string  name;          // kernel name.
+            DiskCounters last;
+            uint64_t     last_ns  = 0;
+            DiskRates    rates;
+            size_t       samples  = 0;
+        };
+
+        size_t                      interval_ms_;
+        std::string                 diskstats_;
+        std::string                 sysfs_;
+        std::map<std::string, Disk> disks_;     // by device, as given.
+
+        std::thread                 thread_;
+        mutable std::mutex          mutex_;
+        std::condition_variable     cv_;
+        bool                        stop_;
+    };
+};
+
+#endif // BDE_UTILS_DISKSTATS_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,215 @@
+#include <stdexcept>
+
+#include "utils.h"
+#include "envelope.h"
+#include "dispatcher.h"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    size_t const max_pooled       = 64;
+    size_t const max_pooled_bytes = 1 << 20;
+}
+
+// ----------------------------------------------------------------------
+
+utils::MessageDispatcher::MessageDispatcher(size_t workers, Handler handler)
+    : handler_(handler)
+    , queued_(0)
+    , stop_(false)
+{
+    if (workers == 0)
+    {
+        throw std::invalid_argument("MessageDispatcher: no workers");
+    }
+
+    for (size_t i = 0; i < workers; i++)
+    {
+        workers_.emplace_back(new Worker);
+    }
+
+    for (auto &w : workers_)
+    {
+        w->thread = std::thread(&MessageDispatcher::run, this, std::ref(*w));
+    }
+}
+
+utils::MessageDispatcher::~MessageDispatcher()
+{
+    stop();
+}
+
+void utils::MessageDispatcher::post(char const *topic, char const *data, size_t len)
+{
+    if (stop_)
+        return;
+
+    auto msg = take_buffer();
+
+    msg->topic.assign(topic);
+    msg->payload.assign(data, data + len);
+
+    size_t n = 0;
+
+    if (workers_.size() > 1)
+    {
+        char const *key     = nullptr;
+        size_t      key_len = 0;
+
+        if (envelope_peek(data, len, "corr_id", key, key_len))
+            msg->key.assign(key, key_len);
+        else
+            msg->key = msg->topic;
+
+        n = route(msg->key);
+    }
+
+    auto &w = *workers_[n];
+
+    queued_++;
+    w.bytes += len;
+    w.queue.push(std::move(msg));
+
+    // Against the worker's going to sleep: either it sees the message,
+    // or we see it asleep.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (w.sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.cv.notify_one();
+    }
+}
+
+void utils::MessageDispatcher::stop()
+{
+    if (stop_.exchange(true))
+        return;
+
+    for (auto &w : workers_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            w->cv.notify_one();
+        }
+
+        w->thread.join();
+    }
+}
+
+void utils::MessageDispatcher::run(Worker &w)
+{
+    MessagePtr msg;
+
+    while (true)
+    {
+        if (w.queue.pop(msg))
+        {
+            try
+            {
+                handler_(msg->topic, msg->payload.data(), msg->payload.size());
+            }
+            catch (std::exception const &ex)
+            {
+                utils::slog() << "[MessageDispatcher] Handler failed on " << msg->topic << ": " << ex.what();
+            }
+            catch (...)
+            {
+                utils::slog() << "[MessageDispatcher] Handler failed on " << msg->topic << ".";
+            }
+
+            if (workers_.size() > 1)
+                routed(msg->key);
+
+            w.bytes -= msg->payload.size();
+            queued_--;
+
+            give_buffer(std::move(msg));
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(w.mutex);
+
+        w.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (w.queue.empty())
+        {
+            if (stop_)
+                break;
+
+            w.cv.wait(lock);
+        }
+
+        w.sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+size_t utils::MessageDispatcher::route(std::string const &key)
+{
+    std::lock_guard<std::mutex> lock(route_mutex_);
+
+    auto iter = inflight_.find(key);
+
+    if (iter != inflight_.end())
+    {
+        iter->second.second++;
+        return iter->second.first;
+    }
+
+    size_t n = 0;
+
+    for (size_t i = 1; i < workers_.size(); i++)
+    {
+        if (workers_[i]->bytes < workers_[n]->bytes)
+            n = i;
+    }
+
+    inflight_.emplace(key, std::make_pair(n, size_t(1)));
+
+    return n;
+}
+
+void utils::MessageDispatcher::routed(std::string const &key)
+{
+    std::lock_guard<std::mutex> lock(route_mutex_);
+
+    auto iter = inflight_.find(key);
+
+    if (iter != inflight_.end() and --iter->second.second == 0)
+        inflight_.erase(iter);
+}
+
+utils::MessageDispatcher::MessagePtr utils::MessageDispatcher::take_buffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+
+        if (not pool_.empty())
+        {
+            auto msg = std::move(pool_.back());
+            pool_.pop_back();
+            return msg;
+        }
+    }
+
+    return MessagePtr(new Message);
+}
+
+void utils::MessageDispatcher::give_buffer(MessagePtr msg)
+{
+    if (msg->payload.capacity() > max_pooled_bytes)
+        return;
+
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+
+    if (pool_.size() < max_pooled)
+        pool_.push_back(std::move(msg));
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,120 @@
+//
+//  Hands incoming messages over from the thread that receives them,
+//  the MQTT network loop, to worker threads that parse and handle
+//  them, so that a few large messages don't hold up the network loop,
+//  nor, with more than one worker, the messages behind them.
+//
+//  post() copies the message into a pooled buffer and pushes it onto
+//  the lock-free queue of a worker, chosen by the message's routing
+//  key: its "corr_id" if it has one (see envelope.h), its topic if
+//  not.  While a key has messages queued or being handled, more of
+//  them go to the same worker, so that they are handled in the order
+//  they were posted, which keeps the messages of a streamed RPC
+//  response in order; otherwise the worker with the fewest bytes to
+//  go gets it, so that small messages don't queue up behind a large
+//  one being parsed.
+//
+//      utils::MessageDispatcher dispatcher(4, [](std::string const &topic,
+//                                                char const *data, size_t len) {
+//              handle(topic, parse(data, len));
+//          });
+//
+//      dispatcher.post(topic, payload, payload_len);   // network loop
+//
+
+#ifndef BDE_UTILS_DISPATCHER_H
+#define BDE_UTILS_DISPATCHER_H
+
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <functional>
+#include <condition_variable>
+
+#include "mpscqueue.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    class MessageDispatcher
+    {
+    public:
+        using Handler = std::function<void(std::string const &topic, char const *data, size_t len)>;
+
+        // Starts @workers@ threads; throws if there are none.
+        MessageDispatcher(size_t workers, Handler handler);
+
+        // Stops, after the messages posted have been handled.
+        ~MessageDispatcher();
+
+        MessageDispatcher(MessageDispatcher const &) = delete;
+        MessageDispatcher& operator=(MessageDispatcher const &) = delete;
+
+        // From any thread; does not block but for the short locks of
+        // the buffer pool and of routing.  Dropped once stopped.
+        void post(char const *topic, char const *data, size_t len);
+
+        // Handle the messages posted, and stop the threads.
+        void stop();
+
+        size_t workers() const { return workers_.size(); }
+
+        // Messages posted and not handled yet.
+        size_t queued() const { return queued_; }
+
+    private:
+        struct Message
+        {
+            std::string       topic;
+            std::vector<char> payload;
+            std::string       key;      // routed by, if workers > 1.
+        };
+
+        using MessagePtr = std::unique_ptr<Message>;
+
+        struct Worker
+        {
+            MpscQueue<MessagePtr>   queue;
+            std::atomic<bool>       sleeping{false};
+            std::atomic<size_t>     bytes{0};       // queued or being handled.
+            std::mutex              mutex;
+            std::condition_variable cv;
+            std::thread             thread;
+        };
+
+        void run(Worker &worker);
+
+        size_t route(std::string const &key);
+        void   routed(std::string const &key);
+
+        MessagePtr take_buffer();
+        void       give_buffer(MessagePtr msg);
+
+        Handler                              handler_;
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::atomic<size_t>                  queued_;
+        std::atomic<bool>                    stop_;
+
+        // Keys with messages in flight: their worker, and how many.
+        std::mutex                           route_mutex_;
+        std::unordered_map<std::string, std::pair<size_t, size_t>> inflight_;
+
+        // Buffers are kept for reuse, but not too many, nor too big.
+        std::mutex                           pool_mutex_;
+        std::vector<MessagePtr>              pool_;
+    };
+};
+
+#endif // BDE_UTILS_DISPATCHER_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -1,14 +1,25 @@
 #ifndef BDE_UTILS_ECHO_H
 #define BDE_UTILS_ECHO_H
 
-// Helpers for DTN Agents to send/receive "ping" commands.  Code is
-// straight from asio "echo" example; except that we reverse the
+// Helpers for DTN Agents to send/receive "ping" commands.  Code
+// started out as the asio "echo" example; except that we reverse the
 // response string, just for fun.
+//
+// pong_server runs its acceptor and sessions on a pool of threads,
+// so that many DTNs can ping (or probe, see tcpprobe.h) this one at
+// the same time without queueing up behind each other.
 
 #include <cstdlib>
 #include <iostream>
 #include <memory>
 #include <utility>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 #include "asio.hpp"
 
 #include "utils/utils.h"
@@ -17,80 +28,304 @@ using asio::ip::tcp;
 
 namespace utils
 {
+    // Connections that start with this line are throughput probes
+    // (see tcpprobe.h) rather than pings: whatever follows is read
+    // and thrown away, and when the other side is done sending, we
+    // tell it how many bytes we got.
+    static const std::string probe_magic = "BDE-PROBE\n";
+
+    // What a session did, reported when it ends.
+    struct pong_session_info
+    {
+        std::string peer;
+        std::string kind;       // "ping" or "probe".
+        size_t      pings     = 0;
+        size_t      bytes_in  = 0;
+        size_t      bytes_out = 0;
+        double      seconds   = 0;
+    };
+
+    // Totals over all sessions of a pong server.
+    struct pong_stats
+    {
+        size_t active    = 0;
+        size_t sessions  = 0;
+        size_t pings     = 0;
+        size_t probes    = 0;
+        size_t bytes_in  = 0;
+        size_t bytes_out = 0;
+    };
+
+    class pong_server;
 
     class echo_session
         : public std::enable_shared_from_this<echo_session>
     {
     public:
-        echo_session(tcp::socket socket)
-            : socket_(std::move(socket)) {
-        }
+        echo_session(tcp::socket socket, pong_server &server);
+        ~echo_session();
 
         void start() {
-            do_read();
+            do_read_header();
         }
 
     private:
+        // Read until we know whether this is a ping or a probe.
+        void do_read_header() {
+            auto self(shared_from_this());
+            socket_.async_read_some(
+                asio::buffer(data_, max_length),
+                [this, self](std::error_code ec, std::size_t length) {
+                    if (ec) {
+                        return;
+                    }
+
+                    info_.bytes_in += length;
+                    header_.append(data_, length);
+
+                    auto n = std::min(header_.size(), probe_magic.size());
+
+                    if (header_.compare(0, n, probe_magic, 0, n) != 0) {
+                        do_write(header_);
+                        header_.clear();
+                    } else if (header_.size() >= probe_magic.size()) {
+                        info_.kind = "probe";
+                        received_  = header_.size() - probe_magic.size();
+                        header_.clear();
+                        do_sink();
+                    } else {
+                        do_read_header();
+                    }
+                });
+        }
+
         void do_read() {
             auto self(shared_from_this());
             socket_.async_read_some(
                 asio::buffer(data_, max_length),
                 [this, self](std::error_code ec, std::size_t length) {
                     if (!ec) {
-                        utils::slog() << "echo received data: " << data_;
-                        do_write(length);
+                        info_.bytes_in += length;
+                        do_write(std::string(data_, length));
                     }
                 });
         }
 
-        void do_write(std::size_t length) {
+        void do_write(std::string const &request) {
             auto self(shared_from_this());
 
-            std::string response(data_);
-            std::reverse(response.begin(), response.end());
+            response_ = request;
+            std::reverse(response_.begin(), response_.end());
 
-            utils::slog() << "echo sending response: " << response;
+            info_.pings++;
 
             asio::async_write(
-                socket_, asio::buffer(response, response.length()),
-                [this, self](std::error_code ec, std::size_t /*length*/) {
+                socket_, asio::buffer(response_),
+                [this, self](std::error_code ec, std::size_t length) {
+                    info_.bytes_out += length;
+
                     if (!ec) {
                         do_read();
                     }
                 });
         }
 
-        tcp::socket socket_;
-        enum { max_length = 1024 };
+        void do_sink() {
+            auto self(shared_from_this());
+            socket_.async_read_some(
+                asio::buffer(data_, max_length),
+                [this, self](std::error_code ec, std::size_t length) {
+                    received_      += length;
+                    info_.bytes_in += length;
+
+                    // The sender is done when it shuts down its side;
+                    // if the connection broke instead, the reply
+                    // will just fail.
+                    if (!ec) {
+                        do_sink();
+                    } else {
+                        do_probe_reply();
+                    }
+                });
+        }
+
+        void do_probe_reply() {
+            auto self(shared_from_this());
+
+            response_ = "BDE-PROBE-RECEIVED " + std::to_string(received_) + "\n";
+
+            asio::async_write(
+                socket_, asio::buffer(response_),
+                [this, self](std::error_code /*ec*/, std::size_t length) {
+                    info_.bytes_out += length;
+                });
+        }
+
+        tcp::socket  socket_;
+        pong_server &server_;
+
+        enum { max_length = 64 * 1024 };
         char data_[max_length];
+
+        std::string header_;
+        std::string response_;
+        size_t      received_;
+
+        pong_session_info                     info_;
+        std::chrono::steady_clock::time_point start_;
     };
 
-    class echo_server
+    class pong_server
     {
     public:
-        echo_server(asio::io_service& io_service, short port)
-            : acceptor_(io_service, tcp::endpoint(tcp::v4(), port)),
-              socket_(io_service) {
+        // Listen on the given port (0 picks one), and serve sessions
+        // on @threads@ threads once start() is called.
+        pong_server(unsigned short port, size_t threads = 4)
+            : nthreads_(std::max<size_t>(threads, 1)),
+              acceptor_(io_service_),
+              socket_(io_service_) {
+            tcp::endpoint endpoint(tcp::v4(), port);
+
+            acceptor_.open(endpoint.protocol());
+            acceptor_.set_option(tcp::acceptor::reuse_address(true));
+            acceptor_.bind(endpoint);
+            acceptor_.listen(asio::socket_base::max_connections);
+        }
+
+        ~pong_server() {
+            stop();
+        }
+
+        void start() {
+            if (not threads_.empty()) {
+                return;
+            }
+
+            // In case we were stopped before.
+            io_service_.reset();
+
             do_accept();
+
+            for (size_t i = 0; i < nthreads_; i++) {
+                threads_.emplace_back([this]() { io_service_.run(); });
+            }
+        }
+
+        void stop() {
+            io_service_.stop();
+
+            for (auto &t : threads_) {
+                t.join();
+            }
+
+            threads_.clear();
+        }
+
+        // The port we're listening on; useful when asked for port 0.
+        unsigned short port() const {
+            return acceptor_.local_endpoint().port();
+        }
+
+        size_t threads() const { return nthreads_; }
+
+        pong_stats stats() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stats_;
+        }
+
+        // The last few sessions that ended, oldest first.
+        std::vector<pong_session_info> recent_sessions() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return std::vector<pong_session_info>(recent_.begin(), recent_.end());
         }
 
     private:
+        friend class echo_session;
+
+        void session_started() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.active++;
+            stats_.sessions++;
+        }
+
+        void session_ended(pong_session_info const &info) {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            stats_.active--;
+            stats_.pings     += info.pings;
+            stats_.bytes_in  += info.bytes_in;
+            stats_.bytes_out += info.bytes_out;
+
+            if (info.kind == "probe") {
+                stats_.probes++;
+            }
+
+            recent_.push_back(info);
+
+            if (recent_.size() > max_recent) {
+                recent_.pop_front();
+            }
+        }
+
         void do_accept() {
             acceptor_.async_accept(
                 socket_, [this](std::error_code ec) {
                     if (!ec) {
+                        asio::error_code ignored;
+                        socket_.set_option(tcp::no_delay(true), ignored);
+
                         std::make_shared<echo_session>(
-                            std::move(socket_))->start();
+                            std::move(socket_), *this)->start();
                     }
 
                     do_accept();
                 });
         }
 
-        tcp::acceptor acceptor_;
-        tcp::socket   socket_;
+        enum { max_recent = 64 };
+
+        // Sessions report here as they go away, which may be as late
+        // as when io_service_ is destroyed; so these come first.
+        mutable std::mutex             mutex_;
+        pong_stats                     stats_;
+        std::deque<pong_session_info>  recent_;
+
+        size_t                   nthreads_;
+        std::vector<std::thread> threads_;
+
+        asio::io_service io_service_;
+        tcp::acceptor    acceptor_;
+        tcp::socket      socket_;
     };
 
+    inline echo_session::echo_session(tcp::socket socket, pong_server &server)
+        : socket_(std::move(socket)),
+          server_(server),
+          received_(0),
+          start_(std::chrono::steady_clock::now()) {
+        asio::error_code ec;
+        auto peer = socket_.remote_endpoint(ec);
+
+        if (!ec) {
+            info_.peer = peer.address().to_string() + ":" +
+                std::to_string(peer.port());
+        }
+
+        info_.kind = "ping";
+        server_.session_started();
+    }
+
+    inline echo_session::~echo_session() {
+        info_.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start_).count();
+
+        if (info_.kind == "probe") {
+            utils::slog() << "pong: probe from " << info_.peer << " received "
+                          << received_ << " bytes in " << info_.seconds << " s";
+        }
+
+        server_.session_ended(info_);
+    }
 };
 
 #endif // BDE_UTILS_ECHO_H
@@ -0,0 +1,319 @@
+#include <cstring>
+
+#include "msgpack.h"
+#include "envelope.h"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // Nesting is only counted, so there is no limit to it.
+    class JsonScanner
+    {
+    public:
+        JsonScanner(char const *data, size_t len)
+            : begin_(data)
+            , p_(data)
+            , end_(data + len) { }
+
+        bool peek(char const *key, char const *&value, size_t &value_len)
+        {
+            size_t const key_len = std::strlen(key);
+            bool         decided = false;
+
+            if (peek_back(key, key_len, value, value_len, decided))
+                return true;
+
+            if (decided)
+                return false;
+
+            space();
+
+            if (not next_is('{'))
+                return false;
+
+            while (true)
+            {
+                char const *k     = nullptr;
+                size_t      k_len = 0;
+
+                space();
+
+                if (not string(k, k_len))
+                    return false;
+
+                space();
+
+                if (not next_is(':'))
+                    return false;
+
+                space();
+
+                if (k_len == key_len and std::memcmp(k, key, key_len) == 0)
+                    return string(value, value_len);
+
+                if (not skip())
+                    return false;
+
+                space();
+
+                // '}', the end, or something amiss.
+                if (not next_is(','))
+                    return false;
+            }
+        }
+
+    private:
+        // From the end, over the members that come after the last
+        // object or array: JsonCpp writes members sorted by name, so
+        // that is where "corr_id" is, past a "body" of any size.
+        // @decided@ if not finding it there settles it.
+        bool peek_back(char const *key, size_t key_len,
+                       char const *&value, size_t &value_len, bool &decided)
+        {
+            char const *q = end_;
+
+            back_space(q);
+
+            if (not back_is(q, '}'))
+                return false;
+
+            while (true)
+            {
+                char const *v      = nullptr;
+                size_t      v_len  = 0;
+                bool        string = false;
+
+                back_space(q);
+
+                if (q == begin_ or q[-1] == '}' or q[-1] == ']')
+                    return false;       // forward, then.
+
+                if (q[-1] == '"')
+                {
+                    if (not back_string(q, v, v_len))
+                        return false;
+
+                    string = true;
+                }
+                else if (not back_scalar(q))
+                {
+                    return false;
+                }
+
+                char const *k     = nullptr;
+                size_t      k_len = 0;
+
+                back_space(q);
+
+                if (not back_is(q, ':'))
+                    return false;
+
+                back_space(q);
+
+                if (not back_string(q, k, k_len))
+                    return false;
+
+                // The last of a name is the one a parser keeps.
+                if (k_len == key_len and std::memcmp(k, key, key_len) == 0)
+                {
+                    decided = not string;
+                    value     = v;
+                    value_len = v_len;
+                    return string;
+                }
+
+                back_space(q);
+
+                if (back_is(q, ','))
+                    continue;
+
+                if (back_is(q, '{'))
+                {
+                    back_space(q);
+                    decided = q == begin_;
+                }
+
+                return false;
+            }
+        }
+
+        void back_space(char const *&q) const
+        {
+            while (q != begin_ and (q[-1] == ' ' or q[-1] == '\t' or q[-1] == '\n' or q[-1] == '\r'))
+                --q;
+        }
+
+        bool back_is(char const *&q, char c) const
+        {
+            if (q == begin_ or q[-1] != c)
+                return false;
+
+            --q;
+            return true;
+        }
+
+        // A quote is escaped if an odd number of backslashes come
+        // right before it.
+        bool escaped(char const *quote, char const *from) const
+        {
+            size_t n = 0;
+
+            while (quote - n != from and quote[-1 - static_cast<ptrdiff_t>(n)] == '\\')
+                n++;
+
+            return n % 2 == 1;
+        }
+
+        bool back_string(char const *&q, char const *&begin, size_t &len) const
+        {
+            if (q == begin_ or q[-1] != '"')
+                return false;
+
+            char const *const end = --q;
+
+            while (q != begin_)
+            {
+                --q;
+
+                if (*q == '"' and not escaped(q, begin_))
+                {
+                    begin = q + 1;
+                    len   = end - begin;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // A number, true, false or null.
+        bool back_scalar(char const *&q) const
+        {
+            char const *const end = q;
+
+            while (q != begin_ and q[-1] != ':' and q[-1] != ',' and q[-1] != '{'
+                   and q[-1] != '"' and q[-1] != ' ' and q[-1] != '\t'
+                   and q[-1] != '\n' and q[-1] != '\r')
+            {
+                --q;
+            }
+
+            return q != end;
+        }
+
+        void space()
+        {
+            while (p_ != end_ and (*p_ == ' ' or *p_ == '\t' or *p_ == '\n' or *p_ == '\r'))
+                ++p_;
+        }
+
+        bool next_is(char c)
+        {
+            if (p_ == end_ or *p_ != c)
+                return false;
+
+            ++p_;
+            return true;
+        }
+
+        // The contents of a string, between the quotes.
+        bool string(char const *&begin, size_t &len)
+        {
+            if (not next_is('"'))
+                return false;
+
+            begin = p_;
+
+            while (auto q = static_cast<char const *>(std::memchr(p_, '"', end_ - p_)))
+            {
+                p_ = q + 1;
+
+                if (not escaped(q, begin))
+                {
+                    len = q - begin;
+                    return true;
+                }
+            }
+
+            p_ = end_;
+            return false;
+        }
+
+        bool skip()
+        {
+            if (p_ == end_)
+                return false;
+
+            char const *begin = nullptr;
+            size_t      len   = 0;
+
+            if (*p_ == '"')
+                return string(begin, len);
+
+            if (*p_ != '{' and *p_ != '[')
+            {
+                // A number, true, false or null.
+                begin = p_;
+
+                while (p_ != end_ and *p_ != ',' and *p_ != '}' and *p_ != ']'
+                       and *p_ != ' ' and *p_ != '\t' and *p_ != '\n' and *p_ != '\r')
+                {
+                    ++p_;
+                }
+
+                return p_ != begin;
+            }
+
+            size_t depth = 0;
+
+            while (p_ != end_)
+            {
+                switch (*p_)
+                {
+                case '"':
+                    if (not string(begin, len))
+                        return false;
+                    continue;
+
+                case '{': case '[':
+                    depth++;
+                    break;
+
+                case '}': case ']':
+                    if (--depth == 0)
+                    {
+                        ++p_;
+                        return true;
+                    }
+                    break;
+                }
+
+                ++p_;
+            }
+
+            return false;
+        }
+
+        char const *begin_;
+        char const *p_;
+        char const *end_;
+    };
+}
+
+// ----------------------------------------------------------------------
+
+bool utils::envelope_peek(char const *data, size_t len, char const *key,
+                          char const *&value, size_t &value_len)
+{
+    if (utils::is_msgpack(data, len))
+        return utils::msgpack_peek(data, len, key, value, value_len);
+
+    return JsonScanner(data, len).peek(key, value, value_len);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
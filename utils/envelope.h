@@ -0,0 +1,40 @@
+//
+//  A look at the envelope of a message, JSON or MessagePack, without
+//  parsing it: enough to tell where a message goes, say by its
+//  "corr_id", before paying for the whole of a large body.
+//
+//      char const *corr_id;
+//      size_t      len;
+//
+//      if (utils::envelope_peek(data, size, "corr_id", corr_id, len))
+//          route(std::string(corr_id, len));
+//
+//  Only top level members are looked at, and those are skipped over,
+//  not decoded.  JSON is looked at from the end first, where JsonCpp
+//  puts "corr_id", after "body"; a message without the member is
+//  scanned all through.
+//
+
+#ifndef BDE_UTILS_ENVELOPE_H
+#define BDE_UTILS_ENVELOPE_H
+
+#include <cstddef>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // The bytes of the top level string member @key@, in place; JSON
+    // escapes are left as they are.  False if there is none, if it is
+    // not a string, or if the message is malformed before it.
+    bool envelope_peek(char const *data, size_t len, char const *key,
+                       char const *&value, size_t &value_len);
+};
+
+#endif // BDE_UTILS_ENVELOPE_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "utils.h"
+#include "executor.h"
+
+// ----------------------------------------------------------------------
+
+utils::PriorityExecutor::PriorityExecutor(std::string const &name,
+                                          size_t             threads,
+                                          size_t             max_queued)
+    : name_(name)
+    , max_queued_(max_queued)
+    , seq_(0)
+    , stop_(false)
+    , total_wait_ms_(0)
+{
+    if (threads == 0)
+    {
+        throw std::invalid_argument("PriorityExecutor " + name + ": no threads");
+    }
+
+    stats_.threads = threads;
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        threads_.emplace_back(&PriorityExecutor::run, this);
+    }
+}
+
+utils::PriorityExecutor::~PriorityExecutor()
+{
+    stop();
+}
+
+bool utils::PriorityExecutor::post(Task task, int priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (stop_ or (max_queued_ > 0 and queue_.size() >= max_queued_))
+        {
+            stats_.rejected++;
+            return false;
+        }
+
+        queue_.push(Entry{priority, seq_++, clock::now(), std::move(task)});
+        stats_.max_queued = std::max(stats_.max_queued, queue_.size());
+    }
+
+    cv_.notify_one();
+
+    return true;
+}
+
+void utils::PriorityExecutor::stop()
+{
+    size_t dropped = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (stop_)
+        {
+            return;
+        }
+
+        stop_   = true;
+        dropped = queue_.size();
+
+        while (not queue_.empty())
+        {
+            queue_.pop();
+        }
+    }
+
+    cv_.notify_all();
+
+    for (auto &t : threads_)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+
+    if (dropped > 0)
+    {
+        utils::slog() << "[Executor " << name_ << "] Dropped "
+                      << dropped << " queued tasks on stop.";
+    }
+}
+
+utils::ExecutorStats utils::PriorityExecutor::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto s = stats_;
+
+    s.queued      = queue_.size();
+    s.avg_wait_ms = s.completed ? total_wait_ms_ / s.completed : 0;
+
+    return s;
+}
+
+void utils::PriorityExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        cv_.wait(lock, [this]() { return stop_ or not queue_.empty(); });
+
+        if (stop_)
+        {
+            return;
+        }
+
+        // priority_queue::top() is const; the task is moved out of
+        // the entry before it is popped.
+        auto &top  = const_cast<Entry &>(queue_.top());
+        auto  task = std::move(top.task);
+        auto  wait = std::chrono::duration<double, std::milli>(clock::now() - top.queued_at).count();
+
+        queue_.pop();
+        stats_.running++;
+
+        lock.unlock();
+
+        try
+        {
+            task();
+        }
+        catch (std::exception const &ex)
+        {
+            utils::slog() << "[Executor " << name_ << "] Task failed: " << ex.what();
+        }
+        catch (...)
+        {
+            utils::slog() << "[Executor " << name_ << "] Task failed.";
+        }
+
+        lock.lock();
+
+        stats_.running--;
+        stats_.completed++;
+        stats_.max_wait_ms = std::max(stats_.max_wait_ms, wait);
+        total_wait_ms_    += wait;
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,110 @@
+//
+//  A pool of threads running tasks from a queue of its own, highest
+//  priority first, and first come first served among equals.
+//
+//  The agent manager keeps one of these per class of command, so that
+//  a few long checksum or expand commands can only take the threads
+//  of their own class, and status or ping commands still get answered
+//  right away.
+//
+
+#ifndef BDE_UTILS_EXECUTOR_H
+#define BDE_UTILS_EXECUTOR_H
+
+#include <queue>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct ExecutorStats
+    {
+        size_t   threads        = 0;
+        size_t   queued         = 0;    // right now.
+        size_t   running        = 0;    // right now.
+        size_t   max_queued     = 0;    // since start.
+        uint64_t completed      = 0;
+        uint64_t rejected       = 0;    // queue was full.
+        double   avg_wait_ms    = 0;    // in the queue, of completed tasks.
+        double   max_wait_ms    = 0;
+    };
+
+    class PriorityExecutor
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // @max_queued@ of 0 means no limit.
+        PriorityExecutor(std::string const &name,
+                         size_t             threads,
+                         size_t             max_queued = 0);
+
+        // Waits for running tasks; queued ones are dropped.
+        ~PriorityExecutor();
+
+        PriorityExecutor(PriorityExecutor const &) = delete;
+        PriorityExecutor& operator=(PriorityExecutor const &) = delete;
+
+        std::string const & name() const { return name_; }
+
+        // Queue a task.  Returns false, and does not run it, if the
+        // queue is full or the executor is stopped.  Exceptions that
+        // escape tasks are logged.
+        bool post(Task task, int priority = 0);
+
+        // Stop taking tasks, and wait for running ones.
+        void stop();
+
+        ExecutorStats stats() const;
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct Entry
+        {
+            int               priority;
+            uint64_t          seq;
+            clock::time_point queued_at;
+            Task              task;
+
+            // Lower priority, then later, goes further back.
+            bool operator<(Entry const &other) const
+            {
+                if (priority != other.priority)
+                    return priority < other.priority;
+                return seq > other.seq;
+            }
+        };
+
+        void run();
+
+        std::string const               name_;
+        size_t const                    max_queued_;
+
+        std::priority_queue<Entry>      queue_;
+        uint64_t                        seq_;
+        bool                            stop_;
+        ExecutorStats                   stats_;
+        double                          total_wait_ms_;
+
+        std::vector<std::thread>        threads_;
+        mutable std::mutex              mutex_;
+        std::condition_variable         cv_;
+    };
+};
+
+#endif // BDE_UTILS_EXECUTOR_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
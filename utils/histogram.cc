@@ -0,0 +1,190 @@
+#include <cmath>
+#include <algorithm>
+
+#include "histogram.h"
+
+// ----------------------------------------------------------------------
+
+utils::HistogramSnapshot::HistogramSnapshot()
+    : counts_(LatencyHistogram::num_buckets, 0)
+    , count_(0)
+    , sum_(0)
+    , max_(0)
+{
+}
+
+uint64_t utils::HistogramSnapshot::max() const
+{
+    if (max_ > 0 or count_ == 0)
+    {
+        return max_;
+    }
+
+    for (size_t b = counts_.size(); b-- > 0;)
+    {
+        if (counts_[b] > 0)
+        {
+            return LatencyHistogram::bucket_highest(b);
+        }
+    }
+
+    return 0;
+}
+
+double utils::HistogramSnapshot::mean() const
+{
+    return count_ ? double(sum_) / count_ : 0;
+}
+
+uint64_t utils::HistogramSnapshot::percentile(double p) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+
+    p = std::min(100.0, std::max(0.0, p));
+
+    auto const rank = std::max<uint64_t>(1, std::ceil(p / 100 * count_));
+    uint64_t   seen = 0;
+
+    for (size_t b = 0; b < counts_.size(); b++)
+    {
+        seen += counts_[b];
+
+        if (seen >= rank)
+        {
+            auto const v = LatencyHistogram::bucket_highest(b);
+            return max_ > 0 ? std::min(v, max_) : v;
+        }
+    }
+
+    return max();
+}
+
+utils::HistogramSnapshot
+utils::HistogramSnapshot::operator-(HistogramSnapshot const &earlier) const
+{
+    HistogramSnapshot d;
+
+    for (size_t b = 0; b < counts_.size(); b++)
+    {
+        d.counts_[b] = counts_[b] - std::min(counts_[b], earlier.counts_[b]);
+        d.count_    += d.counts_[b];
+    }
+
+    d.sum_ = sum_ - std::min(sum_, earlier.sum_);
+
+    return d;
+}
+
+Json::Value utils::HistogramSnapshot::summary() const
+{
+    Json::Value v;
+
+    v["count"]   = Json::UInt64(count_);
+    v["mean_us"] = mean();
+    v["p50_us"]  = Json::UInt64(percentile(50));
+    v["p90_us"]  = Json::UInt64(percentile(90));
+    v["p99_us"]  = Json::UInt64(percentile(99));
+    v["p999_us"] = Json::UInt64(percentile(99.9));
+    v["max_us"]  = Json::UInt64(max());
+
+    return v;
+}
+
+// ----------------------------------------------------------------------
+
+const int      utils::LatencyHistogram::sub_bits;
+const int      utils::LatencyHistogram::max_bits;
+const size_t   utils::LatencyHistogram::num_buckets;
+const uint64_t utils::LatencyHistogram::max_value;
+
+utils::LatencyHistogram::LatencyHistogram()
+    : sum_(0)
+    , max_(0)
+{
+    for (auto &c : counts_)
+    {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t utils::LatencyHistogram::bucket_of(uint64_t value)
+{
+    value = std::min(value, max_value);
+
+    // Exact below 2^(sub_bits + 1).
+    if (value < (uint64_t(2) << sub_bits))
+    {
+        return value;
+    }
+
+    int const msb   = 63 - __builtin_clzll(value);
+    int const shift = msb - sub_bits;
+
+    return ((shift + 1) << sub_bits) + ((value >> shift) - (uint64_t(1) << sub_bits));
+}
+
+uint64_t utils::LatencyHistogram::bucket_lowest(size_t bucket)
+{
+    if (bucket < (size_t(2) << sub_bits))
+    {
+        return bucket;
+    }
+
+    int const      shift = (bucket >> sub_bits) - 1;
+    uint64_t const top   = (bucket & ((size_t(1) << sub_bits) - 1)) + (uint64_t(1) << sub_bits);
+
+    return top << shift;
+}
+
+uint64_t utils::LatencyHistogram::bucket_highest(size_t bucket)
+{
+    if (bucket < (size_t(2) << sub_bits))
+    {
+        return bucket;
+    }
+
+    int const shift = (bucket >> sub_bits) - 1;
+
+    return bucket_lowest(bucket) + (uint64_t(1) << shift) - 1;
+}
+
+void utils::LatencyHistogram::record(uint64_t value)
+{
+    value = std::min(value, max_value);
+
+    counts_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    auto m = max_.load(std::memory_order_relaxed);
+
+    while (value > m and not max_.compare_exchange_weak(m, value, std::memory_order_relaxed))
+        ;
+}
+
+// Not atomic as a whole: a value recorded meanwhile may be in its
+// bucket and not yet in the sum.  The count is that of the buckets,
+// so that percentiles always agree with it.
+utils::HistogramSnapshot utils::LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot s;
+
+    for (size_t b = 0; b < num_buckets; b++)
+    {
+        s.counts_[b] = counts_[b].load(std::memory_order_relaxed);
+        s.count_    += s.counts_[b];
+    }
+
+    s.sum_ = sum_.load(std::memory_order_relaxed);
+    s.max_ = max_.load(std::memory_order_relaxed);
+
+    return s;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,149 @@
+//
+//  Latency histograms, HDR style: buckets are linear within each
+//  power of two, so that any value is known to within about 3%, from
+//  a microsecond to many hours, in a fixed 8 KiB of counters.
+//
+//  Recording is lock free, so that commands running on many threads
+//  don't wait on each other to be timed:
+//
+//      utils::LatencyHistograms latencies;
+//
+//      latencies.get("dtn_list").record(elapsed_us);
+//
+//      auto s = latencies.get("dtn_list").snapshot();
+//      auto p99 = s.percentile(99);
+//
+//  Histograms may be named by any key that orders, such as a (module,
+//  command) pair, with LatencyHistogramsBy<Key>.
+//
+//  Snapshots subtract, which gives the latencies of an interval.
+//  Values are microseconds, by convention.
+//
+
+#ifndef BDE_UTILS_HISTOGRAM_H
+#define BDE_UTILS_HISTOGRAM_H
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "json/json.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    class HistogramSnapshot
+    {
+    public:
+        HistogramSnapshot();
+
+        uint64_t count() const { return count_; }
+        uint64_t sum()   const { return sum_; }
+        uint64_t max()   const;
+        double   mean()  const;
+
+        // The value that @p@ percent of the recorded ones are at or
+        // below, rounded up to its bucket; 0 if nothing was recorded.
+        uint64_t percentile(double p) const;
+
+        // What was recorded since @earlier@, a snapshot of the same
+        // histogram.  Its max is that of the highest bucket.
+        HistogramSnapshot operator-(HistogramSnapshot const &earlier) const;
+
+        // count, mean_us, p50_us, p90_us, p99_us, p999_us and max_us.
+        Json::Value summary() const;
+
+    private:
+        friend class LatencyHistogram;
+
+        std::vector<uint64_t> counts_;
+        uint64_t              count_;
+        uint64_t              sum_;
+        uint64_t              max_;     // recorded; 0 for differences.
+    };
+
+    class LatencyHistogram
+    {
+    public:
+        // 32 buckets per power of two, for values up to 2^36.
+        static const int      sub_bits    = 5;
+        static const int      max_bits    = 36;
+        static const size_t   num_buckets = (max_bits - sub_bits + 1) << sub_bits;
+        static const uint64_t max_value   = (uint64_t(1) << max_bits) - 1;
+
+        LatencyHistogram();
+
+        LatencyHistogram(LatencyHistogram const &) = delete;
+        LatencyHistogram& operator=(LatencyHistogram const &) = delete;
+
+        // Values above max_value count as max_value.
+        void record(uint64_t value);
+
+        HistogramSnapshot snapshot() const;
+
+        static size_t   bucket_of(uint64_t value);
+        static uint64_t bucket_lowest(size_t bucket);
+        static uint64_t bucket_highest(size_t bucket);
+
+    private:
+        std::array<std::atomic<uint64_t>, num_buckets> counts_;
+        std::atomic<uint64_t>                          sum_;
+        std::atomic<uint64_t>                          max_;
+    };
+
+    // Histograms by name, made on first use and kept.  Only finding
+    // them takes a lock; callers recording often may keep the
+    // reference, which stays valid.
+    template <typename Key>
+    class LatencyHistogramsBy
+    {
+    public:
+        LatencyHistogram & get(Key const &name)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto &h = histograms_[name];
+
+            if (not h)
+            {
+                h.reset(new LatencyHistogram());
+            }
+
+            return *h;
+        }
+
+        std::map<Key, HistogramSnapshot> snapshot() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            std::map<Key, HistogramSnapshot> s;
+
+            for (auto const &h : histograms_)
+            {
+                s[h.first] = h.second->snapshot();
+            }
+
+            return s;
+        }
+
+    private:
+        std::map<Key, std::unique_ptr<LatencyHistogram>> histograms_;
+        mutable std::mutex                               mutex_;
+    };
+
+    using LatencyHistograms = LatencyHistogramsBy<std::string>;
+};
+
+#endif // BDE_UTILS_HISTOGRAM_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
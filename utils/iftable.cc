@@ -0,0 +1,613 @@
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/ether.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "utils.h"
+#include "network.h"
+#include "iftable.h"
+
+// ----------------------------------------------------------------------
+
+bool utils::IfaceEntry::up_and_running() const
+{
+    return (flags & IFF_UP) and (flags & IFF_RUNNING);
+}
+
+// ----------------------------------------------------------------------
+
+static std::string format_address(int family, void const *data)
+{
+    char str[INET6_ADDRSTRLEN] = {0};
+
+    if (inet_ntop(family, data, str, sizeof(str)) == nullptr)
+    {
+        return "";
+    }
+
+    return str;
+}
+
+static std::string format_mac(void const *data, size_t len)
+{
+    if (len != ETH_ALEN)
+    {
+        return "";
+    }
+
+    char buffer[32] = {0};
+    utils::ether_ntoa_zero_pad(static_cast<ether_addr const *>(data), buffer);
+
+    return buffer;
+}
+
+static void remove_address(std::vector<std::string> &addrs,
+                           std::string const        &addr)
+{
+    addrs.erase(std::remove(addrs.begin(), addrs.end(), addr), addrs.end());
+}
+
+// ----------------------------------------------------------------------
+
+utils::IfaceTable &utils::IfaceTable::instance()
+{
+    static IfaceTable table;
+    return table;
+}
+
+utils::IfaceTable::IfaceTable()
+    : sock_(-1)
+    , ready_(false)
+    , generation_(0)
+    , snapshot_(std::make_shared<IfaceSnapshot const>())
+    , next_listener_(1)
+{
+    wakeup_[0] = wakeup_[1] = -1;
+
+    try
+    {
+        sock_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+        if (sock_ < 0)
+        {
+            throw std::runtime_error("socket() error: " +
+                                     std::string(strerror(errno)));
+        }
+
+        sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+        if (bind(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            throw std::runtime_error("bind() error: " +
+                                     std::string(strerror(errno)));
+        }
+
+        if (pipe2(wakeup_, O_CLOEXEC) < 0)
+        {
+            throw std::runtime_error("pipe2() error: " +
+                                     std::string(strerror(errno)));
+        }
+
+        dump(true);
+
+        thread_ = std::thread(&IfaceTable::run, this);
+    }
+    catch (std::exception const &ex)
+    {
+        utils::slog() << "[IfaceTable] Not tracking interfaces: " << ex.what();
+
+        ready_ = false;
+
+        for (auto fd : {sock_, wakeup_[0], wakeup_[1]})
+        {
+            if (fd >= 0) close(fd);
+        }
+
+        sock_ = wakeup_[0] = wakeup_[1] = -1;
+    }
+}
+
+utils::IfaceTable::~IfaceTable()
+{
+    if (thread_.joinable())
+    {
+        char c = 0;
+        if (write(wakeup_[1], &c, 1) < 0)
+        {
+            // Nothing to do; the thread would not hear us anyway.
+        }
+
+        thread_.join();
+    }
+
+    for (auto fd : {sock_, wakeup_[0], wakeup_[1]})
+    {
+        if (fd >= 0) close(fd);
+    }
+}
+
+// ----------------------------------------------------------------------
+
+std::shared_ptr<utils::IfaceSnapshot const> utils::IfaceTable::snapshot() const
+{
+    return std::atomic_load(&snapshot_);
+}
+
+bool utils::IfaceTable::lookup(std::string const &iface, IfaceEntry &entry) const
+{
+    auto table = snapshot();
+    auto it    = table->find(iface);
+
+    if (it == table->end())
+    {
+        return false;
+    }
+
+    entry = it->second;
+    return true;
+}
+
+int utils::IfaceTable::add_listener(Listener const &listener)
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+
+    auto id = next_listener_++;
+    listeners_[id] = listener;
+
+    return id;
+}
+
+void utils::IfaceTable::remove_listener(int id)
+{
+    // Waits for listeners being called.
+    std::lock_guard<std::recursive_mutex> dispatch(dispatch_mutex_);
+    std::lock_guard<std::mutex>           lock(listeners_mutex_);
+
+    listeners_.erase(id);
+}
+
+// ----------------------------------------------------------------------
+
+// Read everything there is in the current table from the kernel,
+// links first, then addresses.  Events that come in along with the
+// dumps are applied in order, too.
+void utils::IfaceTable::dump(bool initial)
+{
+    auto table = std::make_shared<IfaceSnapshot>();
+    std::vector<IfaceChange> changes;
+
+    for (int type : {RTM_GETLINK, RTM_GETADDR})
+    {
+        struct
+        {
+            nlmsghdr nlh;
+            rtgenmsg gen;
+        } req;
+
+        memset(&req, 0, sizeof(req));
+        req.nlh.nlmsg_len   = NLMSG_LENGTH(sizeof(rtgenmsg));
+        req.nlh.nlmsg_type  = type;
+        req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.nlh.nlmsg_seq   = type;
+        req.gen.rtgen_family = AF_UNSPEC;
+
+        if (send(sock_, &req, req.nlh.nlmsg_len, 0) < 0)
+        {
+            throw std::runtime_error("netlink send() error: " +
+                                     std::string(strerror(errno)));
+        }
+
+        bool done = false;
+
+        while (not done)
+        {
+            char buf[32 * 1024];
+
+            auto len = recv(sock_, buf, sizeof(buf), 0);
+
+            if (len < 0 and errno == EINTR)
+            {
+                continue;
+            }
+
+            if (len < 0)
+            {
+                throw std::runtime_error("netlink recv() error: " +
+                                         std::string(strerror(errno)));
+            }
+
+            for (auto nlh = reinterpret_cast<nlmsghdr *>(buf);
+                 NLMSG_OK(nlh, len);
+                 nlh = NLMSG_NEXT(nlh, len))
+            {
+                if (nlh->nlmsg_seq == unsigned(type) and
+                    (nlh->nlmsg_type == NLMSG_DONE or
+                     nlh->nlmsg_type == NLMSG_ERROR))
+                {
+                    done = true;
+                    break;
+                }
+
+                apply(nlh, *table, changes);
+            }
+        }
+    }
+
+    changes.clear();
+
+    if (not initial)
+    {
+        IfaceChange change;
+        change.kind = IfaceChange::resync;
+        changes.push_back(change);
+    }
+
+    publish(table, changes);
+    ready_.store(true, std::memory_order_release);
+}
+
+// Apply one netlink message to @table@; true if it changed anything.
+bool utils::IfaceTable::apply(void const                *msg,
+                              IfaceSnapshot             &table,
+                              std::vector<IfaceChange>  &changes)
+{
+    auto nlh = static_cast<nlmsghdr const *>(msg);
+
+    auto find_index = [&table](int index) {
+        for (auto it = table.begin(); it != table.end(); ++it)
+        {
+            if (it->second.index == index and it->second.link.empty())
+            {
+                return it;
+            }
+        }
+        return table.end();
+    };
+
+    switch (nlh->nlmsg_type)
+    {
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+    {
+        auto ifi = static_cast<ifinfomsg const *>(NLMSG_DATA(nlh));
+        int  len = IFLA_PAYLOAD(nlh);
+
+        std::string name;
+        std::string mac;
+
+        for (auto rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+        {
+            if (rta->rta_type == IFLA_IFNAME)
+            {
+                name = static_cast<char const *>(RTA_DATA(rta));
+            }
+            else if (rta->rta_type == IFLA_ADDRESS)
+            {
+                mac = format_mac(RTA_DATA(rta), RTA_PAYLOAD(rta));
+            }
+        }
+
+        if (nlh->nlmsg_type == RTM_DELLINK)
+        {
+            bool removed = false;
+
+            // The link and its aliases.
+            for (auto it = table.begin(); it != table.end(); )
+            {
+                if (it->second.index == ifi->ifi_index)
+                {
+                    changes.push_back({IfaceChange::link_removed, it->first, ""});
+                    it      = table.erase(it);
+                    removed = true;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            return removed;
+        }
+
+        if (name.empty())
+        {
+            return false;
+        }
+
+        auto it = find_index(ifi->ifi_index);
+
+        IfaceEntry entry;
+
+        if (it != table.end())
+        {
+            if (it->second.name == name and it->second.flags == ifi->ifi_flags and
+                it->second.mac == mac)
+            {
+                return false;
+            }
+
+            // Renames keep the addresses.
+            entry = it->second;
+            table.erase(it);
+        }
+
+        auto kind = entry.name.empty() ?
+            IfaceChange::link_added : IfaceChange::link_changed;
+
+        entry.index = ifi->ifi_index;
+        entry.name  = name;
+        entry.flags = ifi->ifi_flags;
+        entry.mac   = mac;
+
+        // Aliases follow the state of their link.
+        for (auto &e : table)
+        {
+            if (e.second.index == entry.index)
+            {
+                e.second.link  = entry.name;
+                e.second.flags = entry.flags;
+                e.second.mac   = entry.mac;
+            }
+        }
+
+        table[name] = entry;
+        changes.push_back({kind, name, ""});
+
+        return true;
+    }
+
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+    {
+        auto ifa = static_cast<ifaddrmsg const *>(NLMSG_DATA(nlh));
+        int  len = IFA_PAYLOAD(nlh);
+
+        if (ifa->ifa_family != AF_INET and ifa->ifa_family != AF_INET6)
+        {
+            return false;
+        }
+
+        std::string address;
+        std::string local;
+        std::string label;
+
+        for (auto rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+        {
+            if (rta->rta_type == IFA_ADDRESS)
+            {
+                address = format_address(ifa->ifa_family, RTA_DATA(rta));
+            }
+            else if (rta->rta_type == IFA_LOCAL)
+            {
+                local = format_address(ifa->ifa_family, RTA_DATA(rta));
+            }
+            else if (rta->rta_type == IFA_LABEL)
+            {
+                label = static_cast<char const *>(RTA_DATA(rta));
+            }
+        }
+
+        // IFA_ADDRESS is the peer address of point-to-point links;
+        // getifaddrs() reports IFA_LOCAL then, and so do we.
+        if (not local.empty())
+        {
+            address = local;
+        }
+
+        auto link = find_index(ifa->ifa_index);
+
+        if (address.empty() or link == table.end())
+        {
+            return false;
+        }
+
+        std::vector<std::string> names{link->first};
+
+        if (not label.empty() and label != link->first)
+        {
+            names.push_back(label);
+        }
+
+        bool changed = false;
+
+        for (auto const &name : names)
+        {
+            auto it = table.find(name);
+
+            if (nlh->nlmsg_type == RTM_NEWADDR)
+            {
+                if (it == table.end())
+                {
+                    IfaceEntry alias = link->second;
+                    alias.name = name;
+                    alias.link = link->first;
+                    alias.ipv4.clear();
+                    alias.ipv6.clear();
+                    it = table.emplace(name, alias).first;
+                }
+
+                auto &addrs = ifa->ifa_family == AF_INET ?
+                    it->second.ipv4 : it->second.ipv6;
+
+                if (std::find(addrs.begin(), addrs.end(), address) == addrs.end())
+                {
+                    addrs.push_back(address);
+                    changes.push_back({IfaceChange::address_added, name, address});
+                    changed = true;
+                }
+            }
+            else if (it != table.end())
+            {
+                auto &addrs = ifa->ifa_family == AF_INET ?
+                    it->second.ipv4 : it->second.ipv6;
+
+                auto size = addrs.size();
+                remove_address(addrs, address);
+
+                if (addrs.size() != size)
+                {
+                    changes.push_back({IfaceChange::address_removed, name, address});
+                    changed = true;
+                }
+
+                // An alias with no addresses left is gone.
+                if (name != link->first and
+                    it->second.ipv4.empty() and it->second.ipv6.empty())
+                {
+                    table.erase(it);
+                }
+            }
+        }
+
+        return changed;
+    }
+
+    default:
+        return false;
+    }
+}
+
+void utils::IfaceTable::publish(std::shared_ptr<IfaceSnapshot>  table,
+                                std::vector<IfaceChange> const &changes)
+{
+    std::shared_ptr<IfaceSnapshot const> next = table;
+    std::atomic_store(&snapshot_, next);
+
+    generation_++;
+
+    if (changes.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> dispatch(dispatch_mutex_);
+
+    std::map<int, Listener> listeners;
+
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex_);
+        listeners = listeners_;
+    }
+
+    for (auto const &change : changes)
+    {
+        for (auto const &l : listeners)
+        {
+            // one that removed itself, on an earlier change
+            {
+                std::lock_guard<std::mutex> lock(listeners_mutex_);
+
+                if (listeners_.count(l.first) == 0)
+                    continue;
+            }
+
+            try
+            {
+                l.second(change);
+            }
+            catch (std::exception const &ex)
+            {
+                utils::slog() << "[IfaceTable] Listener error: " << ex.what();
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+
+void utils::IfaceTable::run()
+{
+    while (true)
+    {
+        pollfd fds[2];
+        fds[0].fd     = sock_;
+        fds[0].events = POLLIN;
+        fds[1].fd     = wakeup_[0];
+        fds[1].events = POLLIN;
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        if (fds[1].revents)
+        {
+            break;
+        }
+
+        char buf[32 * 1024];
+
+        auto len = recv(sock_, buf, sizeof(buf), MSG_DONTWAIT);
+
+        if (len < 0)
+        {
+            if (errno == EINTR or errno == EAGAIN)
+            {
+                continue;
+            }
+
+            // The kernel dropped events we were too slow to read;
+            // the only way to catch up is to read it all again.
+            if (errno == ENOBUFS)
+            {
+                utils::slog() << "[IfaceTable] Lost netlink events; resyncing.";
+
+                try
+                {
+                    dump(false);
+                }
+                catch (std::exception const &ex)
+                {
+                    utils::slog() << "[IfaceTable] Resync failed: " << ex.what();
+                }
+
+                continue;
+            }
+
+            utils::slog() << "[IfaceTable] recv() error: " << strerror(errno)
+                          << "; no longer tracking interfaces.";
+            ready_ = false;
+            break;
+        }
+
+        // Copy on write: readers keep whatever snapshot they have.
+        auto table = std::make_shared<IfaceSnapshot>(*snapshot());
+        std::vector<IfaceChange> changes;
+
+        for (auto nlh = reinterpret_cast<nlmsghdr *>(buf);
+             NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len))
+        {
+            apply(nlh, *table, changes);
+        }
+
+        if (not changes.empty())
+        {
+            publish(table, changes);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,122 @@
+//
+//  A process-wide table of network interfaces and their addresses,
+//  kept current by listening to rtnetlink link and address events.
+//
+
+#ifndef BDE_UTILS_IFTABLE_H
+#define BDE_UTILS_IFTABLE_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct IfaceEntry
+    {
+        int                      index = 0;
+        std::string              name;
+        std::string              link;          // of aliases ("eth0:1"); else "".
+        unsigned                 flags = 0;     // IFF_UP, IFF_RUNNING, ...
+        std::string              mac;           // "" if there is none.
+        std::vector<std::string> ipv4;          // in the kernel's order.
+        std::vector<std::string> ipv6;
+
+        bool up_and_running() const;
+    };
+
+    // What changed, passed to change listeners.
+    struct IfaceChange
+    {
+        enum Kind { link_added, link_changed, link_removed,
+                    address_added, address_removed, resync };
+
+        Kind        kind;
+        std::string iface;      // empty for resync.
+        std::string address;    // for address changes.
+    };
+
+    // Interfaces by name.  Snapshots are never modified once
+    // published, so readers can hold on to one for as long as they
+    // like without any locking.
+    typedef std::unordered_map<std::string, IfaceEntry> IfaceSnapshot;
+
+    class IfaceTable
+    {
+    public:
+        typedef std::function<void(IfaceChange const &)> Listener;
+
+        // The table of this process.  The netlink listener is
+        // started on first use; if netlink is not available, the
+        // table stays empty and ready() is false.
+        static IfaceTable &instance();
+
+        ~IfaceTable();
+
+        IfaceTable(IfaceTable const &) = delete;
+        IfaceTable& operator=(IfaceTable const &) = delete;
+
+        // True once the initial dump is in, and while the listener
+        // is alive.
+        bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+        // The current table.
+        std::shared_ptr<IfaceSnapshot const> snapshot() const;
+
+        // Copy the entry of @iface@ into @entry@; false if there is
+        // no such interface.
+        bool lookup(std::string const &iface, IfaceEntry &entry) const;
+
+        // Listeners are called on the netlink thread, after the new
+        // snapshot is published; they should be quick.  Once
+        // remove_listener() returns, the listener is not running and
+        // won't be called again, so that what it captures may go.
+        int  add_listener(Listener const &listener);
+        void remove_listener(int id);
+
+        // Number of snapshots published so far; handy in tests.
+        uint64_t generation() const { return generation_.load(); }
+
+    private:
+        IfaceTable();
+
+        void run();
+        void dump(bool initial);
+        bool apply(void const *nlh, IfaceSnapshot &table,
+                   std::vector<IfaceChange> &changes);
+        void publish(std::shared_ptr<IfaceSnapshot> table,
+                     std::vector<IfaceChange> const &changes);
+
+        int                         sock_;
+        int                         wakeup_[2];
+        std::thread                 thread_;
+        std::atomic<bool>           ready_;
+        std::atomic<uint64_t>       generation_;
+
+        std::shared_ptr<IfaceSnapshot const> snapshot_;
+
+        // Held while listeners are called; recursive, for listeners
+        // that remove themselves.
+        std::recursive_mutex        dispatch_mutex_;
+
+        std::mutex                  listeners_mutex_;
+        std::map<int, Listener>     listeners_;
+        int                         next_listener_;
+    };
+};
+
+#endif // BDE_UTILS_IFTABLE_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
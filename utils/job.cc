@@ -0,0 +1,280 @@
+#include <algorithm>
+
+#include "job.h"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    double seconds(std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+}
+
+// ----------------------------------------------------------------------
+
+char const * utils::job_state_name(Job::State state)
+{
+    switch (state)
+    {
+    case Job::State::queued:    return "queued";
+    case Job::State::running:   return "running";
+    case Job::State::done:      return "done";
+    case Job::State::failed:    return "failed";
+    case Job::State::cancelled: return "cancelled";
+    }
+
+    return "unknown";
+}
+
+// ----------------------------------------------------------------------
+
+utils::Job::Job(std::string const &id, std::string const &target, std::string const &cmd)
+    : id_(id)
+    , target_(target)
+    , cmd_(cmd)
+    , bytes_total_(0)
+    , bytes_done_(0)
+    , files_total_(0)
+    , files_done_(0)
+    , cancelled_(false)
+    , version_(0)
+    , state_(State::queued)
+    , queued_at_(clock::now())
+{
+}
+
+void utils::Job::add_total(uint64_t bytes, uint64_t files)
+{
+    bytes_total_ += bytes;
+    files_total_ += files;
+    version_++;
+}
+
+void utils::Job::add_done(uint64_t bytes, uint64_t files)
+{
+    bytes_done_ += bytes;
+    files_done_ += files;
+    version_++;
+}
+
+void utils::Job::start()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (state_ == State::queued)
+    {
+        state_      = State::running;
+        started_at_ = clock::now();
+        version_++;
+    }
+}
+
+// Work that was cancelled may still return, with whatever error its
+// handler made of JobCancelled; it is cancelled all the same.
+void utils::Job::finish(Json::Value const &result)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (state_ == State::queued or state_ == State::running)
+    {
+        state_       = cancelled_ ? State::cancelled : State::done;
+        result_      = result;
+        finished_at_ = clock::now();
+        version_++;
+    }
+}
+
+void utils::Job::fail(std::string const &error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (state_ == State::queued or state_ == State::running)
+    {
+        state_       = cancelled_ ? State::cancelled : State::failed;
+        error_       = error;
+        finished_at_ = clock::now();
+        version_++;
+    }
+}
+
+utils::Job::State utils::Job::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+bool utils::Job::finished() const
+{
+    auto const s = state();
+    return s != State::queued and s != State::running;
+}
+
+std::chrono::steady_clock::time_point utils::Job::finished_at() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_at_;
+}
+
+Json::Value utils::Job::status(bool with_result) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Json::Value s;
+
+    s["job"]    = id_;
+    s["target"] = target_;
+    s["cmd"]    = cmd_;
+    s["state"]  = job_state_name(state_);
+
+    if (cancelled_ and state_ == State::running)
+    {
+        s["cancelling"] = true;
+    }
+
+    uint64_t const bytes_done  = bytes_done_;
+    uint64_t const bytes_total = bytes_total_;
+
+    Json::Value p;
+
+    p["bytes_done"]  = Json::UInt64(bytes_done);
+    p["bytes_total"] = Json::UInt64(bytes_total);
+    p["files_done"]  = Json::UInt64(files_done_);
+    p["files_total"] = Json::UInt64(files_total_);
+
+    auto const now = clock::now();
+
+    s["queued_s"] = seconds((state_ == State::queued ? now : started_at_) - queued_at_);
+
+    if (state_ != State::queued and started_at_ != clock::time_point())
+    {
+        auto const end     = state_ == State::running ? now : finished_at_;
+        double const spent = seconds(end - started_at_);
+
+        s["elapsed_s"] = spent;
+
+        if (spent > 0)
+        {
+            double const rate = bytes_done / spent;
+
+            p["bytes_per_sec"] = rate;
+
+            // Only while running, with a known total, and once some
+            // of it is done.
+            if (state_ == State::running and bytes_total > bytes_done and rate > 0)
+            {
+                p["eta_s"] = (bytes_total - bytes_done) / rate;
+            }
+        }
+    }
+
+    s["progress"] = p;
+
+    if (with_result)
+    {
+        if (state_ == State::done)
+            s["result"] = result_;
+        else if (state_ == State::failed or (state_ == State::cancelled and not error_.empty()))
+            s["error"] = error_;
+    }
+
+    return s;
+}
+
+// ----------------------------------------------------------------------
+
+utils::JobTable::JobTable(size_t keep_seconds, size_t max_finished)
+    : keep_seconds_(keep_seconds)
+    , max_finished_(max_finished)
+    , next_(0)
+{
+}
+
+std::shared_ptr<utils::Job> utils::JobTable::create(std::string const &target,
+                                                    std::string const &cmd)
+{
+    // Ids don't repeat across restarts of the agent, so that an old
+    // handle cannot find somebody else's job.
+    auto const epoch = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto const id  = std::to_string(epoch) + "-" + std::to_string(++next_);
+    auto       job = std::make_shared<Job>(id, target, cmd);
+
+    jobs_[id] = job;
+
+    return job;
+}
+
+std::shared_ptr<utils::Job> utils::JobTable::find(std::string const &id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto j = jobs_.find(id);
+
+    return j == jobs_.end() ? nullptr : j->second;
+}
+
+std::vector<std::shared_ptr<utils::Job>> utils::JobTable::list() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::shared_ptr<Job>> jobs;
+
+    for (auto const &j : jobs_)
+    {
+        jobs.push_back(j.second);
+    }
+
+    return jobs;
+}
+
+void utils::JobTable::expire()
+{
+    auto const now = std::chrono::steady_clock::now();
+    auto const ttl = std::chrono::seconds(keep_seconds_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<std::chrono::steady_clock::time_point, std::string>> finished;
+
+    for (auto j = jobs_.begin(); j != jobs_.end();)
+    {
+        if (not j->second->finished())
+        {
+            ++j;
+            continue;
+        }
+
+        auto const at = j->second->finished_at();
+
+        if (now - at >= ttl)
+        {
+            j = jobs_.erase(j);
+            continue;
+        }
+
+        finished.emplace_back(at, j->first);
+        ++j;
+    }
+
+    // Too many kept: the oldest go first.
+    if (finished.size() > max_finished_)
+    {
+        std::sort(finished.begin(), finished.end());
+
+        for (size_t i = 0; i < finished.size() - max_finished_; i++)
+        {
+            jobs_.erase(finished[i].second);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
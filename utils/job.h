@@ -0,0 +1,195 @@
+//
+//  Long running commands, as jobs: the caller gets a handle right
+//  away, and can ask how far along the job is, fetch its result once
+//  it is done, or cancel it.
+//
+//  Code doing the work finds its job with current_job(), which is set
+//  for the thread by a JobScope, and reports progress to it.  Long
+//  loops call check_cancelled(), which throws JobCancelled once the
+//  job is cancelled, so that cancelling really stops the work.  Code
+//  handing work to other threads passes the job along:
+//
+//      auto job = utils::current_job();
+//
+//      std::thread t([job]() {
+//              utils::JobScope scope(job);
+//              ...
+//          });
+//
+
+#ifndef BDE_UTILS_JOB_H
+#define BDE_UTILS_JOB_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include "json/json.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    class JobCancelled : public std::runtime_error
+    {
+    public:
+        JobCancelled() : std::runtime_error("job cancelled") { }
+    };
+
+    class Job
+    {
+    public:
+        enum class State { queued, running, done, failed, cancelled };
+
+        Job(std::string const &id, std::string const &target, std::string const &cmd);
+
+        std::string const & id()     const { return id_; }
+        std::string const & target() const { return target_; }
+        std::string const & cmd()    const { return cmd_; }
+
+        // Progress, from any thread.  Totals add up, as work is
+        // found; they may stay unknown (zero), and then so does the
+        // ETA.
+        void add_total(uint64_t bytes, uint64_t files = 0);
+        void add_done(uint64_t bytes, uint64_t files = 0);
+
+        // Asking for cancellation; the work stops at its next check.
+        void cancel()          { cancelled_ = true; }
+        bool cancelled() const { return cancelled_; }
+
+        // Throws JobCancelled if cancelled.
+        void check() const
+        {
+            if (cancelled_)
+                throw JobCancelled();
+        }
+
+        // Changes of state, by whoever runs the job.
+        void start();
+        void finish(Json::Value const &result);
+        void fail(std::string const &error);
+
+        State state() const;
+        bool  finished() const;
+
+        // Bumped by every change, so that progress reports can skip
+        // jobs that did not move.
+        uint64_t version() const { return version_; }
+
+        // State and progress, with the result or error once there is
+        // one.
+        Json::Value status(bool with_result = true) const;
+
+        std::chrono::steady_clock::time_point finished_at() const;
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        std::string const       id_;
+        std::string const       target_;
+        std::string const       cmd_;
+
+        std::atomic<uint64_t>   bytes_total_;
+        std::atomic<uint64_t>   bytes_done_;
+        std::atomic<uint64_t>   files_total_;
+        std::atomic<uint64_t>   files_done_;
+        std::atomic<bool>       cancelled_;
+        std::atomic<uint64_t>   version_;
+
+        State                   state_;
+        clock::time_point       queued_at_;
+        clock::time_point       started_at_;
+        clock::time_point       finished_at_;
+        Json::Value             result_;
+        std::string             error_;
+        mutable std::mutex      mutex_;
+    };
+
+    char const * job_state_name(Job::State state);
+
+    // The job the calling thread works for, or null.  These are
+    // inline, so that the path walkers can check for cancellation
+    // without linking with the rest of utils.
+    inline std::shared_ptr<Job> & thread_job()
+    {
+        static thread_local std::shared_ptr<Job> job;
+        return job;
+    }
+
+    inline std::shared_ptr<Job> current_job()
+    {
+        return thread_job();
+    }
+
+    // Throws JobCancelled if the calling thread works for a job that
+    // was cancelled.
+    inline void check_cancelled()
+    {
+        auto const &job = thread_job();
+
+        if (job)
+            job->check();
+    }
+
+    // Makes @job@ the calling thread's job, until it goes out of scope.
+    class JobScope
+    {
+    public:
+        explicit JobScope(std::shared_ptr<Job> const &job)
+            : previous_(thread_job())
+        {
+            thread_job() = job;
+        }
+
+        ~JobScope()
+        {
+            thread_job() = previous_;
+        }
+
+        JobScope(JobScope const &) = delete;
+        JobScope& operator=(JobScope const &) = delete;
+
+    private:
+        std::shared_ptr<Job> previous_;
+    };
+
+    // Jobs by id.  Finished ones are kept for @keep_seconds@, and no
+    // more than @max_finished@ of them, for their results to be
+    // fetched.
+    class JobTable
+    {
+    public:
+        explicit JobTable(size_t keep_seconds = 3600, size_t max_finished = 1000);
+
+        std::shared_ptr<Job> create(std::string const &target, std::string const &cmd);
+
+        // Null if there is no such job, or no longer.
+        std::shared_ptr<Job> find(std::string const &id) const;
+
+        std::vector<std::shared_ptr<Job>> list() const;
+
+        // Forget finished jobs past their time.
+        void expire();
+
+    private:
+        size_t const                                keep_seconds_;
+        size_t const                                max_finished_;
+        uint64_t                                    next_;
+        std::map<std::string, std::shared_ptr<Job>> jobs_;
+        mutable std::mutex                          mutex_;
+    };
+};
+
+#endif // BDE_UTILS_JOB_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,409 @@
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "utils.h"
+#include "linksampler.h"
+
+// ----------------------------------------------------------------------
+
+// In the order of LinkSample fields, after time_ns.
+static const char * const counter_names[] = {
+    "rx_bytes",
+    "tx_bytes",
+    "rx_packets",
+    "tx_packets",
+    "rx_dropped",
+    "tx_dropped",
+    "rx_errors",
+    "tx_errors"
+};
+
+static uint64_t steady_now_ns()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+// ----------------------------------------------------------------------
+
+utils::LinkCounterReader::LinkCounterReader(std::string const &iface)
+    : iface_(iface)
+{
+    fds_.fill(-1);
+
+    for (size_t i = 0; i < fds_.size(); i++)
+    {
+        auto path = "/sys/class/net/" + iface + "/statistics/" + counter_names[i];
+
+        fds_[i] = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fds_[i] < 0)
+        {
+            auto error = "Could not open " + path + ": " + strerror(errno);
+
+            for (auto fd : fds_)
+            {
+                if (fd >= 0) close(fd);
+            }
+
+            throw std::runtime_error(error);
+        }
+    }
+}
+
+utils::LinkCounterReader::~LinkCounterReader()
+{
+    for (auto fd : fds_)
+    {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void utils::LinkCounterReader::read(LinkSample &sample) const
+{
+    uint64_t counters[8] = {0};
+
+    for (size_t i = 0; i < fds_.size(); i++)
+    {
+        char buf[32] = {0};
+
+        auto n = pread(fds_[i], buf, sizeof(buf) - 1, 0);
+
+        if (n <= 0)
+        {
+            throw std::runtime_error("Could not read " +
+                                     std::string(counter_names[i]) +
+                                     " of " + iface_ + ": " +
+                                     (n < 0 ? strerror(errno) : "empty read"));
+        }
+
+        counters[i] = strtoull(buf, nullptr, 10);
+    }
+
+    sample.rx_bytes   = counters[0];
+    sample.tx_bytes   = counters[1];
+    sample.rx_packets = counters[2];
+    sample.tx_packets = counters[3];
+    sample.rx_dropped = counters[4];
+    sample.tx_dropped = counters[5];
+    sample.rx_errors  = counters[6];
+    sample.tx_errors  = counters[7];
+}
+
+// ----------------------------------------------------------------------
+
+utils::LinkSampleRing::LinkSampleRing(size_t capacity)
+    : capacity_(capacity)
+    , slots_(new Slot[capacity])
+    , head_(0)
+{
+    if (capacity == 0)
+    {
+        throw std::runtime_error("LinkSampleRing: capacity cannot be zero");
+    }
+
+    for (size_t i = 0; i < capacity; i++)
+    {
+        slots_[i].seq.store(0, std::memory_order_relaxed);
+    }
+}
+
+void utils::LinkSampleRing::push(LinkSample const &sample)
+{
+    auto  seq  = head_.load(std::memory_order_relaxed);
+    auto &slot = slots_[seq % capacity_];
+
+    uint64_t values[nfields];
+    memcpy(values, &sample, sizeof(values));
+
+    // Mark the slot as being written before touching the fields, so
+    // that a reader holding an older copy of it can tell.
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < nfields; i++)
+    {
+        slot.fields[i].store(values[i], std::memory_order_relaxed);
+    }
+
+    slot.seq.store(seq + 1, std::memory_order_release);
+    head_.store(seq + 1, std::memory_order_release);
+}
+
+std::vector<utils::LinkSample> utils::LinkSampleRing::latest(size_t count) const
+{
+    auto const head = head_.load(std::memory_order_acquire);
+    auto const n    = std::min<uint64_t>({count, head, capacity_});
+
+    std::vector<LinkSample> samples;
+    samples.reserve(n);
+
+    for (auto seq = head - n; seq < head; seq++)
+    {
+        auto const &slot = slots_[seq % capacity_];
+
+        if (slot.seq.load(std::memory_order_acquire) != seq + 1)
+        {
+            continue;
+        }
+
+        uint64_t values[nfields];
+
+        for (size_t i = 0; i < nfields; i++)
+        {
+            values[i] = slot.fields[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Overwritten by the writer while we were at it.
+        if (slot.seq.load(std::memory_order_relaxed) != seq + 1)
+        {
+            continue;
+        }
+
+        LinkSample sample;
+        memcpy(&sample, values, sizeof(values));
+        samples.push_back(sample);
+    }
+
+    return samples;
+}
+
+// ----------------------------------------------------------------------
+
+std::vector<utils::LinkRates>
+utils::link_rates(std::vector<LinkSample> const &samples)
+{
+    std::vector<LinkRates> rates;
+
+    if (samples.size() < 2)
+    {
+        return rates;
+    }
+
+    rates.reserve(samples.size() - 1);
+
+    for (size_t i = 1; i < samples.size(); i++)
+    {
+        auto const &a = samples[i - 1];
+        auto const &b = samples[i];
+
+        if (b.time_ns <= a.time_ns)
+        {
+            continue;
+        }
+
+        double const dt = (b.time_ns - a.time_ns) / 1e9;
+
+        auto rate = [dt](uint64_t from, uint64_t to) {
+            return to >= from ? (to - from) / dt : 0.0;
+        };
+
+        LinkRates r;
+        r.time_ns    = b.time_ns;
+        r.rx_bps     = rate(a.rx_bytes, b.rx_bytes) * 8;
+        r.tx_bps     = rate(a.tx_bytes, b.tx_bytes) * 8;
+        r.rx_pps     = rate(a.rx_packets, b.rx_packets);
+        r.tx_pps     = rate(a.tx_packets, b.tx_packets);
+        r.rx_dropped = rate(a.rx_dropped, b.rx_dropped);
+        r.tx_dropped = rate(a.tx_dropped, b.tx_dropped);
+
+        rates.push_back(r);
+    }
+
+    return rates;
+}
+
+utils::LinkRateStats
+utils::link_rate_stats(std::vector<LinkRates> const &rates,
+                       double LinkRates::*field)
+{
+    LinkRateStats stats{0, 0, 0, 0, 0};
+
+    if (rates.empty())
+    {
+        return stats;
+    }
+
+    std::vector<double> values;
+    values.reserve(rates.size());
+
+    double sum = 0;
+
+    for (auto const &r : rates)
+    {
+        values.push_back(r.*field);
+        sum += r.*field;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    // Nearest-rank percentiles.
+    auto percentile = [&values](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+        return values[rank > 0 ? rank - 1 : 0];
+    };
+
+    stats.avg  = sum / values.size();
+    stats.peak = values.back();
+    stats.p50  = percentile(0.50);
+    stats.p90  = percentile(0.90);
+    stats.p99  = percentile(0.99);
+
+    return stats;
+}
+
+// ----------------------------------------------------------------------
+
+utils::LinkSampler::LinkSampler(std::vector<std::string> const &ifaces,
+                                size_t                          interval_ms,
+                                size_t                          history_seconds)
+    : interval_ms_(interval_ms)
+    , stop_(false)
+{
+    if (interval_ms == 0)
+    {
+        throw std::runtime_error("LinkSampler: interval cannot be zero");
+    }
+
+    auto const capacity = history_seconds * 1000 / interval_ms + 1;
+
+    for (auto const &iface : ifaces)
+    {
+        try
+        {
+            links_[iface].reset(new Link(iface, capacity));
+        }
+        catch (std::exception const &ex)
+        {
+            links_.erase(iface);
+            utils::slog() << "[LinkSampler] Not sampling " << iface
+                          << ": " << ex.what();
+        }
+    }
+}
+
+utils::LinkSampler::~LinkSampler()
+{
+    stop();
+}
+
+void utils::LinkSampler::start()
+{
+    if (thread_.joinable() or links_.empty())
+    {
+        return;
+    }
+
+    stop_   = false;
+    thread_ = std::thread(&LinkSampler::run, this);
+
+    utils::slog() << "[LinkSampler] Sampling " << links_.size()
+                  << " interface(s) every " << interval_ms_ << " ms.";
+}
+
+void utils::LinkSampler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+std::vector<std::string> utils::LinkSampler::interfaces() const
+{
+    std::vector<std::string> names;
+
+    for (auto const &l : links_)
+    {
+        names.push_back(l.first);
+    }
+
+    return names;
+}
+
+std::vector<utils::LinkSample>
+utils::LinkSampler::history(std::string const &iface, size_t seconds) const
+{
+    auto it = links_.find(iface);
+
+    if (it == links_.end())
+    {
+        throw std::runtime_error("Interface " + iface + " is not sampled");
+    }
+
+    return it->second->ring.latest(seconds * 1000 / interval_ms_ + 1);
+}
+
+void utils::LinkSampler::run()
+{
+    auto const interval = std::chrono::milliseconds(interval_ms_);
+    auto       next     = std::chrono::steady_clock::now();
+
+    // Log read errors once per interface, not on every sample.
+    std::map<std::string, bool> failing;
+
+    while (true)
+    {
+        for (auto &l : links_)
+        {
+            LinkSample sample;
+
+            try
+            {
+                l.second->reader.read(sample);
+                sample.time_ns = steady_now_ns();
+                l.second->ring.push(sample);
+
+                failing[l.first] = false;
+            }
+            catch (std::exception const &ex)
+            {
+                if (not failing[l.first])
+                {
+                    utils::slog() << "[LinkSampler] " << ex.what();
+                }
+
+                failing[l.first] = true;
+            }
+        }
+
+        next += interval;
+
+        // Don't try to catch up after a stall.
+        auto const now = std::chrono::steady_clock::now();
+        if (next < now)
+        {
+            next = now;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (cv_.wait_until(lock, next, [this]() { return stop_; }))
+        {
+            break;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,174 @@
+//
+//  Sample network interface counters at a high rate, and keep a
+//  short history of them in memory.
+//
+
+#ifndef BDE_UTILS_LINK_SAMPLER_H
+#define BDE_UTILS_LINK_SAMPLER_H
+
+#include <map>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // One reading of an interface's counters.  Time is in
+    // nanoseconds of the steady clock.
+    struct LinkSample
+    {
+        uint64_t time_ns;
+        uint64_t rx_bytes;
+        uint64_t tx_bytes;
+        uint64_t rx_packets;
+        uint64_t tx_packets;
+        uint64_t rx_dropped;
+        uint64_t tx_dropped;
+        uint64_t rx_errors;
+        uint64_t tx_errors;
+    };
+
+    // Reads counters of an interface from
+    // /sys/class/net/<iface>/statistics.  The counter files are
+    // opened once and re-read with pread(), which is a lot cheaper
+    // than going through getifaddrs() for every sample.
+    class LinkCounterReader
+    {
+    public:
+        explicit LinkCounterReader(std::string const &iface);
+        ~LinkCounterReader();
+
+        LinkCounterReader(LinkCounterReader const &) = delete;
+        LinkCounterReader& operator=(LinkCounterReader const &) = delete;
+
+        std::string const &iface() const { return iface_; }
+
+        // Fill in the counters of @sample@; time is left alone.
+        void read(LinkSample &sample) const;
+
+    private:
+        std::string        iface_;
+        std::array<int, 8> fds_;
+    };
+
+    // A fixed size ring of samples, with one writer and any number of
+    // readers.  Neither side takes a lock: each slot carries the
+    // sequence number of the sample in it, and readers drop the slots
+    // that were overwritten while they were reading them.
+    class LinkSampleRing
+    {
+    public:
+        explicit LinkSampleRing(size_t capacity);
+
+        size_t capacity() const { return capacity_; }
+
+        // Called by the writer only.
+        void push(LinkSample const &sample);
+
+        // Up to @count@ latest samples, oldest first.
+        std::vector<LinkSample> latest(size_t count) const;
+
+    private:
+        static const size_t nfields = sizeof(LinkSample) / sizeof(uint64_t);
+
+        struct Slot
+        {
+            std::atomic<uint64_t>                          seq;
+            std::array<std::atomic<uint64_t>, nfields>     fields;
+        };
+
+        size_t                   capacity_;
+        std::unique_ptr<Slot[]>  slots_;
+        std::atomic<uint64_t>    head_;   // samples written so far.
+    };
+
+    // Rates computed over a series of samples.
+    struct LinkRateStats
+    {
+        double avg;
+        double peak;
+        double p50;
+        double p90;
+        double p99;
+    };
+
+    struct LinkRates
+    {
+        uint64_t time_ns;     // end of the interval.
+        double   rx_bps;
+        double   tx_bps;
+        double   rx_pps;
+        double   tx_pps;
+        double   rx_dropped;  // per second.
+        double   tx_dropped;  // per second.
+    };
+
+    // Per-interval rates of consecutive samples.  Counter resets
+    // (counters going backwards) give a zero rate.
+    std::vector<LinkRates> link_rates(std::vector<LinkSample> const &samples);
+
+    // Average, peak, and percentiles of one field of the given rates.
+    LinkRateStats link_rate_stats(std::vector<LinkRates> const &rates,
+                                  double LinkRates::*field);
+
+    // Samples the given interfaces every @interval_ms@ milliseconds on
+    // a thread of its own, keeping @history_seconds@ worth of samples
+    // per interface.  Interfaces whose counters can't be opened are
+    // logged and skipped.
+    class LinkSampler
+    {
+    public:
+        LinkSampler(std::vector<std::string> const &ifaces,
+                    size_t                          interval_ms     = 100,
+                    size_t                          history_seconds = 60);
+        ~LinkSampler();
+
+        void start();
+        void stop();
+
+        size_t interval_ms() const { return interval_ms_; }
+
+        std::vector<std::string> interfaces() const;
+
+        // Samples of the last @seconds@ seconds, oldest first.
+        // Throws if the interface is not sampled.
+        std::vector<LinkSample> history(std::string const &iface,
+                                        size_t             seconds) const;
+
+    private:
+        void run();
+
+        struct Link
+        {
+            Link(std::string const &iface, size_t capacity)
+                : reader(iface), ring(capacity) {}
+
+            LinkCounterReader reader;
+            LinkSampleRing    ring;
+        };
+
+        size_t                                       interval_ms_;
+        std::map<std::string, std::unique_ptr<Link>> links_;
+
+        std::thread             thread_;
+        std::mutex              mutex_;
+        std::condition_variable cv_;
+        bool                    stop_;
+    };
+};
+
+#endif // BDE_UTILS_LINK_SAMPLER_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
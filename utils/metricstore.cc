@@ -0,0 +1,289 @@
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "metricstore.h"
+
+// ----------------------------------------------------------------------
+
+std::vector<utils::MetricTier> utils::default_metric_tiers()
+{
+    return parse_metric_tiers("1s:1h,10s:6h,1m:24h");
+}
+
+static uint64_t parse_duration_ms(std::string const &str)
+{
+    size_t   pos = 0;
+    uint64_t n   = 0;
+
+    try
+    {
+        n = std::stoull(str, &pos);
+    }
+    catch (std::exception const &)
+    {
+        throw std::invalid_argument("bad duration \"" + str + "\"");
+    }
+
+    auto const unit = str.substr(pos);
+
+    if (unit == "ms")
+        return n;
+    if (unit == "s")
+        return n * 1000;
+    if (unit == "m")
+        return n * 60 * 1000;
+    if (unit == "h")
+        return n * 60 * 60 * 1000;
+    if (unit == "d")
+        return n * 24 * 60 * 60 * 1000;
+
+    throw std::invalid_argument("bad duration \"" + str + "\"");
+}
+
+std::vector<utils::MetricTier> utils::parse_metric_tiers(std::string const &spec)
+{
+    std::vector<MetricTier> tiers;
+    std::istringstream      in(spec);
+    std::string             item;
+
+    while (std::getline(in, item, ','))
+    {
+        auto const colon = item.find(':');
+
+        if (colon == std::string::npos)
+        {
+            throw std::invalid_argument("bad metric tier \"" + item + "\"");
+        }
+
+        auto const resolution = parse_duration_ms(item.substr(0, colon));
+        auto const history    = parse_duration_ms(item.substr(colon + 1));
+
+        if (resolution == 0 or history < resolution)
+        {
+            throw std::invalid_argument("bad metric tier \"" + item + "\"");
+        }
+
+        if (not tiers.empty() and resolution <= tiers.back().resolution_ms)
+        {
+            throw std::invalid_argument("metric tiers must go from fine to coarse");
+        }
+
+        tiers.push_back({resolution, static_cast<size_t>(history / resolution)});
+    }
+
+    if (tiers.empty())
+    {
+        throw std::invalid_argument("no metric tiers in \"" + spec + "\"");
+    }
+
+    return tiers;
+}
+
+// ----------------------------------------------------------------------
+
+utils::MetricSeries::MetricSeries(std::vector<MetricTier> const &tiers)
+{
+    for (auto const &t : tiers)
+    {
+        tiers_.push_back({t.resolution_ms, std::vector<Bucket>(t.buckets), 0, 0});
+    }
+}
+
+void utils::MetricSeries::record(uint64_t time_ms, double value)
+{
+    // Would poison min and max for the whole bucket.
+    if (not std::isfinite(value))
+    {
+        return;
+    }
+
+    for (auto &tier : tiers_)
+    {
+        auto const start = time_ms - time_ms % tier.resolution_ms;
+        auto      &head  = tier.ring[tier.head];
+
+        if (tier.size > 0 and start == head.start_ms)
+        {
+            head.min    = std::min(head.min, value);
+            head.max    = std::max(head.max, value);
+            head.sum   += value;
+            head.count += 1;
+            continue;
+        }
+
+        if (tier.size > 0 and start < head.start_ms)
+        {
+            continue;
+        }
+
+        if (tier.size > 0)
+        {
+            tier.head = (tier.head + 1) % tier.ring.size();
+        }
+
+        tier.ring[tier.head] = {start, value, value, value, 1};
+        tier.size = std::min(tier.size + 1, tier.ring.size());
+    }
+}
+
+uint64_t utils::MetricSeries::oldest(Tier const &tier)
+{
+    auto const n = tier.ring.size();
+    return tier.ring[(tier.head + n - tier.size + 1) % n].start_ms;
+}
+
+utils::MetricRange utils::MetricSeries::fetch(uint64_t from_ms,
+                                              uint64_t to_ms,
+                                              uint64_t min_resolution_ms) const
+{
+    Tier const *best = nullptr;
+
+    for (auto const &tier : tiers_)
+    {
+        if (tier.resolution_ms < min_resolution_ms and &tier != &tiers_.back())
+        {
+            continue;
+        }
+
+        if (tier.size == 0)
+        {
+            continue;
+        }
+
+        // A tier that has not wrapped yet has everything there is.
+        if (tier.size < tier.ring.size() or oldest(tier) <= from_ms)
+        {
+            best = &tier;
+            break;
+        }
+
+        if (best == nullptr or oldest(tier) < oldest(*best))
+        {
+            best = &tier;
+        }
+    }
+
+    MetricRange range{best ? best->resolution_ms : tiers_.back().resolution_ms, {}};
+
+    if (best == nullptr)
+    {
+        return range;
+    }
+
+    auto const n = best->ring.size();
+
+    for (size_t i = 0; i < best->size; i++)
+    {
+        auto const &b = best->ring[(best->head + n - best->size + 1 + i) % n];
+
+        if (b.start_ms + best->resolution_ms > from_ms and b.start_ms <= to_ms)
+        {
+            range.points.push_back({b.start_ms, b.min, b.max, b.sum / b.count, b.count});
+        }
+    }
+
+    return range;
+}
+
+size_t utils::MetricSeries::memory() const
+{
+    size_t bytes = 0;
+
+    for (auto const &tier : tiers_)
+    {
+        bytes += tier.ring.size() * sizeof(Bucket);
+    }
+
+    return bytes;
+}
+
+// ----------------------------------------------------------------------
+
+utils::MetricStore::MetricStore(std::vector<MetricTier> const &tiers)
+    : tiers_(tiers)
+{
+    if (tiers_.empty())
+    {
+        throw std::invalid_argument("MetricStore: no tiers");
+    }
+}
+
+uint64_t utils::MetricStore::now_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+void utils::MetricStore::record(std::string const &series, double value)
+{
+    record(series, now_ms(), value);
+}
+
+void utils::MetricStore::record(std::string const &series,
+                                uint64_t           time_ms,
+                                double             value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto s = series_.find(series);
+
+    if (s == series_.end())
+    {
+        s = series_.emplace(series, MetricSeries(tiers_)).first;
+    }
+
+    s->second.record(time_ms, value);
+}
+
+std::vector<std::string> utils::MetricStore::series() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::string> names;
+
+    for (auto const &s : series_)
+    {
+        names.push_back(s.first);
+    }
+
+    return names;
+}
+
+utils::MetricRange utils::MetricStore::fetch(std::string const &series,
+                                             uint64_t           from_ms,
+                                             uint64_t           to_ms,
+                                             uint64_t           min_resolution_ms) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto s = series_.find(series);
+
+    if (s == series_.end())
+    {
+        throw std::out_of_range("no metric series \"" + series + "\"");
+    }
+
+    return s->second.fetch(from_ms, to_ms, min_resolution_ms);
+}
+
+size_t utils::MetricStore::memory() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t bytes = 0;
+
+    for (auto const &s : series_)
+    {
+        bytes += s.second.memory();
+    }
+
+    return bytes;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
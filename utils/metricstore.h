@@ -0,0 +1,145 @@
+//
+//  A small time series store kept in memory by each agent, so that
+//  recent history of its interfaces, disks and load can be asked for
+//  without a trip to the time series database.
+//
+//  Each series has a few tiers, from fine to coarse: say one second
+//  buckets for the last hour, ten second ones for the last six hours,
+//  and one minute ones for the last day.  A tier is a ring of a fixed
+//  number of buckets, allocated when the series is created, so memory
+//  does not grow with time.  Every value goes into the bucket of each
+//  tier it falls in; buckets keep min, max, sum and count.
+//
+
+#ifndef BDE_UTILS_METRIC_STORE_H
+#define BDE_UTILS_METRIC_STORE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct MetricTier
+    {
+        uint64_t resolution_ms;     // width of a bucket.
+        size_t   buckets;           // how many are kept.
+    };
+
+    // The default: 1s:1h,10s:6h,1m:24h.
+    std::vector<MetricTier> default_metric_tiers();
+
+    // Parse tiers written as "<resolution>:<history>,...", finest
+    // first, where durations are a number and a unit among ms, s, m,
+    // h and d.  For example "1s:1h,10s:6h,1m:24h".  Throws
+    // std::invalid_argument on anything else.
+    std::vector<MetricTier> parse_metric_tiers(std::string const &spec);
+
+    struct MetricPoint
+    {
+        uint64_t time_ms;           // start of the bucket, since epoch.
+        double   min;
+        double   max;
+        double   avg;
+        uint32_t count;
+    };
+
+    struct MetricRange
+    {
+        uint64_t                 resolution_ms;
+        std::vector<MetricPoint> points;    // oldest first.
+    };
+
+    // Rings of buckets of one series.  Not thread-safe; MetricStore
+    // takes care of that.
+    class MetricSeries
+    {
+    public:
+        explicit MetricSeries(std::vector<MetricTier> const &tiers);
+
+        // Values are expected in time order: one older than the
+        // latest bucket of a tier is not added to that tier.
+        void record(uint64_t time_ms, double value);
+
+        // Buckets that start in [from_ms, to_ms], from the finest
+        // tier at least @min_resolution_ms@ wide that reaches back to
+        // @from_ms@; if none does, from the one that reaches furthest.
+        MetricRange fetch(uint64_t from_ms,
+                          uint64_t to_ms,
+                          uint64_t min_resolution_ms = 0) const;
+
+        // Bytes taken by the buckets.
+        size_t memory() const;
+
+    private:
+        struct Bucket
+        {
+            uint64_t start_ms;
+            double   min;
+            double   max;
+            double   sum;
+            uint32_t count;
+        };
+
+        struct Tier
+        {
+            uint64_t            resolution_ms;
+            std::vector<Bucket> ring;
+            size_t              head;       // latest bucket.
+            size_t              size;       // buckets in use.
+        };
+
+        // Start of the oldest bucket held.
+        static uint64_t oldest(Tier const &tier);
+
+        std::vector<Tier> tiers_;
+    };
+
+    // Named series, created on first use.
+    class MetricStore
+    {
+    public:
+        explicit MetricStore(std::vector<MetricTier> const &tiers = default_metric_tiers());
+
+        MetricStore(MetricStore const &) = delete;
+        MetricStore& operator=(MetricStore const &) = delete;
+
+        // Record a value now, or at @time_ms@ since epoch.
+        void record(std::string const &series, double value);
+        void record(std::string const &series, uint64_t time_ms, double value);
+
+        std::vector<std::string> series() const;
+
+        // See MetricSeries::fetch().  Throws std::out_of_range if
+        // there is no such series.
+        MetricRange fetch(std::string const &series,
+                          uint64_t           from_ms,
+                          uint64_t           to_ms,
+                          uint64_t           min_resolution_ms = 0) const;
+
+        std::vector<MetricTier> const & tiers() const { return tiers_; }
+
+        // Bytes taken by the buckets of all series.
+        size_t memory() const;
+
+        // Milliseconds since epoch, of the system clock.
+        static uint64_t now_ms();
+
+    private:
+        std::vector<MetricTier>             tiers_;
+        std::map<std::string, MetricSeries> series_;
+        mutable std::mutex                  mutex_;
+    };
+};
+
+#endif // BDE_UTILS_METRIC_STORE_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
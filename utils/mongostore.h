@@ -8,9 +8,12 @@
 #include "mongocxx/pool.hpp"
 #include "mongocxx/instance.hpp"
 #include "mongocxx/uri.hpp"
+#include "mongocxx/options/insert.hpp"
 
 #include "json/json.h"
 
+#include <vector>
+
 // ---------------------------------------------------------------
 // Types
 // ---------------------------------------------------------------
@@ -96,6 +99,34 @@ namespace utils
             auto res = (*c)[dbname][collection].insert_one(std::move(bsoncxx::from_json(Json::FastWriter().write(doc)))); 
             return res ? (*res).inserted_id().get_oid().value.to_string() : ""; }
 
+        // db.insert many -- one bulk write for the whole lot.  Returns
+        // the ids in the same order as the input documents; with
+        // ordered inserts a failure stops at the failing document.
+        std::vector<std::string>
+          insert_many(std::string const & collection, std::vector<Json::Value> const & docs, bool ordered = true)
+          { std::vector<std::string> ids;
+            if (docs.empty()) return ids;
+            std::vector<bsoncxx::document::value> bdocs;
+            bdocs.reserve(docs.size());
+            Json::FastWriter writer;
+            for (auto const & doc : docs) bdocs.push_back(bsoncxx::from_json(writer.write(doc)));
+            mongocxx::options::insert opts;
+            opts.ordered(ordered);
+            auto c = client();
+            auto res = (*c)[dbname][collection].insert_many(bdocs, opts);
+            if (!res) return ids;
+            ids.resize(docs.size());
+            for (auto const & id : (*res).inserted_ids()) ids[id.first] = id.second.get_oid().value.to_string();
+            return ids; }
+
+        // db.update one -- @update@ is an update document, i.e. one
+        // made of "$set", "$push", and such operators.
+        void
+          update_one_by_id(std::string const & collection, std::string const & id, Json::Value const & update)
+          { auto c = client();
+            (*c)[dbname][collection].update_one(document{} << "_id" << bsoncxx::oid(id) << finalize,
+                                                bsoncxx::from_json(Json::FastWriter().write(update))); }
+
 #if 0
         void
         update(std::string const & collection, Json::Value const & doc)
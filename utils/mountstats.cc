@@ -0,0 +1,353 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "utils.h"
+#include "mountstats.h"
+
+// ----------------------------------------------------------------------
+
+static uint64_t now_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string read_file(std::string const &path, bool &ok)
+{
+    std::ifstream in(path);
+
+    ok = in.is_open();
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+
+    return ss.str();
+}
+
+static bool is_nfs(std::string const &fstype)
+{
+    return fstype == "nfs" or fstype == "nfs4";
+}
+
+// ----------------------------------------------------------------------
+
+// Each mount starts with a line like
+//
+//   device server:/export mounted on /mnt/data with fstype nfs4 statvers=1.1
+//
+// followed, for NFS, by indented lines of counters.  Those we use are
+//
+//   bytes:  normalread normalwrite directread directwrite serverread serverwrite ...
+//
+// and, after "per-op statistics", one line per operation:
+//
+//   READ: ops trans timeouts bytes_sent bytes_recv queue rtt exe [errors]
+//
+std::map<std::string, utils::NfsMountCounters>
+utils::parse_mountstats(std::string const &text)
+{
+    std::map<std::string, NfsMountCounters> result;
+
+    std::istringstream lines(text);
+    std::string        line;
+
+    NfsMountCounters *mount  = nullptr;
+    bool              per_op = false;
+
+    while (std::getline(lines, line))
+    {
+        std::istringstream in(line);
+        std::string        word;
+
+        if (not (in >> word))
+            continue;
+
+        if (word == "device")
+        {
+            std::string device, mounted, on, mount_point, with, fstype_word, fstype;
+
+            mount  = nullptr;
+            per_op = false;
+
+            if (in >> device >> mounted >> on >> mount_point >> with
+                >> fstype_word >> fstype and is_nfs(fstype))
+            {
+                mount = &result[mount_point];
+
+                *mount             = NfsMountCounters();
+                mount->device      = device;
+                mount->mount_point = mount_point;
+                mount->fstype      = fstype;
+            }
+
+            continue;
+        }
+
+        if (mount == nullptr)
+            continue;
+
+        if (word == "bytes:")
+        {
+            uint64_t normal_read = 0, normal_write = 0;
+            uint64_t direct_read = 0, direct_write = 0;
+
+            if (in >> normal_read >> normal_write >> direct_read >> direct_write
+                >> mount->server_read_bytes >> mount->server_write_bytes)
+            {
+                mount->app_read_bytes  = normal_read + direct_read;
+                mount->app_write_bytes = normal_write + direct_write;
+            }
+        }
+        else if (word == "per-op")
+        {
+            per_op = true;
+        }
+        else if (per_op and word.size() > 1 and word.back() == ':')
+        {
+            NfsOpCounters c;
+
+            if (in >> c.ops >> c.trans >> c.timeouts >> c.bytes_sent
+                >> c.bytes_recv >> c.queue_ms >> c.rtt_ms >> c.exe_ms)
+            {
+                mount->ops[word.substr(0, word.size() - 1)] = c;
+            }
+        }
+    }
+
+    return result;
+}
+
+utils::NfsMountRates utils::nfs_mount_rates(NfsMountCounters const &a,
+                                            NfsMountCounters const &b,
+                                            double                  seconds)
+{
+    NfsMountRates r;
+
+    if (seconds <= 0)
+    {
+        return r;
+    }
+
+    auto delta = [](uint64_t from, uint64_t to) -> double {
+        return to >= from ? to - from : 0;
+    };
+
+    // Counters of an operation in the interval; zero if it wasn't
+    // there before (first use since mount).
+    auto op_delta = [&](std::string const &name) {
+        NfsOpCounters d;
+
+        auto after = b.ops.find(name);
+
+        if (after == b.ops.end())
+            return d;
+
+        auto before = a.ops.find(name);
+        auto empty  = NfsOpCounters();
+        auto const &x = before != a.ops.end() ? before->second : empty;
+        auto const &y = after->second;
+
+        d.ops      = delta(x.ops, y.ops);
+        d.trans    = delta(x.trans, y.trans);
+        d.timeouts = delta(x.timeouts, y.timeouts);
+        d.rtt_ms   = delta(x.rtt_ms, y.rtt_ms);
+        d.exe_ms   = delta(x.exe_ms, y.exe_ms);
+
+        return d;
+    };
+
+    r.read_bytes_per_sec  = delta(a.server_read_bytes, b.server_read_bytes) / seconds;
+    r.write_bytes_per_sec = delta(a.server_write_bytes, b.server_write_bytes) / seconds;
+
+    double ops = 0, retrans = 0;
+
+    for (auto const &op : b.ops)
+    {
+        auto const d = op_delta(op.first);
+
+        ops += d.ops;
+
+        if (d.trans > d.ops)
+            retrans += d.trans - d.ops;
+    }
+
+    r.ops_per_sec     = ops / seconds;
+    r.retrans_per_sec = retrans / seconds;
+
+    auto const read  = op_delta("READ");
+    auto const write = op_delta("WRITE");
+
+    r.read_ops_per_sec  = read.ops / seconds;
+    r.write_ops_per_sec = write.ops / seconds;
+
+    if (read.ops > 0)
+    {
+        r.read_rtt_ms = double(read.rtt_ms) / read.ops;
+        r.read_exe_ms = double(read.exe_ms) / read.ops;
+    }
+
+    if (write.ops > 0)
+    {
+        r.write_rtt_ms = double(write.rtt_ms) / write.ops;
+        r.write_exe_ms = double(write.exe_ms) / write.ops;
+    }
+
+    return r;
+}
+
+// ----------------------------------------------------------------------
+
+utils::NfsStatsSampler::NfsStatsSampler(std::vector<std::string> const &mount_points,
+                                        size_t                          interval_ms,
+                                        std::string const              &mountstats)
+    : interval_ms_(interval_ms)
+    , mountstats_(mountstats)
+    , stop_(false)
+{
+    if (interval_ms == 0)
+    {
+        throw std::runtime_error("NfsStatsSampler: interval cannot be zero");
+    }
+
+    for (auto const &mount_point : mount_points)
+    {
+        mounts_[mount_point];
+    }
+}
+
+utils::NfsStatsSampler::~NfsStatsSampler()
+{
+    stop();
+}
+
+void utils::NfsStatsSampler::start()
+{
+    if (thread_.joinable() or mounts_.empty())
+    {
+        return;
+    }
+
+    stop_   = false;
+    thread_ = std::thread(&NfsStatsSampler::run, this);
+
+    utils::slog() << "[NfsStatsSampler] Sampling " << mounts_.size()
+                  << " mount(s) every " << interval_ms_ << " ms.";
+}
+
+void utils::NfsStatsSampler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void utils::NfsStatsSampler::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (not stop_)
+    {
+        lock.unlock();
+        sample();
+        lock.lock();
+
+        cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_),
+                     [this]() { return stop_; });
+    }
+}
+
+void utils::NfsStatsSampler::sample()
+{
+    bool ok = false;
+
+    auto const text = read_file(mountstats_, ok);
+    auto const time = now_ns();
+
+    if (not ok)
+    {
+        return;
+    }
+
+    auto const all = parse_mountstats(text);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &m : mounts_)
+    {
+        auto &mount = m.second;
+        auto  found = all.find(m.first);
+
+        if (found == all.end())
+        {
+            // Unmounted, or not NFS (any more): start over.
+            mount.samples = 0;
+            continue;
+        }
+
+        // Remounted from elsewhere: the counters don't follow on.
+        if (mount.samples > 0 and mount.last.device != found->second.device)
+        {
+            mount.samples = 0;
+        }
+
+        if (mount.samples > 0 and time > mount.last_ns)
+        {
+            mount.rates = nfs_mount_rates(mount.last, found->second,
+                                          (time - mount.last_ns) / 1e9);
+        }
+
+        mount.last    = found->second;
+        mount.last_ns = time;
+        mount.samples++;
+    }
+}
+
+bool utils::NfsStatsSampler::rates(std::string const &mount_point,
+                                   NfsMountRates     &rates) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto m = mounts_.find(mount_point);
+
+    if (m == mounts_.end() or m->second.samples < 2)
+    {
+        return false;
+    }
+
+    rates = m->second.rates;
+
+    return true;
+}
+
+bool utils::NfsStatsSampler::counters(std::string const &mount_point,
+                                      NfsMountCounters  &counters) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto m = mounts_.find(mount_point);
+
+    if (m == mounts_.end() or m->second.samples < 1)
+    {
+        return false;
+    }
+
+    counters = m->second.last;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
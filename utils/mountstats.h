@@ -0,0 +1,130 @@
+//
+//  NFS client statistics from /proc/self/mountstats, so that storage
+//  agents need not run nfsiostat(8) and parse its output.  Rates and
+//  RPC latencies are computed from the difference of two readings,
+//  the way nfsiostat does.
+//
+
+#ifndef BDE_UTILS_MOUNTSTATS_H
+#define BDE_UTILS_MOUNTSTATS_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // Counters of one NFS operation ("READ", "WRITE"...).  Times are
+    // cumulative milliseconds.
+    struct NfsOpCounters
+    {
+        uint64_t ops        = 0;
+        uint64_t trans      = 0;    // transmissions, retransmits included.
+        uint64_t timeouts   = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t bytes_recv = 0;
+        uint64_t queue_ms   = 0;
+        uint64_t rtt_ms     = 0;
+        uint64_t exe_ms     = 0;
+    };
+
+    struct NfsMountCounters
+    {
+        std::string device;         // "server:/export"
+        std::string mount_point;
+        std::string fstype;
+
+        // From the "bytes:" line: what applications read and wrote,
+        // buffered and O_DIRECT, and what went over the wire.
+        uint64_t app_read_bytes     = 0;
+        uint64_t app_write_bytes    = 0;
+        uint64_t server_read_bytes  = 0;
+        uint64_t server_write_bytes = 0;
+
+        std::map<std::string, NfsOpCounters> ops;
+    };
+
+    // Parse the contents of /proc/self/mountstats.  Only NFS mounts
+    // are returned, by mount point.
+    std::map<std::string, NfsMountCounters>
+    parse_mountstats(std::string const &text);
+
+    // What nfsiostat would say about an interval.  Averages are per
+    // operation in the interval, and zero if there were none.
+    struct NfsMountRates
+    {
+        double read_bytes_per_sec  = 0;     // over the wire.
+        double write_bytes_per_sec = 0;
+        double read_ops_per_sec    = 0;
+        double write_ops_per_sec   = 0;
+        double ops_per_sec         = 0;     // of all operations.
+        double retrans_per_sec     = 0;
+        double read_rtt_ms         = 0;     // average round trip time.
+        double write_rtt_ms        = 0;
+        double read_exe_ms         = 0;     // average, queueing included.
+        double write_exe_ms        = 0;
+    };
+
+    NfsMountRates nfs_mount_rates(NfsMountCounters const &before,
+                                  NfsMountCounters const &after,
+                                  double                  seconds);
+
+    // Samples the NFS mounts at the given mount points every
+    // @interval_ms@ milliseconds on a thread of its own, keeping the
+    // latest rates of each.  Mount points that are not NFS are
+    // reported as not found until they are.
+    class NfsStatsSampler
+    {
+    public:
+        NfsStatsSampler(std::vector<std::string> const &mount_points,
+                        size_t                          interval_ms = 1000,
+                        std::string const              &mountstats  = "/proc/self/mountstats");
+        ~NfsStatsSampler();
+
+        void start();
+        void stop();
+
+        // Take one sample now; the thread does this every interval.
+        void sample();
+
+        // Rates over the last interval, and the counters at its end.
+        // Return false until there have been two samples of the mount
+        // (one, for counters), and for mounts that are not sampled.
+        bool rates(std::string const &mount_point, NfsMountRates &rates) const;
+        bool counters(std::string const &mount_point, NfsMountCounters &counters) const;
+
+    private:
+        void run();
+
+        struct Mount
+        {
+            NfsMountCounters last;
+            uint64_t         last_ns = 0;
+            NfsMountRates    rates;
+            size_t           samples = 0;
+        };
+
+        size_t                       interval_ms_;
+        std::string                  mountstats_;
+        std::map<std::string, Mount> mounts_;
+
+        std::thread                  thread_;
+        mutable std::mutex           mutex_;
+        std::condition_variable      cv_;
+        bool                         stop_;
+    };
+};
+
+#endif // BDE_UTILS_MOUNTSTATS_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,107 @@
+//
+//  An unbounded lock-free queue for many producers and one consumer
+//  (D. Vyukov's node based MPSC queue).  A push is one exchange and
+//  one store, whatever the other producers and the consumer are doing;
+//  a pop touches no shared state that producers write but the node it
+//  takes.
+//
+//      utils::MpscQueue<Item> queue;
+//
+//      queue.push(item);           // any thread
+//
+//      Item item;
+//      while (queue.pop(item))     // one thread only
+//          handle(item);
+//
+//  A push that is under way in another thread may not be seen by pop()
+//  yet, which then returns false; consumers that sleep when the queue
+//  is empty must be woken by the producer after its push.
+//
+
+#ifndef BDE_UTILS_MPSC_QUEUE_H
+#define BDE_UTILS_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+        MpscQueue()
+            : head_(new Node)
+            , tail_(head_.load(std::memory_order_relaxed)) { }
+
+        ~MpscQueue()
+        {
+            T value;
+
+            while (pop(value))
+                ;
+
+            delete tail_;
+        }
+
+        MpscQueue(MpscQueue const &) = delete;
+        MpscQueue& operator=(MpscQueue const &) = delete;
+
+        void push(T value)
+        {
+            Node *node = new Node(std::move(value));
+            Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        // Consumer only.
+        bool pop(T &value)
+        {
+            Node *tail = tail_;
+            Node *next = tail->next.load(std::memory_order_acquire);
+
+            if (next == nullptr)
+                return false;
+
+            // @next@ is the stub from now on.
+            value = std::move(next->value);
+            tail_ = next;
+
+            delete tail;
+
+            return true;
+        }
+
+        // Consumer only.
+        bool empty() const
+        {
+            return tail_->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        struct Node
+        {
+            Node() : next(nullptr), value() { }
+            explicit Node(T v) : next(nullptr), value(std::move(v)) { }
+
+            std::atomic<Node *> next;
+            T                   value;
+        };
+
+        // Producers and the consumer on cache lines of their own.
+        std::atomic<Node *> head_;
+        char                pad_[64];
+        Node               *tail_;
+    };
+};
+
+#endif // BDE_UTILS_MPSC_QUEUE_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
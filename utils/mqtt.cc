@@ -18,6 +18,8 @@ Mqtt::Mqtt(std::string const & host, int port, std::string const & cid, msg_hand
 , con_handler(ch)
 , looping(false)
 , listen_thread()
+, workers(1)
+, dispatcher()
 , subscriptions()
 , conn(false)
 , use_psk(false)
@@ -29,19 +31,18 @@ Mqtt::Mqtt(std::string const & host, int port, std::string const & cid, msg_hand
     // create the handler
     mosq = mosquitto_new(cid.c_str(), true, this);
 
-    // set up the callback
+    // set up the callback; with more than one worker, the network
+    // loop only hands the message over, and the dispatcher's threads
+    // parse it
     mosquitto_message_callback_set(mosq, [](struct mosquitto * mosq, void * obj, const struct mosquitto_message * message) {
         if (message->payloadlen == 0) return;
 
         Mqtt * inst = static_cast<Mqtt*>(obj);
-        Json::Value msg;
 
-        if (Json::Reader().parse((const char*)message->payload, (const char*)message->payload + message->payloadlen, msg)) { 
-            //slog() << "[MQTT received] " << msg;
-            inst->msg_handler(message->topic, msg);
-        } else {
-            slog(s_error) << "unable to parse the payload of the incoming MQTT message";
-        }
+        if (inst->dispatcher)
+            inst->dispatcher->post(message->topic, (const char*)message->payload, message->payloadlen);
+        else
+            inst->on_payload(message->topic, (const char*)message->payload, message->payloadlen);
     });
 
     mosquitto_connect_callback_set(mosq, [](struct mosquitto * mosq, void * obj, int rc) {
@@ -84,7 +85,15 @@ void Mqtt::start()
         throw std::runtime_error("mqtt connect fail with an unknown error.");
     }
 
-    // start listening thread
+    // message handling threads, if any, then the listening thread
+    if (workers > 1)
+    {
+        dispatcher.reset(new MessageDispatcher(workers, [this](std::string const & topic, char const * data, size_t len) {
+            on_payload(topic, data, len);
+        }));
+    }
+
+    looping = true;
     listen_thread = std::thread(&Mqtt::loop, this);
 }
 
@@ -94,6 +103,22 @@ Mqtt::~Mqtt()
     mosquitto_lib_cleanup();
 }
 
+void Mqtt::on_payload(std::string const & topic, char const * data, size_t len)
+{
+    Json::Value msg;
+
+    bool parsed = utils::is_msgpack(data, len)
+        ? utils::msgpack_decode(data, len, msg)
+        : Json::Reader().parse(data, data + len, msg);
+
+    if (parsed) { 
+        //slog() << "[MQTT received] " << msg;
+        msg_handler(topic, msg);
+    } else {
+        slog(s_error) << "unable to parse the payload of the incoming MQTT message";
+    }
+}
+
 void Mqtt::subscribe(std::string const & topic, int qos)
 {
     subscriptions.emplace(topic, qos);
@@ -107,6 +132,9 @@ void Mqtt::stop()
         looping = false; 
         listen_thread.join();
     }
+
+    // after the messages received are handled
+    dispatcher.reset();
 }
 
 int Mqtt::loop()
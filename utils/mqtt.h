@@ -3,9 +3,12 @@
 #define MCUTILS_MQTT_H
 
 #include "json/json.h"
+#include "msgpack.h"
+#include "dispatcher.h"
 
 #include <mosquitto.h>
 
+#include <memory>
 #include <functional>
 #include <string>
 #include <tuple>
@@ -75,6 +78,10 @@ public:
     typedef std::function<void(std::string const &, Json::Value const & msg)> msg_handler_t;
     typedef std::function<void(bool, int)>                                    con_handler_t;
 
+    // Payloads are JSON text, or MessagePack for peers that said they
+    // read it; incoming ones may be either.
+    enum class Encoding { json, msgpack };
+
     Mqtt(std::string const & host, int port, std::string const & cid, msg_handler_t mh, con_handler_t ch = { });
     ~Mqtt();
 
@@ -85,9 +92,21 @@ public:
     bool connected() const { return conn; }
     void subscribe(std::string const & topic, int qos);
 
-    int publish(std::string const & topic, Json::Value const & msg, int qos, bool retain)
+    // With @n@ above one, incoming messages are parsed and handled by
+    // that many threads rather than the network loop; messages of the
+    // same RPC call, or of the same topic when they are not RPC
+    // messages, stay in order.  One by default: the network loop
+    // handles them, for handlers that are not thread-safe.
+    void set_workers(size_t n)
+    {
+        if (looping) throw std::runtime_error("set_workers can only be called before calling the start()");
+        workers = n;
+    }
+
+    int publish(std::string const & topic, Json::Value const & msg, int qos, bool retain,
+                Encoding enc = Encoding::json)
     { 
-        std::string frame = Json::FastWriter().write(msg);
+        std::string frame = enc == Encoding::msgpack ? utils::msgpack_encode(msg) : Json::FastWriter().write(msg);
         return mosquitto_publish(mosq, NULL, topic.c_str(), frame.size(), frame.c_str(), qos, retain);
     }
 
@@ -159,6 +178,9 @@ private:
 
     int loop();
 
+    // parses an incoming message and hands it to the handler
+    void on_payload(std::string const & topic, char const * data, size_t len);
+
     struct mosquitto * mosq;
     std::string host;
     int         port;
@@ -170,6 +192,9 @@ private:
     bool looping;
     std::thread listen_thread;
 
+    size_t workers;
+    std::unique_ptr<utils::MessageDispatcher> dispatcher;
+
     std::map<std::string, int> subscriptions;
 
     bool conn;
@@ -0,0 +1,542 @@
+#include <limits>
+#include <cstring>
+#include <cstdint>
+
+#include "msgpack.h"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // Nesting deeper than this is refused, rather than recursed into.
+    const int max_depth = 256;
+
+    template <typename T>
+    void put_be(std::string &out, T v)
+    {
+        char buf[sizeof(T)];
+
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            buf[i] = static_cast<char>(v >> (8 * (sizeof(T) - 1 - i)));
+        }
+
+        out.append(buf, sizeof(T));
+    }
+
+    void put_tagged(std::string &out, unsigned char tag)
+    {
+        out.push_back(static_cast<char>(tag));
+    }
+
+    void put_unsigned(std::string &out, uint64_t v)
+    {
+        if (v < 0x80)
+        {
+            put_tagged(out, v);
+        }
+        else if (v <= 0xff)
+        {
+            put_tagged(out, 0xcc);
+            put_be<uint8_t>(out, v);
+        }
+        else if (v <= 0xffff)
+        {
+            put_tagged(out, 0xcd);
+            put_be<uint16_t>(out, v);
+        }
+        else if (v <= 0xffffffff)
+        {
+            put_tagged(out, 0xce);
+            put_be<uint32_t>(out, v);
+        }
+        else
+        {
+            put_tagged(out, 0xcf);
+            put_be<uint64_t>(out, v);
+        }
+    }
+
+    void put_signed(std::string &out, int64_t v)
+    {
+        if (v >= 0)
+        {
+            put_unsigned(out, v);
+        }
+        else if (v >= -32)
+        {
+            put_tagged(out, static_cast<unsigned char>(v));
+        }
+        else if (v >= std::numeric_limits<int8_t>::min())
+        {
+            put_tagged(out, 0xd0);
+            put_be<uint8_t>(out, v);
+        }
+        else if (v >= std::numeric_limits<int16_t>::min())
+        {
+            put_tagged(out, 0xd1);
+            put_be<uint16_t>(out, v);
+        }
+        else if (v >= std::numeric_limits<int32_t>::min())
+        {
+            put_tagged(out, 0xd2);
+            put_be<uint32_t>(out, v);
+        }
+        else
+        {
+            put_tagged(out, 0xd3);
+            put_be<uint64_t>(out, v);
+        }
+    }
+
+    // fix, 8, 16 and 32 bit lengths of str, array and map.
+    void put_length(std::string &out, size_t n, unsigned char fix, size_t fix_max,
+                    int tag8, unsigned char tag16, unsigned char tag32)
+    {
+        if (n <= fix_max)
+        {
+            put_tagged(out, fix | n);
+        }
+        else if (tag8 >= 0 and n <= 0xff)
+        {
+            put_tagged(out, tag8);
+            put_be<uint8_t>(out, n);
+        }
+        else if (n <= 0xffff)
+        {
+            put_tagged(out, tag16);
+            put_be<uint16_t>(out, n);
+        }
+        else
+        {
+            put_tagged(out, tag32);
+            put_be<uint32_t>(out, n);
+        }
+    }
+
+    void put_string(std::string &out, char const *begin, char const *end)
+    {
+        size_t const n = end - begin;
+
+        put_length(out, n, 0xa0, 31, 0xd9, 0xda, 0xdb);
+        out.append(begin, n);
+    }
+
+    void encode(Json::Value const &v, std::string &out)
+    {
+        switch (v.type())
+        {
+        case Json::nullValue:
+            put_tagged(out, 0xc0);
+            break;
+
+        case Json::booleanValue:
+            put_tagged(out, v.asBool() ? 0xc3 : 0xc2);
+            break;
+
+        case Json::intValue:
+            put_signed(out, v.asLargestInt());
+            break;
+
+        case Json::uintValue:
+            put_unsigned(out, v.asLargestUInt());
+            break;
+
+        case Json::realValue:
+        {
+            double const d = v.asDouble();
+            uint64_t     bits;
+
+            std::memcpy(&bits, &d, sizeof(bits));
+
+            put_tagged(out, 0xcb);
+            put_be<uint64_t>(out, bits);
+            break;
+        }
+
+        case Json::stringValue:
+        {
+            char const *begin = nullptr;
+            char const *end   = nullptr;
+
+            v.getString(&begin, &end);
+            put_string(out, begin, end);
+            break;
+        }
+
+        case Json::arrayValue:
+            put_length(out, v.size(), 0x90, 15, -1, 0xdc, 0xdd);
+
+            for (auto const &e : v)
+            {
+                encode(e, out);
+            }
+            break;
+
+        case Json::objectValue:
+            put_length(out, v.size(), 0x80, 15, -1, 0xde, 0xdf);
+
+            for (auto i = v.begin(); i != v.end(); ++i)
+            {
+                char const *end   = nullptr;
+                char const *begin = i.memberName(&end);
+
+                put_string(out, begin, end);
+                encode(*i, out);
+            }
+            break;
+        }
+    }
+
+    class Decoder
+    {
+    public:
+        Decoder(char const *data, size_t len)
+            : p_(reinterpret_cast<unsigned char const *>(data))
+            , end_(p_ + len) { }
+
+        bool done() const { return p_ == end_; }
+
+        bool value(Json::Value &v, int depth)
+        {
+            if (depth > max_depth or p_ == end_)
+                return false;
+
+            unsigned char const b = *p_++;
+
+            if (b < 0x80)
+            {
+                v = integer(b);
+                return true;
+            }
+
+            if (b >= 0xe0)
+            {
+                v = Json::Value(Json::Int(static_cast<int8_t>(b)));
+                return true;
+            }
+
+            if ((b & 0xf0) == 0x80)
+                return map(v, b & 0x0f, depth);
+
+            if ((b & 0xf0) == 0x90)
+                return array(v, b & 0x0f, depth);
+
+            if ((b & 0xe0) == 0xa0)
+                return string(v, b & 0x1f);
+
+            uint64_t n = 0;
+
+            switch (b)
+            {
+            case 0xc0: v = Json::Value(); return true;
+            case 0xc2: v = false;         return true;
+            case 0xc3: v = true;          return true;
+
+            case 0xcc: return get(n, 1) and (v = integer(n), true);
+            case 0xcd: return get(n, 2) and (v = integer(n), true);
+            case 0xce: return get(n, 4) and (v = integer(n), true);
+            case 0xcf: return get(n, 8) and (v = integer(n), true);
+
+            case 0xd0: return get(n, 1) and (v = Json::Value(Json::Int(int8_t(n))), true);
+            case 0xd1: return get(n, 2) and (v = Json::Value(Json::Int(int16_t(n))), true);
+            case 0xd2: return get(n, 4) and (v = Json::Value(Json::Int(int32_t(n))), true);
+            case 0xd3: return get(n, 8) and (v = Json::Value(Json::Int64(int64_t(n))), true);
+
+            case 0xca:
+            {
+                if (not get(n, 4))
+                    return false;
+
+                uint32_t const bits = n;
+                float          f;
+
+                std::memcpy(&f, &bits, sizeof(f));
+                v = double(f);
+                return true;
+            }
+
+            case 0xcb:
+            {
+                if (not get(n, 8))
+                    return false;
+
+                double d;
+
+                std::memcpy(&d, &n, sizeof(d));
+                v = d;
+                return true;
+            }
+
+            // bin is taken as a string.
+            case 0xc4: case 0xd9: return get(n, 1) and string(v, n);
+            case 0xc5: case 0xda: return get(n, 2) and string(v, n);
+            case 0xc6: case 0xdb: return get(n, 4) and string(v, n);
+
+            case 0xdc: return get(n, 2) and array(v, n, depth);
+            case 0xdd: return get(n, 4) and array(v, n, depth);
+            case 0xde: return get(n, 2) and map(v, n, depth);
+            case 0xdf: return get(n, 4) and map(v, n, depth);
+            }
+
+            // ext types, and the unused 0xc1.
+            return false;
+        }
+
+        // Finds the str member @key@ of the map at hand.
+        bool peek(char const *key, char const *&value, size_t &value_len)
+        {
+            if (p_ == end_)
+                return false;
+
+            unsigned char const b = *p_++;
+            uint64_t            n = 0;
+
+            if ((b & 0xf0) == 0x80)
+                n = b & 0x0f;
+            else if (not ((b == 0xde and get(n, 2)) or (b == 0xdf and get(n, 4))))
+                return false;
+
+            size_t const key_len = std::strlen(key);
+
+            for (uint64_t i = 0; i < n; i++)
+            {
+                char const *k = nullptr;
+                uint64_t    k_len = 0;
+
+                if (not string_bytes(k, k_len))
+                    return false;
+
+                if (k_len == key_len and std::memcmp(k, key, key_len) == 0)
+                {
+                    uint64_t v_len = 0;
+
+                    if (not string_bytes(value, v_len))
+                        return false;
+
+                    value_len = v_len;
+                    return true;
+                }
+
+                if (not skip(0))
+                    return false;
+            }
+
+            return false;
+        }
+
+    private:
+        bool skip(int depth)
+        {
+            if (depth > max_depth or p_ == end_)
+                return false;
+
+            unsigned char const b = *p_++;
+
+            if (b < 0x80 or b >= 0xe0)
+                return true;
+
+            if ((b & 0xf0) == 0x80)
+                return skip_n(2 * (b & 0x0f), depth);
+
+            if ((b & 0xf0) == 0x90)
+                return skip_n(b & 0x0f, depth);
+
+            if ((b & 0xe0) == 0xa0)
+                return skip_bytes(b & 0x1f);
+
+            uint64_t n = 0;
+
+            switch (b)
+            {
+            case 0xc0: case 0xc2: case 0xc3:
+                return true;
+
+            case 0xcc: case 0xd0:            return skip_bytes(1);
+            case 0xcd: case 0xd1:            return skip_bytes(2);
+            case 0xca: case 0xce: case 0xd2: return skip_bytes(4);
+            case 0xcb: case 0xcf: case 0xd3: return skip_bytes(8);
+
+            case 0xc4: case 0xd9: return get(n, 1) and skip_bytes(n);
+            case 0xc5: case 0xda: return get(n, 2) and skip_bytes(n);
+            case 0xc6: case 0xdb: return get(n, 4) and skip_bytes(n);
+
+            case 0xdc: return get(n, 2) and skip_n(n, depth);
+            case 0xdd: return get(n, 4) and skip_n(n, depth);
+            case 0xde: return get(n, 2) and skip_n(2 * n, depth);
+            case 0xdf: return get(n, 4) and skip_n(2 * n, depth);
+            }
+
+            return false;
+        }
+
+        bool skip_n(uint64_t n, int depth)
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                if (not skip(depth + 1))
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool skip_bytes(uint64_t n)
+        {
+            char const *begin = nullptr;
+
+            return string_bytes_of(begin, n);
+        }
+
+        // As Json::Reader has it: ints while they fit in 32 bits.
+        static Json::Value integer(uint64_t n)
+        {
+            if (n <= uint64_t(Json::Value::maxInt))
+                return Json::Value(Json::Int(n));
+
+            return Json::Value(Json::UInt64(n));
+        }
+
+        bool get(uint64_t &n, size_t bytes)
+        {
+            if (size_t(end_ - p_) < bytes)
+                return false;
+
+            n = 0;
+
+            for (size_t i = 0; i < bytes; i++)
+            {
+                n = (n << 8) | *p_++;
+            }
+
+            return true;
+        }
+
+        bool string(Json::Value &v, uint64_t n)
+        {
+            char const *begin = nullptr;
+
+            if (not string_bytes_of(begin, n))
+                return false;
+
+            v = Json::Value(begin, begin + n);
+
+            return true;
+        }
+
+        bool array(Json::Value &v, uint64_t n, int depth)
+        {
+            // Every element takes a byte at least.
+            if (uint64_t(end_ - p_) < n)
+                return false;
+
+            v = Json::Value(Json::arrayValue);
+
+            if (n > 0)
+            {
+                v.resize(n);
+            }
+
+            for (Json::ArrayIndex i = 0; i < n; i++)
+            {
+                if (not value(v[i], depth + 1))
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool map(Json::Value &v, uint64_t n, int depth)
+        {
+            if (uint64_t(end_ - p_) < 2 * n)
+                return false;
+
+            v = Json::Value(Json::objectValue);
+
+            for (uint64_t i = 0; i < n; i++)
+            {
+                char const *key = nullptr;
+                uint64_t    len = 0;
+
+                if (not string_bytes(key, len))
+                    return false;
+
+                if (not value(v[std::string(key, len)], depth + 1))
+                    return false;
+            }
+
+            return true;
+        }
+
+        // A str, in place.
+        bool string_bytes(char const *&begin, uint64_t &n)
+        {
+            if (p_ == end_)
+                return false;
+
+            unsigned char const b = *p_++;
+
+            if ((b & 0xe0) == 0xa0)
+                n = b & 0x1f;
+            else if (b == 0xd9)
+                return get(n, 1) and string_bytes_of(begin, n);
+            else if (b == 0xda)
+                return get(n, 2) and string_bytes_of(begin, n);
+            else if (b == 0xdb)
+                return get(n, 4) and string_bytes_of(begin, n);
+            else
+                return false;
+
+            return string_bytes_of(begin, n);
+        }
+
+        bool string_bytes_of(char const *&begin, uint64_t n)
+        {
+            if (uint64_t(end_ - p_) < n)
+                return false;
+
+            begin = reinterpret_cast<char const *>(p_);
+            p_   += n;
+
+            return true;
+        }
+
+        unsigned char const *p_;
+        unsigned char const *end_;
+    };
+}
+
+// ----------------------------------------------------------------------
+
+void utils::msgpack_encode(Json::Value const &value, std::string &out)
+{
+    encode(value, out);
+}
+
+std::string utils::msgpack_encode(Json::Value const &value)
+{
+    std::string out;
+    encode(value, out);
+    return out;
+}
+
+bool utils::msgpack_decode(char const *data, size_t len, Json::Value &value)
+{
+    Decoder d(data, len);
+
+    return d.value(value, 0) and d.done();
+}
+
+bool utils::msgpack_peek(char const *data, size_t len, char const *key,
+                         char const *&value, size_t &value_len)
+{
+    Decoder d(data, len);
+
+    return d.peek(key, value, value_len);
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
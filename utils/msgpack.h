@@ -0,0 +1,59 @@
+//
+//  MessagePack encoding of Json::Value, for RPC messages: smaller than
+//  JSON text, and much cheaper to write and read, since numbers are
+//  not printed and parsed, and strings are not escaped.
+//
+//  Values decode to what Json::Reader makes of the same JSON, so that
+//  handlers can't tell which encoding a message came in.
+//
+//  Our messages are all objects, so whether a payload is MessagePack
+//  or JSON can be told from its first byte; see is_msgpack().
+//
+
+#ifndef BDE_UTILS_MSGPACK_H
+#define BDE_UTILS_MSGPACK_H
+
+#include <string>
+#include <cstddef>
+
+#include "json/json.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // Appends to @out@.
+    void msgpack_encode(Json::Value const &value, std::string &out);
+
+    std::string msgpack_encode(Json::Value const &value);
+
+    // False, and @value@ left unspecified, if @data@ is not one whole
+    // MessagePack value.
+    bool msgpack_decode(char const *data, size_t len, Json::Value &value);
+
+    // The bytes of the string member @key@ of a map, in place, with
+    // the other members skipped rather than decoded.  False if there
+    // is none, or it is not a string.
+    bool msgpack_peek(char const *data, size_t len, char const *key,
+                      char const *&value, size_t &value_len);
+
+    // A MessagePack map, rather than a JSON object, which starts with
+    // '{' or white space.
+    inline bool is_msgpack(char const *data, size_t len)
+    {
+        if (len == 0)
+            return false;
+
+        auto const b = static_cast<unsigned char>(data[0]);
+
+        return (b & 0xf0) == 0x80 or b == 0xde or b == 0xdf;
+    }
+};
+
+#endif // BDE_UTILS_MSGPACK_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,353 @@
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+#include "utils.h"
+#include "netconfig.h"
+
+// ----------------------------------------------------------------------
+
+static in_addr parse_ipv4(std::string const &addr, std::string const &what)
+{
+    in_addr in;
+
+    if (inet_pton(AF_INET, addr.c_str(), &in) != 1)
+    {
+        throw std::runtime_error(what + ": bad IPv4 address \"" + addr + "\"");
+    }
+
+    return in;
+}
+
+static int parse_ifindex(std::string const &device, std::string const &what)
+{
+    int ifindex = if_nametoindex(device.c_str());
+
+    if (ifindex == 0)
+    {
+        throw std::runtime_error(what + ": no such device \"" + device + "\"");
+    }
+
+    return ifindex;
+}
+
+// "255.255.255.0" -> 24; masks that are not contiguous are refused.
+static int mask_to_prefix(std::string const &mask, std::string const &what)
+{
+    uint32_t const m = ntohl(parse_ipv4(mask, what).s_addr);
+
+    int bits = 0;
+
+    while (bits < 32 and (m & (0x80000000u >> bits)))
+    {
+        bits++;
+    }
+
+    if (bits < 32 and (m << bits) != 0)
+    {
+        throw std::runtime_error(what + ": bad netmask \"" + mask + "\"");
+    }
+
+    return bits;
+}
+
+// ----------------------------------------------------------------------
+
+size_t utils::NetConfigBatch::add_route(std::string const &dest,
+                                        std::string const &via,
+                                        std::string const &mask,
+                                        std::string const &device)
+{
+    auto what = "route " + dest;
+
+    if (not via.empty())
+        what += " via " + via;
+    if (not device.empty())
+        what += " dev " + device;
+
+    auto slash = dest.find('/');
+    auto dst   = parse_ipv4(dest.substr(0, slash), what);
+    int  bits  = 32;
+
+    if (slash != std::string::npos)
+    {
+        try
+        {
+            bits = std::stoi(dest.substr(slash + 1));
+        }
+        catch (std::exception const &)
+        {
+            bits = -1;
+        }
+
+        if (bits < 0 or bits > 32)
+        {
+            throw std::runtime_error(what + ": bad prefix length");
+        }
+    }
+    else if (not mask.empty())
+    {
+        bits = mask_to_prefix(mask, what);
+    }
+
+    // Same as "ip route": host bits of the destination must be zero.
+    if (bits < 32)
+    {
+        dst.s_addr &= htonl(bits == 0 ? 0 : ~0u << (32 - bits));
+    }
+
+    in_addr gateway;
+    int     ifindex = 0;
+
+    if (not via.empty())
+    {
+        gateway = parse_ipv4(via, what);
+    }
+
+    if (not device.empty())
+    {
+        ifindex = parse_ifindex(device, what);
+    }
+
+    if (via.empty() and device.empty())
+    {
+        throw std::runtime_error(what + ": needs a gateway or a device");
+    }
+
+    auto make = [&](int type, int flags) {
+        NetlinkMessage msg(type, flags);
+
+        rtmsg rtm;
+        memset(&rtm, 0, sizeof(rtm));
+        rtm.rtm_family   = AF_INET;
+        rtm.rtm_dst_len  = bits;
+        rtm.rtm_table    = RT_TABLE_MAIN;
+        rtm.rtm_protocol = RTPROT_BOOT;
+        rtm.rtm_scope    = type == RTM_DELROUTE ? RT_SCOPE_NOWHERE :
+            via.empty() ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE;
+        rtm.rtm_type     = RTN_UNICAST;
+        msg.put(rtm);
+
+        msg.attr(RTA_DST, dst);
+
+        if (not via.empty())
+            msg.attr(RTA_GATEWAY, gateway);
+
+        if (ifindex != 0)
+            msg.attr(RTA_OIF, ifindex);
+
+        return msg;
+    };
+
+    Item item;
+    item.what      = what;
+    item.may_exist = true;
+    item.steps.push_back("add " + what);
+    item.requests.push_back(make(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL));
+    item.undo.push_back(make(RTM_DELROUTE, 0));
+
+    items_.push_back(item);
+
+    return items_.size() - 1;
+}
+
+size_t utils::NetConfigBatch::add_neighbor(std::string const &ip,
+                                           std::string const &mac,
+                                           std::string const &device)
+{
+    auto const what = "neighbor " + ip + " lladdr " + mac + " dev " + device;
+
+    auto dst     = parse_ipv4(ip, what);
+    auto ifindex = parse_ifindex(device, what);
+
+    unsigned v[6];
+    char     extra;
+
+    if (sscanf(mac.c_str(), "%x:%x:%x:%x:%x:%x%c",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &extra) != 6)
+    {
+        throw std::runtime_error(what + ": bad MAC address");
+    }
+
+    uint8_t lladdr[6];
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (v[i] > 0xff)
+            throw std::runtime_error(what + ": bad MAC address");
+
+        lladdr[i] = v[i];
+    }
+
+    auto make = [&](int type, int flags) {
+        NetlinkMessage msg(type, flags);
+
+        ndmsg ndm;
+        memset(&ndm, 0, sizeof(ndm));
+        ndm.ndm_family  = AF_INET;
+        ndm.ndm_ifindex = ifindex;
+        ndm.ndm_state   = NUD_PERMANENT;
+        msg.put(ndm);
+
+        msg.attr(NDA_DST, dst);
+
+        if (type == RTM_NEWNEIGH)
+            msg.attr(NDA_LLADDR, lladdr, sizeof(lladdr));
+
+        return msg;
+    };
+
+    Item item;
+    item.what      = what;
+    item.may_exist = false;
+    item.steps.push_back("replace " + what);
+    item.requests.push_back(make(RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_REPLACE));
+    item.undo.push_back(make(RTM_DELNEIGH, 0));
+
+    items_.push_back(item);
+
+    return items_.size() - 1;
+}
+
+size_t utils::NetConfigBatch::add_queue(TcBatch &queue)
+{
+    auto const device = queue.device();
+
+    Item item;
+    item.what      = "queue on " + device;
+    item.may_exist = false;
+
+    for (auto &op : queue.release())
+    {
+        item.steps.push_back(op.what);
+        item.requests.push_back(op.msg);
+    }
+
+    if (item.requests.empty())
+    {
+        throw std::runtime_error(item.what + ": nothing to do");
+    }
+
+    TcBatch undo(device);
+    undo.delete_qdisc("root");
+
+    for (auto &op : undo.release())
+    {
+        item.undo.push_back(op.msg);
+    }
+
+    items_.push_back(item);
+
+    return items_.size() - 1;
+}
+
+// ----------------------------------------------------------------------
+
+bool utils::NetConfigBatch::apply(std::vector<NetConfigStatus> &status)
+{
+    status.assign(items_.size(), NetConfigStatus());
+
+    std::vector<NetlinkMessage>             requests;
+    std::vector<std::pair<size_t, size_t>>  origin;     // (item, step)
+
+    for (size_t i = 0; i < items_.size(); i++)
+    {
+        status[i].what = items_[i].what;
+
+        for (size_t j = 0; j < items_[i].requests.size(); j++)
+        {
+            requests.push_back(items_[i].requests[j]);
+            origin.emplace_back(i, j);
+        }
+    }
+
+    auto const results = netlink_route_transact(requests);
+
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        auto const &item = items_[origin[r].first];
+        auto       &st   = status[origin[r].first];
+        auto const  err  = results[r];
+
+        // Queues are undone by deleting their qdisc, which is ours
+        // only if adding it went well.
+        if (err == 0)
+        {
+            if (origin[r].second == 0)
+                st.applied = true;
+        }
+        else if (err == EEXIST and item.may_exist)
+        {
+            st.existed = true;
+        }
+        else if (st.error == 0)
+        {
+            st.error   = err;
+            st.message = item.steps[origin[r].second] + " failed: " +
+                netlink_error(err);
+        }
+    }
+
+    bool ok = true;
+
+    for (auto const &st : status)
+    {
+        if (st.error != 0)
+            ok = false;
+    }
+
+    if (ok)
+    {
+        return true;
+    }
+
+    // Undo, newest first, what we did.  The kernel went on with the
+    // requests after the one that failed, so those are undone too.
+    std::vector<NetlinkMessage> undo;
+    std::vector<size_t>         undo_origin;
+
+    for (size_t i = items_.size(); i-- > 0; )
+    {
+        if (not status[i].applied)
+            continue;
+
+        for (auto const &msg : items_[i].undo)
+        {
+            undo.push_back(msg);
+            undo_origin.push_back(i);
+        }
+
+        status[i].rolled_back = true;
+    }
+
+    auto const undone = netlink_route_transact(undo);
+
+    for (size_t u = 0; u < undone.size(); u++)
+    {
+        // Gone already is as good as undone.
+        if (undone[u] != 0 and undone[u] != ENOENT and undone[u] != ESRCH)
+        {
+            auto &st = status[undo_origin[u]];
+
+            st.rolled_back    = false;
+            st.rollback_error = netlink_error(undone[u]);
+
+            utils::slog() << "[NetConfigBatch] Could not undo " << st.what
+                          << ": " << st.rollback_error;
+        }
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,83 @@
+//
+//  Apply routes, neighbor (ARP) entries, and queues as one batch of
+//  rtnetlink requests, undoing what was applied if any of it fails.
+//
+
+#ifndef BDE_UTILS_NETCONFIG_H
+#define BDE_UTILS_NETCONFIG_H
+
+#include <string>
+#include <vector>
+
+#include "netlink.h"
+#include "tc.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // What became of an item of a NetConfigBatch.
+    struct NetConfigStatus
+    {
+        std::string what;
+        int         error       = 0;        // errno value; 0 if it went well.
+        std::string message;                // what failed, if something did.
+        bool        existed     = false;    // was there already; left alone.
+        bool        applied     = false;    // (partly) done by us.
+        bool        rolled_back = false;
+        std::string rollback_error;
+    };
+
+    class NetConfigBatch
+    {
+    public:
+        // "ip route add <dest> [via <via>] [dev <device>]".  @dest@
+        // is an address with an optional prefix length ("10.1.0.0/16"),
+        // or an address and a @mask@ ("255.255.0.0"); with neither,
+        // it is a host route.  A route that is there already is
+        // reported as "existed".  Throws on malformed arguments.
+        size_t add_route(std::string const &dest,
+                         std::string const &via,
+                         std::string const &mask,
+                         std::string const &device);
+
+        // "ip neigh replace <ip> lladdr <mac> dev <device> nud
+        // permanent".  Rolling back removes the entry, even if it
+        // replaced one.
+        size_t add_neighbor(std::string const &ip,
+                            std::string const &mac,
+                            std::string const &device);
+
+        // The changes queued in @queue@; rolling back deletes the root
+        // qdisc of its device.
+        size_t add_queue(TcBatch &queue);
+
+        size_t size() const { return items_.size(); }
+
+        // Send everything as one batch.  If anything fails, undo
+        // whatever got applied, in reverse order, and return false.
+        // @status@ gets one entry per item, in the order they were
+        // added.  Throws only if talking to the kernel fails.
+        bool apply(std::vector<NetConfigStatus> &status);
+
+    private:
+        struct Item
+        {
+            std::string                 what;
+            bool                        may_exist;
+            std::vector<std::string>    steps;  // what each request does.
+            std::vector<NetlinkMessage> requests;
+            std::vector<NetlinkMessage> undo;
+        };
+
+        std::vector<Item> items_;
+    };
+};
+
+#endif // BDE_UTILS_NETCONFIG_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
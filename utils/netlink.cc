@@ -0,0 +1,188 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "utils.h"
+#include "netlink.h"
+
+// ----------------------------------------------------------------------
+
+utils::NetlinkMessage::NetlinkMessage(int type, int flags)
+{
+    nlmsghdr nlh;
+    memset(&nlh, 0, sizeof(nlh));
+    nlh.nlmsg_type  = type;
+    nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+
+    put(&nlh, sizeof(nlh));
+}
+
+void utils::NetlinkMessage::put(void const *data, size_t len)
+{
+    auto const start = bytes_.size();
+    bytes_.resize(start + NLMSG_ALIGN(len), 0);
+    memcpy(bytes_.data() + start, data, len);
+
+    reinterpret_cast<nlmsghdr *>(bytes_.data())->nlmsg_len = bytes_.size();
+}
+
+void utils::NetlinkMessage::attr(int type, void const *data, size_t len)
+{
+    rtattr rta;
+    rta.rta_type = type;
+    rta.rta_len  = RTA_LENGTH(len);
+
+    auto const start = bytes_.size();
+    bytes_.resize(start + RTA_SPACE(len), 0);
+    memcpy(bytes_.data() + start, &rta, sizeof(rta));
+
+    if (len > 0)
+    {
+        memcpy(bytes_.data() + start + RTA_LENGTH(0), data, len);
+    }
+
+    reinterpret_cast<nlmsghdr *>(bytes_.data())->nlmsg_len = bytes_.size();
+}
+
+void utils::NetlinkMessage::attr(int type, std::string const &str)
+{
+    attr(type, str.c_str(), str.size() + 1);
+}
+
+size_t utils::NetlinkMessage::nest_begin(int type)
+{
+    auto const start = bytes_.size();
+    attr(type, nullptr, 0);
+    return start;
+}
+
+void utils::NetlinkMessage::nest_end(size_t start)
+{
+    reinterpret_cast<rtattr *>(bytes_.data() + start)->rta_len =
+        bytes_.size() - start;
+}
+
+void utils::NetlinkMessage::set_seq(uint32_t seq)
+{
+    reinterpret_cast<nlmsghdr *>(bytes_.data())->nlmsg_seq = seq;
+}
+
+// ----------------------------------------------------------------------
+
+std::string utils::netlink_error(int err)
+{
+    return strerror(err < 0 ? -err : err);
+}
+
+std::vector<int>
+utils::netlink_route_transact(std::vector<NetlinkMessage> &requests)
+{
+    std::vector<int> results(requests.size(), 0);
+
+    if (requests.empty())
+    {
+        return results;
+    }
+
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (sock < 0)
+    {
+        throw std::runtime_error("netlink socket() error: " +
+                                 netlink_error(errno));
+    }
+
+    // Don't wait forever for a kernel that won't answer.
+    timeval tv{5, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    auto fail = [sock](std::string const &what) {
+        auto error = netlink_error(errno);
+        close(sock);
+        throw std::runtime_error("netlink " + what + " error: " + error);
+    };
+
+    // Sequence numbers are request indices, plus one.
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        requests[i].set_seq(i + 1);
+    }
+
+    size_t sent  = 0;
+    size_t acked = 0;
+
+    while (sent < requests.size())
+    {
+        // A chunk that comfortably fits the socket buffer.
+        std::vector<iovec> iov;
+        size_t             chunk = 0;
+
+        while (sent < requests.size() and
+               (iov.empty() or chunk + requests[sent].size() <= 32 * 1024))
+        {
+            auto &r = requests[sent++];
+            iov.push_back({const_cast<uint8_t *>(r.data()), r.size()});
+            chunk += r.size();
+        }
+
+        sockaddr_nl kernel;
+        memset(&kernel, 0, sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name    = &kernel;
+        msg.msg_namelen = sizeof(kernel);
+        msg.msg_iov     = iov.data();
+        msg.msg_iovlen  = iov.size();
+
+        if (sendmsg(sock, &msg, 0) < 0)
+        {
+            fail("sendmsg()");
+        }
+
+        while (acked < sent)
+        {
+            char buf[16 * 1024];
+            auto len = recv(sock, buf, sizeof(buf), 0);
+
+            if (len < 0 and errno == EINTR)
+                continue;
+
+            if (len < 0)
+                fail("recv()");
+
+            for (auto h = reinterpret_cast<nlmsghdr *>(buf);
+                 NLMSG_OK(h, len);
+                 h = NLMSG_NEXT(h, len))
+            {
+                if (h->nlmsg_type != NLMSG_ERROR)
+                    continue;
+
+                auto err = static_cast<nlmsgerr const *>(NLMSG_DATA(h));
+
+                if (h->nlmsg_seq >= 1 and h->nlmsg_seq <= requests.size())
+                {
+                    results[h->nlmsg_seq - 1] = -err->error;
+                }
+
+                acked++;
+            }
+        }
+    }
+
+    close(sock);
+
+    return results;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
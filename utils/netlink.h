@@ -0,0 +1,68 @@
+//
+//  Just enough rtnetlink to build requests and send many of them at
+//  once; see tc.h and netconfig.h.
+//
+
+#ifndef BDE_UTILS_NETLINK_H
+#define BDE_UTILS_NETLINK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // A netlink request: a header, a fixed size message (tcmsg,
+    // rtmsg, ndmsg...), then attributes.
+    class NetlinkMessage
+    {
+    public:
+        NetlinkMessage(int type, int flags);
+
+        // The fixed size part; call once, before any attributes.
+        template <typename T>
+        void put(T const &body) { put(&body, sizeof(body)); }
+        void put(void const *data, size_t len);
+
+        template <typename T>
+        void attr(int type, T const &value) { attr(type, &value, sizeof(value)); }
+        void attr(int type, void const *data, size_t len);
+        void attr(int type, std::string const &str);
+
+        // Nested attributes: attributes added between these two go
+        // inside the attribute of the given type.
+        size_t nest_begin(int type);
+        void   nest_end(size_t start);
+
+        uint8_t const *data() const { return bytes_.data(); }
+        size_t         size() const { return bytes_.size(); }
+
+        void set_seq(uint32_t seq);
+
+    private:
+        std::vector<uint8_t> bytes_;
+    };
+
+    // Send the given requests on a NETLINK_ROUTE socket, in as few
+    // sendmsg() calls as fit, and wait for all the acks.  Requests
+    // should ask for acks (they do, as made above).  Returns the
+    // result of each request: zero, or an errno value.
+    //
+    // The kernel handles each request on its own, so a failed one
+    // does not stop those after it.  Throws if talking to the kernel
+    // fails.
+    std::vector<int> netlink_route_transact(std::vector<NetlinkMessage> &requests);
+
+    // strerror() for the results above.
+    std::string netlink_error(int err);
+};
+
+#endif // BDE_UTILS_NETLINK_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -15,6 +15,7 @@
 #include <linux/if_packet.h>
 
 #include "network.h"
+#include "iftable.h"
 #include "utils/utils.h"
 
 // ------------------------------------------------------------
@@ -236,6 +237,21 @@ std::set<utils::NetworkInterface> utils::get_interfaces()
 
 std::string utils::get_first_ipv4_address(std::string const &iface)
 {
+    auto const &table = IfaceTable::instance();
+
+    if (table.ready())
+    {
+        IfaceEntry entry;
+
+        if (table.lookup(iface, entry) and not entry.ipv4.empty())
+        {
+            return entry.ipv4.front();
+        }
+
+        throw std::runtime_error("interface " + iface +
+                                 " or ipv4 address not found");
+    }
+
     for (auto && i : get_interfaces())
     {
         if (i.name() == iface)
@@ -256,6 +272,21 @@ std::string utils::get_first_ipv4_address(std::string const &iface)
 
 std::string utils::get_first_ipv6_address(std::string const &iface)
 {
+    auto const &table = IfaceTable::instance();
+
+    if (table.ready())
+    {
+        IfaceEntry entry;
+
+        if (table.lookup(iface, entry) and not entry.ipv6.empty())
+        {
+            return entry.ipv6.front();
+        }
+
+        throw std::runtime_error("interface " + iface +
+                                 " or ipv6 address not found");
+    }
+
     for (auto && i : get_interfaces())
     {
         if (i.name() == iface)
@@ -270,7 +301,7 @@ std::string utils::get_first_ipv6_address(std::string const &iface)
         }
     }
 
-    auto err = "interface " + iface + " or ipv4 address not found";
+    auto err = "interface " + iface + " or ipv6 address not found";
     throw std::runtime_error(err);
 }
 
@@ -282,6 +313,15 @@ std::string utils::get_iface_mac_address(std::string const & iface)
         throw std::runtime_error(err);
     }
 
+    // Links that are not Ethernet have no MAC address in the table;
+    // ask ioctl() for whatever it makes of them.
+    IfaceEntry entry;
+
+    if (IfaceTable::instance().lookup(iface, entry) and not entry.mac.empty())
+    {
+        return entry.mac;
+    }
+
     struct ifreq ifr;
     strncpy(ifr.ifr_name, iface.c_str(), IFNAMSIZ);
 
@@ -431,6 +471,20 @@ int utils::get_vlan_id(std::string const &iface)
 
 bool utils::iface_up_and_running(std::string const &iface)
 {
+    auto const &table = IfaceTable::instance();
+
+    if (table.ready())
+    {
+        IfaceEntry entry;
+
+        if (not table.lookup(iface, entry))
+        {
+            throw std::runtime_error("no such interface: " + iface);
+        }
+
+        return entry.up_and_running();
+    }
+
     ifreq ifr;
 
     memset(&ifr, 0, sizeof(ifr));
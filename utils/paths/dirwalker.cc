@@ -1,6 +1,7 @@
 #include <stdexcept>
 #include <cstring>
 #include <algorithm>
+#include <memory>
 
 #include <sys/types.h>
 #include <unistd.h>
@@ -9,6 +10,7 @@
 #include <sys/stat.h>
 
 #include "utils/utils.h"
+#include "utils/job.h"
 #include "dirwalker.h"
 
 // ----------------------------------------------------------------------
@@ -22,6 +24,10 @@ void utils::DirectoryWalker::init()
 
 void utils::DirectoryWalker::recurse(const Path &path)
 {
+    // Walking a large tree takes a while; a job that was cancelled
+    // stops at the next directory.
+    utils::check_cancelled();
+
     if (not path.is_directory())
     {
         if (throw_exception_)
@@ -32,7 +38,9 @@ void utils::DirectoryWalker::recurse(const Path &path)
         return;
     }
 
-    DIR *dirp = opendir(path.name().c_str());
+    // Closed however we leave, cancelled walks and errors in the
+    // folders below included.
+    std::unique_ptr<DIR, int (*)(DIR *)> dirp(opendir(path.name().c_str()), closedir);
 
     if (dirp == nullptr)
     {
@@ -46,7 +54,7 @@ void utils::DirectoryWalker::recurse(const Path &path)
 
     struct dirent *resultp = nullptr;
 
-    while ((resultp = readdir(dirp)) != nullptr)
+    while ((resultp = readdir(dirp.get())) != nullptr)
     {
         if (std::string(resultp->d_name) == "." or
             std::string(resultp->d_name) == "..")
@@ -68,8 +76,6 @@ void utils::DirectoryWalker::recurse(const Path &path)
             recurse(newpath);
         }
     }
-
-    closedir(dirp);
 }
 
 // ----------------------------------------------------------------------
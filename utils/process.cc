@@ -364,7 +364,8 @@ void
 utils::supervise_process(std::string const                        &prog,
                          std::vector<std::string> const           &args,
                          std::map<std::string, std::string> const &env,
-                         int                                       restart_interval)
+                         int                                       restart_interval,
+                         CpuPlacement const                       &placement)
 {
     if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0)
     {
@@ -489,6 +490,22 @@ utils::supervise_process(std::string const                        &prog,
                           << "reason: " << strerror(errno);
         }
 
+        // Keep it on the CPUs and memory it was asked to use.
+        if (not placement.empty())
+        {
+            auto const error = apply_placement(placement);
+
+            if (error.empty())
+            {
+                utils::slog() << "[process] Placement: " << placement.describe();
+            }
+            else
+            {
+                utils::slog() << "[process] Could not apply placement ("
+                              << placement.describe() << "): " << error;
+            }
+        }
+
         utils::slog() << "Running \"" << prog << argstr << "\""
                       << " (pid: " << getpid() << ")"
                       << " (env: " << envstr << ")";
@@ -552,7 +569,7 @@ utils::supervise_process(std::string const                        &prog,
                               << "; restarting."
                               << term_color(TermColor::Reset) ;
                 sleep(restart_interval);
-                supervise_process(prog, args, env);
+                supervise_process(prog, args, env, restart_interval, placement);
             }
             else
             {
@@ -568,7 +585,7 @@ utils::supervise_process(std::string const                        &prog,
                           << "terminated by signal " <<  WTERMSIG(status)
                           << "; restarting.";
             sleep(restart_interval);
-            supervise_process(prog, args, env);
+            supervise_process(prog, args, env, restart_interval, placement);
         }
         else if (WIFSTOPPED(status))
         {
@@ -5,6 +5,8 @@
 #include <vector>
 #include <map>
 
+#include "topology.h"
+
 namespace utils
 {
     struct ProcessResult
@@ -38,11 +40,15 @@ namespace utils
     // Note that we can't use this function to supervise programs that
     // daemonize themselves: attempting to do so will result in a fork
     // bomb.
+    //
+    // The subprocess (and every restart of it) runs with the given
+    // CPU and memory placement; see topology.h.
     void
     supervise_process(std::string const                        &prog,
                       std::vector<std::string> const           &args,
                       std::map<std::string, std::string> const &env = {},
-                      int                                       restart_interval = 1);
+                      int                                       restart_interval = 1,
+                      CpuPlacement const                       &placement = {});
 
     // Toggle a flag.
     void stop_process_supervision(void);
@@ -1,6 +1,8 @@
 
 #include "rpcclient.h"
 #include "utils.h"
+#include "msgpack.h"
+#include "compress.h"
 #include "json/json.h"
 
 #include <stdexcept>
@@ -15,6 +17,48 @@
 
 using namespace utils;
 
+// this will put a prefix of "rpc/" to the target if not present
+static std::string rpc_topic(std::string const & target)
+{
+    std::string topic;
+
+    if ( target.compare(0, 4, "rpc/") ) topic = "rpc/" + target;
+    else topic = target;
+
+    if (topic == "rpc/")
+        throw std::runtime_error("RpcClient::call() empty target not allowed");
+
+    return topic;
+}
+
+// the body of a response, inflated if it came compressed
+static Json::Value response_body(Json::Value const & msg)
+{
+    if (msg["zip"].asString() != "zlib")
+        return msg["body"];
+
+    char const * begin = nullptr;
+    char const * end   = nullptr;
+
+    std::string raw;
+    Json::Value body;
+
+    if (msg["body"].isString()
+        && msg["body"].getString(&begin, &end)
+        && zlib_decompress(begin, end - begin, raw)
+        && msgpack_decode(raw.data(), raw.size(), body))
+    {
+        return body;
+    }
+
+    slog(s_error) << "malformed compressed rpc response " << msg["corr_id"].asString();
+
+    body = Json::Value();
+    body["error"] = "malformed compressed rpc response";
+
+    return body;
+}
+
 RpcClient::RpcClient(std::string const & host, int port)
 : hostname ( host )
 , port ( port )
@@ -25,13 +69,21 @@ RpcClient::RpcClient(std::string const & host, int port)
          [this](std::string const & topic, Json::Value const & msg) { on_msg(topic, msg); },
          [this](bool conn, int i) { on_conn(conn, i); } )
 
-, promises ( )
+, pending ( )
+, timers ( std::chrono::milliseconds(100) )
 {
     std::srand(std::time(0));
+
+    // responses to different calls are parsed and handled in parallel
+    mqtt.set_workers(4);
 }
 
 RpcClient::~RpcClient()
 {
+    // no more responses, then no more timeouts: callbacks of the calls
+    // still in flight run once, before anything they use is gone
+    stop();
+    timers.stop();
 }
 
 void RpcClient::start()
@@ -43,6 +95,20 @@ void RpcClient::start()
 void RpcClient::stop()
 {
     mqtt.stop();
+
+    // no response can come any more; callers waiting get the timed
+    // out reply now rather than later
+    std::vector<std::string> corrids;
+
+    {
+        std::lock_guard<std::mutex> lk(pending_mtx);
+
+        for (auto const & p : pending)
+            corrids.push_back(p.first);
+    }
+
+    for (auto const & corrid : corrids)
+        complete(corrid, Json::Value());
 }
 
 void RpcClient::on_msg(std::string const & topic, Json::Value const & msg)
@@ -50,21 +116,79 @@ void RpcClient::on_msg(std::string const & topic, Json::Value const & msg)
     // no need to check the topic since only subscribed to one topic
     // extract the correlation id
     auto corr = msg["corr_id"].asString();
+    auto body = response_body(msg);
+
+    // messages of a streamed call go to the waiting caller
+    {
+        std::lock_guard<std::mutex> lk(streams_mtx);
+        auto siter = streams.find(corr);
+
+        if (siter != streams.end())
+        {
+            siter->second->push(std::move(body));
+            return;
+        }
+    }
 
-    // find the promise
-    auto iter = promises.find(corr);
+    complete(corr, body, msg["enc"].asString() == "msgpack");
+}
+
+// A null response means the call timed out.  Whichever of the
+// response and the timeout comes second finds nothing to do.
+void RpcClient::complete(std::string const & corrid, Json::Value const & res, bool msgpack)
+{
+    pending_call call;
 
-    if (iter == promises.end())
     {
-        slog(s_error) << "invalid correlation id\n";
-        return;
+        std::lock_guard<std::mutex> lk(pending_mtx);
+        auto iter = pending.find(corrid);
+
+        if (iter == pending.end())
+        {
+            if (!res.isNull())
+                slog(s_error) << "invalid or late correlation id " << corrid;
+
+            return;
+        }
+
+        call = std::move(iter->second);
+        pending.erase(iter);
+
+        // a server that timed out, or answered in JSON, may have been
+        // replaced by one that doesn't read MessagePack
+        if (msgpack)
+            msgpack_topics.insert(call.topic);
+        else
+            msgpack_topics.erase(call.topic);
     }
 
-    // set the promise
-    iter->second.set_value(msg["body"]);
+    Json::Value v = res;
+
+    if (res.isNull())
+    {
+        // forms a timeout reply
+        v["timed_out"] = true;
+        v["error"] = "rpc call timed out";
+        v["params"] = call.params;
 
-    // erase the promise entry
-    promises.erase(iter);
+        if (call.verbose)
+        {
+            slog(s_debug) << "rpc request timed out: " << v;
+        }
+    }
+    else if (call.verbose)
+    {
+        slog(s_debug) << "rpc response: " << v;
+    }
+
+    try
+    {
+        call.cb(v);
+    }
+    catch (std::exception const & ex)
+    {
+        slog(s_error) << "rpc response handler failed: " << ex.what();
+    }
 }
 
 void RpcClient::on_conn(bool conn, int)
@@ -73,75 +197,170 @@ void RpcClient::on_conn(bool conn, int)
 
 Json::Value RpcClient::call(std::string const & target, Json::Value const & params, int timeout, int verbose)
 {
+    // always ready by the timeout, if not before
+    return call_future(target, params, timeout, verbose).get();
+}
+
+void RpcClient::call_async(std::string const & target, Json::Value const & params,
+        res_cb_t const & cb, int timeout, int verbose)
+{
+    // decide the publish topic
+    std::string topic = rpc_topic(target);
+
     // generate a correlation id for the rpc call
     std::string corrid = utils::guid();
 
-    // create a promise associated with the correlation id
-    auto r = promises.emplace(corrid, std::promise<Json::Value>{});
+    bool msgpack = false;
 
-    if (r.second == false)
+    // registered before the request goes, so that the response can't
+    // come first
     {
-        throw std::runtime_error("correlation id already exists in rpc call");
+        std::lock_guard<std::mutex> lk(pending_mtx);
+        auto r = pending.emplace(corrid, pending_call{cb, params, verbose, topic});
+
+        if (r.second == false)
+        {
+            throw std::runtime_error("correlation id already exists in rpc call");
+        }
+
+        msgpack = msgpack_topics.count(topic) > 0;
     }
 
-    // get the future from the promise
-    std::future<Json::Value> f = r.first->second.get_future();
+    timers.schedule(std::chrono::seconds(timeout), [this, corrid]() {
+        complete(corrid, Json::Value());
+    });
 
     // prepare the message
     Json::Value msg;
     msg["corr_id"] = corrid;
     msg["reply_to"] = queue;
     msg["body"] = params;
-
-    // decide the publish topic
-    // this will put a prefix of "rpc/" to the target if not present
-    std::string topic;
-
-    if ( target.compare(0, 4, "rpc/") ) topic = "rpc/" + target;
-    else topic = target;
-
-    if (topic == "rpc/")
-        throw std::runtime_error("RpcClient::call() empty target not allowed");
+    msg["accept"] = "msgpack";
+    msg["accept_zip"] = "zlib";
 
     // publish
-    mqtt.publish(topic, msg, 1, false);
+    mqtt.publish(topic, msg, 1, false, msgpack ? Mqtt::Encoding::msgpack : Mqtt::Encoding::json);
 
     // log
     if (verbose)
     {
         slog(s_debug) << "rpc request: " << msg;
     }
+}
 
-    // wait for reply
-    auto res = f.wait_for(std::chrono::seconds(timeout));
+std::future<Json::Value> RpcClient::call_future(std::string const & target, Json::Value const & params,
+        int timeout, int verbose)
+{
+    auto p = std::make_shared<std::promise<Json::Value>>();
+    auto f = p->get_future();
 
-    // check and return the response
-    if (res != std::future_status::ready)
-    {
-        // no response received. delete the promise entry
-        promises.erase(r.first);
+    call_async(target, params, [p](Json::Value const & res) {
+        p->set_value(res);
+    }, timeout, verbose);
 
-        // forms a timeout reply
-        Json::Value v;
-        v["timed_out"] = true;
-        v["error"] = "rpc call timed out";
-        v["params"] = params;
+    return f;
+}
 
-        if (verbose)
+std::vector<Json::Value> RpcClient::call_many(std::vector<std::pair<std::string, Json::Value>> const & calls,
+        int timeout, int verbose)
+{
+    std::vector<std::future<Json::Value>> futures;
+    futures.reserve(calls.size());
+
+    for (auto const & c : calls)
+        futures.push_back(call_future(c.first, c.second, timeout, verbose));
+
+    std::vector<Json::Value> res;
+    res.reserve(calls.size());
+
+    for (auto & f : futures)
+        res.push_back(f.get());
+
+    return res;
+}
+
+
+Json::Value RpcClient::call_stream(std::string const & target, Json::Value const & params,
+        std::function<void(Json::Value const &)> const & handler, int timeout, int verbose)
+{
+    std::string corrid = utils::guid();
+    std::string topic  = rpc_topic(target);
+
+    auto st = std::make_shared<RpcStreamReader>();
+
+    {
+        std::lock_guard<std::mutex> lk(streams_mtx);
+        auto r = streams.emplace(corrid, st);
+
+        if (r.second == false)
         {
-            slog(s_debug) << "rpc request timed out: " << v;
+            throw std::runtime_error("correlation id already exists in rpc call");
         }
+    }
 
-        return v;
+    // prepare the message
+    Json::Value msg;
+    msg["corr_id"] = corrid;
+    msg["reply_to"] = queue;
+    msg["body"] = params;
+    msg["accept"] = "msgpack";
+    msg["accept_zip"] = "zlib";
+
+    mqtt.publish(topic, msg, 1, false);
+
+    if (verbose)
+    {
+        slog(s_debug) << "rpc stream request: " << msg;
     }
-    else
+
+    Json::Value res = st->read(handler, std::chrono::seconds(timeout));
+
+    if (res.isNull())
     {
+        res["timed_out"] = true;
+        res["error"] = "rpc call timed out";
+        res["params"] = params;
+
         if (verbose)
         {
-            slog(s_debug) << "rpc response: " << f.get();
+            slog(s_debug) << "rpc stream request timed out: " << res;
         }
-
-        return f.get();
     }
+
+    std::lock_guard<std::mutex> lk(streams_mtx);
+    streams.erase(corrid);
+
+    return res;
+}
+
+
+void RpcStreamReader::push(Json::Value msg)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    msgs.push_back(std::move(msg));
+    cv.notify_one();
 }
 
+Json::Value RpcStreamReader::read(std::function<void(Json::Value const &)> const & handler,
+        std::chrono::milliseconds timeout)
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+
+        if (!cv.wait_for(lk, timeout, [this]() { return !msgs.empty(); }))
+            return Json::Value();
+
+        Json::Value body = std::move(msgs.front());
+        msgs.pop_front();
+        lk.unlock();
+
+        auto kind = body.get("stream", "").asString();
+
+        // a non-streamed reply, or the end of the stream
+        if (kind != "partial" && kind != "trailer")
+            return body;
+
+        handler(body);
+    }
+}
@@ -2,6 +2,7 @@
 #define BDE_UTILS_RPCCLIENT_H
 
 #include "mqtt.h"
+#include "timerwheel.h"
 
 #include "json/json.h"
 
@@ -10,12 +11,54 @@
 #include <functional>
 #include <thread>
 #include <future>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <set>
+#include <utility>
+#include <chrono>
+#include <condition_variable>
+
+
+// The messages of a streamed call (see RpcResponseStream in
+// rpcserver.h), put in on the MQTT threads as they come and read by
+// the caller: "partial" and "trailer" messages go to the handler, and
+// the one that ends the call is returned.
+class RpcStreamReader
+{
+public:
+
+    void push(Json::Value msg);
+
+    // Waits up to @timeout@ for each message; returns a null value if
+    // one doesn't come in time.
+    Json::Value read(std::function<void(Json::Value const &)> const & handler,
+            std::chrono::milliseconds timeout);
 
+private:
+
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::deque<Json::Value> msgs;
+};
 
+// Calls may be made from any thread, and any number of them may be in
+// flight at once: responses are matched to calls by correlation id,
+// and timeouts are kept on a timer wheel rather than by a blocked
+// thread per call.
+//
+// Requests say that responses may come in MessagePack, with large
+// bodies compressed; once a response from a server has come so,
+// further requests to it go in MessagePack too, until one times out
+// or is answered in JSON.  Servers that don't know of it go on
+// talking JSON.
 class RpcClient
 {
 public:
 
+    using res_cb_t = std::function<void(Json::Value const &)>;
+
     RpcClient(std::string const & host, int port);
     ~RpcClient();
 
@@ -31,12 +74,42 @@ public:
     void on_msg(std::string const & topic, Json::Value const & msg);
     void on_conn(bool conn, int i);
 
+    // Blocks until the response comes, or for @timeout@ seconds; the
+    // response then has "timed_out" set.
     Json::Value call(std::string const & queue, Json::Value const & params, int timeout=5, int verbose=0);
 
+    // Does not block: @cb@ gets the response, or the timed out reply,
+    // exactly once, on an MQTT or the timer thread; it must not
+    // block either.
+    void call_async(std::string const & queue, Json::Value const & params,
+            res_cb_t const & cb, int timeout=5, int verbose=0);
+
+    std::future<Json::Value> call_future(std::string const & queue, Json::Value const & params,
+            int timeout=5, int verbose=0);
+
+    // Sends all the calls, (queue, params) pairs, at once, and waits
+    // for all of them; responses are in the order of the calls.
+    std::vector<Json::Value> call_many(std::vector<std::pair<std::string, Json::Value>> const & calls,
+            int timeout=5, int verbose=0);
+
+    // Call a command that sends its response as a stream of partial
+    // responses (see RpcResponseStream in rpcserver.h).  Each "partial"
+    // or "trailer" message is handed over to the handler as it arrives,
+    // and the final message of the call is returned.  The timeout is
+    // applied to the gap between two consecutive messages, not to the
+    // call as a whole.
+    Json::Value call_stream(std::string const & queue, Json::Value const & params,
+            std::function<void(Json::Value const &)> const & handler,
+            int timeout=5, int verbose=0);
+
 private:
 
     void consumer();
 
+    // hands the response of a call to its callback, once; @msgpack@
+    // if the server said it reads MessagePack
+    void complete(std::string const & corrid, Json::Value const & res, bool msgpack = false);
+
     std::string hostname;
     int port;
     std::string cid;
@@ -44,8 +117,30 @@ private:
 
     Mqtt mqtt;
 
-    // command handlers
-    std::map<std::string, std::promise<Json::Value>> promises;
+    // calls in flight
+    struct pending_call
+    {
+        res_cb_t    cb;
+        Json::Value params;
+        int         verbose;
+        std::string topic;
+    };
+
+    std::map<std::string, pending_call> pending;
+
+    // topics of the servers known to read MessagePack
+    std::set<std::string> msgpack_topics;
+
+    // guards both of the above
+    std::mutex pending_mtx;
+
+    // streamed calls
+    std::map<std::string, std::shared_ptr<RpcStreamReader>> streams;
+    std::mutex streams_mtx;
+
+    // timeouts of the calls in flight; last, so that its thread is
+    // gone before anything it uses
+    utils::TimerWheel timers;
 
 };
 
@@ -2,6 +2,8 @@
 #include "rpcserver.h"
 #include "json/json.h"
 #include "utils.h"
+#include "msgpack.h"
+#include "compress.h"
 
 #include <stdexcept>
 #include <iostream>
@@ -25,6 +27,7 @@ RpcServer::RpcServer( std::string const & host, int port, std::string const & ci
 , handlers ( )
 , handler  ( handler )
 , bypass   ( (bool)handler )
+, compress_bytes ( 8192 )
 {
 }
 
@@ -46,7 +49,11 @@ void RpcServer::stop()
 void RpcServer::on_msg(std::string const & topic, Json::Value const & msg)
 {
     // RPC properties
-    RpcProps rpcprops = { msg["corr_id"].asString(), msg["reply_to"].asString() };
+    // Callers that read MessagePack, or compressed bodies, say so;
+    // others, older ones among them, get plain JSON.
+    RpcProps rpcprops = { msg["corr_id"].asString(), msg["reply_to"].asString(),
+                          msg["accept"].asString() == "msgpack",
+                          msg["accept_zip"].asString() == "zlib" };
 
     // command handler
     if (bypass)
@@ -76,7 +83,7 @@ void RpcServer::on_msg(std::string const & topic, Json::Value const & msg)
         }
 
         // send the response
-        mqtt.publish("rpc/" + rpcprops.reply_to, reply, 1, false);
+        publish_response(rpcprops, "rpc/" + rpcprops.reply_to, reply);
     }
 }
 
@@ -96,6 +103,36 @@ void RpcServer::send_response(Json::Value const & reply, RpcProps const & props)
     msg["corr_id"] = props.correlation_id;
     msg["body"] = reply;
 
-    mqtt.publish(props.reply_to, msg, 1, false);
+    publish_response(props, props.reply_to, msg);
+}
+
+// "enc" tells the caller that requests may come in MessagePack too.
+// Large bodies go compressed, as bytes in "body", flagged by "zip";
+// only in MessagePack, where bytes need no escaping.
+void RpcServer::publish_response(RpcProps const & props, std::string const & topic, Json::Value & msg)
+{
+    if (props.msgpack)
+    {
+        msg["enc"] = "msgpack";
+
+        if (props.zlib && compress_bytes > 0)
+        {
+            auto body = utils::msgpack_encode(msg["body"]);
+
+            if (body.size() >= compress_bytes)
+            {
+                auto z = utils::zlib_compress(body.data(), body.size());
+
+                msg["body"] = Json::Value(z.data(), z.data() + z.size());
+                msg["zip"]  = "zlib";
+            }
+        }
+
+        mqtt.publish(topic, msg, 1, false, Mqtt::Encoding::msgpack);
+    }
+    else
+    {
+        mqtt.publish(topic, msg, 1, false);
+    }
 }
 
@@ -10,11 +10,71 @@
 #include <map>
 #include <functional>
 #include <thread>
+#include <stdexcept>
 
 struct RpcProps
 {
     std::string correlation_id;
     std::string reply_to;
+
+    // the caller reads MessagePack responses
+    bool        msgpack;
+
+    // the caller inflates zlib compressed response bodies
+    bool        zlib;
+};
+
+// A response stream lets a command handler send its result as a
+// sequence of partial responses on the correlation id of a single RPC
+// call, rather than as one (potentially huge) message.
+//
+// Every message sent through the stream is tagged with a "stream"
+// marker ("partial", "trailer", or "end") and a "seq" number, so
+// that the client knows how to put the pieces back together and when
+// the response is complete.  A default-constructed stream is
+// disabled; handlers should check enabled() before using it.
+class RpcResponseStream
+{
+public:
+
+    typedef std::function<void(Json::Value const &)> sender_t;
+
+    RpcResponseStream(sender_t const & sender = { })
+    : sender ( sender )
+    , seq    ( 0 )
+    { }
+
+    bool   enabled()  const { return (bool)sender; }
+    bool   started()  const { return seq > 0; }
+    size_t sequence() const { return seq; }
+
+    // send a partial response (or a "trailer") down the stream.
+    void send(Json::Value msg, std::string const & kind = "partial")
+    {
+        if (!sender) throw std::runtime_error("RpcResponseStream::send() on a disabled stream");
+
+        msg["stream"] = kind;
+        msg["seq"]    = static_cast<Json::UInt64>(seq++);
+        sender(msg);
+    }
+
+    // mark the final response of the call as the end of the stream,
+    // if anything has been streamed; otherwise return it untouched.
+    Json::Value finish(Json::Value msg)
+    {
+        if (started())
+        {
+            msg["stream"] = "end";
+            msg["seq"]    = static_cast<Json::UInt64>(seq++);
+        }
+
+        return msg;
+    }
+
+private:
+
+    sender_t sender;
+    size_t   seq;
 };
 
 
@@ -36,11 +96,20 @@ public:
     void set_tls_ca(std::string const & cafile)
     { mqtt.set_tls_ca(cafile); }
 
+    // Response bodies of this many bytes or more, once encoded, are
+    // compressed for callers that can take it; 0 never compresses.
+    void set_compress_bytes(size_t bytes)
+    { compress_bytes = bytes; }
+
     std::string const & queue() const
     { return queue_; }
 
     void send_response(Json::Value const & reply, RpcProps const & pros);
 
+    // a stream of partial responses to the call identified by props
+    RpcResponseStream response_stream(RpcProps const & props)
+    { return RpcResponseStream([this, props](Json::Value const & v) { send_response(v, props); }); }
+
     void reg_handler(std::string const & name, std::function<Json::Value(Json::Value const &)> h)
     { handlers.insert(std::make_pair(name, h)); }
 
@@ -48,6 +117,7 @@ private:
 
     void on_msg(std::string const & topic, Json::Value const & msg);
     void on_conn(bool conn, int i);
+    void publish_response(RpcProps const & props, std::string const & topic, Json::Value & msg);
 
     BaseConf const & conf;
 
@@ -65,6 +135,8 @@ private:
     // the RPC server works in bypass mode or not
     bool bypass;
 
+    size_t compress_bytes;
+
 };
 
 
@@ -0,0 +1,207 @@
+//
+//  Identical requests that come in together are computed once: the
+//  first caller runs the computation, and callers asking for the same
+//  key meanwhile wait for its result instead of starting their own.
+//  Results may also be kept for a while, for callers that come a
+//  little later.
+//
+//      utils::SingleFlight<Json::Value> flight;
+//
+//      auto v = flight.get("dtn_status", std::chrono::seconds(1), []() {
+//              return compute_status();
+//          });
+//
+//  Errors are shared with the callers that waited on them, but are
+//  never kept.
+//
+
+#ifndef BDE_UTILS_SINGLE_FLIGHT_H
+#define BDE_UTILS_SINGLE_FLIGHT_H
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct SingleFlightStats
+    {
+        uint64_t hits      = 0;     // answered from a kept result.
+        uint64_t misses    = 0;     // computed.
+        uint64_t coalesced = 0;     // waited on someone else's computation.
+        uint64_t entries   = 0;     // kept or in flight, right now.
+    };
+
+    template <typename T>
+    class SingleFlight
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        // Keep results for @ttl@, if @keep@ says they are worth
+        // keeping; a @ttl@ of zero only shares computations in flight.  Exceptions of @fn@ are
+        // thrown to every caller that waited on it.
+        T get(std::string const                    &key,
+              std::chrono::milliseconds             ttl,
+              std::function<T()> const             &fn,
+              std::function<bool(T const &)> const &keep = nullptr)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            auto const now = clock::now();
+            auto       e   = entries_.find(key);
+
+            if (e != entries_.end())
+            {
+                if (not e->second.done)
+                {
+                    stats_.coalesced++;
+
+                    auto result = e->second.result;
+                    lock.unlock();
+
+                    return result.get();
+                }
+
+                if (now < e->second.expires_at)
+                {
+                    stats_.hits++;
+
+                    auto result = e->second.result;
+                    lock.unlock();
+
+                    return result.get();
+                }
+
+                entries_.erase(e);
+            }
+
+            stats_.misses++;
+
+            if (++misses_since_sweep_ >= sweep_every)
+            {
+                sweep(now);
+            }
+
+            std::promise<T> promise;
+            auto            id = ++next_id_;
+
+            entries_[key] = Entry{promise.get_future().share(), false, now, id};
+
+            lock.unlock();
+
+            try
+            {
+                T    value = fn();
+                bool kept  = ttl.count() > 0 and (not keep or keep(value));
+
+                promise.set_value(value);
+
+                lock.lock();
+                finish(key, id, kept, ttl);
+
+                return value;
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+
+                lock.lock();
+                finish(key, id, false, ttl);
+
+                throw;
+            }
+        }
+
+        // Forget kept results; computations in flight go on.
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            for (auto e = entries_.begin(); e != entries_.end();)
+            {
+                if (e->second.done)
+                    e = entries_.erase(e);
+                else
+                    ++e;
+            }
+        }
+
+        SingleFlightStats stats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto s = stats_;
+            s.entries = entries_.size();
+
+            return s;
+        }
+
+    private:
+        struct Entry
+        {
+            std::shared_future<T> result;
+            bool                  done;
+            clock::time_point     expires_at;
+            uint64_t              id;       // who computes it.
+        };
+
+        static const size_t sweep_every = 256;
+
+        // The entry may have been cleared, and even replaced, while
+        // its result was computed.
+        void finish(std::string const &key, uint64_t id, bool keep,
+                    std::chrono::milliseconds ttl)
+        {
+            auto e = entries_.find(key);
+
+            if (e == entries_.end() or e->second.id != id)
+                return;
+
+            if (keep)
+            {
+                e->second.done       = true;
+                e->second.expires_at = clock::now() + ttl;
+            }
+            else
+            {
+                entries_.erase(e);
+            }
+        }
+
+        // Drop expired results, so that keys asked for once don't
+        // stay forever.
+        void sweep(clock::time_point now)
+        {
+            misses_since_sweep_ = 0;
+
+            for (auto e = entries_.begin(); e != entries_.end();)
+            {
+                if (e->second.done and now >= e->second.expires_at)
+                    e = entries_.erase(e);
+                else
+                    ++e;
+            }
+        }
+
+        std::map<std::string, Entry> entries_;
+        SingleFlightStats            stats_;
+        uint64_t                     next_id_            = 0;
+        size_t                       misses_since_sweep_ = 0;
+        mutable std::mutex           mutex_;
+    };
+};
+
+#endif // BDE_UTILS_SINGLE_FLIGHT_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
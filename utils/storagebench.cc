@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#include "utils.h"
+#include "storagebench.h"
+
+// ----------------------------------------------------------------------
+
+// O_DIRECT wants buffers, offsets and sizes aligned to the logical
+// block size of the device; 4 KiB covers every device we know of.
+static const size_t alignment = 4096;
+
+// No libaio; these are thin enough to call directly.
+static int io_setup(unsigned nr, aio_context_t *ctx)
+{
+    return syscall(SYS_io_setup, nr, ctx);
+}
+
+static int io_destroy(aio_context_t ctx)
+{
+    return syscall(SYS_io_destroy, ctx);
+}
+
+static int io_submit(aio_context_t ctx, long nr, iocb **iocbpp)
+{
+    return syscall(SYS_io_submit, ctx, nr, iocbpp);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+                        io_event *events, timespec *timeout)
+{
+    return syscall(SYS_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+static std::string errno_string(std::string const &what, int err)
+{
+    return what + " error: " + strerror(err);
+}
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    struct AlignedFree
+    {
+        void operator()(void *p) const { free(p); }
+    };
+
+    using Buffer = std::unique_ptr<uint8_t, AlignedFree>;
+
+    // Open with O_DIRECT if the filesystem lets us; tmpfs and some
+    // network filesystems don't.
+    int open_file(std::string const &path, int flags, bool &direct)
+    {
+        int fd = -1;
+
+        if (direct)
+        {
+            fd = open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0600);
+
+            if (fd >= 0 or errno != EINVAL)
+                return fd;
+
+            direct = false;
+        }
+
+        return open(path.c_str(), flags | O_CLOEXEC, 0600);
+    }
+
+    // Sequential I/O over a whole file, keeping up to @depth@ requests
+    // in flight with native AIO, or one at a time if AIO can't be set
+    // up.  Throws on errors and short transfers.
+    void sequential_io(int                  fd,
+                       bool                 write,
+                       size_t               file_size,
+                       size_t               block_size,
+                       std::vector<Buffer> &buffers)
+    {
+        auto const depth = buffers.size();
+
+        aio_context_t ctx = 0;
+
+        if (io_setup(depth, &ctx) < 0)
+        {
+            for (size_t off = 0; off < file_size; off += block_size)
+            {
+                auto const n = write ?
+                    pwrite(fd, buffers[0].get(), block_size, off) :
+                    pread(fd, buffers[0].get(), block_size, off);
+
+                if (n < 0)
+                    throw std::runtime_error(errno_string(write ? "pwrite()" : "pread()", errno));
+
+                if (size_t(n) != block_size)
+                    throw std::runtime_error("short transfer");
+            }
+
+            return;
+        }
+
+        std::vector<iocb>     cbs(depth);
+        std::vector<size_t>   free_slots;
+        std::vector<io_event> events(depth);
+
+        for (size_t i = 0; i < depth; i++)
+            free_slots.push_back(i);
+
+        size_t      offset   = 0;
+        size_t      inflight = 0;
+        std::string error;
+
+        while (error.empty() and (offset < file_size or inflight > 0))
+        {
+            while (offset < file_size and not free_slots.empty())
+            {
+                auto const slot = free_slots.back();
+                auto      &cb   = cbs[slot];
+
+                memset(&cb, 0, sizeof(cb));
+                cb.aio_data       = slot;
+                cb.aio_fildes     = fd;
+                cb.aio_lio_opcode = write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+                cb.aio_buf        = reinterpret_cast<uint64_t>(buffers[slot].get());
+                cb.aio_nbytes     = block_size;
+                cb.aio_offset     = offset;
+
+                iocb *p = &cb;
+
+                if (io_submit(ctx, 1, &p) != 1)
+                {
+                    error = errno_string("io_submit()", errno);
+                    break;
+                }
+
+                free_slots.pop_back();
+                offset += block_size;
+                inflight++;
+            }
+
+            if (inflight == 0)
+                break;
+
+            auto const n = io_getevents(ctx, 1, depth, events.data(), nullptr);
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                error = errno_string("io_getevents()", errno);
+                break;
+            }
+
+            for (int i = 0; i < n; i++)
+            {
+                auto const res = static_cast<int64_t>(events[i].res);
+
+                if (res < 0)
+                    error = errno_string(write ? "write" : "read", -res);
+                else if (size_t(res) != block_size and error.empty())
+                    error = "short transfer";
+
+                free_slots.push_back(events[i].data);
+                inflight--;
+            }
+        }
+
+        // Requests still in flight must finish before the buffers go.
+        while (inflight > 0)
+        {
+            auto const n = io_getevents(ctx, 1, depth, events.data(), nullptr);
+
+            if (n < 0 and errno != EINTR)
+                break;
+
+            if (n > 0)
+                inflight -= n;
+        }
+
+        io_destroy(ctx);
+
+        if (not error.empty())
+        {
+            throw std::runtime_error(error);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+
+utils::StorageBenchResult
+utils::run_storage_bench(StorageBenchParams const &params, size_t threads)
+{
+    if (params.dir.empty() or threads == 0 or params.files == 0 or
+        params.queue_depth == 0 or params.block_size == 0)
+    {
+        throw std::runtime_error("storage bench: bad parameters");
+    }
+
+    // Round up to what O_DIRECT can take.
+    auto const block_size = (params.block_size + alignment - 1) /
+        alignment * alignment;
+    auto const file_size  = std::max(block_size,
+                                     (params.file_size + block_size - 1) /
+                                     block_size * block_size);
+
+    std::vector<std::vector<std::string>> paths(threads);
+
+    for (size_t t = 0; t < threads; t++)
+    {
+        for (size_t f = 0; f < params.files; f++)
+        {
+            paths[t].push_back(params.dir + "/" + params.prefix + "." +
+                               std::to_string(getpid()) + "." +
+                               std::to_string(t) + "." + std::to_string(f));
+        }
+    }
+
+    StorageBenchResult result;
+    result.threads = threads;
+
+    std::mutex  mutex;
+    std::string error;
+    bool        direct = true;
+
+    auto worker = [&](size_t t, bool write) {
+        try
+        {
+            std::vector<Buffer> buffers;
+
+            for (size_t i = 0; i < params.queue_depth; i++)
+            {
+                void *p = nullptr;
+
+                if (posix_memalign(&p, alignment, block_size) != 0)
+                    throw std::runtime_error("out of memory");
+
+                // Not zeros, which some storage would compress away.
+                auto *bytes = static_cast<uint8_t *>(p);
+                for (size_t b = 0; b < block_size; b++)
+                    bytes[b] = (b * 31 + t * 7 + i) & 0xff;
+
+                buffers.emplace_back(bytes);
+            }
+
+            for (auto const &path : paths[t])
+            {
+                if (write and params.prepare)
+                    params.prepare(path);
+
+                bool direct_here = true;
+                int  fd = open_file(path,
+                                    write ? O_WRONLY | O_CREAT : O_RDONLY,
+                                    direct_here);
+
+                if (fd < 0)
+                    throw std::runtime_error(errno_string("open(\"" + path + "\")", errno));
+
+                try
+                {
+                    sequential_io(fd, write, file_size, block_size, buffers);
+
+                    // Without O_DIRECT, make the writes count, and
+                    // don't read back from the page cache.
+                    if (not direct_here)
+                    {
+                        if (write and fdatasync(fd) < 0)
+                            throw std::runtime_error(errno_string("fdatasync()", errno));
+
+                        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                    }
+                }
+                catch (...)
+                {
+                    close(fd);
+                    throw;
+                }
+
+                close(fd);
+
+                if (not direct_here)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    direct = false;
+                }
+            }
+        }
+        catch (std::exception const &ex)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (error.empty())
+                error = ex.what();
+        }
+    };
+
+    // Aggregate bandwidth of a phase, from the start of the first
+    // thread to the end of the last.
+    auto phase = [&](bool write) {
+        auto const start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> workers;
+
+        for (size_t t = 0; t < threads; t++)
+            workers.emplace_back(worker, t, write);
+
+        for (auto &w : workers)
+            w.join();
+
+        std::chrono::duration<double> const secs =
+            std::chrono::steady_clock::now() - start;
+
+        double const bytes = double(file_size) * params.files * threads;
+
+        return secs.count() > 0 ? bytes / 1e6 / secs.count() : 0;
+    };
+
+    result.write_mbps = phase(true);
+
+    if (error.empty())
+    {
+        result.read_mbps = phase(false);
+    }
+
+    for (auto const &files : paths)
+    {
+        for (auto const &path : files)
+            unlink(path.c_str());
+    }
+
+    if (not error.empty())
+    {
+        throw std::runtime_error("storage bench in " + params.dir + ": " + error);
+    }
+
+    result.direct = direct;
+
+    return result;
+}
+
+utils::StorageBenchCurve
+utils::storage_bench_sweep(StorageBenchParams const &params,
+                           size_t                    max_threads,
+                           double                    threshold)
+{
+    StorageBenchCurve curve;
+
+    for (size_t threads = 1; threads <= std::max<size_t>(1, max_threads); threads *= 2)
+    {
+        auto const r = run_storage_bench(params, threads);
+
+        utils::slog() << "[StorageBench] " << params.dir << ", "
+                      << threads << " thread(s): write " << r.write_mbps
+                      << " MB/s, read " << r.read_mbps << " MB/s"
+                      << (r.direct ? "" : " (no O_DIRECT)");
+
+        curve.points.push_back(r);
+
+        curve.peak_write_mbps = std::max(curve.peak_write_mbps, r.write_mbps);
+        curve.peak_read_mbps  = std::max(curve.peak_read_mbps, r.read_mbps);
+
+        if (curve.points.size() >= 2)
+        {
+            auto const &prev = curve.points[curve.points.size() - 2];
+
+            bool const write_flat = r.write_mbps < prev.write_mbps * (1 + threshold);
+            bool const read_flat  = r.read_mbps < prev.read_mbps * (1 + threshold);
+
+            if (write_flat and read_flat)
+            {
+                curve.saturation_threads    = prev.threads;
+                curve.saturation_write_mbps = prev.write_mbps;
+                curve.saturation_read_mbps  = prev.read_mbps;
+                return curve;
+            }
+        }
+    }
+
+    // Still climbing at max_threads.
+    auto const &last = curve.points.back();
+
+    curve.saturation_threads    = last.threads;
+    curve.saturation_write_mbps = last.write_mbps;
+    curve.saturation_read_mbps  = last.read_mbps;
+
+    return curve;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
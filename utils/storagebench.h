@@ -0,0 +1,89 @@
+//
+//  An in-process storage bandwidth benchmark: sequential writes, then
+//  reads, of files in a work folder, by a number of threads, with
+//  O_DIRECT and a queue of asynchronous requests per file.  Sweeping
+//  the number of threads finds where the storage saturates.  This
+//  replaces running iozone and parsing its output.
+//
+
+#ifndef BDE_UTILS_STORAGE_BENCH_H
+#define BDE_UTILS_STORAGE_BENCH_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct StorageBenchParams
+    {
+        std::string dir;                            // work folder.
+        std::string prefix         = "bde-bench";   // of file names.
+        size_t      block_size     = 4 << 20;       // bytes per request.
+        size_t      file_size      = 128 << 20;     // bytes per file.
+        size_t      queue_depth    = 4;             // requests in flight per thread.
+        size_t      files          = 1;             // files per thread.
+
+        // Called with the path of each file before it is opened, for
+        // things like "lfs setstripe".  Files that exist are
+        // overwritten in place, not truncated, so a layout given to
+        // them is kept.
+        std::function<void(std::string const &)> prepare;
+    };
+
+    // One point of the bandwidth-vs-concurrency curve.  Bandwidths are
+    // in MB/s (10^6 bytes per second), aggregated over all threads.
+    struct StorageBenchResult
+    {
+        size_t threads     = 0;
+        double write_mbps  = 0;
+        double read_mbps   = 0;
+        bool   direct      = true;  // false if O_DIRECT was refused.
+    };
+
+    struct StorageBenchCurve
+    {
+        std::vector<StorageBenchResult> points;
+
+        // The smallest thread count past which more threads gained
+        // less than the saturation threshold, and the bandwidths seen
+        // there.  Peaks are the best bandwidths seen at any count.
+        size_t saturation_threads = 0;
+        double saturation_write_mbps = 0;
+        double saturation_read_mbps  = 0;
+        double peak_write_mbps = 0;
+        double peak_read_mbps  = 0;
+    };
+
+    // Write, then read, params.files files of params.file_size bytes
+    // on each of @threads@ threads, and remove them.  Throws if the
+    // files can't be written or read.
+    StorageBenchResult run_storage_bench(StorageBenchParams const &params,
+                                         size_t                    threads);
+
+    // Run the benchmark with 1, 2, 4... threads, up to @max_threads@,
+    // and stop once doubling the threads gains less than @threshold@
+    // (0.1: ten percent) in both reads and writes.
+    StorageBenchCurve storage_bench_sweep(StorageBenchParams const &params,
+                                          size_t                    max_threads = 16,
+                                          double                    threshold   = 0.1);
+
+    // What a storage node can take, in bytes/s as ResourceManager
+    // admits transfers in, from the MB/s the benchmark reports: the
+    // lesser of the two, since a transfer either reads or writes.
+    inline double storage_capacity_bps(double write_mbps, double read_mbps)
+    {
+        return 1e6 * std::min(write_mbps, read_mbps);
+    }
+};
+
+#endif // BDE_UTILS_STORAGE_BENCH_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
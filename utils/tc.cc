@@ -0,0 +1,477 @@
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/if_ether.h>
+
+#include "utils.h"
+#include "netlink.h"
+#include "tc.h"
+
+// ----------------------------------------------------------------------
+
+static int nl_open()
+{
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (sock < 0)
+    {
+        throw std::runtime_error("netlink socket() error: " +
+                                 utils::netlink_error(errno));
+    }
+
+    // Don't wait forever for a kernel that won't answer.
+    timeval tv{5, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    return sock;
+}
+
+// ----------------------------------------------------------------------
+
+uint32_t utils::tc_parse_handle(std::string const &handle)
+{
+    if (handle == "root")
+    {
+        return TC_H_ROOT;
+    }
+
+    if (handle == "none" or handle.empty())
+    {
+        return TC_H_UNSPEC;
+    }
+
+    auto colon = handle.find(':');
+
+    if (colon == std::string::npos or colon == 0)
+    {
+        throw std::runtime_error("bad tc handle: \"" + handle + "\"");
+    }
+
+    auto parse = [&handle](std::string const &s) -> uint32_t {
+        if (s.empty())
+            return 0;
+
+        size_t pos   = 0;
+        auto   value = std::stoul(s, &pos, 16);
+
+        if (pos != s.size() or value > 0xffff)
+            throw std::runtime_error("bad tc handle: \"" + handle + "\"");
+
+        return value;
+    };
+
+    try
+    {
+        return TC_H_MAKE(parse(handle.substr(0, colon)) << 16,
+                         parse(handle.substr(colon + 1)));
+    }
+    catch (std::invalid_argument const &)
+    {
+        throw std::runtime_error("bad tc handle: \"" + handle + "\"");
+    }
+}
+
+std::string utils::tc_format_handle(uint32_t handle)
+{
+    if (handle == TC_H_ROOT)
+    {
+        return "root";
+    }
+
+    std::stringstream ss;
+    ss << std::hex << (TC_H_MAJ(handle) >> 16) << ":";
+
+    if (TC_H_MIN(handle))
+    {
+        ss << TC_H_MIN(handle);
+    }
+
+    return ss.str();
+}
+
+// ----------------------------------------------------------------------
+
+std::vector<utils::TcQdisc> utils::tc_list_qdiscs(std::string const &device)
+{
+    int const ifindex = if_nametoindex(device.c_str());
+
+    if (ifindex == 0)
+    {
+        throw std::runtime_error("no such device: " + device);
+    }
+
+    struct
+    {
+        nlmsghdr nlh;
+        tcmsg    tcm;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len   = NLMSG_LENGTH(sizeof(tcmsg));
+    req.nlh.nlmsg_type  = RTM_GETQDISC;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nlh.nlmsg_seq   = 1;
+    req.tcm.tcm_family  = AF_UNSPEC;
+    req.tcm.tcm_ifindex = ifindex;
+
+    int sock = nl_open();
+
+    if (send(sock, &req, req.nlh.nlmsg_len, 0) < 0)
+    {
+        auto error = utils::netlink_error(errno);
+        close(sock);
+        throw std::runtime_error("netlink send() error: " + error);
+    }
+
+    std::vector<TcQdisc> qdiscs;
+    bool                 done = false;
+
+    while (not done)
+    {
+        char buf[32 * 1024];
+        auto len = recv(sock, buf, sizeof(buf), 0);
+
+        if (len < 0 and errno == EINTR)
+        {
+            continue;
+        }
+
+        if (len < 0)
+        {
+            auto error = utils::netlink_error(errno);
+            close(sock);
+            throw std::runtime_error("netlink recv() error: " + error);
+        }
+
+        for (auto h = reinterpret_cast<nlmsghdr *>(buf);
+             NLMSG_OK(h, len);
+             h = NLMSG_NEXT(h, len))
+        {
+            if (h->nlmsg_type == NLMSG_DONE or h->nlmsg_type == NLMSG_ERROR)
+            {
+                done = true;
+                break;
+            }
+
+            if (h->nlmsg_type != RTM_NEWQDISC)
+            {
+                continue;
+            }
+
+            auto t = static_cast<tcmsg const *>(NLMSG_DATA(h));
+
+            // Older kernels dump the qdiscs of all devices.
+            if (t->tcm_ifindex != ifindex)
+            {
+                continue;
+            }
+
+            TcQdisc q;
+            q.handle = t->tcm_handle;
+            q.parent = t->tcm_parent;
+
+            int alen = h->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+
+            for (auto rta = reinterpret_cast<rtattr const *>(
+                     reinterpret_cast<char const *>(t) + NLMSG_ALIGN(sizeof(*t)));
+                 RTA_OK(rta, alen);
+                 rta = RTA_NEXT(rta, alen))
+            {
+                if (rta->rta_type == TCA_KIND)
+                {
+                    q.kind = static_cast<char const *>(RTA_DATA(rta));
+                }
+            }
+
+            qdiscs.push_back(q);
+        }
+    }
+
+    close(sock);
+
+    return qdiscs;
+}
+
+// ----------------------------------------------------------------------
+
+utils::TcBatch::TcBatch(std::string const &device)
+    : device_(device)
+    , ifindex_(if_nametoindex(device.c_str()))
+{
+    if (ifindex_ == 0)
+    {
+        throw std::runtime_error("no such device: " + device);
+    }
+}
+
+utils::TcBatch::Op &utils::TcBatch::new_op(std::string const &what,
+                                           int                type,
+                                           int                flags,
+                                           uint32_t           handle,
+                                           uint32_t           parent,
+                                           uint32_t           info,
+                                           std::string const &kind)
+{
+    ops_.push_back({what + " on " + device_, NetlinkMessage(type, flags)});
+
+    auto &op = ops_.back();
+
+    tcmsg tcm;
+    memset(&tcm, 0, sizeof(tcm));
+    tcm.tcm_family  = AF_UNSPEC;
+    tcm.tcm_ifindex = ifindex_;
+    tcm.tcm_handle  = handle;
+    tcm.tcm_parent  = parent;
+    tcm.tcm_info    = info;
+    op.msg.put(tcm);
+
+    if (not kind.empty())
+    {
+        op.msg.attr(TCA_KIND, kind);
+    }
+
+    return op;
+}
+
+utils::TcBatch &utils::TcBatch::add_prio_qdisc(std::string const &handle,
+                                               std::string const &parent,
+                                               int                bands)
+{
+    auto &op = new_op("add prio qdisc " + handle, RTM_NEWQDISC,
+                      NLM_F_CREATE | NLM_F_EXCL,
+                      tc_parse_handle(handle), tc_parse_handle(parent), 0,
+                      "prio");
+
+    // Same as the default of tc(8).
+    tc_prio_qopt opt{bands, {1, 2, 2, 2, 1, 2, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1}};
+    op.msg.attr(TCA_OPTIONS, opt);
+
+    return *this;
+}
+
+utils::TcBatch &utils::TcBatch::add_htb_qdisc(std::string const &handle,
+                                              std::string const &parent,
+                                              uint32_t           default_class)
+{
+    auto &op = new_op("add htb qdisc " + handle, RTM_NEWQDISC,
+                      NLM_F_CREATE | NLM_F_EXCL,
+                      tc_parse_handle(handle), tc_parse_handle(parent), 0,
+                      "htb");
+
+    tc_htb_glob glob;
+    memset(&glob, 0, sizeof(glob));
+    glob.version      = TC_HTB_PROTOVER;
+    glob.rate2quantum = 10;
+    glob.defcls       = default_class;
+
+    auto nest = op.msg.nest_begin(TCA_OPTIONS);
+    op.msg.attr(TCA_HTB_INIT, glob);
+    op.msg.nest_end(nest);
+
+    return *this;
+}
+
+utils::TcBatch &utils::TcBatch::add_htb_class(std::string const &classid,
+                                              std::string const &parent,
+                                              uint64_t           rate_bps,
+                                              uint64_t           ceil_bps)
+{
+    if (rate_bps == 0)
+    {
+        throw std::runtime_error("htb class " + classid + ": rate cannot be zero");
+    }
+
+    if (ceil_bps == 0)
+    {
+        ceil_bps = rate_bps;
+    }
+
+    auto &op = new_op("add htb class " + classid, RTM_NEWTCLASS,
+                      NLM_F_CREATE | NLM_F_EXCL,
+                      tc_parse_handle(classid), tc_parse_handle(parent), 0,
+                      "htb");
+
+    uint64_t const rate = rate_bps / 8;
+    uint64_t const ceil = ceil_bps / 8;
+
+    // Like tc(8), allow a burst of what the rate sends in a jiffy
+    // (at HZ=1000), plus a packet.  Buffers are in psched ticks of
+    // 64 ns.
+    auto buffer = [](uint64_t bytes_per_sec) -> uint32_t {
+        uint64_t burst = bytes_per_sec / 1000 + 1600;
+        uint64_t ticks = burst * 1000000000ull / bytes_per_sec / 64;
+        return std::min<uint64_t>(ticks, UINT32_MAX);
+    };
+
+    tc_htb_opt opt;
+    memset(&opt, 0, sizeof(opt));
+
+    // Rates that don't fit 32 bits go in TCA_HTB_RATE64 and
+    // TCA_HTB_CEIL64 as well.
+    opt.rate.rate      = std::min<uint64_t>(rate, UINT32_MAX);
+    opt.rate.linklayer = TC_LINKLAYER_ETHERNET;
+    opt.ceil.rate      = std::min<uint64_t>(ceil, UINT32_MAX);
+    opt.ceil.linklayer = TC_LINKLAYER_ETHERNET;
+    opt.buffer         = buffer(rate);
+    opt.cbuffer        = buffer(ceil);
+
+    auto nest = op.msg.nest_begin(TCA_OPTIONS);
+
+    op.msg.attr(TCA_HTB_PARMS, opt);
+
+    if (rate > UINT32_MAX)
+    {
+        op.msg.attr(TCA_HTB_RATE64, rate);
+    }
+
+    if (ceil > UINT32_MAX)
+    {
+        op.msg.attr(TCA_HTB_CEIL64, ceil);
+    }
+
+    op.msg.nest_end(nest);
+
+    return *this;
+}
+
+utils::TcBatch &utils::TcBatch::replace_fq_qdisc(std::string const &handle,
+                                                 std::string const &parent,
+                                                 uint64_t           max_rate_bps)
+{
+    // ~0U is "no limit" to the kernel, so that and above won't do.
+    if (max_rate_bps / 8 >= UINT32_MAX)
+    {
+        throw std::runtime_error("fq qdisc " + handle + ": max rate " +
+                                 std::to_string(max_rate_bps) +
+                                 " bps is too high");
+    }
+
+    auto &op = new_op("replace fq qdisc " + handle, RTM_NEWQDISC,
+                      NLM_F_CREATE | NLM_F_REPLACE,
+                      tc_parse_handle(handle), tc_parse_handle(parent), 0,
+                      "fq");
+
+    uint32_t const enable   = 1;
+    uint32_t const max_rate = max_rate_bps == 0 ? ~0U :
+        static_cast<uint32_t>(max_rate_bps / 8);
+
+    auto nest = op.msg.nest_begin(TCA_OPTIONS);
+    op.msg.attr(TCA_FQ_RATE_ENABLE, enable);
+    op.msg.attr(TCA_FQ_FLOW_MAX_RATE, max_rate);
+    op.msg.nest_end(nest);
+
+    return *this;
+}
+
+utils::TcBatch &utils::TcBatch::add_u32_filter(std::string const &parent,
+                                               int                prio,
+                                               std::string const &prefix,
+                                               std::string const &flowid,
+                                               bool               match_dst)
+{
+    auto slash = prefix.find('/');
+    auto addr  = prefix.substr(0, slash);
+    int  bits  = 32;
+
+    if (slash != std::string::npos)
+    {
+        bits = std::stoi(prefix.substr(slash + 1));
+    }
+
+    in_addr in;
+
+    if (inet_pton(AF_INET, addr.c_str(), &in) != 1 or bits < 0 or bits > 32)
+    {
+        throw std::runtime_error("u32 filter: bad address \"" + prefix + "\"");
+    }
+
+    auto &op = new_op("add u32 filter " + prefix + " -> " + flowid,
+                      RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL,
+                      0, tc_parse_handle(parent),
+                      TC_H_MAKE(uint32_t(prio) << 16, htons(ETH_P_IP)),
+                      "u32");
+
+    uint32_t const mask = bits == 0 ? 0 : htonl(~0U << (32 - bits));
+
+    // A selector with one key; keys follow the selector.
+    uint8_t sel[sizeof(tc_u32_sel) + sizeof(tc_u32_key)];
+    memset(sel, 0, sizeof(sel));
+
+    auto s = reinterpret_cast<tc_u32_sel *>(sel);
+    s->flags = TC_U32_TERMINAL;
+    s->nkeys = 1;
+
+    tc_u32_key key;
+    memset(&key, 0, sizeof(key));
+    key.mask = mask;
+    key.val  = in.s_addr & mask;
+    key.off  = match_dst ? 16 : 12;     // in the IPv4 header.
+    memcpy(sel + sizeof(tc_u32_sel), &key, sizeof(key));
+
+    uint32_t const classid = tc_parse_handle(flowid);
+
+    auto nest = op.msg.nest_begin(TCA_OPTIONS);
+    op.msg.attr(TCA_U32_CLASSID, classid);
+    op.msg.attr(TCA_U32_SEL, sel, sizeof(sel));
+    op.msg.nest_end(nest);
+
+    return *this;
+}
+
+utils::TcBatch &utils::TcBatch::delete_qdisc(std::string const &parent,
+                                             std::string const &handle)
+{
+    new_op("delete qdisc " + parent, RTM_DELQDISC, 0,
+           tc_parse_handle(handle), tc_parse_handle(parent), 0, "");
+
+    return *this;
+}
+
+// ----------------------------------------------------------------------
+
+std::vector<utils::TcBatch::Op> utils::TcBatch::release()
+{
+    auto ops = std::move(ops_);
+    ops_.clear();
+    return ops;
+}
+
+void utils::TcBatch::commit()
+{
+    auto ops = release();
+
+    std::vector<NetlinkMessage> requests;
+
+    for (auto &op : ops)
+    {
+        requests.push_back(op.msg);
+    }
+
+    auto results = netlink_route_transact(requests);
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i] != 0)
+        {
+            throw std::runtime_error(ops[i].what + " failed: " +
+                                     netlink_error(results[i]));
+        }
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
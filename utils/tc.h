@@ -0,0 +1,127 @@
+//
+//  Traffic control over rtnetlink: the parts of "tc" that DTN Agent
+//  needs, without forking a tc process for every rule.
+//
+
+#ifndef BDE_UTILS_TC_H
+#define BDE_UTILS_TC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "netlink.h"
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // Parse a tc handle as tc(8) does: "root", "1:", "1:0", "1:10";
+    // numbers are in hex.  Throws on malformed handles.
+    uint32_t tc_parse_handle(std::string const &handle);
+
+    // Format a handle back, as "1:10".
+    std::string tc_format_handle(uint32_t handle);
+
+    // A qdisc as reported by the kernel.
+    struct TcQdisc
+    {
+        std::string kind;
+        uint32_t    handle;
+        uint32_t    parent;
+    };
+
+    // Qdiscs of a device; throws if the device does not exist.
+    std::vector<TcQdisc> tc_list_qdiscs(std::string const &device);
+
+    // A batch of traffic control changes to one device.  Changes are
+    // queued up, and commit() sends them all to the kernel at once and
+    // waits for the acks.
+    //
+    // Note that the kernel applies each change on its own: if one of
+    // them fails, those before it stay.  commit() throws on the first
+    // failure, naming the change that failed.
+    class TcBatch
+    {
+    public:
+        // Throws if there is no such device.
+        explicit TcBatch(std::string const &device);
+
+        std::string const &device() const { return device_; }
+        size_t size() const { return ops_.size(); }
+
+        // "tc qdisc add dev <device> parent <parent> handle <handle>
+        // prio bands <bands>"
+        TcBatch &add_prio_qdisc(std::string const &handle,
+                                std::string const &parent = "root",
+                                int                bands  = 3);
+
+        // "tc qdisc add ... htb default <default_class>"
+        TcBatch &add_htb_qdisc(std::string const &handle,
+                               std::string const &parent        = "root",
+                               uint32_t           default_class = 0);
+
+        // "tc class add ... classid <classid> htb rate <rate> ceil
+        // <ceil>", rates in bits per second; a zero ceil is the rate.
+        TcBatch &add_htb_class(std::string const &classid,
+                               std::string const &parent,
+                               uint64_t           rate_bps,
+                               uint64_t           ceil_bps = 0);
+
+        // "tc qdisc replace ... fq maxrate <max_rate>": paces every
+        // flow on its own, to no more than the given rate (bits per
+        // second; zero means no limit).  The kernel takes the rate as
+        // 32 bits of bytes per second, so it tops out at about 34
+        // Gbps per flow; higher rates throw.
+        TcBatch &replace_fq_qdisc(std::string const &handle,
+                                  std::string const &parent       = "root",
+                                  uint64_t           max_rate_bps = 0);
+
+        // "tc filter add ... parent <parent> prio <prio> protocol ip
+        // u32 match ip {src|dst} <prefix> flowid <flowid>"; prefix is
+        // like "10.0.0.1" or "10.0.0.0/24".
+        TcBatch &add_u32_filter(std::string const &parent,
+                                int                prio,
+                                std::string const &prefix,
+                                std::string const &flowid,
+                                bool               match_dst = false);
+
+        // "tc qdisc del dev <device> parent <parent> [handle <handle>]"
+        TcBatch &delete_qdisc(std::string const &parent = "root",
+                              std::string const &handle = "");
+
+        // Send the queued changes, and clear the batch.
+        void commit();
+
+        struct Op
+        {
+            std::string    what;        // for error messages.
+            NetlinkMessage msg;
+        };
+
+        // Take the queued changes instead, to send them along with
+        // other requests; see netconfig.h.
+        std::vector<Op> release();
+
+    private:
+        Op &new_op(std::string const &what,
+                   int                type,
+                   int                flags,
+                   uint32_t           handle,
+                   uint32_t           parent,
+                   uint32_t           info,
+                   std::string const &kind);
+
+        std::string     device_;
+        int             ifindex_;
+        std::vector<Op> ops_;
+    };
+};
+
+#endif // BDE_UTILS_TC_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,349 @@
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "utils.h"
+#include "tcpprobe.h"
+
+// Same as probe_magic in echo.h.
+static const std::string probe_header = "BDE-PROBE\n";
+static const std::string probe_reply  = "BDE-PROBE-RECEIVED ";
+
+typedef std::chrono::steady_clock probe_clock;
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+static const int probe_zerocopy_flag = MSG_ZEROCOPY;
+#else
+static const int probe_zerocopy_flag = 0;
+#endif
+
+// ----------------------------------------------------------------------
+
+bool utils::tcp_probe_result::ok() const
+{
+    for (auto const &s : streams)
+    {
+        if (not s.error.empty())
+            return false;
+    }
+
+    return not streams.empty();
+}
+
+// ----------------------------------------------------------------------
+
+static int probe_connect(utils::tcp_probe_params const &params)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *res = nullptr;
+    auto port = std::to_string(params.port);
+
+    auto ret = getaddrinfo(params.host.c_str(), port.c_str(), &hints, &res);
+    if (ret != 0)
+    {
+        throw std::runtime_error("could not resolve " + params.host + ": " +
+                                 gai_strerror(ret));
+    }
+
+    timeval tv;
+    tv.tv_sec  = params.timeout_ms / 1000;
+    tv.tv_usec = (params.timeout_ms % 1000) * 1000;
+
+    std::string error = "no address";
+
+    for (auto ai = res; ai != nullptr; ai = ai->ai_next)
+    {
+        int sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+        if (sock < 0)
+        {
+            error = "socket() error: " + std::string(strerror(errno));
+            continue;
+        }
+
+        // On Linux SO_SNDTIMEO bounds connect() as well.
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            freeaddrinfo(res);
+            return sock;
+        }
+
+        error = "connect() error: " + std::string(strerror(errno));
+        close(sock);
+    }
+
+    freeaddrinfo(res);
+    throw std::runtime_error(error);
+}
+
+static bool probe_tcp_info(int sock, tcp_info &info)
+{
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    return getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0;
+}
+
+// Completion notices of MSG_ZEROCOPY sends pile up on the socket's
+// error queue; read them off so that sends don't fail with ENOBUFS.
+static void probe_drain_errqueue(int sock)
+{
+    char    control[128];
+    msghdr  msg;
+
+    for (;;)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+    }
+}
+
+// Send [header, data...] until time or volume runs out, then wait for
+// the server to tell how much it received.
+static void probe_stream(utils::tcp_probe_params const &params,
+                         std::vector<char> const       &buffer,
+                         uint64_t                       volume,
+                         utils::tcp_probe_stream       &result,
+                         std::vector<uint32_t>         &rtts)
+{
+    int sock = probe_connect(params);
+
+    int flags = MSG_NOSIGNAL;
+
+#ifdef SO_ZEROCOPY
+    if (params.zerocopy and probe_zerocopy_flag)
+    {
+        int one = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0)
+        {
+            flags |= probe_zerocopy_flag;
+            result.zerocopy = true;
+        }
+    }
+#endif
+
+    try
+    {
+        if (send(sock, probe_header.data(), probe_header.size(), MSG_NOSIGNAL) < 0)
+        {
+            throw std::runtime_error("send() error: " + std::string(strerror(errno)));
+        }
+
+        auto const start    = probe_clock::now();
+        auto const deadline = start + std::chrono::duration_cast<probe_clock::duration>(
+            std::chrono::duration<double>(params.duration));
+        auto next_sample    = start + std::chrono::milliseconds(100);
+
+        while (volume == 0 or result.bytes_sent < volume)
+        {
+            auto const now = probe_clock::now();
+
+            if (params.duration > 0 and now >= deadline)
+                break;
+
+            if (now >= next_sample)
+            {
+                tcp_info info;
+                if (probe_tcp_info(sock, info) and info.tcpi_rtt > 0)
+                    rtts.push_back(info.tcpi_rtt);
+
+                next_sample = now + std::chrono::milliseconds(100);
+            }
+
+            size_t len = buffer.size();
+            if (volume > 0)
+                len = std::min<uint64_t>(len, volume - result.bytes_sent);
+
+            auto n = send(sock, buffer.data(), len, flags);
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == ENOBUFS and (flags & probe_zerocopy_flag))
+                {
+                    probe_drain_errqueue(sock);
+                    continue;
+                }
+
+                throw std::runtime_error("send() error: " + std::string(strerror(errno)));
+            }
+
+            result.bytes_sent += n;
+
+            if (flags & probe_zerocopy_flag)
+                probe_drain_errqueue(sock);
+        }
+
+        shutdown(sock, SHUT_WR);
+
+        // The reply comes once the server has read everything.
+        std::string reply;
+        char        buf[64];
+
+        for (;;)
+        {
+            auto n = recv(sock, buf, sizeof(buf), 0);
+
+            if (n < 0 and errno == EINTR)
+                continue;
+
+            if (n < 0)
+                throw std::runtime_error("recv() error: " + std::string(strerror(errno)));
+
+            if (n == 0 or reply.append(buf, n).find('\n') != std::string::npos)
+                break;
+        }
+
+        auto const end = probe_clock::now();
+
+        if (reply.compare(0, probe_reply.size(), probe_reply) != 0)
+        {
+            throw std::runtime_error("unexpected reply from server: \"" + reply + "\"");
+        }
+
+        result.bytes_received = std::stoull(reply.substr(probe_reply.size()));
+        result.seconds        = std::chrono::duration<double>(end - start).count();
+        result.gbps           = result.seconds > 0 ?
+            result.bytes_received * 8 / result.seconds / 1e9 : 0;
+
+        tcp_info info;
+        if (probe_tcp_info(sock, info))
+        {
+            result.retransmits = info.tcpi_total_retrans;
+
+            if (info.tcpi_rtt > 0)
+                rtts.push_back(info.tcpi_rtt);
+        }
+    }
+    catch (...)
+    {
+        close(sock);
+        throw;
+    }
+
+    close(sock);
+}
+
+// ----------------------------------------------------------------------
+
+utils::tcp_probe_result utils::tcp_probe(utils::tcp_probe_params const &params)
+{
+    if (params.host.empty() or params.port <= 0)
+        throw std::runtime_error("tcp_probe: host and port are required");
+
+    if (params.streams == 0 or params.streams > 128)
+        throw std::runtime_error("tcp_probe: streams should be in [1, 128]");
+
+    if (params.duration <= 0 and params.bytes == 0)
+        throw std::runtime_error("tcp_probe: either duration or bytes is needed");
+
+    if (params.buffer_size == 0)
+        throw std::runtime_error("tcp_probe: buffer_size cannot be zero");
+
+    // Contents don't matter; all streams share the same buffer.
+    std::vector<char> buffer(params.buffer_size, 'x');
+
+    tcp_probe_result result;
+    result.streams.resize(params.streams);
+
+    std::vector<std::vector<uint32_t>> rtts(params.streams);
+    std::vector<std::thread>           threads;
+
+    for (size_t i = 0; i < params.streams; i++)
+    {
+        // Split the volume evenly; the first streams take the rest.
+        uint64_t volume = params.bytes / params.streams;
+        if (i < params.bytes % params.streams)
+            volume++;
+
+        if (params.bytes > 0 and volume == 0)
+            volume = 1;
+
+        threads.emplace_back([&, i, volume]() {
+                try
+                {
+                    probe_stream(params, buffer, volume, result.streams[i], rtts[i]);
+                }
+                catch (std::exception const &ex)
+                {
+                    result.streams[i].error = ex.what();
+                }
+            });
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    std::vector<uint32_t> all_rtts;
+
+    for (size_t i = 0; i < params.streams; i++)
+    {
+        auto const &s = result.streams[i];
+
+        result.bytes       += s.bytes_received;
+        result.seconds      = std::max(result.seconds, s.seconds);
+        result.retransmits += s.retransmits;
+
+        all_rtts.insert(all_rtts.end(), rtts[i].begin(), rtts[i].end());
+    }
+
+    if (result.seconds > 0)
+        result.gbps = result.bytes * 8 / result.seconds / 1e9;
+
+    if (not all_rtts.empty())
+    {
+        std::sort(all_rtts.begin(), all_rtts.end());
+
+        auto percentile = [&all_rtts](double p) {
+            size_t rank = static_cast<size_t>(std::ceil(p * all_rtts.size()));
+            return all_rtts[rank > 0 ? rank - 1 : 0];
+        };
+
+        result.rtt_min     = all_rtts.front();
+        result.rtt_p50     = percentile(0.50);
+        result.rtt_p90     = percentile(0.90);
+        result.rtt_p99     = percentile(0.99);
+        result.rtt_max     = all_rtts.back();
+        result.rtt_samples = all_rtts.size();
+    }
+
+    utils::slog() << "[tcp_probe] " << params.host << ":" << params.port
+                  << ", " << params.streams << " stream(s): "
+                  << result.bytes << " bytes in " << result.seconds
+                  << " s, " << result.gbps << " Gbps, rtt p50 "
+                  << result.rtt_p50 << " us, retransmits "
+                  << result.retransmits;
+
+    return result;
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
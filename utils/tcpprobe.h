@@ -0,0 +1,74 @@
+//
+//  Measure what a network path can carry: open a few parallel TCP
+//  streams to a "pong" server (see echo.h), send as much as we can
+//  for a while, and report throughput, RTT, and retransmits.
+//
+
+#ifndef BDE_UTILS_TCP_PROBE_H
+#define BDE_UTILS_TCP_PROBE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct tcp_probe_params
+    {
+        std::string host;
+        int         port         = 0;
+        size_t      streams      = 4;
+        double      duration     = 5.0;      // seconds.
+        uint64_t    bytes        = 0;        // total; 0 means no limit.
+        size_t      buffer_size  = 1 << 20;  // size of each send().
+        bool        zerocopy     = false;    // use MSG_ZEROCOPY if we can.
+        int         timeout_ms   = 5000;     // for connect and replies.
+    };
+
+    struct tcp_probe_stream
+    {
+        uint64_t    bytes_sent     = 0;
+        uint64_t    bytes_received = 0;      // as reported by the server.
+        double      seconds        = 0;
+        double      gbps           = 0;
+        uint32_t    retransmits    = 0;
+        bool        zerocopy       = false;  // whether it was used.
+        std::string error;
+    };
+
+    struct tcp_probe_result
+    {
+        std::vector<tcp_probe_stream> streams;
+
+        uint64_t    bytes       = 0;         // received, all streams.
+        double      seconds     = 0;         // longest stream.
+        double      gbps        = 0;         // aggregate.
+        uint32_t    retransmits = 0;
+
+        // Smoothed RTT (tcpi_rtt) samples of all streams, taken every
+        // 100 ms or so, in microseconds.
+        uint32_t    rtt_min     = 0;
+        uint32_t    rtt_p50     = 0;
+        uint32_t    rtt_p90     = 0;
+        uint32_t    rtt_p99     = 0;
+        uint32_t    rtt_max     = 0;
+        size_t      rtt_samples = 0;
+
+        // True if no stream failed.
+        bool ok() const;
+    };
+
+    // Run the probe; failures of individual streams are reported in
+    // their "error" field.  Throws on bad parameters.
+    tcp_probe_result tcp_probe(tcp_probe_params const &params);
+};
+
+#endif // BDE_UTILS_TCP_PROBE_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "utils.h"
+#include "timerwheel.h"
+
+// ----------------------------------------------------------------------
+
+utils::TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slots)
+    : tick_(tick)
+    , slots_(slots)
+    , now_(0)
+    , pending_(0)
+    , stop_(false)
+{
+    if (tick.count() <= 0 or slots == 0)
+    {
+        throw std::invalid_argument("TimerWheel: tick and slots must be positive");
+    }
+
+    thread_ = std::thread(&TimerWheel::run, this);
+}
+
+utils::TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+void utils::TimerWheel::schedule(std::chrono::milliseconds delay, Task task)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (stop_)
+    {
+        return;
+    }
+
+    // Part of the current tick has passed already; counting from the
+    // next one, timers are never early.
+    auto const ticks = (std::max<int64_t>(0, delay.count()) + tick_.count() - 1) / tick_.count();
+    auto const due   = now_ + 1 + ticks;
+
+    slots_[due % slots_.size()].push_back(Timer{uint64_t(due), std::move(task)});
+    pending_++;
+}
+
+void utils::TimerWheel::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (stop_)
+        {
+            return;
+        }
+
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &slot : slots_)
+    {
+        slot.clear();
+    }
+
+    pending_ = 0;
+}
+
+size_t utils::TimerWheel::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+void utils::TimerWheel::run()
+{
+    auto const start = clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        // Ticks are kept to the start, so that they don't drift by
+        // the time the timers take.
+        auto const next = start + tick_ * (now_ + 1);
+
+        if (cv_.wait_until(lock, next, [this]() { return stop_; }))
+        {
+            return;
+        }
+
+        now_++;
+
+        auto &slot = slots_[now_ % slots_.size()];
+
+        std::vector<Task> due;
+
+        // Order within a tick does not matter; timers due are swapped
+        // out with the last one.
+        for (size_t i = 0; i < slot.size();)
+        {
+            if (slot[i].due <= now_)
+            {
+                due.push_back(std::move(slot[i].task));
+                std::swap(slot[i], slot.back());
+                slot.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        pending_ -= due.size();
+
+        lock.unlock();
+
+        for (auto &task : due)
+        {
+            try
+            {
+                task();
+            }
+            catch (std::exception const &ex)
+            {
+                utils::slog() << "[TimerWheel] Timer failed: " << ex.what();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
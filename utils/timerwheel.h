@@ -0,0 +1,90 @@
+//
+//  A hashed timer wheel: timers go to the slot of the tick they are
+//  due at, and one thread looks at a single slot per tick, so that
+//  many thousands of timers cost little to add and nothing while they
+//  wait.
+//
+//  Timers can't be cancelled; work that finishes before its timer
+//  leaves the timer to find nothing to do.  That suits timeouts, such
+//  as those of RPC calls in flight:
+//
+//      utils::TimerWheel timers;
+//
+//      timers.schedule(std::chrono::seconds(5), [this, id]() {
+//              expire(id);     // no-op if the answer came first
+//          });
+//
+//  Timers run on the wheel's thread, up to two ticks late, and must
+//  not block it.
+//
+
+#ifndef BDE_UTILS_TIMER_WHEEL_H
+#define BDE_UTILS_TIMER_WHEEL_H
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    class TimerWheel
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // Starts the thread; timers longer than @slots@ ticks go
+        // round the wheel more than once.
+        explicit TimerWheel(std::chrono::milliseconds tick  = std::chrono::milliseconds(100),
+                            size_t                    slots = 512);
+
+        // Stops; timers that are not due yet are dropped.
+        ~TimerWheel();
+
+        TimerWheel(TimerWheel const &) = delete;
+        TimerWheel& operator=(TimerWheel const &) = delete;
+
+        // Run @task@ once @delay@ has passed, at the next tick.
+        void schedule(std::chrono::milliseconds delay, Task task);
+
+        // Stop the thread, and drop the timers that are left.
+        void stop();
+
+        // Timers not run yet.
+        size_t pending() const;
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct Timer
+        {
+            uint64_t due;       // tick.
+            Task     task;
+        };
+
+        void run();
+
+        std::chrono::milliseconds const tick_;
+        std::vector<std::vector<Timer>> slots_;
+        uint64_t                        now_;       // ticks done.
+        size_t                          pending_;
+        bool                            stop_;
+
+        mutable std::mutex              mutex_;
+        std::condition_variable         cv_;
+        std::thread                     thread_;
+    };
+};
+
+#endif // BDE_UTILS_TIMER_WHEEL_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+
+// ----------------------------------------------------------------------
+
+// First line of a sysfs file, or an empty string if it can't be read.
+static std::string read_line(std::string const &path)
+{
+    std::ifstream in(path);
+    std::string   line;
+
+    std::getline(in, line);
+
+    return line;
+}
+
+// Numeric names in a directory, sorted; "node" entries are matched by
+// their prefix ("node0", "node1"...).
+static std::vector<int> list_numbered(std::string const &dir,
+                                      std::string const &prefix = "")
+{
+    std::vector<int> result;
+
+    DIR *d = opendir(dir.c_str());
+
+    if (d == nullptr)
+    {
+        return result;
+    }
+
+    while (auto *ent = readdir(d))
+    {
+        std::string name = ent->d_name;
+
+        if (name.size() <= prefix.size() or
+            name.compare(0, prefix.size(), prefix) != 0)
+            continue;
+
+        auto const num = name.substr(prefix.size());
+
+        if (num.find_first_not_of("0123456789") != std::string::npos)
+            continue;
+
+        result.push_back(std::stoi(num));
+    }
+
+    closedir(d);
+
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+// ----------------------------------------------------------------------
+
+std::vector<int> utils::parse_cpu_list(std::string const &list)
+{
+    std::vector<int>  cpus;
+    std::stringstream ss(list);
+    std::string       part;
+
+    while (std::getline(ss, part, ','))
+    {
+        // trailing newlines and blanks, as in sysfs files.
+        part.erase(part.find_last_not_of(" \t\n") + 1);
+
+        if (part.empty())
+            continue;
+
+        int  first = 0, last = 0;
+        char dash  = 0;
+        char extra = 0;
+
+        auto n = sscanf(part.c_str(), "%d%c%d%c", &first, &dash, &last, &extra);
+
+        if (n == 1)
+        {
+            last = first;
+        }
+        else if (n != 3 or dash != '-')
+        {
+            throw std::runtime_error("bad CPU list \"" + list + "\"");
+        }
+
+        if (first < 0 or last < first)
+        {
+            throw std::runtime_error("bad CPU list \"" + list + "\"");
+        }
+
+        for (int c = first; c <= last; c++)
+        {
+            cpus.push_back(c);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    return cpus;
+}
+
+std::string utils::format_cpu_list(std::vector<int> const &cpus)
+{
+    std::stringstream ss;
+
+    for (size_t i = 0; i < cpus.size(); )
+    {
+        size_t j = i;
+
+        while (j + 1 < cpus.size() and cpus[j + 1] == cpus[j] + 1)
+            j++;
+
+        if (i > 0)
+            ss << ",";
+
+        ss << cpus[i];
+
+        if (j > i)
+            ss << "-" << cpus[j];
+
+        i = j + 1;
+    }
+
+    return ss.str();
+}
+
+// ----------------------------------------------------------------------
+
+size_t utils::NicTopology::irqs_off_node() const
+{
+    if (numa_node < 0 or local_cpus.empty())
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+
+    for (auto const &irq : irqs)
+    {
+        auto const &cpus = irq.effective.empty() ? irq.cpus : irq.effective;
+
+        for (auto c : cpus)
+        {
+            if (not std::binary_search(local_cpus.begin(), local_cpus.end(), c))
+            {
+                count++;
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+// ----------------------------------------------------------------------
+
+utils::Topology utils::Topology::read(std::string const &sysfs,
+                                      std::string const &procfs)
+{
+    Topology t;
+    t.sysfs_  = sysfs;
+    t.procfs_ = procfs;
+
+    auto const node_dir = sysfs + "/devices/system/node";
+
+    for (auto id : list_numbered(node_dir, "node"))
+    {
+        auto const list = read_line(node_dir + "/node" + std::to_string(id) +
+                                    "/cpulist");
+        t.nodes_.push_back(NumaNode{id, parse_cpu_list(list)});
+    }
+
+    if (t.nodes_.empty())
+    {
+        auto const online =
+            read_line(sysfs + "/devices/system/cpu/online");
+        t.nodes_.push_back(NumaNode{0, parse_cpu_list(online)});
+    }
+
+    return t;
+}
+
+utils::NicTopology utils::Topology::nic(std::string const &name) const
+{
+    NicTopology nic;
+    nic.name = name;
+
+    auto const dev = sysfs_ + "/class/net/" + name + "/device";
+
+    auto const node = read_line(dev + "/numa_node");
+
+    if (not node.empty())
+    {
+        nic.numa_node = std::stoi(node);
+
+        // Without NUMA the kernel says -1, but everything is local.
+        if (nic.numa_node < 0 and nodes_.size() == 1)
+            nic.numa_node = nodes_[0].id;
+    }
+
+    auto const local = read_line(dev + "/local_cpulist");
+
+    if (not local.empty())
+    {
+        nic.local_cpus = parse_cpu_list(local);
+    }
+    else if (nic.numa_node >= 0)
+    {
+        nic.local_cpus = node_cpus(nic.numa_node);
+    }
+
+    for (auto irq : list_numbered(dev + "/msi_irqs"))
+    {
+        auto const base = procfs_ + "/irq/" + std::to_string(irq);
+
+        IrqAffinity aff;
+        aff.irq = irq;
+
+        auto const cpus = read_line(base + "/smp_affinity_list");
+        auto const eff  = read_line(base + "/effective_affinity_list");
+
+        if (not cpus.empty())
+            aff.cpus = parse_cpu_list(cpus);
+
+        if (not eff.empty())
+            aff.effective = parse_cpu_list(eff);
+
+        nic.irqs.push_back(aff);
+    }
+
+    return nic;
+}
+
+std::vector<utils::NicTopology>
+utils::Topology::nics(std::vector<std::string> const &names) const
+{
+    std::vector<NicTopology> result;
+
+    for (auto const &name : names)
+    {
+        result.push_back(nic(name));
+    }
+
+    return result;
+}
+
+std::vector<int> utils::Topology::node_cpus(int node) const
+{
+    for (auto const &n : nodes_)
+    {
+        if (n.id == node)
+            return n.cpus;
+    }
+
+    return {};
+}
+
+// ----------------------------------------------------------------------
+
+std::string utils::CpuPlacement::describe() const
+{
+    if (empty())
+    {
+        return "anywhere";
+    }
+
+    std::string desc;
+
+    if (not cpus.empty())
+    {
+        desc += "cpus " + format_cpu_list(cpus);
+    }
+
+    if (not mem_nodes.empty())
+    {
+        if (not desc.empty())
+            desc += ", ";
+
+        desc += std::string(strict ? "memory on" : "memory preferably on") +
+            " node " + format_cpu_list(mem_nodes);
+    }
+
+    return desc;
+}
+
+utils::CpuPlacement
+utils::nic_local_placement(Topology const    &topology,
+                           std::string const &iface,
+                           std::string const &policy)
+{
+    CpuPlacement placement;
+
+    if (policy.empty() or policy == "none")
+    {
+        return placement;
+    }
+
+    if (policy != "nic-local" and policy != "nic-local-strict")
+    {
+        throw std::runtime_error("unknown placement policy \"" + policy + "\"");
+    }
+
+    auto const nic = topology.nic(iface);
+
+    // Nothing to gain on a host with a single node.
+    if (nic.numa_node < 0 or topology.nodes().size() < 2)
+    {
+        return placement;
+    }
+
+    placement.cpus = nic.local_cpus;
+    placement.mem_nodes.push_back(nic.numa_node);
+    placement.strict = (policy == "nic-local-strict");
+
+    return placement;
+}
+
+std::string utils::apply_placement(CpuPlacement const &placement)
+{
+    if (not placement.cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for (auto c : placement.cpus)
+        {
+            if (c < CPU_SETSIZE)
+                CPU_SET(c, &set);
+        }
+
+        if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        {
+            return "sched_setaffinity() error: " + std::string(strerror(errno));
+        }
+    }
+
+    if (not placement.mem_nodes.empty())
+    {
+        // No libnuma; set_mempolicy(2) takes a bitmask of nodes.
+        unsigned long mask[16] = {0};
+        auto const    bits     = 8 * sizeof(mask[0]);
+
+        for (auto n : placement.mem_nodes)
+        {
+            if (n >= 0 and size_t(n) < bits * 16)
+                mask[n / bits] |= 1UL << (n % bits);
+        }
+
+        int const mode = placement.strict ? MPOL_BIND : MPOL_PREFERRED;
+
+        // The kernel counts one more bit than it reads.
+        if (syscall(SYS_set_mempolicy, mode, mask, bits * 16 + 1) < 0)
+        {
+            return "set_mempolicy() error: " + std::string(strerror(errno));
+        }
+    }
+
+    return "";
+}
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
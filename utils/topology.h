@@ -0,0 +1,115 @@
+//
+//  NUMA topology of the host, as seen in /sys: which CPUs are on which
+//  node, which node a network interface hangs off, and where its
+//  interrupts go.  Also the means to keep a subprocess on the node of
+//  a given interface.
+//
+
+#ifndef BDE_UTILS_TOPOLOGY_H
+#define BDE_UTILS_TOPOLOGY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    // Parse a kernel CPU (or node) list, like "0-3,8-11".  Throws on
+    // malformed lists.
+    std::vector<int> parse_cpu_list(std::string const &list);
+
+    // And format one back, with ranges folded.
+    std::string format_cpu_list(std::vector<int> const &cpus);
+
+    struct NumaNode
+    {
+        int              id;
+        std::vector<int> cpus;
+    };
+
+    struct IrqAffinity
+    {
+        int              irq;
+        std::vector<int> cpus;          // smp_affinity_list.
+        std::vector<int> effective;     // where it is really routed, if known.
+    };
+
+    struct NicTopology
+    {
+        std::string              name;
+        int                      numa_node = -1;    // -1: unknown, or no device.
+        std::vector<int>         local_cpus;
+        std::vector<IrqAffinity> irqs;
+
+        // IRQs that may land on a CPU outside the NIC's node.
+        size_t irqs_off_node() const;
+    };
+
+    class Topology
+    {
+    public:
+        // Read the topology from the given roots; tests point these at
+        // fixture trees.  A host with no NUMA support in the kernel is
+        // reported as a single node with all online CPUs.
+        static Topology read(std::string const &sysfs  = "/sys",
+                             std::string const &procfs = "/proc");
+
+        std::vector<NumaNode> const &nodes() const { return nodes_; }
+
+        // Topology of the given interfaces, in that order.  Virtual
+        // interfaces (no device) have no node.
+        std::vector<NicTopology>
+        nics(std::vector<std::string> const &names) const;
+
+        NicTopology nic(std::string const &name) const;
+
+        // CPUs of a node; empty if there is no such node.
+        std::vector<int> node_cpus(int node) const;
+
+    private:
+        std::string           sysfs_;
+        std::string           procfs_;
+        std::vector<NumaNode> nodes_;
+    };
+
+    // Where to run a subprocess.
+    struct CpuPlacement
+    {
+        std::vector<int> cpus;              // empty: leave affinity alone.
+        std::vector<int> mem_nodes;         // empty: leave memory policy alone.
+        bool             strict = false;    // MPOL_BIND instead of MPOL_PREFERRED.
+
+        bool empty() const { return cpus.empty() and mem_nodes.empty(); }
+        std::string describe() const;
+    };
+
+    // Placement policies for subprocesses:
+    //
+    //   "none":             run anywhere (the default).
+    //   "nic-local":        CPUs of the interface's node, and memory
+    //                       preferably from that node.
+    //   "nic-local-strict": same, but memory only from that node.
+    //
+    // An interface with no known node gets an empty placement.
+    // Throws on unknown policies.
+    CpuPlacement nic_local_placement(Topology const    &topology,
+                                     std::string const &iface,
+                                     std::string const &policy);
+
+    // Apply a placement to the calling thread, with
+    // sched_setaffinity() and set_mempolicy(); both are inherited
+    // across fork() and exec().  Returns an error message, or an
+    // empty string; this is meant to be called between fork() and
+    // exec(), so it does not throw.
+    std::string apply_placement(CpuPlacement const &placement);
+};
+
+#endif // BDE_UTILS_TOPOLOGY_H
+
+// ----------------------------------------------------------------------
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
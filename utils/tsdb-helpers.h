@@ -4,79 +4,281 @@
 // Code here help us massage time series inputs to some "stringy"
 // shape we want them to be, so that they can be submitted to InfluxDB
 // via its HTTP API.
+//
+// https://docs.influxdata.com/influxdb/v1.2/write_protocols/line_protocol_reference/
+//
+// A point is written as
+//
+//     measurement,tag1=a,tag2=b field1=1,field2="x" 1500000000000000000
+//
+// Everything but tag values and field values is known when a
+// measurement is defined, so LineEncoder escapes it all once, up
+// front, and encoding a point only appends values to a buffer.
+
+#include <array>
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <cstdint>
+#include <type_traits>
 
 namespace utils
 {
-    template<typename T>
-    static std::string format(T const &v) {
-        return std::to_string(v);
-    }
+    namespace line_protocol
+    {
+        inline void append_escaped(std::string &out,
+                                   std::string const &str,
+                                   bool measurement = false)
+        {
+            for (auto c : str)
+            {
+                // Measurement names may have equal signs.
+                if (c == ',' or isspace(static_cast<unsigned char>(c)) or
+                    (c == '=' and not measurement))
+                {
+                    out += '\\';
+                }
 
-    template<>
-    std::string format(bool const &v) {
-        return v ? "true" : "false";
-    }
+                out += c;
+            }
+        }
 
-    template<>
-    std::string format(std::string const &v) {
-        return "\"" + v + "\"";
-    }
+        inline void append_unsigned(std::string &out, unsigned long long v)
+        {
+            char  buf[24];
+            char *end = buf + sizeof(buf);
+            char *p   = end;
 
-    template<>
-    std::string format(const char * const &v) {
-        return "\"" + std::string(v) + "\"";
-    }
+            do
+            {
+                *--p = '0' + v % 10;
+                v /= 10;
+            }
+            while (v != 0);
+
+            out.append(p, end - p);
+        }
+
+        inline void append_signed(std::string &out, long long v)
+        {
+            if (v < 0)
+            {
+                out += '-';
+                // Negate as unsigned, which LLONG_MIN survives.
+                append_unsigned(out, 0ULL - static_cast<unsigned long long>(v));
+            }
+            else
+            {
+                append_unsigned(out, v);
+            }
+        }
+
+        // Field values.  These return false if there is no value to
+        // write, like NaN, which InfluxDB refuses.
+        //
+        // Integers are written without the "i" suffix, as they always
+        // have been, so that existing fields keep their float type.
 
-    std::string escape(std::string const &str);
+        inline bool append_value(std::string &out, bool v)
+        {
+            out += v ? "true" : "false";
+            return true;
+        }
+
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value and
+                                       std::is_signed<T>::value, bool>::type
+        append_value(std::string &out, T v)
+        {
+            append_signed(out, v);
+            return true;
+        }
+
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value and
+                                       std::is_unsigned<T>::value, bool>::type
+        append_value(std::string &out, T v)
+        {
+            append_unsigned(out, v);
+            return true;
+        }
 
-    template <typename Tuple, size_t TupleSize, size_t FieldsSize>
-    struct field_set_builder {
-        static void build(std::string &str,
-                          Tuple const &tup,
-                          std::array<std::string, FieldsSize> const &fs) {
+        // The shortest of two precisions that reads back the same.
+        template <typename T>
+        inline bool append_floating(std::string &out, T v,
+                                    char const *fmt_short, char const *fmt_long)
+        {
+            if (not std::isfinite(v))
+            {
+                return false;
+            }
 
-            field_set_builder<Tuple, TupleSize-1, FieldsSize>::build(str, tup, fs);
+            // Whole numbers, which most of ours are, the fast way.
+            if (v == std::trunc(v) and std::fabs(v) < 1e15)
+            {
+                append_signed(out, static_cast<long long>(v));
+                return true;
+            }
 
-            auto key = fs.at(TupleSize-1);
-            auto val = format(std::get<TupleSize-1>(tup));
+            char buf[64];
+            int  n = snprintf(buf, sizeof(buf), fmt_short, v);
 
-            if (!key.empty() and !val.empty()) {
-                str += "," + key + "=" + val;
+            if (static_cast<T>(strtold(buf, nullptr)) != v)
+            {
+                n = snprintf(buf, sizeof(buf), fmt_long, v);
             }
+
+            out.append(buf, n);
+            return true;
         }
-    };
 
-    template <typename Tuple, size_t FieldsSize>
-    struct field_set_builder<Tuple, 1, FieldsSize> {
-        static void build(std::string &str,
-                          Tuple const &tup,
-                          std::array<std::string, FieldsSize> const &fs) {
-            auto key = fs.at(0);
-            auto val = format(std::get<0>(tup));
+        inline bool append_value(std::string &out, float v)
+        {
+            return append_floating<float>(out, v, "%.6g", "%.9g");
+        }
+
+        inline bool append_value(std::string &out, double v)
+        {
+            return append_floating<double>(out, v, "%.15g", "%.17g");
+        }
+
+        inline bool append_value(std::string &out, long double v)
+        {
+            return append_floating<long double>(out, v, "%.18Lg", "%.21Lg");
+        }
+
+        inline bool append_value(std::string &out, char const *v)
+        {
+            out += '"';
+
+            for (; *v; v++)
+            {
+                if (*v == '"' or *v == '\\')
+                    out += '\\';
 
-            if (!key.empty() and !val.empty()) {
-                str += escape(key) + "=" + val;
+                out += *v;
             }
+
+            out += '"';
+            return true;
         }
-    };
 
-    template <size_t NumTags>
-    struct tag_set_builder {
-        static std::string build(std::array<std::string, NumTags> const &tag_names,
-                                 std::array<std::string, NumTags> const &tag_values) {
-            std::string str{};
+        inline bool append_value(std::string &out, std::string const &v)
+        {
+            return append_value(out, v.c_str());
+        }
+    }
+
+    // Escape commas, equal signs and spaces, as tag keys, tag values
+    // and field keys need.
+    inline std::string escape(std::string const &str)
+    {
+        std::string out;
+        line_protocol::append_escaped(out, str);
+        return out;
+    }
+
+    template <size_t NUM_TAGS, typename... Fields>
+    class LineEncoder
+    {
+    public:
+        static constexpr size_t NUM_FIELDS = sizeof...(Fields);
 
-            for (auto i = 0; i < NumTags; ++i) {
-                auto key = tag_names.at(i);
-                auto val = tag_values.at(i);
+        // Tags and fields with empty names are left out.
+        LineEncoder(std::string const                     &measurement,
+                    std::array<std::string, NUM_FIELDS> const &field_names,
+                    std::array<std::string, NUM_TAGS> const   &tag_names)
+        {
+            line_protocol::append_escaped(prefix_, measurement, true);
 
-                if (!key.empty() and !val.empty()) {
-                    str += "," + escape(key) + "=" + escape(val);
+            for (size_t i = 0; i < NUM_TAGS; i++)
+            {
+                if (not tag_names[i].empty())
+                {
+                    tag_keys_[i] = ",";
+                    line_protocol::append_escaped(tag_keys_[i], tag_names[i]);
+                    tag_keys_[i] += '=';
                 }
             }
 
-            return str;
+            for (size_t i = 0; i < NUM_FIELDS; i++)
+            {
+                if (not field_names[i].empty())
+                {
+                    line_protocol::append_escaped(field_keys_[i], field_names[i]);
+                    field_keys_[i] += '=';
+                }
+            }
         }
+
+        // Append a point to @out@, without a newline.  Tags with
+        // empty values are left out.  Returns false, with @out@ as it
+        // was, if no field has a value.
+        bool encode(std::string                             &out,
+                    Fields const &...                        values,
+                    std::array<std::string, NUM_TAGS> const &tags,
+                    long long                                timestamp_ns) const
+        {
+            auto const start = out.size();
+
+            out += prefix_;
+
+            for (size_t i = 0; i < NUM_TAGS; i++)
+            {
+                if (not tag_keys_[i].empty() and not tags[i].empty())
+                {
+                    out += tag_keys_[i];
+                    line_protocol::append_escaped(out, tags[i]);
+                }
+            }
+
+            out += ' ';
+
+            auto const fields = out.size();
+
+            append_fields<0>(out, fields, values...);
+
+            if (out.size() == fields)
+            {
+                out.resize(start);
+                return false;
+            }
+
+            out += ' ';
+            line_protocol::append_signed(out, timestamp_ns);
+
+            return true;
+        }
+
+    private:
+        template <size_t I>
+        void append_fields(std::string &, size_t) const { }
+
+        template <size_t I, typename T, typename... Rest>
+        void append_fields(std::string &out, size_t fields,
+                           T const &value, Rest const &... rest) const
+        {
+            if (not field_keys_[I].empty())
+            {
+                auto const mark = out.size();
+
+                if (mark != fields)
+                    out += ',';
+
+                out += field_keys_[I];
+
+                if (not line_protocol::append_value(out, value))
+                    out.resize(mark);
+            }
+
+            append_fields<I + 1>(out, fields, rest...);
+        }
+
+        std::string                         prefix_;
+        std::array<std::string, NUM_TAGS>   tag_keys_;      // ",key="
+        std::array<std::string, NUM_FIELDS> field_keys_;    // "key="
     };
 }
 
@@ -1,3 +1,4 @@
+#include <mutex>
 #include <ostream>
 #include <curl_easy.h>
 
@@ -8,6 +9,118 @@
 static const bool verbose = false;
 static       bool printed_error = false;
 
+struct utils::TimeSeriesDB::Connection
+{
+    Connection()
+        : writer(response)
+        , easy(writer)
+        , gzip_header(curl_slist_append(nullptr, "Content-Encoding: gzip")) { }
+
+    ~Connection()
+    {
+        curl_slist_free_all(gzip_header);
+    }
+
+    std::mutex                         mutex;
+    std::ostringstream                 response;
+    curl::curl_ios<std::ostringstream> writer;
+    curl::curl_easy                    easy;
+    curl_slist                        *gzip_header;
+};
+
+static bool tsdb_enabled(BaseConf const &conf)
+{
+    return conf.get<bool>("agent.tsdb.enabled", true);
+}
+
+static utils::TimeSeriesWriterConf writer_conf(BaseConf const &conf)
+{
+    utils::TimeSeriesWriterConf c;
+
+    c.batch_points = conf.get<int>("agent.tsdb.batch_points", c.batch_points);
+    c.batch_bytes  = conf.get<int>("agent.tsdb.batch_bytes", c.batch_bytes);
+    c.flush_ms     = conf.get<int>("agent.tsdb.flush_ms", c.flush_ms);
+    c.queue_points = conf.get<int>("agent.tsdb.queue_points", c.queue_points);
+    c.gzip         = conf.get<bool>("agent.tsdb.gzip", c.gzip);
+    c.spool        = conf.get<std::string>("agent.tsdb.spool", c.spool);
+    c.spool_bytes  = conf.get<int>("agent.tsdb.spool_bytes", c.spool_bytes);
+
+    return c;
+}
+
+utils::TimeSeriesDB::TimeSeriesDB(std::string const          &host,
+                                  int                         port,
+                                  std::string const          &dbname,
+                                  std::string const          &username,
+                                  std::string const          &password,
+                                  TimeSeriesWriterConf const &writer_conf,
+                                  bool                        enabled)
+    : host_(host)
+    , port_(port)
+    , dbname_(dbname)
+    , username_(username)
+    , password_(password)
+    , base_endpoint_(host_ + ":" + std::to_string(port_))
+    , write_endpoint_(base_endpoint_ + "/write" + "?&db=" + dbname_)
+    , query_endpoint_(base_endpoint_ + "/query" + "?&db=" + dbname_)
+    , conn_(new Connection)
+{
+    if (not enabled)
+    {
+        utils::slog() << "[InfluxDB] Disabled; points will not be sent.";
+        return;
+    }
+
+    writer_.reset(new TimeSeriesWriter(
+                      [this](std::string const &body, bool gzipped) {
+                          // Retrying won't make bad points good: only
+                          // what the server failed on is kept for later.
+                          auto const status = post_lines(body, gzipped);
+                          return status != 0 and status < 500;
+                      }, writer_conf));
+}
+
+utils::TimeSeriesDB::TimeSeriesDB(BaseConf const & conf)
+    : TimeSeriesDB(tsdb_enabled(conf) ? conf.get<std::string>("agent.tsdb.host")
+                                      : conf.get<std::string>("agent.tsdb.host", ""),
+                   tsdb_enabled(conf) ? conf.get<int>("agent.tsdb.port")
+                                      : conf.get<int>("agent.tsdb.port", 0),
+                   tsdb_enabled(conf) ? conf.get<std::string>("agent.tsdb.db")
+                                      : conf.get<std::string>("agent.tsdb.db", ""),
+                   std::string(),
+                   std::string(),
+                   writer_conf(conf),
+                   tsdb_enabled(conf))
+{
+}
+
+utils::TimeSeriesDB::~TimeSeriesDB()
+{
+    // Sends, or spools, what is left.
+    writer_.reset();
+}
+
+void utils::TimeSeriesDB::write(std::string line) const
+{
+    if (writer_)
+    {
+        writer_->write(std::move(line));
+    }
+}
+
+void utils::TimeSeriesDB::flush() const
+{
+    if (writer_)
+    {
+        writer_->flush();
+    }
+}
+
+utils::TimeSeriesWriterStats utils::TimeSeriesDB::writer_stats() const
+{
+    return writer_ ? writer_->stats() : TimeSeriesWriterStats();
+}
+
 bool utils::TimeSeriesDB::run_post(std::string const &query) const
 {
     if (query.empty())
@@ -15,15 +128,28 @@ bool utils::TimeSeriesDB::run_post(std::string const &query) const
         throw std::runtime_error("empty query");
     }
 
-    std::ostringstream                 str;
-    curl::curl_ios<std::ostringstream> writer(str);
-    curl::curl_easy                    easy(writer);
+    auto const status = post_lines(query, false);
+
+    return status >= 200 and status < 300;
+}
+
+// Returns the HTTP status, or 0 if there was none.
+long utils::TimeSeriesDB::post_lines(std::string const &body, bool gzipped) const
+{
+    std::lock_guard<std::mutex> lock(conn_->mutex);
+
+    auto &easy = conn_->easy;
+
+    conn_->response.str("");
 
     easy.add<CURLOPT_URL>(write_endpoint_.c_str());
-    easy.add<CURLOPT_POSTFIELDS>(query.c_str());
-    easy.add<CURLOPT_POSTFIELDSIZE_LARGE>(query.length());
+    easy.add<CURLOPT_POSTFIELDS>(body.data());
+    easy.add<CURLOPT_POSTFIELDSIZE_LARGE>(body.size());
+    easy.add<CURLOPT_HTTPHEADER>(gzipped ? conn_->gzip_header : nullptr);
     easy.add<CURLOPT_TCP_KEEPALIVE>(1L);
     easy.add<CURLOPT_NOSIGNAL>(1);
+    easy.add<CURLOPT_CONNECTTIMEOUT>(5L);
+    easy.add<CURLOPT_TIMEOUT>(30L);
 
     if (not username_.empty())
     {
@@ -53,29 +179,30 @@ bool utils::TimeSeriesDB::run_post(std::string const &query) const
             printed_error = true;
         }
 
-        return false;
+        return 0;
     }
 
-    auto status = easy.get_info<CURLINFO_RESPONSE_CODE>().get();
+    long status = easy.get_info<CURLINFO_RESPONSE_CODE>().get();
 
     if (verbose)
     {
-        utils::slog() << "[InfluxDB] sent {" << query << "} to {"
+        utils::slog() << "[InfluxDB] sent " << body.size() << " bytes"
+                      << (gzipped ? " (gzip)" : "") << " to {"
                       << write_endpoint_ << "}; received status: "
-                      << status << ", message: " << str.str();
+                      << status << ", message: " << conn_->response.str();
     }
 
     if (status >= 200 and status < 300)
     {
-        return true;
+        return status;
     }
 
     // log failures.
-    utils::slog() << "[InfluxDB] sent {" << query << "} to {"
+    utils::slog() << "[InfluxDB] sent " << body.size() << " bytes to {"
                   << write_endpoint_ << "}; received status: "
-                  << status << ", message: " << str.str();
+                  << status << ", message: " << conn_->response.str();
 
-    return false;
+    return status;
 }
 
 
@@ -132,25 +259,6 @@ utils::TimeSeriesDB::raw_query(std::string const &query) const
     return std::pair<int, Json::Value>(status, res);
 }
 
-std::string utils::escape(std::string const &str)
-{
-    std::stringstream ss;
-
-    for (auto const &c : str)
-    {
-        if (c == ',' or c == '=' or isspace(c))
-        {
-            ss << '\\' << c;
-        }
-        else
-        {
-            ss << c;
-        }
-    }
-
-    return ss.str();
-}
-
 // Local Variables:
 // mode: c++
 // c-basic-offset: 4
@@ -17,6 +17,9 @@
 // purpose anyway!) over InfluxDB's HTTP API, implemented using
 // curlcpp.
 
+// Points are not sent as they are inserted, but queued and sent in
+// batches by a thread of their own; see tsdbwriter.h.
+//
 // Usage is as follows, which should be pretty self-explanatory:
 //
 //     utils::TimeSeriesDB tsdb("host", 8086, "db");
@@ -29,7 +32,10 @@
 //     m.insert(3.14, true, {"tag-val1", "tag-val2"});
 //
 
+#include <array>
 #include <list>
+#include <chrono>
+#include <memory>
 #include <string>
 #include <utils/json/json.h>
 
@@ -37,6 +43,7 @@
 
 #include "baseconf.h"
 #include "tsdb-helpers.h"
+#include "tsdbwriter.h"
 
 namespace utils
 {
@@ -46,28 +53,38 @@ namespace utils
                      int port,
                      std::string const &dbname,
                      std::string const &username=std::string(),
-                     std::string const &password=std::string())
-            : host_(host)
-            , port_(port)
-            , dbname_(dbname)
-            , username_(username)
-            , password_(password)
-            , base_endpoint_(host_ + ":" + std::to_string(port_))
-            , write_endpoint_(base_endpoint_ + "/write" + "?&db=" + dbname_)
-            , query_endpoint_(base_endpoint_ + "/query" + "?&db=" + dbname_) { };
-
-        TimeSeriesDB(BaseConf const & conf)
-            : host_(conf.get<std::string>("agent.tsdb.host"))
-            , port_(conf.get<int>("agent.tsdb.port"))
-            , dbname_(conf.get<std::string>("agent.tsdb.db"))
-            , base_endpoint_(host_ + ":" + std::to_string(port_))
-            , write_endpoint_(base_endpoint_ + "/write" + "?&db=" + dbname_)
-            , query_endpoint_(base_endpoint_ + "/query" + "?&db=" + dbname_) { };
+                     std::string const &password=std::string(),
+                     TimeSeriesWriterConf const &writer_conf=TimeSeriesWriterConf(),
+                     bool enabled=true);
+
+        // Optional batching settings go in "agent.tsdb" too, next to
+        // host, port and db: "batch_points", "batch_bytes",
+        // "flush_ms", "queue_points", "gzip", "spool" (a file) and
+        // "spool_bytes".  With "enabled": false, points are not sent
+        // anywhere, and host, port and db are not needed.
+        TimeSeriesDB(BaseConf const & conf);
+
+        bool enabled() const { return writer_ != nullptr; }
+
+        ~TimeSeriesDB();
+
+        // Queue a point, in line protocol, for the writer's thread to
+        // send along with others.  Does nothing if not enabled.
+        void write(std::string line) const;
+
+        // Wait until points written so far have been sent, spooled or
+        // dropped.
+        void flush() const;
 
+        TimeSeriesWriterStats writer_stats() const;
+
+        // Send points right away, on the calling thread.
         bool                        run_post(std::string const &query) const;
         std::pair<int, Json::Value> raw_query(std::string const &query) const;
 
     private:
+        long post_lines(std::string const &body, bool gzipped) const;
+
         std::string const host_;
         int         const port_;
         std::string const dbname_;
@@ -76,6 +93,12 @@ namespace utils
         std::string const base_endpoint_;
         std::string const write_endpoint_;
         std::string const query_endpoint_;
+
+        // A curl handle kept from one write to the next, so that its
+        // connection is too.  The writer goes first.
+        struct Connection;
+        std::unique_ptr<Connection>       conn_;
+        std::unique_ptr<TimeSeriesWriter> writer_;
     };
 
     template <size_t N>
@@ -90,8 +113,8 @@ namespace utils
     template<size_t NUM_TAGS, typename... Fields>
     class TimeSeriesMeasurement {
 
-        using row_t = std::tuple<Fields...>;
-        static constexpr auto NUM_FIELDS = std::tuple_size<row_t>::value;
+        using encoder_t = LineEncoder<NUM_TAGS, Fields...>;
+        static constexpr auto NUM_FIELDS = encoder_t::NUM_FIELDS;
 
     public:
         TimeSeriesMeasurement(TimeSeriesDB const           &db,
@@ -99,46 +122,36 @@ namespace utils
                               FieldNames<NUM_FIELDS> const &field_names,
                               TagNames<NUM_TAGS> const     &tag_names)
             : db_(db)
-            , measurement_(measurement)
-            , field_names_(field_names)
-            , tag_names_(tag_names) { }
+            , encoder_(measurement, field_names, tag_names) { }
 
+        // Queues the point; returns false if there is nothing to
+        // insert.
         bool insert(Fields const ... field_values,
-                    TagValues<NUM_TAGS> const &tag_values) {
+                    TagValues<NUM_TAGS> const &tag_values) const {
 
-            auto query   = measurement_;
-            auto tag_str = tag_set_builder<NUM_TAGS>::build(tag_names_, tag_values);
+            // Points may be sent a while later, so they are stamped
+            // now rather than when the database receives them.
+            auto const now = std::chrono::system_clock::now().time_since_epoch();
+            auto const ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
 
-            if (not tag_str.empty()) {
-                query += tag_str;
-            }
-
-            // Construct value fields of the query.
-            std::string val_str{};
-            auto row = std::make_tuple(field_values...);
+            // Kept from one point to the next, so that encoding
+            // allocates nothing once the buffer is big enough.
+            static thread_local std::string buffer;
 
-            field_set_builder<std::tuple<Fields...>,
-                              NUM_FIELDS, NUM_FIELDS>::build(val_str,
-                                                             row,
-                                                             field_names_);
+            buffer.clear();
 
-            if (val_str.empty()) {
+            if (not encoder_.encode(buffer, field_values..., tag_values, ns)) {
                 return false;
             }
 
-            query += " " + val_str;
-
-            // std::cout << __func__ << " q: " << query << "\n";
-            // return true;
+            db_.write(buffer);
 
-            return db_.run_post(query);
+            return true;
         }
 
     private:
-        TimeSeriesDB const     &db_;
-        std::string const       measurement_;
-        FieldNames<NUM_FIELDS>  field_names_;
-        TagNames<NUM_TAGS>      tag_names_;
+        TimeSeriesDB const &db_;
+        encoder_t const     encoder_;
     };
 };
 
@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "compress.h"
+#include "tsdbwriter.h"
+
+// ----------------------------------------------------------------------
+
+utils::TimeSeriesWriter::TimeSeriesWriter(Post                        post,
+                                          TimeSeriesWriterConf const &conf)
+    : post_(post)
+    , conf_(conf)
+    , queue_bytes_(0)
+    , flush_(false)
+    , busy_(false)
+    , stop_(false)
+    , down_(false)
+    , retry_at_(clock::now())
+    , spool_size_(0)
+{
+    if (not post_)
+    {
+        throw std::runtime_error("TimeSeriesWriter: no post function");
+    }
+
+    conf_.batch_points = std::max<size_t>(1, conf_.batch_points);
+    conf_.queue_points = std::max(conf_.batch_points, conf_.queue_points);
+
+    // Left over from a previous run: replayed as soon as the database
+    // answers.
+    struct stat st;
+
+    if (not conf_.spool.empty() and stat(conf_.spool.c_str(), &st) == 0)
+    {
+        spool_size_        = st.st_size;
+        stats_.spool_bytes = spool_size_;
+
+        if (spool_size_ > 0)
+        {
+            utils::slog() << "[TimeSeriesWriter] " << spool_size_
+                          << " bytes to replay from " << conf_.spool;
+        }
+    }
+
+    thread_ = std::thread(&TimeSeriesWriter::run, this);
+}
+
+utils::TimeSeriesWriter::~TimeSeriesWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void utils::TimeSeriesWriter::write(std::string line)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (queue_.empty())
+    {
+        oldest_ = clock::now();
+    }
+
+    queue_bytes_ += line.size() + 1;
+    queue_.push_back(std::move(line));
+
+    while (queue_.size() > conf_.queue_points)
+    {
+        queue_bytes_ -= queue_.front().size() + 1;
+        queue_.pop_front();
+        stats_.points_dropped++;
+    }
+
+    if (queue_.size() >= conf_.batch_points or
+        queue_bytes_ >= conf_.batch_bytes)
+    {
+        cv_.notify_one();
+    }
+}
+
+void utils::TimeSeriesWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (queue_.empty() and not busy_)
+    {
+        return;
+    }
+
+    flush_ = true;
+    cv_.notify_one();
+
+    flushed_.wait(lock, [this]() { return queue_.empty() and not busy_; });
+}
+
+utils::TimeSeriesWriterStats utils::TimeSeriesWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto s = stats_;
+    s.queued = queue_.size();
+
+    return s;
+}
+
+// ----------------------------------------------------------------------
+
+void utils::TimeSeriesWriter::run()
+{
+    auto const flush_after = std::chrono::milliseconds(conf_.flush_ms);
+    auto const retry_after = std::chrono::milliseconds(conf_.retry_ms);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto full = [this]() {
+        return queue_.size() >= conf_.batch_points or
+            queue_bytes_ >= conf_.batch_bytes;
+    };
+
+    auto ready = [&]() {
+        return stop_ or flush_ or full() or
+            (not queue_.empty() and clock::now() >= oldest_ + flush_after) or
+            (spool_size_ > 0 and clock::now() >= retry_at_);
+    };
+
+    while (true)
+    {
+        if (not ready())
+        {
+            // Until the oldest point is due, or it is time to replay
+            // the spool.
+            auto until = clock::now() + retry_after;
+
+            if (not queue_.empty())
+                until = std::min(until, oldest_ + flush_after);
+
+            if (spool_size_ > 0)
+                until = std::min(until, retry_at_);
+
+            cv_.wait_until(lock, until, ready);
+        }
+
+        std::string body;
+        size_t      points = 0;
+
+        if (stop_ or flush_ or full() or
+            (not queue_.empty() and clock::now() >= oldest_ + flush_after))
+        {
+            while (not queue_.empty() and points < conf_.batch_points and
+                   body.size() < conf_.batch_bytes)
+            {
+                body += queue_.front();
+                body += '\n';
+
+                queue_bytes_ -= queue_.front().size() + 1;
+                queue_.pop_front();
+                points++;
+            }
+        }
+
+        bool const stopping = stop_;
+
+        busy_ = true;
+        lock.unlock();
+
+        if (points > 0)
+        {
+            send(body, points);
+        }
+
+        // Not at exit, which should not wait on the database.
+        if (not stopping and spool_size_ > 0 and
+            (not down_ or clock::now() >= retry_at_))
+        {
+            replay();
+        }
+
+        lock.lock();
+        busy_ = false;
+
+        if (queue_.empty())
+        {
+            flush_ = false;
+            flushed_.notify_all();
+
+            if (stop_)
+                break;
+        }
+    }
+}
+
+void utils::TimeSeriesWriter::send(std::string const &body, size_t points)
+{
+    // While down, don't try the database with every batch.
+    if (down_ and clock::now() < retry_at_)
+    {
+        spool(body, points);
+        return;
+    }
+
+    if (post(body))
+    {
+        if (down_)
+        {
+            utils::slog() << "[TimeSeriesWriter] Database is back.";
+        }
+
+        down_ = false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.points_sent += points;
+        stats_.batches_sent++;
+
+        return;
+    }
+
+    if (not down_)
+    {
+        utils::slog() << "[TimeSeriesWriter] Can't write to database; "
+                      << (conf_.spool.empty() ? "dropping" : "spooling")
+                      << " points for now.";
+    }
+
+    down_     = true;
+    retry_at_ = clock::now() + std::chrono::milliseconds(conf_.retry_ms);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.post_failures++;
+    }
+
+    spool(body, points);
+}
+
+bool utils::TimeSeriesWriter::post(std::string const &body)
+{
+    try
+    {
+        if (conf_.gzip and body.size() >= conf_.gzip_bytes)
+        {
+            return post_(gzip_compress(body.data(), body.size()), true);
+        }
+
+        return post_(body, false);
+    }
+    catch (std::exception const &ex)
+    {
+        utils::slog() << "[TimeSeriesWriter] Error: " << ex.what();
+        return false;
+    }
+}
+
+void utils::TimeSeriesWriter::spool(std::string const &body, size_t points)
+{
+    if (conf_.spool.empty() or spool_size_ + body.size() > conf_.spool_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.points_dropped += points;
+        return;
+    }
+
+    std::ofstream out(conf_.spool, std::ios::app | std::ios::binary);
+
+    if (not (out << body) or not out.flush())
+    {
+        utils::slog() << "[TimeSeriesWriter] Can't write to " << conf_.spool;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.points_dropped += points;
+        return;
+    }
+
+    spool_size_ += body.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.points_spooled += points;
+    stats_.spool_bytes = spool_size_;
+}
+
+// Send the spool in batches, oldest first.  What can't be sent is
+// written back, to be tried again later.
+void utils::TimeSeriesWriter::replay()
+{
+    std::ifstream in(conf_.spool, std::ios::binary);
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    in.close();
+
+    auto const text = ss.str();
+
+    size_t start = 0;
+
+    while (start < text.size())
+    {
+        // Whole lines, up to a batch.
+        size_t end    = start;
+        size_t points = 0;
+
+        while (end < text.size() and points < conf_.batch_points and
+               end - start < conf_.batch_bytes)
+        {
+            auto nl = text.find('\n', end);
+            end = nl == std::string::npos ? text.size() : nl + 1;
+            points++;
+        }
+
+        if (not post(text.substr(start, end - start)))
+        {
+            down_     = true;
+            retry_at_ = clock::now() + std::chrono::milliseconds(conf_.retry_ms);
+            break;
+        }
+
+        if (down_)
+        {
+            utils::slog() << "[TimeSeriesWriter] Database is back.";
+        }
+
+        down_  = false;
+        start  = end;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.points_replayed += points;
+    }
+
+    if (start >= text.size())
+    {
+        unlink(conf_.spool.c_str());
+        spool_size_ = 0;
+
+        utils::slog() << "[TimeSeriesWriter] Replayed " << conf_.spool;
+    }
+    else if (start > 0)
+    {
+        std::ofstream out(conf_.spool, std::ios::trunc | std::ios::binary);
+        out << text.substr(start);
+        spool_size_ = text.size() - start;
+    }
+    else
+    {
+        // Nothing went; it may also have been removed under us.
+        spool_size_ = text.size();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.spool_bytes = spool_size_;
+}
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End:
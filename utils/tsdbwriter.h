@@ -0,0 +1,124 @@
+#ifndef BDE_UTILS_TSDB_WRITER_H
+#define BDE_UTILS_TSDB_WRITER_H
+
+// Points written to the time series database are queued, and a
+// thread of their own sends them in batches: one POST of many lines,
+// once enough of them have queued up, or the oldest has waited long
+// enough.  This way a slow or unreachable database slows down nobody
+// but that thread.
+//
+// While the database can't be reached, batches go to a spool file of
+// bounded size instead, which is replayed once it can.  Points carry
+// their own timestamps, so late ones land where they belong.
+//
+//     utils::TimeSeriesWriter writer([](std::string const &body, bool gzipped) {
+//             return post_somewhere(body, gzipped);
+//         });
+//
+//     writer.write("cpu,host=dtn1 load=0.5 1500000000000000000");
+//
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+// ----------------------------------------------------------------------
+
+namespace utils
+{
+    struct TimeSeriesWriterConf
+    {
+        size_t      batch_points = 5000;        // send once this many are queued,
+        size_t      batch_bytes  = 1 << 20;     // or this many bytes,
+        size_t      flush_ms     = 1000;        // or the oldest is this old.
+        size_t      queue_points = 100000;      // beyond which the oldest are dropped.
+        bool        gzip         = false;       // compress batches...
+        size_t      gzip_bytes   = 4096;        // ...of at least this many bytes.
+        std::string spool;                      // spool file; none if empty.
+        size_t      spool_bytes  = 64 << 20;    // beyond which batches are dropped.
+        size_t      retry_ms     = 10000;       // between attempts while down.
+    };
+
+    struct TimeSeriesWriterStats
+    {
+        size_t points_sent     = 0;
+        size_t batches_sent    = 0;
+        size_t points_spooled  = 0;
+        size_t points_replayed = 0;
+        size_t points_dropped  = 0;
+        size_t post_failures   = 0;
+        size_t queued          = 0;     // right now, in memory.
+        size_t spool_bytes     = 0;     // right now, on disk.
+    };
+
+    class TimeSeriesWriter
+    {
+    public:
+        // Sends a batch of newline-separated points; returns false if
+        // they were not accepted, and should be retried later.
+        using Post = std::function<bool(std::string const &body, bool gzipped)>;
+
+        TimeSeriesWriter(Post                        post,
+                         TimeSeriesWriterConf const &conf = TimeSeriesWriterConf());
+
+        // Sends what is queued if it can, and spools it if not.
+        ~TimeSeriesWriter();
+
+        TimeSeriesWriter(TimeSeriesWriter const &) = delete;
+        TimeSeriesWriter & operator=(TimeSeriesWriter const &) = delete;
+
+        // Queue a point, in line protocol.  Never blocks on the
+        // database.
+        void write(std::string line);
+
+        // Wait until everything queued so far has been sent, spooled,
+        // or dropped.
+        void flush();
+
+        TimeSeriesWriterStats stats() const;
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        void run();
+
+        // Outside the lock, on the writer's thread only.
+        void send(std::string const &body, size_t points);
+        bool post(std::string const &body);
+        void spool(std::string const &body, size_t points);
+        void replay();
+
+        Post                    post_;
+        TimeSeriesWriterConf    conf_;
+
+        std::deque<std::string> queue_;
+        size_t                  queue_bytes_;
+        clock::time_point       oldest_;
+        bool                    flush_;
+        bool                    busy_;
+        bool                    stop_;
+
+        // Touched by the writer's thread only.
+        bool                    down_;
+        clock::time_point       retry_at_;
+        size_t                  spool_size_;
+
+        TimeSeriesWriterStats   stats_;
+
+        mutable std::mutex      mutex_;
+        std::condition_variable cv_;
+        std::condition_variable flushed_;
+        std::thread             thread_;
+    };
+};
+
+#endif // BDE_UTILS_TSDB_WRITER_H
+
+// Local Variables:
+// mode: c++
+// c-basic-offset: 4
+// End: